@@ -0,0 +1,109 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Minimal std::allocator replacement for over-aligned element types.
+// C++14 operator new only guarantees alignof(std::max_align_t), which is too little to place data structures on cache line boundaries.
+template<typename T, std::size_t Alignment>
+class AlignedAllocator
+{
+public:
+  typedef T value_type;
+
+  template<typename U>
+  struct rebind
+  {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator()
+  {
+  }
+
+  template<typename U>
+  AlignedAllocator(AlignedAllocator<U, Alignment> const&)
+  {
+  }
+
+  T* allocate(const std::size_t count)
+  {
+    if (count == 0)
+    {
+      return nullptr;
+    }
+    void* ptr = nullptr;
+#if defined(_WIN32)
+    ptr = _aligned_malloc(count * sizeof(T), Alignment);
+#else
+    if (posix_memalign(&ptr, Alignment, count * sizeof(T)) != 0)
+    {
+      ptr = nullptr;
+    }
+#endif
+    if (ptr == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, const std::size_t)
+  {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+};
+
+template<typename T, typename U, std::size_t Alignment>
+bool operator==(AlignedAllocator<T, Alignment> const&, AlignedAllocator<U, Alignment> const&)
+{
+  return true;
+}
+
+template<typename T, typename U, std::size_t Alignment>
+bool operator!=(AlignedAllocator<T, Alignment> const&, AlignedAllocator<U, Alignment> const&)
+{
+  return false;
+}
+
+#endif // ALIGNED_ALLOCATOR_H
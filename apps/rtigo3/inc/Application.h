@@ -52,6 +52,7 @@
 #include "inc/OpenGL_loader.h"
 
 #include "inc/Camera.h"
+#include "inc/GeometryCache.h"
 #include "inc/Options.h"
 #include "inc/Rasterizer.h"
 #include "inc/Raytracer.h"
@@ -113,7 +114,41 @@ enum KeywordScene
   KS_ROTATE,
   KS_SCALE,
   KS_TRANSLATE,
-  KS_MODEL
+  KS_MODEL,
+  KS_SPATIAL_SPLITS,
+  KS_GRID,
+  KS_SCATTER
+};
+
+
+enum ProceduralType
+{
+  PROCEDURAL_PLANE,
+  PROCEDURAL_SPHERE,
+  PROCEDURAL_TORUS
+};
+
+// Construction parameters of the runtime generated meshes.
+struct ProceduralGeometry
+{
+  ProceduralType type;
+  unsigned int   tessU;
+  unsigned int   tessV;
+  unsigned int   upAxis;      // plane
+  float          theta;       // sphere, fraction of the closed sphere.
+  float          innerRadius; // torus
+  float          outerRadius; // torus
+  float          spatialSplitAlpha;
+};
+
+// Procedural instances are deferred while the tessellation level-of-detail is enabled
+// because the triangle budget is only known to be met after the whole scene has been parsed.
+struct ProceduralInstance
+{
+  ProceduralGeometry geometry; // With the full tessellation from the scene description.
+  dp::math::Mat44f   matrix;
+  int                indexMaterial; // Resolved when parsed. Later material definitions with the same name must not change this instance.
+  unsigned int       level;    // Number of halvings of the tessellation selected by the projected size.
 };
 
 
@@ -129,6 +164,9 @@ public:
   void reshape(const int w, const int h);
   bool render();
   void benchmark();
+  void benchmarkBVH();
+  void benchmarkSceneGraph();
+  void benchmarkParser();
 
   void display();
 
@@ -143,6 +181,12 @@ private:
   bool saveSystemDescription();
   bool loadSceneDescription(std::string const& filename);
 
+  // Compiled scene descriptions in the geometry cache. See SceneCache.cpp.
+  bool loadScene(std::string const& filename);
+  bool getSceneKey(std::string const& filename, unsigned long long& key) const;
+  bool loadSceneCache(const unsigned long long key);
+  bool storeSceneCache(const unsigned long long key);
+
   void restartRendering();
 
   bool screenshot(const bool tonemap);
@@ -151,19 +195,63 @@ private:
   void createLights();
   void createPictures();
 
-  void appendInstance(std::shared_ptr<sg::Group>& group,
-                      std::shared_ptr<sg::Triangles> geometry,
+  int  getMaterialIndex(std::string const& reference) const; // Falls back to the "default" material.
+  void appendInstance(const sg::NodeHandle group,
+                      const sg::NodeHandle geometry,
                       dp::math::Mat44f const& matrix,
-                      std::string const& reference,
-                      unsigned int& idInstance);
-
-  std::shared_ptr<sg::Group> createASSIMP(std::string const& filename);
-  std::shared_ptr<sg::Group> traverseScene(const struct aiScene *scene, const unsigned int indexSceneBase, const struct aiNode* node);
+                      std::string const& reference);
+  void appendInstance(const sg::NodeHandle group,
+                      const sg::NodeHandle geometry,
+                      dp::math::Mat44f const& matrix,
+                      const int indexMaterial);
+
+  // Tessellation level-of-detail for the procedural geometry.
+  std::shared_ptr<sg::Triangles> getProceduralGeometry(ProceduralGeometry const& procedural);
+  void appendProcedural(ProceduralGeometry const& procedural, dp::math::Mat44f const& matrix, std::string const& reference);
+  unsigned int getTessellationLevel(ProceduralGeometry const& procedural, dp::math::Mat44f const& matrix) const;
+  void appendProceduralInstances();
+
+  // Element transforms of the "grid" and "scatter" directives. The next model becomes an InstanceArray.
+  void createGrid(const int3 count, const float3 spacing);
+  void createScatter(const std::string& surface, const unsigned int count, const unsigned int seed, const float minScale, const float maxScale);
+
+  // Model import. The files are imported concurrently after parsing, the nodes are created in scene description order. See Assimp.cpp.
+  sg::NodeHandle createASSIMP(std::string const& filename, const float spatialSplitAlpha);
+  void importModels();
+  void importASSIMP(struct AssimpModel& model, const unsigned int numThreads);
+  bool readASSIMP(struct AssimpModel& model, class ThreadPool& pool, const unsigned int postProcessSteps,
+                  std::vector< std::vector<TriangleAttributes> >& attributes, std::vector< std::vector<unsigned int> >& indices,
+                  std::vector<unsigned char>& needsTangents);
+  // Native importers for OBJ and binary PLY files, see NativeImport.cpp. Return false to let assimp read the file.
+  bool readOBJ(struct AssimpModel& model, class ThreadPool& pool,
+               std::vector< std::vector<TriangleAttributes> >& attributes, std::vector< std::vector<unsigned int> >& indices);
+  bool readPLY(struct AssimpModel& model, class ThreadPool& pool,
+               std::vector< std::vector<TriangleAttributes> >& attributes, std::vector< std::vector<unsigned int> >& indices);
+  void resolveASSIMP(struct AssimpModel& model);
+  sg::NodeHandle traverseModel(struct AssimpModel const& model, const unsigned int indexSceneBase, unsigned int& indexNode, sg::NodeHandle group);
+  int getMaterialReference(std::string const& name, const float3* diffuse);
+
+  // Persistent geometry cache.
+  bool loadTriangles(CacheFile const& file, const unsigned int first, std::shared_ptr<sg::Triangles> geometry);
+  void appendTriangles(std::shared_ptr<sg::Triangles> geometry, std::vector<CacheBlob>& blobs);
+  bool loadGeometry(const unsigned long long key, std::shared_ptr<sg::Triangles> geometry);
+  void storeGeometry(const unsigned long long key, std::shared_ptr<sg::Triangles> geometry);
+  void optimizeGeometry(std::shared_ptr<sg::Triangles> geometry);
+  unsigned int getMeshOptimizerVersion() const;
+  bool loadASSIMP(const unsigned long long key, struct AssimpModel& model);
+  void storeASSIMP(const unsigned long long key, struct AssimpModel const& model);
 
   void calculateTangents(std::vector<TriangleAttributes>& attributes, std::vector<unsigned int> const& indices);
+  void getIndexedBounds(std::vector<TriangleAttributes> const& attributes, std::vector<unsigned int> const& indices,
+                        const size_t first, const size_t last, float3& aabbLo, float3& aabbHi);
+  void getTangentDirections(float3 const& aabbLo, float3 const& aabbHi, float3& direction, float3& bidirection);
+  void setTangents(std::vector<TriangleAttributes>& attributes, const size_t first, const size_t last, float3 const& direction, float3 const& bidirection);
 
   void guiRenderingIndicator(const bool isRendering);
 
+  // Scene and device memory report after initScene(). Printed and written as JSON.
+  void reportStatistics();
+
   bool loadString(std::string const& filename, std::string& text);
   bool saveString(std::string const& filename, std::string const& text);
   std::string getDateTime();
@@ -180,16 +268,23 @@ private:
   // Command line options:
   int         m_width;   // Client window size.
   int         m_height;
-  int         m_mode;   // Application mode 0 = interactive, 1 = batched benchmark (single shot).
+  int         m_mode;   // Application mode 0 = interactive, 1 = batched benchmark (single shot), 2 = host BVH benchmark, 3 = host scene graph benchmark, 4 = parser benchmark, 5 = scene compiler.
 
   // System options:
   int         m_strategy;    // "strategy"
   int         m_devicesMask; // "devicesMask" // Bitmask with enabled devices, default 0xFF for 8 devices. Only the visible ones will be used.
+  int         m_numThreads;  // "threads"     // Number of host threads for the RS_CPU_MULTICORE strategy and the model import. 0 = all hardware threads.
   int         m_light;       // "light"
   int         m_miss;        // "miss"
   std::string m_environment; // "envMap"
   int         m_interop;     // "interop"// 0 = none all through host, 1 = register texture image, 2 = register pixel buffer
   bool        m_present;     // "present"
+  bool        m_compressedNodes; // "compressedNodes" // Quantized BVH8 nodes for the RS_CPU_MULTICORE strategy.
+  int         m_builder;     // "builder"     // BLAS builder for the RS_CPU_MULTICORE strategy. 0 = SAH, 1 = LBVH, 2 = LBVH with treelet restructuring.
+  int         m_geometryFormat; // "geometryFormat" // Vertex attribute encoding. 0 = full, 1 = compact (octahedral normals, half texcoords), 2 = compact with quantized vertices.
+  bool        m_optimizeMeshes; // "optimizeMeshes" // Weld, Morton sort and vertex cache reorder all generated and loaded meshes. Default on.
+  float       m_tessellationLod; // "tessellationLod" // Target triangle edge length in pixels for plane, sphere and torus at the initial camera. 0.0f = off, use the scene tessellation.
+  unsigned int m_triangleBudget; // "triangleBudget"  // Maximum number of triangles in all procedural meshes when the tessellationLod is enabled.
 
   bool        m_presentNext;      // (derived)
   double      m_presentAtSecond;  // (derived)
@@ -206,6 +301,9 @@ private:
   float      m_clockFactor;         // "clockFactor"
 
   std::string m_prefixScreenshot;   // "prefixScreenshot", allows to set a path and the prefix for the screenshot filename. spp, data, time and extension will be appended.
+  std::string m_prefixStatistics;   // "prefixStatistics", path and prefix of the JSON memory report. Date, time and extension will be appended.
+
+  GeometryCache m_geometryCache;    // "cachePath", existing directory for the converted models, generated meshes and host BVHs. Disabled when not set.
 
   TonemapperGUI m_tonemapperGUI;    // "gamma", "whitePoint", "burnHighlights", "crushBlacks", "saturation", "brightness"
 
@@ -223,20 +321,21 @@ private:
   DeviceState                m_state;
 
   // The scene description:
-  // Unique identifiers per host scene node.
-  unsigned int m_idGroup;
-  unsigned int m_idInstance;
+  // Unique identifiers per geometry. Groups and Instances are identified by their sg::NodeHandle.
   unsigned int m_idGeometry;
 
-  std::shared_ptr<sg::Group> m_scene; // Root group node of the scene.
+  sg::Scene      m_scene; // Host side scene graph.
+  sg::NodeHandle m_root;  // Root group node of the scene.
 
-  std::vector< std::shared_ptr<sg::Triangles> > m_geometries; // All geometries in the scene.
+  std::vector< std::shared_ptr<sg::Triangles> > m_geometries; // All triangle geometries in the scene.
+  std::vector< std::shared_ptr<sg::Primitive> > m_primitives; // All analytic primitives in the scene. Shares the m_idGeometry space with m_geometries.
 
   // For the runtime generated objects, this allows to find geometries with the same type and construction parameters.
-  std::map<std::string, unsigned int> m_mapGeometries;
+  std::map<std::string, unsigned int> m_mapGeometries;  // Index into m_geometries.
+  std::map<std::string, unsigned int> m_mapPrimitives;  // Index into m_primitives.
 
   // For all model file format loaders. Allows instancing of full models in the host side scene graph.
-  std::map< std::string, std::shared_ptr<sg::Group> > m_mapGroups;
+  std::map<std::string, sg::NodeHandle> m_mapGroups;
 
   std::vector<CameraDefinition> m_cameras;
   std::vector<LightDefinition>  m_lights;
@@ -247,7 +346,13 @@ private:
 
   std::map<std::string, Picture*> m_mapPictures;
 
-  std::vector<unsigned int> m_remappedMeshIndices;
+  std::vector< std::shared_ptr<struct AssimpModel> > m_models; // Pending model imports of the scene description, in order of their first use.
+
+  std::vector<ProceduralInstance> m_proceduralInstances; // Deferred instances of the tessellation level-of-detail.
+
+  std::vector<float> m_arrayTransforms; // Pending 3x4 row-major element transforms of a "grid" or "scatter" directive for the next model.
+
+  std::vector<std::string> m_sceneDependencies; // The scene file and all models it loaded. A compiled scene is stale when their size or time changed.
 };
 
 #endif // APPLICATION_H
@@ -0,0 +1,117 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef ASSIMP_MODEL_H
+#define ASSIMP_MODEL_H
+
+#include "inc/SceneGraph.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Part of the cache key of the models read by the native OBJ and PLY importers. Increment when their conversion changes.
+#define NATIVE_IMPORT_VERSION 1
+
+// Cached assimp models. Blob 0 holds the AssimpCacheMesh, blob 1 the AssimpCacheMaterial, blob 2 the material names,
+// blob 3 the AssimpCacheNode in depth first order and blob 4 the mesh indices of the nodes.
+// Each converted geometry follows with its attributes and indices blobs.
+#define ASSIMP_CACHE_FIRST_GEOMETRY 5
+
+struct AssimpCacheMesh
+{
+  unsigned int geometry; // Index of the geometry inside this model, ~0u for meshes without triangles.
+  unsigned int material;
+};
+
+struct AssimpCacheMaterial
+{
+  float3       diffuse;
+  unsigned int hasDiffuse;
+  unsigned int offsetName;
+  unsigned int lengthName;
+};
+
+struct AssimpCacheNode
+{
+  float        trafo[12];
+  unsigned int numChildren;
+  unsigned int firstMesh;
+  unsigned int numMeshes;
+};
+
+// One model file of the scene description. importASSIMP() fills the data on a worker thread, either from the cache,
+// the native OBJ and PLY importers or the assimp importer.
+// resolveASSIMP() assigns the geometry IDs and creates the scene graph nodes on the main thread in scene description order.
+// The data is the same as in the cache entry of the model.
+struct AssimpModel
+{
+  std::string                filename;
+  sg::NodeHandle             group;             // Created by createASSIMP() while parsing. Stays empty when the import fails.
+  float                      spatialSplitAlpha; // Option at the first use of the model.
+  std::map<std::string, int> references;        // The material references at the first use of the model.
+
+  std::vector<AssimpCacheMesh>     meshes;
+  std::vector<AssimpCacheMaterial> materials;
+  std::string                      names;
+  std::vector<AssimpCacheNode>     nodes;
+  std::vector<unsigned int>        nodeMeshes;
+
+  std::vector< std::shared_ptr<sg::Triangles> > geometries; // Provisional IDs until resolveASSIMP().
+};
+
+// Vertices or triangles per work item of the mesh conversion inside one model.
+#define ASSIMP_IMPORT_CHUNK_SIZE 65536
+
+struct AssimpImportChunk
+{
+  unsigned int geometry; // Index into the geometries of the model.
+  unsigned int first;    // First vertex or triangle.
+  unsigned int count;
+};
+
+// Splits the vertices or triangles of one geometry into work items, so that large meshes are spread over all threads.
+inline void appendChunks(const unsigned int geometry, const unsigned int count, std::vector<AssimpImportChunk>& chunks)
+{
+  for (unsigned int first = 0; first < count; first += ASSIMP_IMPORT_CHUNK_SIZE)
+  {
+    AssimpImportChunk chunk;
+
+    chunk.geometry = geometry;
+    chunk.first    = first;
+    chunk.count    = std::min(count - first, static_cast<unsigned int>(ASSIMP_IMPORT_CHUNK_SIZE));
+
+    chunks.push_back(chunk);
+  }
+}
+
+#endif // ASSIMP_MODEL_H
@@ -0,0 +1,276 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef BVH_H
+#define BVH_H
+
+// For the vector types.
+#include <cuda_runtime.h>
+
+#include "inc/AlignedAllocator.h"
+#include "inc/SceneGraph.h"
+#include "inc/ThreadPool.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Number of SAH bins per axis.
+#define BVH_NUM_BINS 16
+// Number of spatial split bins per axis of the SBVH build.
+#define BVH_NUM_SPATIAL_BINS 32
+// Default overlap threshold of the SBVH build for the "spatialSplits" scene option. See BVHBuildOptions::splitAlpha.
+#define BVH_SPLIT_ALPHA 1.0e-5f
+// Leaves are created for this many triangles or less when the SAH prefers that.
+#define BVH_MAX_LEAF_SIZE 4
+// The builders balance subtrees which would get deeper, so leaves never exceed BVH_MAX_LEAF_SIZE. This bounds the traversal stack size.
+#define BVH_MAX_DEPTH 64
+// Maximum number of rays in a BVHRayPacket. One bit per ray inside the unsigned long long ray masks.
+#define BVH_PACKET_SIZE 64
+
+
+// 32 bytes. The two children of an inner node are stored next to each other in the same 64 byte cache line.
+struct BVHNode
+{
+  float3       aabbMin;
+  unsigned int index;   // Inner node: Index of the left child, the right child is index + 1. Leaf: First entry inside the primitive list.
+  float3       aabbMax;
+  unsigned int count;   // Leaf: Number of triangles. Inner node: 0.
+};
+
+struct BVHRay
+{
+  float3 origin;
+  float  tmin;
+  float3 direction; // Doesn't need to be normalized. The hit distance is in units of the direction length.
+  float  tmax;
+};
+
+enum BVHBuildMethod
+{
+  BVH_BUILD_SAH, // Binned surface area heuristic, optionally with spatial splits.
+  BVH_BUILD_LBVH // Linear BVH over Morton codes. Several times faster to build, slower to trace.
+};
+
+// Build settings which differ per geometry.
+struct BVHBuildOptions
+{
+  BVHBuildOptions()
+  : method(BVH_BUILD_SAH)
+  , splitAlpha(0.0f)
+  , restructure(false)
+  {
+  }
+
+  BVHBuildMethod method;
+
+  // BVH_BUILD_SAH only. Values above 0.0f enable the spatial split BVH (SBVH). Spatial splits are tried when the children of the best object split
+  // overlap by more than this fraction of the root surface area. Triangles straddling a spatial split are referenced by both children.
+  float splitAlpha;
+
+  // BVH_BUILD_LBVH only. Optimizes the topology of small treelets for the SAH, recovers most of the trace speed for a fraction of the SAH build time.
+  bool restructure;
+};
+
+// Node visits and triangle tests, accumulated over all queries which receive the same stats.
+struct BVHTraversalStats
+{
+  BVHTraversalStats()
+  : rays(0)
+  , nodes(0)
+  , triangles(0)
+  {
+  }
+
+  unsigned long long rays;
+  unsigned long long nodes;     // Visited nodes, including the root.
+  unsigned long long triangles; // Ray-triangle intersection tests.
+};
+
+struct BVHHit
+{
+  float        distance;
+  float2       barycentrics; // beta and gamma of vertex 1 and 2, same as optixGetTriangleBarycentrics().
+  unsigned int primitive;    // Triangle index inside the sg::Triangles indices, same as optixGetPrimitiveIndex().
+};
+
+// Coherent rays which are traced together, like the primary rays of a pixel block. All rays share the tmin.
+struct BVHRayPacket
+{
+  // Calculates the invDirection after the origin and direction of all rays have been set.
+  void prepare();
+
+  unsigned int count;
+  float        tmin;
+  float3       origin[BVH_PACKET_SIZE];
+  float3       direction[BVH_PACKET_SIZE];
+  float3       invDirection[BVH_PACKET_SIZE];
+  float        tmax[BVH_PACKET_SIZE]; // Per ray. The packet queries shorten these to the closest hit distance.
+};
+
+// Interval arithmetic bounds of the active rays of a packet. Used to cull nodes for all rays with a single test.
+struct BVHPacketBounds
+{
+  void set(BVHRayPacket const& packet, const unsigned long long active);
+
+  // Conservative slab test. Returns false when no ray of the packet can hit the box.
+  // tNear is a lower bound of the entry distances of all rays, used to order the traversal.
+  bool intersect(float3 const& aabbMin, float3 const& aabbMax, float& tNear) const
+  {
+    const float2 tx = slab(aabbMin.x, aabbMax.x, originMin.x, originMax.x, invDirectionMin.x, invDirectionMax.x);
+    const float2 ty = slab(aabbMin.y, aabbMax.y, originMin.y, originMax.y, invDirectionMin.y, invDirectionMax.y);
+    const float2 tz = slab(aabbMin.z, aabbMax.z, originMin.z, originMax.z, invDirectionMin.z, invDirectionMax.z);
+
+    const float t0 = (tx.x > ty.x) ? tx.x : ty.x;
+    const float t1 = (tz.x > tmin) ? tz.x : tmin;
+    const float t2 = (tx.y < ty.y) ? tx.y : ty.y;
+    const float t3 = (tz.y < tmax) ? tz.y : tmax;
+
+    tNear = (t0 > t1) ? t0 : t1;
+
+    return tNear <= ((t2 < t3) ? t2 : t3);
+  }
+
+  // Returns the minimum entry and the maximum exit distance of all rays for one axis in .x and .y.
+  // Each ray enters at min((lower - o) * i, (upper - o) * i) and exits at the max of both,
+  // so the interval products over both planes bound all rays, independent of the direction signs.
+  static float2 slab(const float lower, const float upper, const float oMin, const float oMax, const float iMin, const float iMax)
+  {
+    const float p[8] =
+    {
+      (lower - oMax) * iMin, (lower - oMax) * iMax, (lower - oMin) * iMin, (lower - oMin) * iMax,
+      (upper - oMax) * iMin, (upper - oMax) * iMax, (upper - oMin) * iMin, (upper - oMin) * iMax
+    };
+
+    float2 t;
+
+    t.x = p[0];
+    t.y = p[0];
+    for (int i = 1; i < 8; ++i)
+    {
+      t.x = (p[i] < t.x) ? p[i] : t.x;
+      t.y = (p[i] > t.y) ? p[i] : t.y;
+    }
+    return t;
+  }
+
+  float3 originMin;
+  float3 originMax;
+  float3 invDirectionMin;
+  float3 invDirectionMax;
+  float  tmin;
+  float  tmax; // Maximum of all active rays.
+};
+
+// Optional any hit program. Return false to ignore the intersection, e.g. for cutout opacity.
+typedef std::function<bool(const unsigned int primitive, float2 const& barycentrics)> BVHFilter;
+
+// Called for each primitive inside the leaves the ray reaches, front to back, with the current ray tmax.
+// Returns the new ray tmax, e.g. the distance of a closer hit, or a negative value to terminate the traversal.
+typedef std::function<float(const unsigned int primitive, const float tmax)> BVHVisitor;
+
+// Packet version of the BVHVisitor. The mask contains the rays which hit the leaf bounds. Shortens the packet.tmax of the rays it hits.
+typedef std::function<void(const unsigned int primitive, const unsigned long long mask, BVHRayPacket& packet)> BVHPacketVisitor;
+
+
+// Host side bounding volume hierarchy over the triangles of one sg::Triangles node (bottom level)
+// or over a list of bounding boxes like the instances in world space (top level).
+// Built with a binned surface area heuristic. The top levels are split with parallel binning,
+// the remaining subtrees are built in parallel by the ThreadPool. BVHBuildOptions::splitAlpha optionally adds spatial splits (SBVH).
+// BVH_BUILD_LBVH builds from Morton codes instead, for interactive rebuilds where the build time matters more than the trace speed.
+class BVH
+{
+public:
+  BVH();
+  ~BVH();
+
+  // The threadPool is optional. The geometry is referenced, not copied. Uses the build options stored at the geometry.
+  void build(std::shared_ptr<sg::Triangles> geometry, ThreadPool* threadPool);
+  void build(std::shared_ptr<sg::Triangles> geometry, ThreadPool* threadPool, BVHBuildOptions const& options);
+  // Build over boxes. The aabbs contain the minimum and maximum corner per primitive. Only traverse() works on these.
+  void build(std::vector<float3> const& aabbs, ThreadPool* threadPool);
+  // Recomputes the node bounds of a box hierarchy for moved boxes. Same number and order of boxes as the build. The topology is kept.
+  void refit(std::vector<float3> const& aabbs);
+  // Same for only the listed boxes moved. Walks up from their leaves, the cost is proportional to the number of moved boxes.
+  void refit(std::vector<float3> const& aabbs, std::vector<unsigned int> const& moved);
+
+  // Closest hit query. On a hit, returns true and updates hit. The ray.tmax limits the search.
+  bool intersect(BVHRay const& ray, BVHHit& hit, BVHFilter const* filter = nullptr) const;
+  // Same query with traversal statistics for benchmarks.
+  bool intersect(BVHRay const& ray, BVHHit& hit, BVHTraversalStats& stats) const;
+  // Any hit query for visibility tests. Returns true when any accepted intersection is inside [ray.tmin, ray.tmax].
+  bool occluded(BVHRay const& ray, BVHFilter const* filter = nullptr) const;
+  // Ordered traversal which leaves the primitive intersection to the visitor. Used for the top level over the instances.
+  void traverse(BVHRay const& ray, BVHVisitor const& visitor) const;
+  // Same for a packet of rays. Whole nodes are culled with interval arithmetic on the packet bounds.
+  void traversePacket(BVHRayPacket& packet, const unsigned long long active, BVHPacketVisitor const& visitor) const;
+
+  float3 getAabbMin() const;
+  float3 getAabbMax() const;
+
+  unsigned int getNumTriangles() const;  // Number of primitives. Boxes for the top level.
+  unsigned int getNumReferences() const; // Size of the primitive list. Above the number of triangles when spatial splits duplicated references.
+  unsigned int getNumNodes() const;
+  size_t       getMemorySize() const; // In bytes, nodes plus primitive list.
+  float        getCost() const;       // SAH cost relative to the root surface area. Grows when refitted boxes move apart.
+
+  std::shared_ptr<sg::Triangles> getGeometry() const;
+
+  std::vector< BVHNode, AlignedAllocator<BVHNode, 64> > const& getNodes() const;
+  std::vector<unsigned int> const& getPrimitives() const;
+
+private:
+  bool intersectTriangle(const unsigned int primitive, float3 const& origin, float3 const& direction, const float tmin, const float tmax, float& t, float2& barycentrics) const;
+
+  template<typename Stats>
+  bool intersectClosest(BVHRay const& ray, BVHHit& hit, BVHFilter const* filter, Stats& stats) const;
+
+  void   initRefit();
+  double getCostSum() const;
+
+private:
+  std::shared_ptr<sg::Triangles> m_geometry; // Keeps the referenced attributes and indices alive.
+  const TriangleAttributes*      m_attributes;
+  const unsigned int*            m_indices;
+
+  // Node 0 is the root. Node 1 is unused padding to place all sibling pairs on 64 byte boundaries.
+  std::vector< BVHNode, AlignedAllocator<BVHNode, 64> > m_nodes;
+
+  std::vector<unsigned int> m_primitives; // Triangle indices reordered so that each leaf references a contiguous range. May contain duplicates with spatial splits.
+
+  unsigned int m_numTriangles;
+
+  // Box hierarchies only.
+  std::vector<unsigned int> m_parents; // Per node for the partial refit. ~0u at the root and the padding.
+  std::vector<unsigned int> m_leaves;  // Per box, the leaf node referencing it.
+  double                    m_costSum; // Unnormalized getCost(), kept up to date by the refits.
+};
+
+#endif // BVH_H
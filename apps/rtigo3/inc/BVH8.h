@@ -0,0 +1,190 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef BVH8_H
+#define BVH8_H
+
+#include "inc/BVH.h"
+#include "inc/GeometryCache.h"
+
+// Traversal stack entries. Every visited inner node pushes at most 8 children.
+#define BVH8_STACK_SIZE (8 * BVH_MAX_DEPTH)
+// Packet subtrees hit by this many rays or less are finished with the single ray kernels.
+#define BVH8_PACKET_MIN_RAYS 8
+// Part of the cache key of the stored BVH8. Increment when the builders or the stored layout change.
+#define BVH_CACHE_VERSION 1
+
+
+// 256 bytes, four cache lines. The child bounds are stored in SoA layout to test one ray against all 8 children with one SIMD instruction per plane.
+// The lower and upper planes per axis are adjacent, which allows the AVX-512 kernel to load both with one instruction.
+// Unused child slots have inverted bounds which never pass the slab test.
+struct BVH8Node
+{
+  float        lowerX[8];
+  float        upperX[8];
+  float        lowerY[8];
+  float        upperY[8];
+  float        lowerZ[8];
+  float        upperZ[8];
+  unsigned int index[8]; // Inner child: Index of the BVH8Node. Leaf child: First entry inside the primitive list.
+  unsigned int count[8]; // Leaf child: Number of triangles. Inner child: 0.
+};
+
+// 80 bytes. Compressed wide BVH node (Ylitie, Karras, Laine, "Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs", HPG 2017).
+// The child bounds are 8-bit offsets on a grid over the node bounds: lower = origin + qlo * 2^exponent per axis, rounded outwards.
+// The inner children are stored consecutively from childBase, the leaves reference consecutive blocks or primitive list entries.
+struct BVH8CompressedNode
+{
+  float         origin[3];
+  signed char   exponent[3];
+  unsigned char imask;         // Bit i is set when child i is an inner node.
+  unsigned int  childBase;     // Index of the first inner child node.
+  unsigned int  primitiveBase; // First block or primitive list entry of the leaf children.
+  unsigned char meta[8];       // Leaf child: Triangle count in bits 0 to 2, offset from primitiveBase in bits 3 to 7. Otherwise 0.
+  unsigned char qlo[3][8];     // [axis][child]
+  unsigned char qhi[3][8];
+};
+
+// Four triangles in SoA layout with their vertices copied out of the indexed TriangleAttributes. 160 bytes.
+// The builders split all leaves down to BVH_MAX_LEAF_SIZE == 4 triangles, so each leaf references exactly one block.
+// BVH8::build() falls back to indexed triangles and full nodes for hierarchies which violate that.
+// Replaces the gather of three 48 byte TriangleAttributes through the indices per triangle test.
+struct BVH8TriangleBlock
+{
+  float        vertex[3][3][4]; // [vertex][axis][lane]
+  unsigned int primitive[4];    // Triangle index inside the sg::Triangles indices.
+};
+
+// Leaf triangle representations. Both use the same watertight intersection.
+enum BVH8Triangles
+{
+  BVH8_TRIANGLES_INDEXED, // Vertices fetched through the primitive list and the sg::Triangles indices.
+  BVH8_TRIANGLES_BLOCKS   // Leaves reference a BVH8TriangleBlock and are tested 4-wide.
+};
+
+// Node representations. The compressed nodes need less than a third of the memory for slightly looser child bounds.
+enum BVH8Nodes
+{
+  BVH8_NODES_FULL,      // BVH8Node with float bounds.
+  BVH8_NODES_COMPRESSED // BVH8CompressedNode with quantized bounds.
+};
+
+// Instruction sets of the traversal kernels. Ordered, each one requires the previous.
+enum BVH8Isa
+{
+  BVH8_ISA_SCALAR,
+  BVH8_ISA_AVX2,
+  BVH8_ISA_AVX512
+};
+
+// What the traversal kernels need from the BVH8.
+struct BVH8Data
+{
+  const BVH8Node*           nodes;           // nullptr for BVH8_NODES_COMPRESSED.
+  const BVH8CompressedNode* compressedNodes; // nullptr for BVH8_NODES_FULL.
+  const unsigned int*       primitives;
+  const TriangleAttributes* attributes;
+  const unsigned int*       indices;
+  const BVH8TriangleBlock*  blocks; // Not nullptr for BVH8_TRIANGLES_BLOCKS. The leaves then store block indices.
+  unsigned int              root; // Start node of the traversal. Packets hand subtrees with few rays to the single ray kernels.
+};
+
+
+// 8-wide BVH collapsed from the binary BVH. Halves the number of node fetches which dominate the binary BVH traversal.
+// Same queries as the BVH. The kernel is selected at runtime from the instruction sets the CPU supports.
+class BVH8
+{
+public:
+  BVH8();
+  ~BVH8();
+
+  // Collapses the finished binary BVH. The binary BVH is not needed afterwards.
+  void build(BVH const& bvh, const BVH8Triangles triangles = BVH8_TRIANGLES_BLOCKS, const BVH8Nodes nodes = BVH8_NODES_FULL);
+
+  // Persistent cache. The key must cover the geometry contents, the triangle and the node representation.
+  // A loaded BVH8 traverses the nodes and triangle blocks in place inside the memory mapped cache file.
+  bool load(GeometryCache const& cache, const unsigned long long key, std::shared_ptr<sg::Triangles> geometry);
+  bool store(GeometryCache const& cache, const unsigned long long key) const;
+
+  bool intersect(BVHRay const& ray, BVHHit& hit, BVHFilter const* filter = nullptr) const;
+  bool occluded(BVHRay const& ray, BVHFilter const* filter = nullptr) const;
+
+  // Closest hit query for the active rays of a coherent packet. No filter, cutout materials need the single ray queries.
+  // Writes hits[r] and shortens packet.tmax[r] for each ray r with a closer hit. Returns the mask of these rays.
+  unsigned long long intersectPacket(BVHRayPacket& packet, const unsigned long long active, BVHHit* hits) const;
+
+  float3 getAabbMin() const;
+  float3 getAabbMax() const;
+
+  unsigned int getNumTriangles() const;
+  unsigned int getNumNodes() const;
+  size_t       getMemorySize() const; // In bytes, nodes plus primitive list or triangle blocks.
+  float        getBytesPerTriangle() const;
+
+  BVH8Triangles getTriangles() const;
+  BVH8Nodes     getNodeFormat() const;
+
+  std::shared_ptr<sg::Triangles> getGeometry() const;
+
+  // For benchmarks. Requests above the supported instruction set fall back to the best supported one.
+  void    setIsa(const BVH8Isa isa);
+  BVH8Isa getIsa() const;
+
+  static BVH8Isa     getSupportedIsa(); // Queried with CPUID once.
+  static const char* getIsaName(const BVH8Isa isa);
+
+private:
+  bool intersectKernel(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter) const;
+  void compressNodes();
+
+private:
+  std::shared_ptr<sg::Triangles> m_geometry;
+
+  std::vector< BVH8Node, AlignedAllocator<BVH8Node, 64> > m_nodes; // Node 0 is the root. Empty for BVH8_NODES_COMPRESSED.
+  std::vector< BVH8CompressedNode, AlignedAllocator<BVH8CompressedNode, 16> > m_compressedNodes; // Only for BVH8_NODES_COMPRESSED.
+  std::vector<unsigned int> m_primitives; // Only for BVH8_TRIANGLES_INDEXED.
+  std::vector< BVH8TriangleBlock, AlignedAllocator<BVH8TriangleBlock, 16> > m_blocks; // Only for BVH8_TRIANGLES_BLOCKS.
+
+  std::shared_ptr<CacheFile> m_file; // Keeps the mapping alive when the data is used in place. The vectors are empty then.
+
+  unsigned int m_numTriangles;
+  unsigned int m_numNodes;
+  size_t       m_memorySize;
+
+  float3 m_aabbMin;
+  float3 m_aabbMax;
+
+  BVH8Triangles m_triangles;
+  BVH8Nodes     m_nodeFormat;
+  BVH8Data      m_data;
+  BVH8Isa       m_isa;
+};
+
+#endif // BVH8_H
@@ -0,0 +1,660 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef BVH8_TRAVERSAL_H
+#define BVH8_TRAVERSAL_H
+
+// Included by the per instruction set kernel sources only.
+// These are compiled with different ISA flags, so everything in here must have internal linkage.
+// Otherwise the linker is free to pick an AVX-512 compiled copy of an inline function for the scalar code path.
+// For the same reason the vector_math.h functions and the std::function call operator are not used here.
+
+#include "inc/BVH8.h"
+
+#include "inc/MyAssert.h"
+
+#include <cstring>
+#include <limits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// The triangle tests are called from several places inside the traversal loops.
+// Left to the compiler they end up as calls which cost more than the tests themselves for small leaves.
+#if defined(_MSC_VER)
+#define BVH8_FORCEINLINE __forceinline
+#else
+#define BVH8_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#define BVH8_SSE 1
+#include <emmintrin.h>
+#endif
+
+// The kernels per instruction set. Only called through BVH8::intersect() and BVH8::occluded().
+bool intersectBVH8Scalar(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter);
+bool occludedBVH8Scalar(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter);
+bool intersectBVH8AVX2(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter);
+bool occludedBVH8AVX2(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter);
+bool intersectBVH8AVX512(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter);
+bool occludedBVH8AVX512(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter);
+// Compressed nodes. AVX-512 CPUs use the AVX2 kernels.
+bool intersectBVH8CompressedScalar(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter);
+bool occludedBVH8CompressedScalar(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter);
+bool intersectBVH8CompressedAVX2(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter);
+bool occludedBVH8CompressedAVX2(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter);
+
+// Calls the filter. Implemented in BVH8.cpp which is compiled for the baseline instruction set.
+bool callBVH8Filter(BVHFilter const* filter, const unsigned int primitive, float2 const& barycentrics);
+
+
+namespace
+{
+  // Per ray data shared by all node tests.
+  struct BVH8RayData
+  {
+    float origin[3];
+    float invDirection[3];
+    int   octant[3]; // 1 when the direction component is negative. Selects the near and far planes per axis.
+    // Watertight triangle test. The ray is transformed into a space where it runs along +z, see Woop et al. 2013.
+    int   kx;
+    int   ky;
+    int   kz;        // The dimension with the largest absolute direction component.
+    float shear[3];  // Sx, Sy, Sz
+  };
+
+  struct BVH8StackEntry
+  {
+    unsigned int index;
+    unsigned int count; // != 0 for leaves.
+    float        tNear;
+  };
+
+  inline unsigned int findLowestBit(const unsigned int mask)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+  }
+
+  // Portable, the scalar kernel must not require the POPCNT instruction.
+  inline unsigned int countBits8(unsigned int mask)
+  {
+    mask = mask - ((mask >> 1) & 0x55u);
+    mask = (mask & 0x33u) + ((mask >> 2) & 0x33u);
+    return (mask + (mask >> 4)) & 0x0Fu;
+  }
+
+  // 2^exponent for the exponents of normalized floats.
+  inline float getScale(const signed char exponent)
+  {
+    const unsigned int bits = static_cast<unsigned int>(exponent + 127) << 23;
+
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+    return scale;
+  }
+
+  // Node layouts. getChild() returns false for unused slots.
+  // Otherwise it returns the node index with count == 0 for inner children, the first block or primitive list entry for leaves.
+  struct NodeAccessFull
+  {
+    typedef BVH8Node Node;
+
+    static const Node* getNodes(BVH8Data const& data)
+    {
+      return data.nodes;
+    }
+
+    static bool getChild(Node const& node, const unsigned int i, unsigned int& index, unsigned int& count)
+    {
+      index = node.index[i];
+      count = node.count[i];
+      return true; // The inverted bounds of the unused slots never pass the slab test.
+    }
+  };
+
+  struct NodeAccessCompressed
+  {
+    typedef BVH8CompressedNode Node;
+
+    static const Node* getNodes(BVH8Data const& data)
+    {
+      return data.compressedNodes;
+    }
+
+    static bool getChild(Node const& node, const unsigned int i, unsigned int& index, unsigned int& count)
+    {
+      if (node.imask & (1u << i))
+      {
+        index = node.childBase + countBits8(node.imask & ((1u << i) - 1u));
+        count = 0;
+        return true;
+      }
+      index = node.primitiveBase + (node.meta[i] >> 3);
+      count = node.meta[i] & 7u;
+      return count != 0; // Unused slots have meta == 0. Their bounds are not reliably inverted on coarse grids.
+    }
+  };
+
+  // Dequantizes the child bounds, the index and count of all 8 children. Unused slots get inverted bounds.
+  // The build checks that exactly this calculation contains the original child bounds.
+  inline void decodeNode(BVH8CompressedNode const& src, BVH8Node& dst)
+  {
+    const float scale[3] = { getScale(src.exponent[0]), getScale(src.exponent[1]), getScale(src.exponent[2]) };
+
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+      if (!NodeAccessCompressed::getChild(src, i, dst.index[i], dst.count[i]))
+      {
+        dst.lowerX[i] = std::numeric_limits<float>::max();
+        dst.lowerY[i] = std::numeric_limits<float>::max();
+        dst.lowerZ[i] = std::numeric_limits<float>::max();
+        dst.upperX[i] = -std::numeric_limits<float>::max();
+        dst.upperY[i] = -std::numeric_limits<float>::max();
+        dst.upperZ[i] = -std::numeric_limits<float>::max();
+        dst.index[i]  = 0;
+        dst.count[i]  = 0;
+        continue;
+      }
+
+      dst.lowerX[i] = src.origin[0] + float(src.qlo[0][i]) * scale[0];
+      dst.lowerY[i] = src.origin[1] + float(src.qlo[1][i]) * scale[1];
+      dst.lowerZ[i] = src.origin[2] + float(src.qlo[2][i]) * scale[2];
+      dst.upperX[i] = src.origin[0] + float(src.qhi[0][i]) * scale[0];
+      dst.upperY[i] = src.origin[1] + float(src.qhi[1][i]) * scale[1];
+      dst.upperZ[i] = src.origin[2] + float(src.qhi[2][i]) * scale[2];
+    }
+  }
+
+  inline void setupRay(BVHRay const& ray, BVH8RayData& rayData)
+  {
+    const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+
+    rayData.origin[0] = ray.origin.x;
+    rayData.origin[1] = ray.origin.y;
+    rayData.origin[2] = ray.origin.z;
+
+    for (int i = 0; i < 3; ++i)
+    {
+      // Same as safeInverse() in BVH.cpp. Avoids infinities and NaN for axis aligned directions.
+      const float eps = 1.0e-20f;
+      const float a   = (d[i] < 0.0f) ? -d[i] : d[i];
+
+      rayData.invDirection[i] = 1.0f / ((eps < a) ? d[i] : ((d[i] < 0.0f) ? -eps : eps));
+      rayData.octant[i]       = (rayData.invDirection[i] < 0.0f) ? 1 : 0;
+    }
+
+    const float a[3] = { (d[0] < 0.0f) ? -d[0] : d[0], (d[1] < 0.0f) ? -d[1] : d[1], (d[2] < 0.0f) ? -d[2] : d[2] };
+
+    // Written as selects. The direction is random per ray, branches would be mispredicted half of the time.
+    const int   k = (a[0] < a[1]) ? 1 : 0;
+    const float m = (a[0] < a[1]) ? a[1] : a[0];
+
+    const int kz = (m < a[2]) ? 2 : k;
+    const int kx = (kz == 2) ? 0 : kz + 1;
+    const int ky = (kx == 2) ? 0 : kx + 1;
+
+    // Swapping kx and ky for a negative direction keeps the winding order of the triangles.
+    const bool flip = (d[kz] < 0.0f);
+
+    rayData.kx = (flip) ? ky : kx;
+    rayData.ky = (flip) ? kx : ky;
+    rayData.kz = kz;
+
+    // The largest component is never below eps, so the inverse direction holds the exact 1 / d[kz].
+    rayData.shear[2] = rayData.invDirection[rayData.kz];
+    rayData.shear[0] = d[rayData.kx] * rayData.shear[2];
+    rayData.shear[1] = d[rayData.ky] * rayData.shear[2];
+  }
+
+  // Watertight ray-triangle intersection (Woop, Benthin, Wald, "Watertight Ray/Triangle Intersection", JCGT 2013) without backface culling.
+  // The vertices are relative to the ray origin in the [kx, ky, kz] order: a[0] == A[kx] etc.
+  // Edges shared by two triangles are hit by exactly one of them, there are no cracks between neighbouring triangles.
+  inline bool intersectTriangleWatertight(const float* a, const float* b, const float* c, BVH8RayData const& rayData,
+                                          const float tmin, const float tmax, float& t, float2& barycentrics)
+  {
+    const float ax = a[0] - rayData.shear[0] * a[2];
+    const float ay = a[1] - rayData.shear[1] * a[2];
+    const float bx = b[0] - rayData.shear[0] * b[2];
+    const float by = b[1] - rayData.shear[1] * b[2];
+    const float cx = c[0] - rayData.shear[0] * c[2];
+    const float cy = c[1] - rayData.shear[1] * c[2];
+
+    // Scaled barycentric coordinates. U belongs to vertex 0.
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    if (u == 0.0f || v == 0.0f || w == 0.0f) // Ray through an edge or vertex. Decide in double precision.
+    {
+      u = static_cast<float>(double(cx) * double(by) - double(cy) * double(bx));
+      v = static_cast<float>(double(ax) * double(cy) - double(ay) * double(cx));
+      w = static_cast<float>(double(bx) * double(ay) - double(by) * double(ax));
+    }
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (0.0f < u || 0.0f < v || 0.0f < w))
+    {
+      return false;
+    }
+
+    const float det = u + v + w;
+    if (det == 0.0f)
+    {
+      return false;
+    }
+
+    const float T = u * (rayData.shear[2] * a[2]) + v * (rayData.shear[2] * b[2]) + w * (rayData.shear[2] * c[2]);
+
+    const float invDet = 1.0f / det;
+
+    t = T * invDet;
+    if (t < tmin || tmax < t)
+    {
+      return false;
+    }
+
+    barycentrics.x = v * invDet;
+    barycentrics.y = w * invDet;
+    return true;
+  }
+
+  // One triangle of the indexed representation.
+  BVH8_FORCEINLINE bool intersectTriangleIndexed(BVH8Data const& data, const unsigned int primitive, BVH8RayData const& rayData,
+                                       const float tmin, const float tmax, float& t, float2& barycentrics)
+  {
+    const unsigned int* tri = &data.indices[primitive * 3];
+
+    const float3 v0 = data.attributes[tri[0]].vertex;
+    const float3 v1 = data.attributes[tri[1]].vertex;
+    const float3 v2 = data.attributes[tri[2]].vertex;
+
+    const float p0[3] = { v0.x - rayData.origin[0], v0.y - rayData.origin[1], v0.z - rayData.origin[2] };
+    const float p1[3] = { v1.x - rayData.origin[0], v1.y - rayData.origin[1], v1.z - rayData.origin[2] };
+    const float p2[3] = { v2.x - rayData.origin[0], v2.y - rayData.origin[1], v2.z - rayData.origin[2] };
+
+    const float a[3] = { p0[rayData.kx], p0[rayData.ky], p0[rayData.kz] };
+    const float b[3] = { p1[rayData.kx], p1[rayData.ky], p1[rayData.kz] };
+    const float c[3] = { p2[rayData.kx], p2[rayData.ky], p2[rayData.kz] };
+
+    return intersectTriangleWatertight(a, b, c, rayData, tmin, tmax, t, barycentrics);
+  }
+
+  // One lane of a triangle block. Same operations as the 4-wide version.
+  inline bool intersectTriangleLane(BVH8TriangleBlock const& block, const int lane, BVH8RayData const& rayData,
+                                    const float tmin, const float tmax, float& t, float2& barycentrics)
+  {
+    float a[3];
+    float b[3];
+    float c[3];
+
+    const int k[3] = { rayData.kx, rayData.ky, rayData.kz };
+
+    for (int i = 0; i < 3; ++i)
+    {
+      a[i] = block.vertex[0][k[i]][lane] - rayData.origin[k[i]];
+      b[i] = block.vertex[1][k[i]][lane] - rayData.origin[k[i]];
+      c[i] = block.vertex[2][k[i]][lane] - rayData.origin[k[i]];
+    }
+
+    return intersectTriangleWatertight(a, b, c, rayData, tmin, tmax, t, barycentrics);
+  }
+
+  // Tests the first count triangles of the block at once. Returns the bit mask of the hit lanes inside [tmin, tmax]
+  // and writes the hit distances and barycentrics of all lanes.
+  BVH8_FORCEINLINE unsigned int intersectTriangleBlock(BVH8TriangleBlock const& block, const unsigned int count, BVH8RayData const& rayData,
+                                             const float tmin, const float tmax, float* t, float2* barycentrics)
+  {
+#if defined(BVH8_SSE)
+    const int kx = rayData.kx;
+    const int ky = rayData.ky;
+    const int kz = rayData.kz;
+
+    const __m128 ox = _mm_set1_ps(rayData.origin[kx]);
+    const __m128 oy = _mm_set1_ps(rayData.origin[ky]);
+    const __m128 oz = _mm_set1_ps(rayData.origin[kz]);
+
+    const __m128 az = _mm_sub_ps(_mm_load_ps(block.vertex[0][kz]), oz);
+    const __m128 bz = _mm_sub_ps(_mm_load_ps(block.vertex[1][kz]), oz);
+    const __m128 cz = _mm_sub_ps(_mm_load_ps(block.vertex[2][kz]), oz);
+
+    const __m128 sx = _mm_set1_ps(rayData.shear[0]);
+    const __m128 sy = _mm_set1_ps(rayData.shear[1]);
+    const __m128 sz = _mm_set1_ps(rayData.shear[2]);
+
+    const __m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(block.vertex[0][kx]), ox), _mm_mul_ps(sx, az));
+    const __m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(block.vertex[0][ky]), oy), _mm_mul_ps(sy, az));
+    const __m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(block.vertex[1][kx]), ox), _mm_mul_ps(sx, bz));
+    const __m128 by = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(block.vertex[1][ky]), oy), _mm_mul_ps(sy, bz));
+    const __m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(block.vertex[2][kx]), ox), _mm_mul_ps(sx, cz));
+    const __m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(block.vertex[2][ky]), oy), _mm_mul_ps(sy, cz));
+
+    const __m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+    const __m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+    const __m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+
+    const __m128 zero = _mm_setzero_ps();
+
+    const int lanes = (1 << count) - 1;
+
+    // Edge and vertex hits are rare. These lanes take the scalar path with the double precision fallback.
+    const int edge = _mm_movemask_ps(_mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(u, zero), _mm_cmpeq_ps(v, zero)), _mm_cmpeq_ps(w, zero))) & lanes;
+
+    const __m128 negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+    const __m128 positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+
+    const __m128 det    = _mm_add_ps(_mm_add_ps(u, v), w);
+    const __m128 T      = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_mul_ps(sz, az)), _mm_mul_ps(v, _mm_mul_ps(sz, bz))), _mm_mul_ps(w, _mm_mul_ps(sz, cz)));
+    const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    const __m128 dist   = _mm_mul_ps(T, invDet);
+
+    const __m128 miss = _mm_or_ps(_mm_and_ps(negative, positive), _mm_cmpeq_ps(det, zero));
+    const __m128 hit  = _mm_andnot_ps(miss, _mm_and_ps(_mm_cmpge_ps(dist, _mm_set1_ps(tmin)), _mm_cmple_ps(dist, _mm_set1_ps(tmax))));
+
+    unsigned int mask = static_cast<unsigned int>(_mm_movemask_ps(hit) & lanes & ~edge);
+
+    float beta[4];
+    float gamma[4];
+
+    _mm_storeu_ps(t, dist);
+    _mm_storeu_ps(beta,  _mm_mul_ps(v, invDet));
+    _mm_storeu_ps(gamma, _mm_mul_ps(w, invDet));
+
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      barycentrics[lane].x = beta[lane];
+      barycentrics[lane].y = gamma[lane];
+
+      if ((edge & (1 << lane)) && intersectTriangleLane(block, lane, rayData, tmin, tmax, t[lane], barycentrics[lane]))
+      {
+        mask |= 1u << lane;
+      }
+    }
+    return mask;
+#else
+    unsigned int mask = 0;
+    for (unsigned int lane = 0; lane < count; ++lane)
+    {
+      if (intersectTriangleLane(block, lane, rayData, tmin, tmax, t[lane], barycentrics[lane]))
+      {
+        mask |= 1u << lane;
+      }
+    }
+    return mask;
+#endif
+  }
+
+  // Closest hit test of the triangles inside one leaf. Shortens tmax on a hit.
+  inline bool intersectLeaf(BVH8Data const& data, const unsigned int index, const unsigned int count, BVH8RayData const& rayData,
+                            const float tmin, float& tmax, BVHHit& hit, BVHFilter const* filter)
+  {
+    bool found = false;
+
+    if (data.blocks != nullptr)
+    {
+      BVH8TriangleBlock const& block = data.blocks[index];
+
+      float  t[4];
+      float2 barycentrics[4];
+
+      unsigned int mask = intersectTriangleBlock(block, count, rayData, tmin, tmax, t, barycentrics);
+      while (mask != 0)
+      {
+        const unsigned int lane = findLowestBit(mask);
+        mask &= mask - 1;
+
+        if (t[lane] <= tmax && (filter == nullptr || callBVH8Filter(filter, block.primitive[lane], barycentrics[lane])))
+        {
+          tmax  = t[lane];
+          found = true;
+
+          hit.distance     = t[lane];
+          hit.barycentrics = barycentrics[lane];
+          hit.primitive    = block.primitive[lane];
+        }
+      }
+      return found;
+    }
+
+    for (unsigned int i = index; i < index + count; ++i)
+    {
+      const unsigned int primitive = data.primitives[i];
+
+      float  t;
+      float2 barycentrics;
+
+      if (intersectTriangleIndexed(data, primitive, rayData, tmin, tmax, t, barycentrics) &&
+          (filter == nullptr || callBVH8Filter(filter, primitive, barycentrics)))
+      {
+        tmax  = t;
+        found = true;
+
+        hit.distance     = t;
+        hit.barycentrics = barycentrics;
+        hit.primitive    = primitive;
+      }
+    }
+    return found;
+  }
+
+  // Any hit test of the triangles inside one leaf.
+  inline bool occludedLeaf(BVH8Data const& data, const unsigned int index, const unsigned int count, BVH8RayData const& rayData,
+                           const float tmin, const float tmax, BVHFilter const* filter)
+  {
+    if (data.blocks != nullptr)
+    {
+      BVH8TriangleBlock const& block = data.blocks[index];
+
+      float  t[4];
+      float2 barycentrics[4];
+
+      unsigned int mask = intersectTriangleBlock(block, count, rayData, tmin, tmax, t, barycentrics);
+      if (filter == nullptr)
+      {
+        return mask != 0;
+      }
+      while (mask != 0)
+      {
+        const unsigned int lane = findLowestBit(mask);
+        mask &= mask - 1;
+
+        if (callBVH8Filter(filter, block.primitive[lane], barycentrics[lane]))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    for (unsigned int i = index; i < index + count; ++i)
+    {
+      const unsigned int primitive = data.primitives[i];
+
+      float  t;
+      float2 barycentrics;
+
+      if (intersectTriangleIndexed(data, primitive, rayData, tmin, tmax, t, barycentrics) &&
+          (filter == nullptr || callBVH8Filter(filter, primitive, barycentrics)))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // NodeTest::intersectChildren(node, rayData, tmin, tmax, tNear) returns the bit mask of the children overlapping [tmin, tmax]
+  // and writes the entry distances of all 8 children into the 32 byte aligned tNear.
+  // NodeTest derives from the NodeAccess of the node layout it tests.
+  template<typename NodeTest>
+  inline bool intersectBVH8(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter)
+  {
+    BVH8RayData rayData;
+    setupRay(ray, rayData);
+
+    float tmax  = ray.tmax;
+    bool  found = false;
+
+    BVH8StackEntry stack[BVH8_STACK_SIZE];
+    int            top = 0;
+
+    stack[top].index = data.root;
+    stack[top].count = 0;
+    stack[top].tNear = ray.tmin;
+    ++top;
+
+#if defined(_MSC_VER)
+    __declspec(align(32)) float tNear[8];
+#else
+    float tNear[8] __attribute__((aligned(32)));
+#endif
+
+    while (0 < top)
+    {
+      const BVH8StackEntry entry = stack[--top];
+
+      if (tmax < entry.tNear) // Behind the closest hit found so far.
+      {
+        continue;
+      }
+
+      if (entry.count != 0)
+      {
+        if (intersectLeaf(data, entry.index, entry.count, rayData, ray.tmin, tmax, hit, filter))
+        {
+          found = true;
+        }
+        continue;
+      }
+
+      typename NodeTest::Node const& node = NodeTest::getNodes(data)[entry.index];
+
+      unsigned int mask = NodeTest::intersectChildren(node, rayData, ray.tmin, tmax, tNear);
+
+      // Push the children sorted by distance, farthest first, to pop the nearest child next.
+      const int first = top;
+      while (mask != 0)
+      {
+        const unsigned int i = findLowestBit(mask);
+        mask &= mask - 1;
+
+        unsigned int index;
+        unsigned int count;
+        if (!NodeTest::getChild(node, i, index, count))
+        {
+          continue;
+        }
+
+        MY_ASSERT(top < BVH8_STACK_SIZE);
+
+        int j = top++;
+        while (first < j && stack[j - 1].tNear < tNear[i])
+        {
+          stack[j] = stack[j - 1];
+          --j;
+        }
+        stack[j].index = index;
+        stack[j].count = count;
+        stack[j].tNear = tNear[i];
+      }
+    }
+
+    return found;
+  }
+
+  template<typename NodeTest>
+  inline bool occludedBVH8(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter)
+  {
+    BVH8RayData rayData;
+    setupRay(ray, rayData);
+
+    BVH8StackEntry stack[BVH8_STACK_SIZE];
+    int            top = 0;
+
+    stack[top].index = data.root;
+    stack[top].count = 0;
+    stack[top].tNear = ray.tmin;
+    ++top;
+
+#if defined(_MSC_VER)
+    __declspec(align(32)) float tNear[8];
+#else
+    float tNear[8] __attribute__((aligned(32)));
+#endif
+
+    while (0 < top)
+    {
+      const BVH8StackEntry entry = stack[--top];
+
+      if (entry.count != 0)
+      {
+        if (occludedLeaf(data, entry.index, entry.count, rayData, ray.tmin, ray.tmax, filter))
+        {
+          return true; // Any hit terminates.
+        }
+        continue;
+      }
+
+      typename NodeTest::Node const& node = NodeTest::getNodes(data)[entry.index];
+
+      unsigned int mask = NodeTest::intersectChildren(node, rayData, ray.tmin, ray.tmax, tNear);
+
+      // No ordering needed for the any hit query.
+      while (mask != 0)
+      {
+        const unsigned int i = findLowestBit(mask);
+        mask &= mask - 1;
+
+        unsigned int index;
+        unsigned int count;
+        if (!NodeTest::getChild(node, i, index, count))
+        {
+          continue;
+        }
+
+        MY_ASSERT(top < BVH8_STACK_SIZE);
+
+        stack[top].index = index;
+        stack[top].count = count;
+        stack[top].tNear = tNear[i];
+        ++top;
+      }
+    }
+
+    return false;
+  }
+} // namespace
+
+#endif // BVH8_TRAVERSAL_H
@@ -42,9 +42,12 @@
 // OptiX 7 function table structure.
 #include <optix_function_table.h>
 
+#include "inc/BVH.h"
+#include "inc/InstanceTable.h"
 #include "inc/MaterialGUI.h"
 #include "inc/Picture.h"
 #include "inc/SceneGraph.h"
+#include "inc/SceneStatistics.h"
 #include "inc/Texture.h"
 #include "inc/MyAssert.h"
 
@@ -55,12 +58,17 @@
 #include <memory>
 #include <vector>
 
+// updateInstances() refits the TLAS to the new instance transforms.
+// It's rebuilt instead when the SAH cost of the refitted hierarchy exceeds the cost after the last build by this factor. 0.0f always refits.
+#define TLAS_REBUILD_RATIO 1.5f
+
 enum RendererStrategy
 {
   RS_INTERACTIVE_SINGLE_GPU,
   RS_INTERACTIVE_MULTI_GPU_ZERO_COPY,
   RS_INTERACTIVE_MULTI_GPU_PEER_ACCESS,
   RS_INTERACTIVE_MULTI_GPU_LOCAL_COPY,
+  RS_CPU_MULTICORE,
   NUM_RENDERER_STRATEGIES
 };
 
@@ -235,6 +243,10 @@ enum ProgramGroupId
   PGID_HIT_SHADOW,
   PGID_HIT_RADIANCE_CUTOUT,
   PGID_HIT_SHADOW_CUTOUT,
+  PGID_HIT_RADIANCE_PRIMITIVE, // Same as above with the __intersection__primitive program for the analytic primitives.
+  PGID_HIT_SHADOW_PRIMITIVE,
+  PGID_HIT_RADIANCE_PRIMITIVE_CUTOUT,
+  PGID_HIT_SHADOW_PRIMITIVE_CUTOUT,
   // Number of all program group entries.
   NUM_PROGRAM_GROUP_IDS
 };
@@ -249,15 +261,25 @@ struct GeometryData
   , numAttributes(0)
   , numIndices(0)
   , d_blas(0)
+  , aabbMin(make_float3(0.0f))
+  , aabbMax(make_float3(0.0f))
+  , format(GEOMETRY_FORMAT_FULL)
+  , vertexScale(make_float3(0.0f))
+  , primitiveType(PRIMITIVE_TRIANGLES)
   {
   }
  
   OptixTraversableHandle traversable;
   CUdeviceptr            d_attributes;
   CUdeviceptr            d_indices;
-  size_t                 numAttributes; // Count of TriangleAttributes structs.
+  size_t                 numAttributes; // Count of vertices in the format below.
   size_t                 numIndices;    // Count of unsigned ints, not triplets.
   CUdeviceptr            d_blas;
+  float3                 aabbMin; // Object space bounding box. The TLAS updates need the world space instance bounds.
+  float3                 aabbMax;
+  GeometryFormat         format;      // Encoding of the d_attributes.
+  float3                 vertexScale; // GEOMETRY_FORMAT_QUANTIZED vertices are aabbMin + code * vertexScale.
+  PrimitiveType          primitiveType; // The d_attributes of analytic primitives hold one PrimitiveDefinition, the GAS one custom primitive.
 };
 
 struct InstanceData
@@ -309,14 +331,22 @@ public:
   virtual void initCameras(std::vector<CameraDefinition> const& cameras);
   virtual void initLights(std::vector<LightDefinition> const& lights);
   virtual void initMaterials(std::vector<MaterialGUI> const& materialsGUI);
-  virtual void initScene(std::shared_ptr<sg::Group> root, const unsigned int numGeometries);
+  virtual void initScene(InstanceTable const& table, const unsigned int numGeometries);
+
+  // Encoding of the vertex attributes uploaded by the following initScene() calls.
+  void setGeometryFormat(const GeometryFormat format);
   
   virtual void updateCamera(const int idCamera, CameraDefinition const& camera);
   virtual void updateLight(const int idLight, LightDefinition const& light);
   virtual void updateMaterial(const int idMaterial, MaterialGUI const& materialGUI);
+  // Applies the instances listed by InstanceTable::getChanged(). The scene structure must be the same as in initScene().
+  // Returns true when the TLAS was rebuilt instead of updated.
+  virtual bool updateInstances(InstanceTable const& table);
   
   virtual void setState(DeviceState const& state);
   virtual void compositor(Device* other);
+
+  DeviceMemoryStatistics getMemoryStatistics() const;
   
   // Abstract functions:
   virtual void activateContext() = 0;
@@ -324,17 +354,22 @@ public:
   virtual void render(const unsigned int iterationIndex, void** buffer) = 0;
   virtual void updateDisplayTexture() = 0;
   virtual const void* getOutputBufferHost() = 0; // This always needs to be implemented for the screenshot functionality!
+  virtual size_t getOutputBufferSize() const = 0;  // Bytes of the strategy's output, tile and texel buffers at the current resolution.
 
 private:
   OptixResult initFunctionTable();
   void initDeviceAttributes();
   void initDeviceProperties();
   void initPipeline();
-  void traverseNode(std::shared_ptr<sg::Node> node, float matrix[12], InstanceData data);
   unsigned int createGeometry(std::shared_ptr<sg::Triangles> geometry);
-  void createInstance( const OptixTraversableHandle traversable, float matrix[12], InstanceData const& data);
+  unsigned int createGeometry(std::shared_ptr<sg::Primitive> primitive);
+  void createInstance( const OptixTraversableHandle traversable, const float* matrix, InstanceData const& data);
   void createTLAS();
+  void buildTLAS(const OptixBuildOperation operation);
+  void getInstanceAabb(const unsigned int index, float3& aabbMin, float3& aabbMax) const;
+  void getInstanceAabbs(std::vector<float3>& aabbs) const;
   void createHitGroupRecords();
+  void setHitGroupRecords(const unsigned int index);
 
 public:
   // Constructor arguments:
@@ -377,9 +412,24 @@ public:
   SbtRecordGeometryInstanceData m_sbtRecordHitRadianceCutout;
   SbtRecordGeometryInstanceData m_sbtRecordHitShadowCutout;
 
+  SbtRecordGeometryInstanceData m_sbtRecordHitRadiancePrimitive;
+  SbtRecordGeometryInstanceData m_sbtRecordHitShadowPrimitive;
+
+  SbtRecordGeometryInstanceData m_sbtRecordHitRadiancePrimitiveCutout;
+  SbtRecordGeometryInstanceData m_sbtRecordHitShadowPrimitiveCutout;
+
   CUdeviceptr m_d_tlas;
+  CUdeviceptr m_d_instances; // Kept for the TLAS updates.
+
+  OptixAccelBufferSizes m_tlasBufferSizes;
+
+  BVH   m_tlasBounds; // Host BVH over the same instance bounds. Estimates the quality of the refitted TLAS which OptiX doesn't report.
+  float m_tlasCost;   // SAH cost of m_tlasBounds after the last build.
+
+  std::vector<float3> m_instanceAabbs; // The m_tlasBounds primitives. updateInstances() replaces the changed ones.
 
   std::vector<GeometryData>  m_geometryData;
+  GeometryFormat             m_geometryFormat;
 
   std::vector<OptixInstance> m_instances;
   std::vector<InstanceData>  m_instanceData; // idGeometry, idMaterial, idLight
@@ -401,6 +451,8 @@ public:
   Texture* m_textureEnv;
 
   std::vector<MaterialDefinition> m_materials; // Staging data for the device side sysData.materialDefinitions
+
+  DeviceMemoryStatistics m_memoryStatistics; // Scene allocations. Textures and output buffers are queried in getMemoryStatistics().
 }; 
 
 #endif // DEVICE_H
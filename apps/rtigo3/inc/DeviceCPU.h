@@ -0,0 +1,327 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef DEVICE_CPU_H
+#define DEVICE_CPU_H
+
+// For RendererStrategy, InstanceData and DeviceState.
+#include "inc/Device.h"
+
+#include "inc/BVH8.h"
+#include "inc/GeometryCache.h"
+#include "inc/InstanceTable.h"
+#include "inc/MaterialGUI.h"
+#include "inc/Picture.h"
+#include "inc/SceneGraph.h"
+#include "inc/TextureCPU.h"
+#include "inc/ThreadPool.h"
+
+#include "shaders/system_data.h"
+#include "shaders/per_ray_data.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+// 0 == Each pixel traces its primary ray individually.
+// 1 == The primary rays of PACKET_BLOCK_SIZE x PACKET_BLOCK_SIZE pixel blocks are traced together as one BVHRayPacket.
+#define USE_PRIMARY_RAY_PACKETS 1
+
+// 8x8 pixels fill a whole BVHRayPacket.
+#define PACKET_BLOCK_SIZE 8
+
+// 0 == The integrator() loop runs each path from start to end. The tiles are handed out to the threads directly.
+// 1 == Wavefront path tracer. Each thread runs the segments of its paths in flight stage by stage, the shading sorted into queues per BSDF.
+#define USE_WAVEFRONT 1
+
+// Maximum pixel blocks per wavefront. 1024 paths keep the path state arrays of each thread inside its L2 cache.
+#define WAVEFRONT_BLOCKS 16
+
+
+// Host copy of one unique sg::Triangles or sg::Primitive node. The attributes and indices are referenced, not copied.
+// The equivalent of the GeometryData with the BLAS on the Device.
+struct GeometryCPU
+{
+  GeometryCPU()
+  : attributes(nullptr)
+  , format(GEOMETRY_FORMAT_FULL)
+  , indices(nullptr)
+  , numTriangles(0)
+  , aabbMin(make_float3(RT_DEFAULT_MAX))
+  , aabbMax(make_float3(-RT_DEFAULT_MAX))
+  , vertexOffset(make_float3(0.0f))
+  , vertexScale(make_float3(0.0f))
+  {
+    memset(&primitive, 0, sizeof(PrimitiveDefinition));
+    primitive.type = PRIMITIVE_TRIANGLES;
+  }
+
+  std::shared_ptr<sg::Triangles> geometry;     // Keeps the referenced attributes and indices alive.
+  const void*                    attributes;   // Either the TriangleAttributes of the geometry or the encoded ones.
+  GeometryFormat                 format;
+  std::vector<unsigned int>      encoded;      // The compact formats.
+  const unsigned int*            indices;      // Triplets.
+  unsigned int                   numTriangles;
+  float3                         aabbMin;      // Object space bounding box.
+  float3                         aabbMax;
+  float3                         vertexOffset; // GEOMETRY_FORMAT_QUANTIZED vertices are vertexOffset + code * vertexScale.
+  float3                         vertexScale;
+  BVH8                           bvh;          // Bottom level acceleration structure. Shared by all instances of this geometry.
+  PrimitiveDefinition            primitive;    // Analytic primitives are intersected directly and have no BLAS. PRIMITIVE_TRIANGLES otherwise.
+};
+
+// Flattened instance, the equivalent of an OptixInstance plus its SBT record data.
+struct InstanceCPU
+{
+  InstanceCPU(InstanceData const& instanceData)
+  : data(instanceData)
+  {
+  }
+
+  float        matrix[12];  // Object to world, row-major 3x4.
+  float        inverse[12]; // World to object.
+  float3       aabbMin;     // World space bounding box.
+  float3       aabbMax;
+  InstanceData data;        // idGeometry, idMaterial, idLight
+};
+
+// The result of a closest hit query. Matches what the OptiX closest hit program queries from the hit.
+struct HitCPU
+{
+  float        distance;     // optixGetRayTmax()
+  float2       barycentrics; // optixGetTriangleBarycentrics(), the surface coordinates on analytic primitives.
+  int          instance;     // Index into m_instances. Negative means miss.
+  unsigned int primitive;    // optixGetPrimitiveIndex()
+};
+
+// The state of one path which persists across its segments. Used by the integrator() loop and the wavefront stages.
+struct PathCPU
+{
+  float4 absorptionStack[MATERIAL_STACK_SIZE]; // The absorption coefficient and IOR of the volumes the ray is inside. .xyz == sigma_a, .w == IOR
+  int    stackIdx;
+  int    depth;      // Path segment index. Primary ray is 0.
+  float3 radiance;
+  float3 throughput; // The throughput for the next radiance.
+};
+
+// Deferred visibility test of the direct lighting. The shadow ray starts at the PerRayData::pos.
+struct ShadowRayCPU
+{
+  float3 direction;
+  float  tmax;
+  float3 radiance; // Added to the PerRayData::radiance when the light is visible.
+};
+
+// The PathCPU fields of one path inside the WavefrontCPU arrays. beginPath(), beginSegment() and endSegment() work on both.
+struct PathRefCPU
+{
+  float4* absorptionStack; // MATERIAL_STACK_SIZE entries.
+  int&    stackIdx;
+  int&    depth;
+  float3& radiance;
+  float3& throughput;
+};
+
+// Structure of arrays with the state of the paths in flight of one thread. Each wavefront stage only touches the arrays it needs.
+// Path i belongs to the pixel block i / BVH_PACKET_SIZE. Partial blocks at the image border leave unused entries.
+struct WavefrontCPU
+{
+  void resize(const size_t size)
+  {
+    prd.resize(size);
+    absorptionStack.resize(size * MATERIAL_STACK_SIZE);
+    stackIdx.resize(size);
+    depth.resize(size);
+    radiance.resize(size);
+    throughput.resize(size);
+    hit.resize(size);
+    shadowRay.resize(size);
+    hasShadowRay.resize(size);
+    pixel.resize(size);
+  }
+
+  PathRefCPU getPath(const unsigned int i)
+  {
+    return PathRefCPU{ &absorptionStack[size_t(i) * MATERIAL_STACK_SIZE], stackIdx[i], depth[i], radiance[i], throughput[i] };
+  }
+
+  std::vector<PerRayData>    prd;
+  std::vector<float4>        absorptionStack; // The PathCPU fields.
+  std::vector<int>           stackIdx;
+  std::vector<int>           depth;
+  std::vector<float3>        radiance;
+  std::vector<float3>        throughput;
+  std::vector<HitCPU>        hit;
+  std::vector<ShadowRayCPU>  shadowRay;
+  std::vector<unsigned char> hasShadowRay;
+  std::vector<uint2>         pixel;
+
+  std::vector<unsigned int> active;                          // The paths which trace their next segment.
+  std::vector<unsigned int> queueMiss;
+  std::vector<unsigned int> queueShade[NUM_BSDF_INDICES + 1]; // Indexed by MaterialDefinition::indexBSDF. The last queue holds unknown BSDFs.
+  std::vector<unsigned int> queueShadow;
+};
+
+// Host equivalents of the BSDF sample and eval callable programs.
+typedef void   (*SampleBSDFFunc)(MaterialDefinition const& material, State const& state, PerRayData* prd);
+typedef float4 (*EvalBSDFFunc)(MaterialDefinition const& material, State const& state, PerRayData* const prd, float3 const& wiL);
+
+
+// Device implementation for the RS_CPU_MULTICORE strategy.
+// This does not derive from Device because that is bound to a CUDA context and OptiX pipeline.
+// The public interface matches the Device class so that the RaytracerCPU can forward the same calls.
+// The shader programs inside the shaders folder are ported to host functions 1:1 and read the same SystemData fields.
+class DeviceCPU
+{
+public:
+  DeviceCPU(const int numThreads,        // Number of host threads, 0 means all hardware threads.
+            const int miss,              // The miss shader ID to use.
+            const unsigned int tex);     // OpenGL HDR texture object handle
+  ~DeviceCPU();
+
+  void initTextures(std::map<std::string, Picture*> const& mapOfPictures);
+  void initCameras(std::vector<CameraDefinition> const& cameras);
+  void initLights(std::vector<LightDefinition> const& lights);
+  void initMaterials(std::vector<MaterialGUI> const& materialsGUI);
+  void initScene(InstanceTable const& table, const unsigned int numGeometries);
+
+  void updateCamera(const int idCamera, CameraDefinition const& camera);
+  void updateLight(const int idLight, LightDefinition const& light);
+  void updateMaterial(const int idMaterial, MaterialGUI const& materialGUI);
+  // Applies the instances listed by InstanceTable::getChanged(). The scene structure must be the same as in initScene().
+  // Returns true when the TLAS was rebuilt instead of refitted.
+  bool updateInstances(InstanceTable const& table);
+
+  void setState(DeviceState const& state);
+
+  void render(const unsigned int iterationIndex);
+  void updateDisplayTexture();
+  const void* getOutputBufferHost();
+
+  // Same fields as the Device::getMemoryStatistics(). The BLAS are the BVH8 and the output buffers include the wavefront path state.
+  DeviceMemoryStatistics getMemoryStatistics() const;
+
+  unsigned int getNumThreads() const;
+
+  // Enables the persistent BVH8 cache for the following initScene() calls. An empty path disables it.
+  void setCachePath(std::string const& path);
+  // Node layout of the BLAS built by the following initScene() calls.
+  void setNodeFormat(const BVH8Nodes nodeFormat);
+  // Binary BVH builder of the BLAS used by the following initScene() calls. The spatial split setting still comes from each geometry.
+  void setBuildMethod(const BVHBuildMethod method, const bool restructure);
+  // Encoding of the vertex attributes read by the shading of the geometries created by the following initScene() calls.
+  // The BLAS triangle blocks keep the full precision vertices.
+  void setGeometryFormat(const GeometryFormat format);
+
+private:
+  unsigned int createGeometry(std::shared_ptr<sg::Triangles> geometry);
+  unsigned int createGeometry(std::shared_ptr<sg::Primitive> primitive);
+  void createInstance(const float* matrix, InstanceData const& data);
+  void setTransform(InstanceCPU& instance, const float* matrix) const;
+  void createTLAS();
+  void getInstanceAabbs(std::vector<float3>& aabbs) const;
+
+  void setMaterial(MaterialDefinition& material, MaterialGUI const& materialGUI);
+
+  // Acceleration structure queries.
+  bool traceRadiance(float3 const& origin, float3 const& direction, const float tmin, const float tmax, PerRayData* prd, HitCPU& hit) const;
+  void traceRadiancePacket(BVHRayPacket& packet, PerRayData* prds, HitCPU* hits) const;
+  bool traceShadow(float3 const& origin, float3 const& direction, const float tmin, const float tmax, PerRayData* prd) const;
+  bool intersectInstance(InstanceCPU const& instance, BVHRay const& rayObject, PerRayData* prd, BVHHit& hit) const;
+  bool intersectPrimitive(InstanceCPU const& instance, BVHRay const& rayObject, PerRayData* prd, BVHHit& hit) const;
+  float getOpacity(InstanceCPU const& instance, const unsigned int primitive, float2 const& barycentrics) const;
+
+  // Host versions of the shader programs.
+  void   raygeneration(const unsigned int x, const unsigned int y);
+  void   raygenerationPacket(const unsigned int xBegin, const unsigned int yBegin, const unsigned int xEnd, const unsigned int yEnd);
+  void   accumulate(const unsigned int x, const unsigned int y, float3 radiance);
+
+  // Wavefront path tracer stages. Each thread works on its own WavefrontCPU.
+  void renderWavefront();
+  void generateWavefront(WavefrontCPU& wavefront, const unsigned int firstBlock, const unsigned int numBlocks);
+  void extendWavefront(WavefrontCPU& wavefront) const;
+  void shadeWavefront(WavefrontCPU& wavefront) const;
+  void continueWavefront(WavefrontCPU& wavefront);
+
+  float3 integrator(PerRayData& prd, HitCPU const* primaryHit = nullptr) const; // The primaryHit replaces the first traceRadiance() call.
+  template<typename Path> void beginPath(Path& path, PerRayData& prd) const; // Path is a PathCPU or PathRefCPU.
+  template<typename Path> void beginSegment(Path const& path, PerRayData& prd) const;
+  template<typename Path> bool endSegment(Path& path, PerRayData& prd) const;
+  void   lensShader(const float2 screen, const float2 pixel, const float2 sample, float3& origin, float3& direction) const;
+  void   lensShaderPacket(const float2 screen, const float2* pixels, const float2* samples, BVHRayPacket& packet) const;
+  void   closestHit(PerRayData* prd, HitCPU const& hit) const;
+  bool   hitSurface(PerRayData* prd, HitCPU const& hit, State& state) const;
+  bool   sampleDirectLighting(PerRayData* prd, MaterialDefinition const& material, State const& state, EvalBSDFFunc eval, ShadowRayCPU& shadowRay) const;
+  void   resolveShadowRay(PerRayData* prd, ShadowRayCPU const& shadowRay) const;
+  void   miss(PerRayData* prd) const;
+  void   sampleLight(float3 const& point, const float2 sample, LightSample& lightSample) const;
+  void   sampleBSDF(MaterialDefinition const& material, State const& state, PerRayData* prd) const;
+  float4 evalBSDF(MaterialDefinition const& material, State const& state, PerRayData* const prd, float3 const& wiL) const;
+
+  float4 tex2D(const cudaTextureObject_t texture, const float u, const float v) const;
+
+public:
+  int          m_miss; // Type of environment miss shader to use. 0 = black no light, 1 = constant white, 2 = spherical HDR env map.
+  unsigned int m_tex;  // The OpenGL HDR texture object.
+
+  std::unique_ptr<ThreadPool> m_threadPool;
+
+  SystemData m_systemData; // Same parameters as the GPU devices. All pointers inside are host pointers.
+
+  bool m_isDirtyOutputBuffer;
+
+  std::vector<CameraDefinition>   m_cameras;
+  std::vector<LightDefinition>    m_lights;
+  std::vector<MaterialDefinition> m_materials; // The texture objects inside are TextureCPU pointers.
+
+  std::vector<GeometryCPU> m_geometryData;
+  std::vector<InstanceCPU> m_instances;
+
+  GeometryCache m_geometryCache; // Per geometry BVH8 keyed by the hash of the attributes and indices.
+  BVH8Nodes     m_nodeFormat;    // BVH8_NODES_COMPRESSED trades some traversal speed for about a third of the node memory.
+  BVHBuildOptions m_buildOptions; // BVH_BUILD_LBVH trades some traversal speed for much faster scene loads.
+  GeometryFormat  m_geometryFormat;
+
+  BVH   m_tlas;     // Top level acceleration structure over the world space bounding boxes of the m_instances.
+  float m_tlasCost; // SAH cost of the m_tlas after the last build. updateInstances() only refits until the cost grows by TLAS_REBUILD_RATIO.
+
+  std::vector<float3> m_instanceAabbs; // The m_tlas primitives. updateInstances() replaces the changed ones.
+
+  TextureCPU* m_textureAlbedo;
+  TextureCPU* m_textureCutout;
+  TextureCPU* m_textureEnv;
+
+  std::vector<float4> m_bufferHost; // The accumulation buffer.
+
+  std::vector<WavefrontCPU> m_wavefronts; // One per thread, reused per render() call.
+};
+
+#endif // DEVICE_CPU_H
@@ -53,6 +53,7 @@ public:
   void render(const unsigned int iterationIndex, void** buffer);
   void updateDisplayTexture();
   const void* getOutputBufferHost();
+  size_t getOutputBufferSize() const;
 
 private:
   CUgraphicsResource  m_cudaGraphicsResource; // The handle for the registered OpenGL PBO when using interop.
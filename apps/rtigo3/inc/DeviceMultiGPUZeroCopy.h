@@ -53,6 +53,7 @@ public:
   void render(const unsigned int iterationIndex, void** buffer);
   void updateDisplayTexture();
   const void* getOutputBufferHost();
+  size_t getOutputBufferSize() const;
 };
 
 #endif // DEVICE_MULTI_GPU_ZERO_COPY_H
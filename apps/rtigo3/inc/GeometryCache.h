@@ -0,0 +1,136 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Part of every key. Increment when the layout of any cached data changes.
+#define GEOMETRY_CACHE_VERSION 2
+// Blobs inside the cache files start at this alignment. Covers the 64 byte aligned BVH nodes used in place.
+#define GEOMETRY_CACHE_ALIGNMENT 64
+// FNV-1a 64-bit offset basis.
+#define GEOMETRY_CACHE_HASH_SEED 0xCBF29CE484222325ull
+
+
+// One contiguous block of data written to a cache file.
+struct CacheBlob
+{
+  const void* data;
+  size_t      size;
+};
+
+// File layout: CacheFileHeader, numBlobs CacheFileBlob entries, then the blob data at GEOMETRY_CACHE_ALIGNMENT offsets.
+struct CacheFileHeader
+{
+  unsigned long long magic;
+  unsigned long long key;
+  unsigned int       version;
+  unsigned int       numBlobs;
+};
+
+struct CacheFileBlob
+{
+  unsigned long long offset; // From the start of the file.
+  unsigned long long size;   // In bytes.
+};
+
+
+// Read-only memory mapping of one cache file. The blobs are valid as long as the CacheFile exists.
+class CacheFile
+{
+public:
+  CacheFile();
+  ~CacheFile();
+
+  // Fails for missing files and for files with the wrong magic, version, key or truncated blobs.
+  bool open(std::string const& filename, const unsigned long long key);
+  void close();
+
+  unsigned int getNumBlobs() const;
+  const void*  getBlob(const unsigned int index, size_t& size) const; // Returns nullptr for invalid indices.
+
+private:
+#if defined(_WIN32)
+  void* m_file;    // HANDLE
+  void* m_mapping; // HANDLE
+#else
+  int   m_file;
+#endif
+
+  const unsigned char* m_data;
+  size_t               m_size;
+
+  unsigned int         m_numBlobs;
+  const CacheFileBlob* m_blobs;
+};
+
+
+// Persistent cache of converted geometry and host acceleration structures.
+// Each entry is one flat binary file "<path>/<key>.bin" keyed by a content hash of its source.
+class GeometryCache
+{
+public:
+  GeometryCache();
+  ~GeometryCache();
+
+  // The directory must exist. An empty path disables the cache.
+  void setPath(std::string const& path);
+  std::string const& getPath() const;
+
+  bool isEnabled() const;
+
+  // Returns nullptr when the cache is disabled or holds no valid entry for the key.
+  std::shared_ptr<CacheFile> load(const unsigned long long key) const;
+  // Writes a temporary file and renames it, so that readers never map partially written entries.
+  bool store(const unsigned long long key, std::vector<CacheBlob> const& blobs) const;
+
+  // 64-bit FNV-1a variant consuming 8 bytes per step. Chain calls by passing the previous result as seed.
+  static unsigned long long hash(const void* data, const size_t size, const unsigned long long seed = GEOMETRY_CACHE_HASH_SEED);
+  // Chains the size and the contents of the file into the key. Returns false when the file cannot be read.
+  static bool hashFile(std::string const& filename, unsigned long long& key);
+
+  template<typename T>
+  static unsigned long long hashValue(T const& value, const unsigned long long seed)
+  {
+    return hash(&value, sizeof(T), seed);
+  }
+
+private:
+  std::string getFilename(const unsigned long long key) const;
+
+private:
+  std::string m_path;
+};
+
+#endif // GEOMETRY_CACHE_H
@@ -0,0 +1,108 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef INSTANCE_TABLE_H
+#define INSTANCE_TABLE_H
+
+#include "inc/SceneGraph.h"
+
+#include <memory>
+#include <vector>
+
+
+// The sg::Scene flattened into one entry per path from the root to a Triangles or Primitive node, stored as structure of arrays.
+// Each element of an InstanceArray is one entry below the Instance holding the array.
+// The devices create their instances from this table instead of traversing the scene graph.
+// update() recomputes only the subtrees below the Instance nodes listed by sg::Scene::getDirtyInstances() since the last build() or update().
+// The scene structure itself must not change after build(), only the transforms, materials and lights at the Instance nodes.
+// The sg::Scene must outlive the table.
+class InstanceTable
+{
+public:
+  InstanceTable();
+  ~InstanceTable();
+
+  void build(sg::Scene& scene, const sg::NodeHandle root);
+
+  // Returns the InstanceDirtyBits of all changes. getChanged() lists the affected instances in ascending order.
+  unsigned int update();
+
+  unsigned int getNumInstances() const;
+
+  const float* getMatrix(const unsigned int index) const; // Concatenated 3x4 row-major object to world matrix.
+  unsigned int getGeometry(const unsigned int index) const;
+  int          getMaterial(const unsigned int index) const;
+  int          getLight(const unsigned int index) const;
+
+  std::shared_ptr<sg::Triangles> getTriangles(const unsigned int idGeometry) const; // nullptr for geometries not referenced by the scene.
+  std::shared_ptr<sg::Primitive> getPrimitive(const unsigned int idGeometry) const; // nullptr for Triangles and unreferenced geometries.
+
+  std::vector<unsigned int> const& getChanged() const;
+
+  size_t getMemorySize() const; // In bytes, the node and instance arrays.
+
+private:
+  void traverse(const sg::NodeHandle node, const unsigned int parent);
+  unsigned int addGeometry(const sg::NodeHandle node);
+  void updateNodes(const unsigned int first, const unsigned int last);
+
+private:
+  sg::Scene* m_scene;
+
+  // Per path to an Instance in depth-first order. The subtree of node i is [i, m_nodeEnds[i]), parents come first.
+  std::vector<sg::NodeHandle> m_nodes; // Instances referenced by several groups appear once per path.
+  std::vector<unsigned int>  m_nodeParents; // ~0u at the root group.
+  std::vector<unsigned int>  m_nodeEnds;
+  std::vector<unsigned int>  m_nodeInstances; // First instance below the node. The range ends at the first instance of m_nodeEnds[i].
+  std::vector<float>         m_nodeMatrices;  // 12 floats per node.
+  std::vector<int>           m_nodeMaterials; // Inherited along the path, last one >= 0 wins.
+  std::vector<int>           m_nodeLights;
+
+  // The nodes of each sg::Scene Instance, indexed by the handle index. The nodes of Instance k are m_instanceNodes[m_instanceNodeFirst[k], m_instanceNodeFirst[k + 1]).
+  std::vector<unsigned int> m_instanceNodeFirst;
+  std::vector<unsigned int> m_instanceNodes;
+
+  // Per instance.
+  std::vector<unsigned int>   m_parents;  // The node holding the Triangles, Primitive or InstanceArray.
+  std::vector<sg::NodeHandle> m_arrays;   // SG_HANDLE_INVALID for entries not inside an InstanceArray.
+  std::vector<unsigned int>   m_elements; // Index inside the InstanceArray.
+  std::vector<float>          m_matrices; // 12 floats per instance.
+  std::vector<unsigned int>   m_geometries;
+  std::vector<int>            m_materials;
+  std::vector<int>            m_lights;
+
+  std::vector< std::shared_ptr<sg::Triangles> > m_triangles;  // Indexed by the geometry ID.
+  std::vector< std::shared_ptr<sg::Primitive> > m_primitives; // Indexed by the geometry ID.
+
+  std::vector<unsigned int> m_changed;
+  std::vector<unsigned int> m_dirtyNodes; // Scratch list of the nodes to update.
+};
+
+#endif // INSTANCE_TABLE_H
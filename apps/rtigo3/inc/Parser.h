@@ -31,6 +31,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <ostream>
 #include <string>
 
 enum ParserTokenType
@@ -43,6 +44,28 @@ enum ParserTokenType
 };
 
 
+// Non-owning view of a token inside the Parser's source. Only valid as long as the Parser lives.
+// (Stands in for std::string_view which is C++17.)
+struct ParserToken
+{
+  ParserToken();
+
+  std::string str() const;
+  void        assign(std::string& dst) const; // Reuses the capacity of dst.
+
+  float toFloat() const; // Same results as atof() for the PTT_VAL tokens, without the copy into a null terminated string.
+  int   toInt() const;   // Same results as atoi().
+
+  bool operator==(const char* rhs) const;
+  bool operator!=(const char* rhs) const;
+
+  const char* data;
+  size_t      size;
+};
+
+std::ostream& operator<<(std::ostream& stream, ParserToken const& token);
+
+
 // System and scene file parsing information.
 class Parser
 {
@@ -50,19 +73,36 @@ public:
   Parser();
   ~Parser();
   
-  bool load(std::string const& filename);
+  // Maps the file read-only by default. Falls back to reading a copy when mapping is not possible.
+  bool load(std::string const& filename, const bool mapped = true);
+
+  ParserTokenType getNextToken(ParserToken& token);
+  ParserTokenType getNextLine(ParserToken& token);
 
+  // Copying variants.
   ParserTokenType getNextToken(std::string& token);
   ParserTokenType getNextLine(std::string& token);
 
-  size_t                 getSize() const;
-  std::string::size_type getIndex() const;
-  unsigned int           getLine() const;
-    
+  const char*  getData() const; // The whole contents, not null terminated.
+  size_t       getSize() const;
+  size_t       getIndex() const;
+  unsigned int getLine() const;
+
 private:
-  std::string            m_source; // System or scene description file contents.
-  std::string::size_type m_index;  // Parser's current character index into m_source.
-  unsigned int           m_line;   // Current source code line, one-based for error messages.
+  Parser(Parser const&) = delete;
+  Parser& operator=(Parser const&) = delete;
+
+  bool map(std::string const& filename);
+  void unmap();
+
+private:
+  const char*  m_data;   // System or scene description file contents. Not null terminated.
+  size_t       m_size;
+  size_t       m_index;  // Parser's current character index into m_data.
+  unsigned int m_line;   // Current source code line, one-based for error messages.
+
+  std::string  m_source;  // The contents when not mapped.
+  void*        m_mapping; // The mapped view, nullptr when not mapped.
 };
 
 #endif // PARSER_H
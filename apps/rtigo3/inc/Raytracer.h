@@ -32,6 +32,7 @@
 #define RAYTRACER_H
 
 #include "inc/Device.h"
+#include "inc/InstanceTable.h"
 #include "inc/MaterialGUI.h"
 #include "inc/Picture.h"
 #include "inc/SceneGraph.h"
@@ -66,15 +67,20 @@ public:
   virtual void initCameras(std::vector<CameraDefinition> const& cameras);
   virtual void initLights(std::vector<LightDefinition> const& lights);
   virtual void initMaterials(std::vector<MaterialGUI> const& materialsGUI);
-  virtual void initScene(std::shared_ptr<sg::Group> root, const unsigned int numGeometries);
+  virtual void initScene(sg::Scene& scene, const sg::NodeHandle root, const unsigned int numGeometries);
   virtual void initState(DeviceState const& state);
 
+  virtual void setGeometryFormat(const GeometryFormat format); // Vertex attribute encoding for the following initScene() calls.
+
   // Update functions should be replaced with NOP functions in a derived batch renderer because the device functions are fully asynchronous then.
   virtual void updateCamera(const int idCamera, CameraDefinition const& camera);
   virtual void updateLight(const int idLight, LightDefinition const& light);
   virtual void updateMaterial(const int idMaterial, MaterialGUI const& src);
+  virtual void updateInstances(); // Only Instance transforms, materials or lights changed since initScene(). Cheap when nothing changed.
   virtual void updateState(DeviceState const& state);
 
+  virtual void getMemoryStatistics(std::vector<DeviceMemoryStatistics>& devices) const; // Appends one entry per active device.
+
   // Abstract functions must be implemented by each derived Raytracer per strategy individually.
   virtual unsigned int render() = 0;
   virtual void updateDisplayTexture() = 0;
@@ -93,6 +99,8 @@ public:
   unsigned int         m_activeDevicesMask; // The bitmask marking the actually enabled devices.
   std::vector<Device*> m_activeDevices;
 
+  InstanceTable m_instanceTable; // The scene graph flattened by initScene().
+
   unsigned int m_iterationIndex;  // Tracks which frame is currently raytraced.
   unsigned int m_samplesPerPixel; // This is samplesSqrt squared. Rendering end-condition is: m_iterationIndex == m_samplesPerPixel.
 
@@ -0,0 +1,78 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+ 
+#ifndef RAYTRACER_CPU_H
+#define RAYTRACER_CPU_H
+
+#include "inc/Raytracer.h"
+
+#include "inc/DeviceCPU.h"
+
+// Renders on the host with all CPU cores. There are no CUDA devices in m_activeDevices for this strategy,
+// all base class pass-through functions are overridden to forward to the single DeviceCPU instead.
+class RaytracerCPU : public Raytracer
+{
+public:
+  RaytracerCPU(const int numThreads,
+               const int miss,
+               const int interop,
+               const unsigned int tex,
+               const unsigned int pbo,
+               std::string const& cachePath,  // Directory of the persistent BVH8 cache. Empty disables it.
+               const bool compressedNodes,    // Quantized BLAS nodes.
+               const int builder);            // BLAS builder. 0 = SAH, 1 = LBVH, 2 = LBVH with treelet restructuring.
+  ~RaytracerCPU();
+
+  void initTextures(std::map<std::string, Picture*> const& mapOfPictures);
+  void initCameras(std::vector<CameraDefinition> const& cameras);
+  void initLights(std::vector<LightDefinition> const& lights);
+  void initMaterials(std::vector<MaterialGUI> const& materialsGUI);
+  void initScene(sg::Scene& scene, const sg::NodeHandle root, const unsigned int numGeometries);
+  void initState(DeviceState const& state);
+
+  void setGeometryFormat(const GeometryFormat format);
+
+  void updateCamera(const int idCamera, CameraDefinition const& camera);
+  void updateLight(const int idLight, LightDefinition const& light);
+  void updateMaterial(const int idMaterial, MaterialGUI const& src);
+  void updateInstances();
+  void updateState(DeviceState const& state);
+
+  void getMemoryStatistics(std::vector<DeviceMemoryStatistics>& devices) const;
+
+  unsigned int render();
+  void updateDisplayTexture();
+  const void* getOutputBufferHost();
+
+public:
+  DeviceCPU* m_device;
+};
+
+#endif // RAYTRACER_CPU_H
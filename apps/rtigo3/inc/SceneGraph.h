@@ -34,6 +34,7 @@
 // For the vector types.
 #include <cuda_runtime.h>
 
+#include "shaders/primitive_definition.h"
 #include "shaders/vertex_attributes.h"
 
 #include "shaders/vector_math.h"
@@ -41,6 +42,14 @@
 #include <memory>
 #include <vector>
 
+// Layout of the sg::NodeHandle.
+#define SG_HANDLE_INDEX_BITS 29
+#define SG_HANDLE_INDEX_MASK ((1u << SG_HANDLE_INDEX_BITS) - 1u)
+#define SG_HANDLE_INVALID    0xFFFFFFFFu
+
+// Part of the geometry cache keys. Increment when Triangles::optimize() changes its output.
+#define SG_MESH_OPTIMIZER_VERSION 1
+
 namespace sg
 {
 
@@ -48,7 +57,18 @@ namespace sg
   {
     NT_GROUP,
     NT_INSTANCE,
-    NT_TRIANGLES
+    NT_TRIANGLES,
+    NT_PRIMITIVE,
+    NT_INSTANCE_ARRAY
+  };
+
+  // Changes at a Scene Instance since the last flattening into an InstanceTable.
+  enum InstanceDirtyBits
+  {
+    DIRTY_NONE      = 0,
+    DIRTY_TRANSFORM = 1,
+    DIRTY_MATERIAL  = 2,
+    DIRTY_LIGHT     = 4
   };
 
   class Node
@@ -64,6 +84,12 @@ namespace sg
       return m_id;
     }
 
+    // Only before the node is added to a Scene. Concurrently imported geometries get their IDs in scene order afterwards.
+    void setId(const unsigned int id)
+    {
+      m_id = id;
+    }
+
   private:
     unsigned int m_id;
   };
@@ -84,59 +110,162 @@ namespace sg
     void createParallelogram(float3 const& position, float3 const& vecU, float3 const& vecV, float3 const& normal);
 
     void setAttributes(std::vector<TriangleAttributes> const& attributes);
+    void setAttributes(const TriangleAttributes* attributes, const size_t count); // E.g. straight from a memory mapped cache file.
     std::vector<TriangleAttributes> const& getAttributes() const;
+
+    // Encodes the attributes into one of the compact GeometryFormats for the device buffers. Returns the stride in bytes.
+    // The offset and scale return the dequantization of GEOMETRY_FORMAT_QUANTIZED vertices.
+    size_t encodeAttributes(const GeometryFormat format, std::vector<unsigned int>& data, float3& offset, float3& scale) const;
     
+    // Welds duplicate vertices, sorts the triangles along a Morton curve and reorders them for the vertex cache. See MeshOptimizer.cpp.
+    void optimize();
+
     void setIndices(std::vector<unsigned int> const&);
+    void setIndices(const unsigned int* indices, const size_t count);
     std::vector<unsigned int> const& getIndices() const;
 
+    // Overlap threshold of the spatial splits in the host BVH build. 0.0f uses the plain SAH build. Ignored by the OptiX devices.
+    void  setSpatialSplitAlpha(const float alpha);
+    float getSpatialSplitAlpha() const;
+
   private:
     std::vector<TriangleAttributes> m_attributes;
     std::vector<unsigned int>       m_indices; // If m_indices.size() == 0, m_attributes are independent primitives.
+
+    float m_spatialSplitAlpha;
   };
 
 
-  class Instance : public Node
+  // A single analytic primitive with exact intersection, instead of its tessellation into Triangles.
+  class Primitive : public Node
   {
   public:
-    Instance(const unsigned int id);
-    ~Instance();
+    Primitive(const unsigned int id);
+    ~Primitive();
 
     sg::NodeType getType() const;
 
-    void setTransform(const float m[12]);
-    const float* getTransform() const;
-    
-    void setChild(std::shared_ptr<sg::Node> node);
-    std::shared_ptr<sg::Node> getChild();
-
-    void setMaterial(const int index);
-    int  getMaterial() const;
+    void createSphere(const float radius); // Full sphere around the origin. Open spheres (maxTheta < M_PIf) need the Triangles.
+    void createParallelogram(float3 const& position, float3 const& vecU, float3 const& vecV, float3 const& normal);
 
-    void setLight(const int index);
-    int  getLight() const;
+    void setDefinition(PrimitiveDefinition const& definition); // E.g. from a compiled scene.
+    PrimitiveDefinition const& getDefinition() const;
 
   private:
-    int                       m_material;
-    int                       m_light;
-    float                     m_matrix[12];
-    std::shared_ptr<sg::Node> m_child; // An Instance can either hold a Group or a Triangles as child.
+    PrimitiveDefinition m_definition;
   };
 
-  class Group : public Node
+
+  // 32-bit reference to a node inside a Scene. The NodeType is stored in the three most significant bits, the index below.
+  // Group, Instance and InstanceArray indices address the Scene arrays, the Triangles and Primitive index is the geometry ID.
+  // Triangles and Primitives share the geometry ID space.
+  typedef unsigned int NodeHandle;
+
+  inline NodeHandle makeHandle(const NodeType type, const unsigned int index)
+  {
+    return (static_cast<unsigned int>(type) << SG_HANDLE_INDEX_BITS) | index;
+  }
+
+  inline NodeType getHandleType(const NodeHandle handle)
+  {
+    return static_cast<NodeType>(handle >> SG_HANDLE_INDEX_BITS);
+  }
+
+  inline unsigned int getHandleIndex(const NodeHandle handle)
+  {
+    return handle & SG_HANDLE_INDEX_MASK;
+  }
+
+
+  // Arena storage of the scene hierarchy. Groups and Instances live in contiguous arrays and reference each other by NodeHandle,
+  // the children of each Group are one contiguous range of a shared child array. Only the Triangles are separate heap objects.
+  // The handles stay valid until clear(). Pointers returned by getChildren() and getTransform() only until the next create or addChild call.
+  class Scene
   {
   public:
-    Group(const unsigned int id);
-    ~Group();
+    Scene();
+    ~Scene();
 
-    sg::NodeType getType() const;
+    void clear();
+    void reserve(const unsigned int numGroups, const unsigned int numInstances, const unsigned int numChildren);
+
+    NodeHandle createGroup();
+    NodeHandle createInstance();
+    // Registers the geometry under its ID. Adding the same geometry again returns the same handle.
+    NodeHandle addTriangles(std::shared_ptr<sg::Triangles> geometry);
+    NodeHandle addPrimitive(std::shared_ptr<sg::Primitive> primitive);
+
+    // Groups can only hold Instances.
+    void              addChild(const NodeHandle group, const NodeHandle instance);
+    unsigned int      getNumChildren(const NodeHandle group) const;
+    const NodeHandle* getChildren(const NodeHandle group) const;
+
+    void         setTransform(const NodeHandle instance, const float m[12]);
+    const float* getTransform(const NodeHandle instance) const;
+
+    void       setChild(const NodeHandle instance, const NodeHandle node); // An Instance can either hold a Group, a Triangles, a Primitive or an InstanceArray as child.
+    NodeHandle getChild(const NodeHandle instance) const;
+
+    // Many copies of one Triangles or Primitive, stored as 3x4 row-major transforms only. Material and light come from the parent Instance.
+    // The transforms are fixed at creation, move the whole array with the parent Instance.
+    NodeHandle   createInstanceArray(const NodeHandle geometry, const float* matrices, const unsigned int count);
+    unsigned int getArraySize(const NodeHandle array) const;
+    const float* getArrayTransforms(const NodeHandle array) const; // 12 floats per element.
+    NodeHandle   getArrayGeometry(const NodeHandle array) const;
 
-    void addChild(std::shared_ptr<sg::Instance> instance); // Groups can only hold Instances.
+    void setMaterial(const NodeHandle instance, const int index);
+    int  getMaterial(const NodeHandle instance) const;
 
-    size_t getNumChildren() const;
-    std::shared_ptr<sg::Instance> getChild(size_t index);
+    void setLight(const NodeHandle instance, const int index);
+    int  getLight(const NodeHandle instance) const;
+
+    // The setters above mark the Instance dirty and list it once. The InstanceTable clears the bits and the list after propagating the changes.
+    unsigned int                   getDirty(const NodeHandle instance) const;
+    std::vector<NodeHandle> const& getDirtyInstances() const;
+    void                           clearDirty();
+
+    std::shared_ptr<sg::Triangles> const& getTriangles(const NodeHandle triangles) const;
+    std::shared_ptr<sg::Primitive> const& getPrimitive(const NodeHandle primitive) const;
+
+    unsigned int getNumGroups() const;
+    unsigned int getNumInstances() const;
+    unsigned int getNumInstanceArrays() const;
+    size_t       getMemorySize() const; // In bytes, the arena arrays without the Triangles.
 
   private:
-    std::vector< std::shared_ptr<sg::Instance> > m_children;
+    struct GroupNode
+    {
+      unsigned int first;    // Into m_children.
+      unsigned int count;
+      unsigned int capacity; // Slots reserved at first. A full range moves to the end of m_children with twice the capacity.
+    };
+
+    // 64 bytes, one cache line.
+    struct InstanceNode
+    {
+      float        matrix[12];
+      int          material; // No material index set by default. Last one >= 0 along a path wins.
+      int          light;    // No light index set by default. Not a light.
+      NodeHandle   child;
+      unsigned int dirty;    // InstanceDirtyBits
+    };
+
+    struct InstanceArrayNode
+    {
+      unsigned int first;    // Into m_arrayMatrices, in units of 12 floats.
+      unsigned int count;
+      NodeHandle   geometry;
+    };
+
+    std::vector<GroupNode>         m_groups;
+    std::vector<InstanceNode>      m_instances;
+    std::vector<NodeHandle>        m_children;
+    std::vector<InstanceArrayNode> m_arrays;
+    std::vector<float>             m_arrayMatrices;
+    std::vector<NodeHandle>        m_dirtyInstances; // The Instances with dirty bits, each listed once.
+
+    std::vector< std::shared_ptr<sg::Triangles> > m_triangles;  // Indexed by the geometry ID.
+    std::vector< std::shared_ptr<sg::Primitive> > m_primitives; // Indexed by the geometry ID.
   };
 
 } // namespace sg
@@ -0,0 +1,91 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef SCENE_STATISTICS_H
+#define SCENE_STATISTICS_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Bytes held by one device after initScene(). Filled at the allocation sites.
+struct DeviceMemoryStatistics
+{
+  DeviceMemoryStatistics();
+
+  size_t getTotal() const;
+
+  std::string name;
+  size_t attributes;    // Vertex attributes or PrimitiveDefinitions. Only copies, the CPU device references the host TriangleAttributes in GEOMETRY_FORMAT_FULL.
+  size_t indices;
+  size_t blas;          // Output of all bottom level acceleration structures.
+  size_t blasTemp;      // Largest temporary build buffer. Freed after the build.
+  size_t tlas;
+  size_t tlasTemp;
+  size_t instances;     // OptixInstance or InstanceCPU arrays.
+  size_t sbt;           // Shader binding table records.
+  size_t textures;      // All Texture or TextureCPU images including the mipmaps.
+  size_t cdf;           // Importance sampling of the spherical environment light.
+  size_t outputBuffers; // Output, tile and texel buffers of the RendererStrategy.
+};
+
+
+// Scene and memory report after initScene(). The Application fills the host side, the Raytracer the devices.
+struct SceneStatistics
+{
+  SceneStatistics();
+
+  void print(std::ostream& stream) const;
+  bool writeJSON(std::string const& filename) const;
+
+  unsigned int numGroups;
+  unsigned int numInstances;      // sg::Instance nodes.
+  unsigned int numInstanceArrays;
+  unsigned int numTriangles;      // Unique sg::Triangles meshes.
+  unsigned int numPrimitives;     // Unique sg::Primitive nodes.
+  unsigned int numTableInstances; // Flattened instances the devices render.
+
+  unsigned long long uniqueTriangles;    // Sum over the unique meshes.
+  unsigned long long instancedTriangles; // Sum over the flattened instances.
+  unsigned long long uniqueVertices;
+
+  size_t attributes;    // Host TriangleAttributes.
+  size_t indices;       // Host indices.
+  size_t sceneGraph;    // sg::Scene arena.
+  size_t instanceTable;
+
+  std::map<std::string, size_t> pictures; // Host image bytes per Picture.
+
+  std::vector<DeviceMemoryStatistics> devices;
+};
+
+#endif // SCENE_STATISTICS_H
@@ -145,6 +145,10 @@ public:
   CUdeviceptr getCDF_V() const;
   float       getIntegral() const;
 
+  // Device memory of the CUDA array including all mipmap levels, and of the environment CDFs.
+  size_t getSizeInBytes() const;
+  size_t getCDFSizeInBytes() const;
+
 private:
   bool create1D(const Picture* picture);
   bool create2D(const Picture* picture);
@@ -178,6 +182,7 @@ private:
 
   CUarray          m_d_array;
   CUmipmappedArray m_d_mipmappedArray;
+  unsigned int     m_numLevels;
 
   // Specific to spherical environment map.
   CUdeviceptr m_d_envCDF_U;
@@ -0,0 +1,85 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef TEXTURE_CPU_H
+#define TEXTURE_CPU_H
+
+// For the vector types.
+#include <cuda_runtime.h>
+
+#include "inc/Picture.h"
+
+#include <vector>
+
+// Host side counterpart of the Texture class for the RS_CPU_MULTICORE strategy.
+// Holds the LOD 0 of a 2D Picture as RGBA32F and emulates the CUDA texture object setup used by the Device:
+// Normalized coordinates, bilinear filtering, wrap addressing, and clamped v-coordinate for the spherical environment map.
+class TextureCPU
+{
+public:
+  TextureCPU();
+  ~TextureCPU();
+
+  bool create(const Picture* picture, const unsigned int flags);
+
+  unsigned int getWidth() const;
+  unsigned int getHeight() const;
+
+  // Equivalent of tex2D<float4>(textureObject, u, v) on the device.
+  float4 sample(const float u, const float v) const;
+
+  // Specific to spherical environment map.
+  const float* getCDF_U() const;
+  const float* getCDF_V() const;
+  float        getIntegral() const;
+
+  size_t getSizeInBytes() const;
+  size_t getCDFSizeInBytes() const;
+
+private:
+  float4 fetch(int x, int y) const;
+
+  // Create cumulative distribution function for importance sampling of spherical environment lights.
+  void calculateSphericalCDF();
+
+private:
+  unsigned int m_width;
+  unsigned int m_height;
+  unsigned int m_flags;
+
+  std::vector<float4> m_texels; // RGBA32F, LOD 0 only.
+
+  // Specific to spherical environment map.
+  std::vector<float> m_cdfU; // 2D, size (width  + 1) * height
+  std::vector<float> m_cdfV; // 1D, size (height + 1)
+  float              m_integral;
+};
+
+#endif // TEXTURE_CPU_H
@@ -0,0 +1,78 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent host worker threads for the CPU rendering strategy and any other host side parallel work.
+// The threads are created once and sleep on a condition variable between jobs, so launching a parallelFor() per frame is cheap.
+class ThreadPool
+{
+public:
+  ThreadPool(const unsigned int numThreads = 0); // 0 means use all hardware threads.
+  ~ThreadPool();
+
+  // The number of threads taking part in a parallelFor(), including the calling thread.
+  unsigned int getNumThreads() const;
+
+  // Calls func(index, threadIndex) for every index in the range [0, count) and returns when all calls have finished.
+  // Indices are handed out dynamically, so uneven work per index is load balanced automatically.
+  // The calling thread participates with threadIndex 0, workers use threadIndex [1, getNumThreads()).
+  // Not reentrant! Do not call parallelFor() from inside func.
+  void parallelFor(const unsigned int count, std::function<void(const unsigned int index, const unsigned int threadIndex)> const& func);
+
+private:
+  void worker(const unsigned int threadIndex);
+  void execute(const unsigned int threadIndex);
+
+private:
+  std::vector<std::thread> m_threads; // The worker threads. One less than getNumThreads() because the caller works as well.
+
+  std::mutex              m_mutex;
+  std::condition_variable m_conditionStart; // Signals the workers that a new job is available or that they should terminate.
+  std::condition_variable m_conditionDone;  // Signals the caller that all workers finished the current job.
+
+  const std::function<void(const unsigned int, const unsigned int)>* m_func; // The current job. Only valid during parallelFor().
+
+  unsigned int              m_count;      // The number of indices in the current job.
+  std::atomic<unsigned int> m_next;       // The next index to be processed.
+  unsigned int              m_busy;       // The number of workers still busy with the current job.
+  unsigned int              m_generation; // Incremented per job to let the workers distinguish new jobs from spurious wakeups.
+  bool                      m_terminate;
+};
+
+#endif // THREAD_POOL_H
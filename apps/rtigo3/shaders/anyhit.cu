@@ -42,6 +42,33 @@
 extern "C" __constant__ SystemData sysData;
 
 
+// The texture coordinate of the current hit for the cutout opacity.
+__forceinline__ __device__ float3 getHitTexcoord(GeometryInstanceData const* theData)
+{
+  if (theData->primitiveType != PRIMITIVE_TRIANGLES)
+  {
+    // The surface coordinates reported by __intersection__primitive are the texcoord.
+    return make_float3(__uint_as_float(optixGetAttribute_0()), __uint_as_float(optixGetAttribute_1()), 0.0f);
+  }
+
+  // Cast the CUdeviceptr to the actual format for Triangles geometry.
+  const uint3* indices    = reinterpret_cast<uint3*>(theData->indices);
+  const void*  attributes = reinterpret_cast<const void*>(theData->attributes);
+
+  const unsigned int thePrimitiveIndex = optixGetPrimitiveIndex();
+
+  const uint3 tri = indices[thePrimitiveIndex];
+
+  const float2 theBarycentrics = optixGetTriangleBarycentrics(); // beta and gamma
+
+  const float  alpha = 1.0f - theBarycentrics.x - theBarycentrics.y;
+
+  return getTriangleTexcoord(attributes, theData->format, tri.x) * alpha +
+         getTriangleTexcoord(attributes, theData->format, tri.y) * theBarycentrics.x +
+         getTriangleTexcoord(attributes, theData->format, tri.z) * theBarycentrics.y;
+}
+
+
 // One anyhit program for the radiance ray for all materials with cutout opacity!
 extern "C" __global__ void __anyhit__radiance_cutout()
 {
@@ -51,21 +78,7 @@ extern "C" __global__ void __anyhit__radiance_cutout()
 
   if (material.textureCutout != 0)
   {
-    // Cast the CUdeviceptr to the actual format for Triangles geometry.
-    const uint3*              indices    = reinterpret_cast<uint3*>(theData->indices);
-    const TriangleAttributes* attributes = reinterpret_cast<TriangleAttributes*>(theData->attributes);
-
-    const unsigned int thePrimitiveIndex = optixGetPrimitiveIndex();
-
-    const uint3 tri = indices[thePrimitiveIndex];
-    
-    const float2 theBarycentrics = optixGetTriangleBarycentrics(); // beta and gamma
-
-    const float  alpha = 1.0f - theBarycentrics.x - theBarycentrics.y;
-
-    const float3 texcoord = attributes[tri.x].texcoord * alpha +
-                            attributes[tri.y].texcoord * theBarycentrics.x +
-                            attributes[tri.z].texcoord * theBarycentrics.y;
+    const float3 texcoord = getHitTexcoord(theData);
 
     const float opacity = intensity(make_float3(tex2D<float4>(material.textureCutout, texcoord.x, texcoord.y)));
 
@@ -101,18 +114,7 @@ extern "C" __global__ void __anyhit__shadow_cutout()
 
   if (material.textureCutout != 0)
   {
-    const unsigned int thePrimitiveIndex = optixGetPrimitiveIndex();
-    const uint3* indices = reinterpret_cast<uint3*>(theData->indices);
-    const uint3  tri     = indices[thePrimitiveIndex];
-
-    const TriangleAttributes* attributes = reinterpret_cast<TriangleAttributes*>(theData->attributes);
-
-    const float2 theBarycentrics = optixGetTriangleBarycentrics(); // beta and gamma
-    const float  alpha = 1.0f - theBarycentrics.x - theBarycentrics.y;
-
-    const float3 texcoord = attributes[tri.x].texcoord * alpha +
-                            attributes[tri.y].texcoord * theBarycentrics.x +
-                            attributes[tri.z].texcoord * theBarycentrics.y;
+    const float3 texcoord = getHitTexcoord(theData);
 
     opacity = intensity(make_float3(tex2D<float4>(material.textureCutout, texcoord.x, texcoord.y)));
   }
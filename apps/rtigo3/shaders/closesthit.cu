@@ -33,6 +33,7 @@
 #include "system_data.h"
 #include "per_ray_data.h"
 #include "vertex_attributes.h"
+#include "primitive_definition.h"
 #include "function_indices.h"
 #include "material_definition.h"
 #include "light_definition.h"
@@ -127,28 +128,43 @@ extern "C" __global__ void __closesthit__radiance()
 {
   GeometryInstanceData* theData = reinterpret_cast<GeometryInstanceData*>(optixGetSbtDataPointer());
 
-  // Cast the CUdeviceptr to the actual format for Triangles geometry.
-  const unsigned int thePrimitiveIndex = optixGetPrimitiveIndex();
+  State state; // All in world space coordinates!
 
-  const uint3* indices = reinterpret_cast<uint3*>(theData->indices);
-  const uint3  tri     = indices[thePrimitiveIndex];
+  float3 ng;
+  float3 tg;
+  float3 ns;
 
-  const TriangleAttributes* attributes = reinterpret_cast<TriangleAttributes*>(theData->attributes);
+  if (theData->primitiveType != PRIMITIVE_TRIANGLES)
+  {
+    // The __intersection__primitive program reported the surface coordinates.
+    const float2 uv = make_float2(__uint_as_float(optixGetAttribute_0()), __uint_as_float(optixGetAttribute_1()));
 
-  TriangleAttributes const& attr0 = attributes[tri.x];
-  TriangleAttributes const& attr1 = attributes[tri.y];
-  TriangleAttributes const& attr2 = attributes[tri.z];
+    getPrimitiveAttributes(*reinterpret_cast<const PrimitiveDefinition*>(theData->attributes), uv, ng, tg, ns, state.texcoord);
+  }
+  else
+  {
+    // Cast the CUdeviceptr to the actual format for Triangles geometry.
+    const unsigned int thePrimitiveIndex = optixGetPrimitiveIndex();
 
-  const float2 theBarycentrics = optixGetTriangleBarycentrics(); // beta and gamma
-  const float  alpha = 1.0f - theBarycentrics.x - theBarycentrics.y;
+    const uint3* indices = reinterpret_cast<uint3*>(theData->indices);
+    const uint3  tri     = indices[thePrimitiveIndex];
 
-  const float3 ng = cross(attr1.vertex - attr0.vertex, attr2.vertex - attr0.vertex);
-  const float3 tg = attr0.tangent * alpha + attr1.tangent * theBarycentrics.x + attr2.tangent * theBarycentrics.y;
-  const float3 ns = attr0.normal  * alpha + attr1.normal  * theBarycentrics.x + attr2.normal  * theBarycentrics.y;
-  
-  State state; // All in world space coordinates!
+    const void* attributes = reinterpret_cast<const void*>(theData->attributes);
+
+    // Decodes the compact geometry formats.
+    const TriangleAttributes attr0 = getTriangleAttributes(attributes, theData->format, tri.x, theData->vertexOffset, theData->vertexScale);
+    const TriangleAttributes attr1 = getTriangleAttributes(attributes, theData->format, tri.y, theData->vertexOffset, theData->vertexScale);
+    const TriangleAttributes attr2 = getTriangleAttributes(attributes, theData->format, tri.z, theData->vertexOffset, theData->vertexScale);
+
+    const float2 theBarycentrics = optixGetTriangleBarycentrics(); // beta and gamma
+    const float  alpha = 1.0f - theBarycentrics.x - theBarycentrics.y;
 
-  state.texcoord = attr0.texcoord * alpha + attr1.texcoord * theBarycentrics.x + attr2.texcoord * theBarycentrics.y;
+    ng = cross(attr1.vertex - attr0.vertex, attr2.vertex - attr0.vertex);
+    tg = attr0.tangent * alpha + attr1.tangent * theBarycentrics.x + attr2.tangent * theBarycentrics.y;
+    ns = attr0.normal  * alpha + attr1.normal  * theBarycentrics.x + attr2.normal  * theBarycentrics.y;
+
+    state.texcoord = attr0.texcoord * alpha + attr1.texcoord * theBarycentrics.x + attr2.texcoord * theBarycentrics.y;
+  }
 
   float4 objectToWorld[3];
   float4 worldToObject[3];
@@ -0,0 +1,63 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#include <optix.h>
+
+#include "system_data.h"
+#include "primitive_definition.h"
+
+
+
+// One intersection program for all analytic primitives. The SBT record attributes point to the PrimitiveDefinition.
+// Reports the surface coordinates as the two attribute registers, read back with optixGetAttribute_0/1() like the triangle barycentrics.
+extern "C" __global__ void __intersection__primitive()
+{
+  GeometryInstanceData* theData = reinterpret_cast<GeometryInstanceData*>(optixGetSbtDataPointer());
+
+  PrimitiveDefinition const& primitive = *reinterpret_cast<const PrimitiveDefinition*>(theData->attributes);
+
+  float  t[2];
+  float2 uv[2];
+
+  const int count = intersectPrimitive(primitive, optixGetObjectRayOrigin(), optixGetObjectRayDirection(), t, uv);
+
+  const float tmin = optixGetRayTmin();
+  const float tmax = optixGetRayTmax();
+
+  for (int i = 0; i < count; ++i)
+  {
+    // The farther sphere hit is only needed when the anyhit program ignored the nearer one.
+    if (tmin <= t[i] && t[i] <= tmax &&
+        optixReportIntersection(t[i], 0, __float_as_uint(uv[i].x), __float_as_uint(uv[i].y)))
+    {
+      return;
+    }
+  }
+}
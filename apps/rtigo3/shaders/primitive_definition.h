@@ -0,0 +1,181 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef PRIMITIVE_DEFINITION_H
+#define PRIMITIVE_DEFINITION_H
+
+#include "vector_math.h"
+
+// Kind of geometry behind a GAS resp. host BLAS.
+enum PrimitiveType
+{
+  PRIMITIVE_TRIANGLES     = 0, // Indexed TriangleAttributes.
+  PRIMITIVE_SPHERE        = 1, // Analytic sphere, OptiX custom primitive.
+  PRIMITIVE_PARALLELOGRAM = 2, // Analytic parallelogram, OptiX custom primitive.
+
+  NUM_PRIMITIVE_TYPES     = 3
+};
+
+// One analytic primitive in object space. The whole geometry is this single primitive, the instances place it in the world.
+// The surface parameterizations match the tessellated sg::Triangles::createSphere() and createParallelogram() texture coordinates.
+struct PrimitiveDefinition
+{
+  int    type;     // PrimitiveType
+  float3 position; // Sphere center or parallelogram footpoint.
+  float  radius;   // Sphere only.
+  float3 vecU;     // Parallelogram only. Unnormalized edge vectors.
+  float3 vecV;
+  float3 normal;   // Parallelogram only. Normalized shading normal on the CCW frontface.
+};
+
+
+VECTOR_MATH_API void getPrimitiveAabb(PrimitiveDefinition const& primitive, float3& aabbMin, float3& aabbMax)
+{
+  if (primitive.type == PRIMITIVE_SPHERE)
+  {
+    aabbMin = primitive.position - make_float3(primitive.radius);
+    aabbMax = primitive.position + make_float3(primitive.radius);
+  }
+  else
+  {
+    const float3 p1 = primitive.position + primitive.vecU;
+    const float3 p2 = primitive.position + primitive.vecU + primitive.vecV;
+    const float3 p3 = primitive.position + primitive.vecV;
+
+    aabbMin = fminf(fminf(primitive.position, p1), fminf(p2, p3));
+    aabbMax = fmaxf(fmaxf(primitive.position, p1), fmaxf(p2, p3));
+  }
+}
+
+// Spherical coordinates of the unit vector from the sphere center, phi around the y-axis and theta starting at the south pole.
+VECTOR_MATH_API float2 getSphereTexcoord(float3 const& n)
+{
+  float u = atan2f(-n.z, n.x) * (0.5f * M_1_PIf);
+  if (u < 0.0f)
+  {
+    u += 1.0f;
+  }
+  const float v = acosf(fminf(fmaxf(-n.y, -1.0f), 1.0f)) * M_1_PIf;
+
+  return make_float2(u, v);
+}
+
+// Returns the number of ray parameters where the unbounded ray crosses the surface, in ascending order, and the surface coordinates there.
+// The direction does not need to be normalized. The caller tests the [tmin, tmax] interval and the order is the order to report hits.
+VECTOR_MATH_API int intersectPrimitive(PrimitiveDefinition const& primitive, float3 const& origin, float3 const& direction, float t[2], float2 uv[2])
+{
+  if (primitive.type == PRIMITIVE_SPHERE)
+  {
+    // The closest point to the center along the ray gives the discriminant with less cancellation than b^2 - a * c.
+    // (Haines et al., "Precision Improvements for Ray/Sphere Intersection", Ray Tracing Gems, 2019)
+    const float3 oc = origin - primitive.position;
+    const float  a  = dot(direction, direction);
+    const float  b  = dot(oc, direction);
+    const float  c  = dot(oc, oc) - primitive.radius * primitive.radius;
+
+    const float3 l    = oc - direction * (b / a);
+    const float  disc = a * (primitive.radius * primitive.radius - dot(l, l));
+
+    if (disc < 0.0f || a == 0.0f)
+    {
+      return 0;
+    }
+
+    const float q  = (0.0f <= b) ? -b - sqrtf(disc) : -b + sqrtf(disc);
+    float       t0 = c / q;
+    float       t1 = q / a;
+
+    if (q == 0.0f) // The origin is on the surface and the ray tangential.
+    {
+      t0 = t1;
+    }
+    if (t1 < t0)
+    {
+      const float temp = t0;
+      t0 = t1;
+      t1 = temp;
+    }
+
+    t[0]  = t0;
+    t[1]  = t1;
+    uv[0] = getSphereTexcoord((oc + direction * t0) / primitive.radius);
+    uv[1] = getSphereTexcoord((oc + direction * t1) / primitive.radius);
+
+    return 2;
+  }
+
+  // Parallelogram. The geometric normal cross(vecU, vecV) matches the CCW triangles.
+  const float3 ng    = cross(primitive.vecU, primitive.vecV);
+  const float  denom = dot(ng, direction);
+
+  if (denom == 0.0f)
+  {
+    return 0;
+  }
+
+  t[0] = dot(ng, primitive.position - origin) / denom;
+
+  // Solve p = u * vecU + v * vecV.
+  const float3 p  = origin + direction * t[0] - primitive.position;
+  const float3 nn = ng / dot(ng, ng);
+
+  uv[0] = make_float2(dot(cross(p, primitive.vecV), nn), dot(cross(primitive.vecU, p), nn));
+
+  return (0.0f <= uv[0].x && uv[0].x <= 1.0f && 0.0f <= uv[0].y && uv[0].y <= 1.0f) ? 1 : 0;
+}
+
+// Object space surface attributes at the surface coordinates returned by intersectPrimitive(). The geometric normal ng is not normalized.
+VECTOR_MATH_API void getPrimitiveAttributes(PrimitiveDefinition const& primitive, float2 const& uv, float3& ng, float3& tangent, float3& normal, float3& texcoord)
+{
+  texcoord = make_float3(uv.x, uv.y, 0.0f);
+
+  if (primitive.type == PRIMITIVE_SPHERE)
+  {
+    const float phi   = uv.x * 2.0f * M_PIf;
+    const float theta = uv.y * M_PIf;
+
+    const float sinPhi   = sinf(phi);
+    const float cosPhi   = cosf(phi);
+    const float sinTheta = sinf(theta);
+    const float cosTheta = cosf(theta);
+
+    normal  = make_float3(cosPhi * sinTheta, -cosTheta, -sinPhi * sinTheta);
+    ng      = normal;
+    tangent = make_float3(-sinPhi, 0.0f, -cosPhi);
+  }
+  else
+  {
+    ng      = cross(primitive.vecU, primitive.vecV);
+    tangent = normalize(primitive.vecU);
+    normal  = primitive.normal;
+  }
+}
+
+#endif // PRIMITIVE_DEFINITION_H
@@ -34,6 +34,7 @@
 #include "camera_definition.h"
 #include "light_definition.h"
 #include "material_definition.h"
+#include "primitive_definition.h"
 #include "vertex_attributes.h"
 
 
@@ -93,10 +94,14 @@ struct SystemData
 // SBT Record data for the hit group. This is used on the device to calculate attributes!
 struct GeometryInstanceData
 {
-  CUdeviceptr attributes;
-  CUdeviceptr indices;
+  CUdeviceptr attributes;   // One PrimitiveDefinition for the analytic primitives.
+  CUdeviceptr indices;      // Unused by the analytic primitives.
   int         materialIndex;
   int         lightIndex; // Negative means not a light.
+  int         format;       // GeometryFormat of the attributes.
+  float3      vertexOffset; // Dequantization of GEOMETRY_FORMAT_QUANTIZED vertices.
+  float3      vertexScale;
+  int         primitiveType; // PrimitiveType
 };
 
 #endif // SYSTEM_DATA_H
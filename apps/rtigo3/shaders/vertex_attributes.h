@@ -31,6 +31,8 @@
 #ifndef VERTEX_ATTRIBUTES_H
 #define VERTEX_ATTRIBUTES_H
 
+#include "vector_math.h"
+
 struct TriangleAttributes
 {
   float3 vertex;
@@ -39,4 +41,224 @@ struct TriangleAttributes
   float3 texcoord;
 };
 
+// Encoding of the vertex attributes in the device buffers.
+enum GeometryFormat
+{
+  GEOMETRY_FORMAT_FULL      = 0, // TriangleAttributes, 48 bytes.
+  GEOMETRY_FORMAT_COMPACT   = 1, // TriangleAttributesCompact, 24 bytes.
+  GEOMETRY_FORMAT_QUANTIZED = 2, // TriangleAttributesQuantized, 20 bytes.
+
+  NUM_GEOMETRY_FORMATS      = 3
+};
+
+// Tangent and normal as 32-bit octahedral unit vectors, the texcoord .xy as two halfs. The texcoord .z is dropped.
+struct TriangleAttributesCompact
+{
+  float3       vertex;   // First member to allow the OptiX build input to read the vertices with the struct stride.
+  unsigned int tangent;
+  unsigned int normal;
+  unsigned int texcoord;
+};
+
+// Like TriangleAttributesCompact with the vertex quantized to 21 bits per component inside the geometry's bounding box.
+struct TriangleAttributesQuantized
+{
+  unsigned int vertex[2];
+  unsigned int tangent;
+  unsigned int normal;
+  unsigned int texcoord;
+};
+
+VECTOR_MATH_API unsigned int getTriangleAttributesSize(const int format)
+{
+  return (format == GEOMETRY_FORMAT_COMPACT)   ? sizeof(TriangleAttributesCompact)   :
+         (format == GEOMETRY_FORMAT_QUANTIZED) ? sizeof(TriangleAttributesQuantized) : sizeof(TriangleAttributes);
+}
+
+#define VERTEX_QUANTIZATION_BITS 21
+#define VERTEX_QUANTIZATION_MAX  ((1u << VERTEX_QUANTIZATION_BITS) - 1u)
+
+
+typedef union
+{
+  float        f;
+  unsigned int u;
+} FloatBits;
+
+// Round to nearest, ties away from zero. Values beyond the half range become infinity.
+VECTOR_MATH_API unsigned int floatToHalf(const float value)
+{
+  FloatBits bits;
+  bits.f = value;
+
+  const unsigned int sign     = (bits.u >> 16) & 0x8000u;
+  const unsigned int exponent = (bits.u >> 23) & 0xFFu;
+  unsigned int       mantissa = bits.u & 0x007FFFFFu;
+
+  if (exponent == 0xFFu) // Infinity or NaN.
+  {
+    return sign | 0x7C00u | ((mantissa != 0) ? 0x0200u : 0u);
+  }
+
+  const int e = int(exponent) - 127 + 15;
+
+  if (31 <= e)
+  {
+    return sign | 0x7C00u;
+  }
+  if (e <= 0) // Denormalized half.
+  {
+    if (e < -10)
+    {
+      return sign;
+    }
+    mantissa |= 0x00800000u;
+
+    const unsigned int shift = static_cast<unsigned int>(14 - e);
+
+    return sign | ((mantissa >> shift) + ((mantissa >> (shift - 1u)) & 1u));
+  }
+  // The rounding carry correctly propagates into the exponent.
+  return sign | (((static_cast<unsigned int>(e) << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1u));
+}
+
+VECTOR_MATH_API float halfToFloat(const unsigned int half)
+{
+  const unsigned int sign     = (half & 0x8000u) << 16;
+  const unsigned int exponent = (half >> 10) & 0x1Fu;
+  const unsigned int mantissa = half & 0x03FFu;
+
+  FloatBits bits;
+
+  if (exponent == 0) // Zero or denormalized.
+  {
+    bits.f = float(mantissa) * (1.0f / 16777216.0f); // 2^-24
+    bits.u |= sign;
+  }
+  else if (exponent == 31)
+  {
+    bits.u = sign | 0x7F800000u | (mantissa << 13);
+  }
+  else
+  {
+    bits.u = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+  }
+  return bits.f;
+}
+
+// Two 16-bit snorm values on the octahedron. Zero vectors encode as +z.
+VECTOR_MATH_API unsigned int encodeOctahedral(const float3 v)
+{
+  const float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+
+  float2 p = (0.0f < l1) ? make_float2(v.x, v.y) / l1 : make_float2(0.0f);
+
+  if (v.z < 0.0f)
+  {
+    p = make_float2((1.0f - fabsf(p.y)) * ((0.0f <= p.x) ? 1.0f : -1.0f),
+                    (1.0f - fabsf(p.x)) * ((0.0f <= p.y) ? 1.0f : -1.0f));
+  }
+
+  const int x = int(floorf(fminf(fmaxf(p.x, -1.0f), 1.0f) * 32767.0f + 0.5f));
+  const int y = int(floorf(fminf(fmaxf(p.y, -1.0f), 1.0f) * 32767.0f + 0.5f));
+
+  return (static_cast<unsigned int>(x) & 0xFFFFu) | (static_cast<unsigned int>(y) << 16);
+}
+
+// Returns a unit vector.
+VECTOR_MATH_API float3 decodeOctahedral(const unsigned int code)
+{
+  const float x = float(short(code & 0xFFFFu)) * (1.0f / 32767.0f);
+  const float y = float(short(code >> 16))     * (1.0f / 32767.0f);
+
+  float3 v = make_float3(x, y, 1.0f - fabsf(x) - fabsf(y));
+
+  const float t = fmaxf(-v.z, 0.0f);
+
+  v.x += (0.0f <= v.x) ? -t : t;
+  v.y += (0.0f <= v.y) ? -t : t;
+
+  return normalize(v);
+}
+
+VECTOR_MATH_API unsigned int encodeTexcoord(const float3 texcoord)
+{
+  return floatToHalf(texcoord.x) | (floatToHalf(texcoord.y) << 16);
+}
+
+VECTOR_MATH_API float3 decodeTexcoord(const unsigned int code)
+{
+  return make_float3(halfToFloat(code & 0xFFFFu), halfToFloat(code >> 16), 0.0f);
+}
+
+// The scale is the bounding box extent divided by VERTEX_QUANTIZATION_MAX. Zero extents need a zero scale.
+VECTOR_MATH_API void encodeQuantized(unsigned int* code, const float3 vertex, const float3 offset, const float3 scale)
+{
+  const float3 f = (vertex - offset) * make_float3((0.0f < scale.x) ? 1.0f / scale.x : 0.0f,
+                                                   (0.0f < scale.y) ? 1.0f / scale.y : 0.0f,
+                                                   (0.0f < scale.z) ? 1.0f / scale.z : 0.0f);
+
+  const unsigned int x = static_cast<unsigned int>(fminf(fmaxf(f.x + 0.5f, 0.0f), float(VERTEX_QUANTIZATION_MAX)));
+  const unsigned int y = static_cast<unsigned int>(fminf(fmaxf(f.y + 0.5f, 0.0f), float(VERTEX_QUANTIZATION_MAX)));
+  const unsigned int z = static_cast<unsigned int>(fminf(fmaxf(f.z + 0.5f, 0.0f), float(VERTEX_QUANTIZATION_MAX)));
+
+  code[0] = x | (y << 21);
+  code[1] = (y >> 11) | (z << 10);
+}
+
+VECTOR_MATH_API float3 decodeQuantized(const unsigned int* code, const float3 offset, const float3 scale)
+{
+  const unsigned int x = code[0] & VERTEX_QUANTIZATION_MAX;
+  const unsigned int y = (code[0] >> 21) | ((code[1] & 0x3FFu) << 11);
+  const unsigned int z = code[1] >> 10;
+
+  return offset + make_float3(float(x), float(y), float(z)) * scale;
+}
+
+// Fetches the vertex attributes at the index from a buffer in any GeometryFormat.
+// The offset and scale of the quantized vertices are only used with GEOMETRY_FORMAT_QUANTIZED.
+VECTOR_MATH_API TriangleAttributes getTriangleAttributes(const void* attributes, const int format, const unsigned int index,
+                                                         const float3 offset, const float3 scale)
+{
+  TriangleAttributes result;
+
+  if (format == GEOMETRY_FORMAT_COMPACT)
+  {
+    TriangleAttributesCompact const& attr = reinterpret_cast<const TriangleAttributesCompact*>(attributes)[index];
+
+    result.vertex   = attr.vertex;
+    result.tangent  = decodeOctahedral(attr.tangent);
+    result.normal   = decodeOctahedral(attr.normal);
+    result.texcoord = decodeTexcoord(attr.texcoord);
+  }
+  else if (format == GEOMETRY_FORMAT_QUANTIZED)
+  {
+    TriangleAttributesQuantized const& attr = reinterpret_cast<const TriangleAttributesQuantized*>(attributes)[index];
+
+    result.vertex   = decodeQuantized(attr.vertex, offset, scale);
+    result.tangent  = decodeOctahedral(attr.tangent);
+    result.normal   = decodeOctahedral(attr.normal);
+    result.texcoord = decodeTexcoord(attr.texcoord);
+  }
+  else
+  {
+    result = reinterpret_cast<const TriangleAttributes*>(attributes)[index];
+  }
+  return result;
+}
+
+// Only the texcoord for the cutout opacity in the anyhit programs.
+VECTOR_MATH_API float3 getTriangleTexcoord(const void* attributes, const int format, const unsigned int index)
+{
+  if (format == GEOMETRY_FORMAT_COMPACT)
+  {
+    return decodeTexcoord(reinterpret_cast<const TriangleAttributesCompact*>(attributes)[index].texcoord);
+  }
+  if (format == GEOMETRY_FORMAT_QUANTIZED)
+  {
+    return decodeTexcoord(reinterpret_cast<const TriangleAttributesQuantized*>(attributes)[index].texcoord);
+  }
+  return reinterpret_cast<const TriangleAttributes*>(attributes)[index].texcoord;
+}
+
 #endif // VERTEX_ATTRIBUTES_H
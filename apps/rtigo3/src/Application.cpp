@@ -27,20 +27,34 @@
  */
 
 #include "inc/Application.h"
+#include "inc/BVH8.h"
+#include "inc/InstanceTable.h"
 #include "inc/Parser.h"
+#include "inc/SceneStatistics.h"
 
 #include "inc/RaytracerSingleGPU.h"
 #include "inc/RaytracerMultiGPUZeroCopy.h"
 #include "inc/RaytracerMultiGPUPeerAccess.h"
 #include "inc/RaytracerMultiGPULocalCopy.h"
+#include "inc/RaytracerCPU.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <stack>
 #include <memory>
 
+// The vertex bounds and tangents of the model import use SSE, which all x86-64 CPUs support.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#define APPLICATION_SSE 1
+#include <emmintrin.h>
+#endif
+
 #include <dp/math/Matmnt.h>
 
 #include "inc/CheckMacros.h"
@@ -57,10 +71,17 @@ Application::Application(GLFWwindow* window, Options const& options)
 , m_mode(0)
 , m_strategy(RS_INTERACTIVE_SINGLE_GPU)
 , m_devicesMask(255)
+, m_numThreads(0)
 , m_light(0)
 , m_miss(1)
 , m_interop(0)
 , m_present(false)
+, m_compressedNodes(false)
+, m_builder(0)
+, m_geometryFormat(GEOMETRY_FORMAT_FULL)
+, m_optimizeMeshes(true)
+, m_tessellationLod(0.0f)
+, m_triangleBudget(4000000)
 , m_presentNext(true)
 , m_presentAtSecond(1.0)
 , m_previousComplete(false)
@@ -70,9 +91,8 @@ Application::Application(GLFWwindow* window, Options const& options)
 , m_environmentRotation(0.0f)
 , m_clockFactor(1000.0f)
 , m_mouseSpeedRatio(10.0f)
-, m_idGroup(0)
-, m_idInstance(0)
 , m_idGeometry(0)
+, m_root(SG_HANDLE_INVALID)
 {
   try
   {
@@ -93,6 +113,9 @@ Application::Application(GLFWwindow* window, Options const& options)
     m_mapKeywordScene["scale"]           = KS_SCALE;
     m_mapKeywordScene["translate"]       = KS_TRANSLATE;
     m_mapKeywordScene["model"]           = KS_MODEL;
+    m_mapKeywordScene["spatialSplits"]   = KS_SPATIAL_SPLITS;
+    m_mapKeywordScene["grid"]            = KS_GRID;
+    m_mapKeywordScene["scatter"]         = KS_SCATTER;
 
     const double timeConstructor = m_timer.getTime();
 
@@ -107,6 +130,7 @@ Application::Application(GLFWwindow* window, Options const& options)
     m_pathLengths = make_int2(0, 2);
 
     m_prefixScreenshot = std::string("./img"); // Default to current working directory and prefix "img".
+    m_prefixStatistics = std::string("./statistics");
 
     // Tonmapper neutral defaults. The system description overrides these.
     m_tonemapperGUI.gamma           = 1.0f;
@@ -128,6 +152,13 @@ Application::Application(GLFWwindow* window, Options const& options)
       return; // m_isValid == false.
     }
 
+    // There is no CUDA device to register OpenGL resources with when rendering on the host.
+    if (m_strategy == RS_CPU_MULTICORE && m_interop != INTEROP_MODE_OFF)
+    {
+      std::cerr << "WARNING: Application() RS_CPU_MULTICORE strategy does not support OpenGL interop, using interop 0 (host)." << std::endl;
+      m_interop = INTEROP_MODE_OFF;
+    }
+
     // Setup ImGui binding.
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -242,6 +273,11 @@ Application::Application(GLFWwindow* window, Options const& options)
         m_raytracer = std::make_unique<RaytracerMultiGPULocalCopy>(m_devicesMask, m_miss, m_interop, tex, pbo);
         m_state.distribution = 1; // Distributed rendering of one frame, when device count > 1, tiled rendering.
         break;
+
+      case RS_CPU_MULTICORE:
+        m_raytracer = std::make_unique<RaytracerCPU>(m_numThreads, m_miss, m_interop, tex, pbo, m_geometryCache.getPath(), m_compressedNodes, m_builder);
+        m_state.distribution = 0; // Full frames. The host threads distribute the tiles dynamically.
+        break;
     }
 
     // If the raytracer could not be initialized correctly, return and leave Application invalid.
@@ -251,6 +287,8 @@ Application::Application(GLFWwindow* window, Options const& options)
       return; // Exit application.
     }
 
+    m_raytracer->setGeometryFormat(static_cast<GeometryFormat>(m_geometryFormat));
+
     // Determine which device is the one running the OpenGL implementation.
     // The first OpenGL-CUDA device match wins.
     int deviceMatch = -1;
@@ -305,7 +343,7 @@ Application::Application(GLFWwindow* window, Options const& options)
     const double timeRaytracer = m_timer.getTime();
 
     // Host side scene information.
-    m_scene = std::make_shared<sg::Group>(m_idGroup++); // Create the scene's root group first.
+    m_root = m_scene.createGroup(); // Create the scene's root group first.
 
     createCameras();
     createLights();
@@ -313,14 +351,20 @@ Application::Application(GLFWwindow* window, Options const& options)
 
     // Load the scene description file and generate the host side scene.
     const std::string filenameScene = options.getScene();
-    if (!loadSceneDescription(filenameScene))
+    if (!loadScene(filenameScene))
     {
       std::cerr << "ERROR: Application() failed to load scene description file " << filenameScene << std::endl;
       MY_ASSERT(!"Failed to load scene description");
       return;
     }
 
-    MY_ASSERT(m_idGeometry == m_geometries.size());
+    if (m_mode == 5) // Scene compiler. Stop after storing the compiled scene.
+    {
+      m_isValid = true;
+      return;
+    }
+
+    MY_ASSERT(m_idGeometry == m_geometries.size() + m_primitives.size());
 
     const double timeScene = m_timer.getTime();
 
@@ -329,10 +373,12 @@ Application::Application(GLFWwindow* window, Options const& options)
     m_raytracer->initCameras(m_cameras);
     m_raytracer->initLights(m_lights);
     m_raytracer->initMaterials(m_materialsGUI);
-    m_raytracer->initScene(m_scene, m_idGeometry); // m_idGeometry is the number of geometries in the scene.
+    m_raytracer->initScene(m_scene, m_root, m_idGeometry); // m_idGeometry is the number of geometries in the scene.
 
     const double timeRenderer = m_timer.getTime();
 
+    reportStatistics();
+
     // Print out hiow long the initialization of each module took.
     std::cout << "Application(): " << timeRenderer - timeConstructor   << " seconds overall" << std::endl;
     std::cout << "{" << std::endl;
@@ -531,6 +577,530 @@ void Application::benchmark()
 }
 
 
+// Measures the host BVH build and ray query throughput on two generated meshes and on all geometries of the loaded scene.
+// The binary BVH is compared against the BVH8 with each of the traversal kernels the CPU supports,
+// and the plain binned SAH build against the spatial split build (SBVH) in SAH cost, traversal steps and throughput.
+void Application::benchmarkBVH()
+{
+  try
+  {
+    ThreadPool threadPool(m_numThreads);
+
+    std::vector< std::pair< std::string, std::shared_ptr<sg::Triangles> > > meshes;
+
+    std::shared_ptr<sg::Triangles> sphere = std::make_shared<sg::Triangles>(m_idGeometry++);
+    sphere->createSphere(1024, 512, 1.0f, M_PIf); // 1M triangles.
+    optimizeGeometry(sphere);
+    meshes.push_back(std::make_pair(std::string("sphere"), sphere));
+
+    std::shared_ptr<sg::Triangles> torus = std::make_shared<sg::Triangles>(m_idGeometry++);
+    torus->createTorus(1024, 512, 0.75f, 0.25f);
+    optimizeGeometry(torus);
+    meshes.push_back(std::make_pair(std::string("torus"), torus));
+
+    for (size_t i = 0; i < m_geometries.size(); ++i)
+    {
+      std::ostringstream name;
+      name << "geometry " << m_geometries[i]->getId();
+      meshes.push_back(std::make_pair(name.str(), m_geometries[i]));
+    }
+
+    const unsigned int numRays    = 1 << 20;
+    const unsigned int raysPerJob = 4096;
+    const unsigned int numJobs    = numRays / raysPerJob;
+
+    std::cout << "benchmarkBVH() " << threadPool.getNumThreads() << " threads, " << numRays << " rays per query" << std::endl;
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+      if (meshes[i].second->getIndices().empty())
+      {
+        continue;
+      }
+
+      // The plain binned SAH build is the reference, independent of the build options at the geometry.
+      BVH bvh;
+
+      m_timer.restart();
+      bvh.build(meshes[i].second, &threadPool, BVHBuildOptions());
+      const double secondsBuild = m_timer.getTime();
+
+      BVHBuildOptions optionsSplit;
+
+      optionsSplit.splitAlpha = (0.0f < meshes[i].second->getSpatialSplitAlpha()) ? meshes[i].second->getSpatialSplitAlpha() : BVH_SPLIT_ALPHA;
+
+      BVH bvhSplit;
+
+      m_timer.restart();
+      bvhSplit.build(meshes[i].second, &threadPool, optionsSplit);
+      const double secondsBuildSplit = m_timer.getTime();
+
+      // The linear BVH builders used for fast scene loads.
+      BVHBuildOptions optionsLinear;
+
+      optionsLinear.method = BVH_BUILD_LBVH;
+
+      BVH bvhLinear;
+
+      m_timer.restart();
+      bvhLinear.build(meshes[i].second, &threadPool, optionsLinear);
+      const double secondsBuildLinear = m_timer.getTime();
+
+      optionsLinear.restructure = true;
+
+      BVH bvhTreelets;
+
+      m_timer.restart();
+      bvhTreelets.build(meshes[i].second, &threadPool, optionsLinear);
+      const double secondsBuildTreelets = m_timer.getTime();
+
+      // Rays from random points on the bounding sphere towards random points inside the bounding box.
+      const float3 aabbMin = bvh.getAabbMin();
+      const float3 aabbMax = bvh.getAabbMax();
+      const float3 center  = (aabbMin + aabbMax) * 0.5f;
+      const float  radius  = length(aabbMax - aabbMin) * 0.5f;
+
+      std::vector<BVHRay> rays(numRays);
+
+      std::mt19937 generator(12345u);
+      std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+      for (unsigned int r = 0; r < numRays; ++r)
+      {
+        const float z   = 1.0f - 2.0f * distribution(generator);
+        const float phi = 2.0f * M_PIf * distribution(generator);
+        const float s   = sqrtf(std::max(0.0f, 1.0f - z * z));
+
+        const float3 origin = center + make_float3(s * cosf(phi), s * sinf(phi), z) * (radius * 1.5f);
+        const float3 target = aabbMin + (aabbMax - aabbMin) * make_float3(distribution(generator), distribution(generator), distribution(generator));
+
+        rays[r].origin    = origin;
+        rays[r].tmin      = 0.0f;
+        rays[r].direction = normalize(target - origin);
+        rays[r].tmax      = RT_DEFAULT_MAX;
+      }
+
+      // Runs the closest and any hit queries of all rays and prints the throughput.
+      auto measure = [&](std::string const& name,
+                         std::function<bool(BVHRay const& ray, BVHHit& hit)> const& queryClosest,
+                         std::function<bool(BVHRay const& ray)> const& queryAny)
+      {
+        std::vector<unsigned int> hitsClosest(numJobs, 0);
+        std::vector<unsigned int> hitsAny(numJobs, 0);
+
+        m_timer.restart();
+        threadPool.parallelFor(numJobs, [&](const unsigned int job, const unsigned int threadIndex)
+        {
+          for (unsigned int r = job * raysPerJob; r < (job + 1) * raysPerJob; ++r)
+          {
+            BVHHit hit;
+            if (queryClosest(rays[r], hit))
+            {
+              ++hitsClosest[job];
+            }
+          }
+        });
+        const double secondsClosest = m_timer.getTime();
+
+        m_timer.restart();
+        threadPool.parallelFor(numJobs, [&](const unsigned int job, const unsigned int threadIndex)
+        {
+          for (unsigned int r = job * raysPerJob; r < (job + 1) * raysPerJob; ++r)
+          {
+            if (queryAny(rays[r]))
+            {
+              ++hitsAny[job];
+            }
+          }
+        });
+        const double secondsAny = m_timer.getTime();
+
+        unsigned int numHitsClosest = 0;
+        unsigned int numHitsAny     = 0;
+        for (unsigned int job = 0; job < numJobs; ++job)
+        {
+          numHitsClosest += hitsClosest[job];
+          numHitsAny     += hitsAny[job];
+        }
+
+        std::ostringstream stream;
+        stream.precision(3); // Precision is # digits in fraction part.
+        stream << std::fixed << "  " << name << std::endl
+               << "    closest " << double(numRays) * 1.0e-6 / secondsClosest << " Mrays/s (" << numHitsClosest << " hits)" << std::endl
+               << "    any     " << double(numRays) * 1.0e-6 / secondsAny << " Mrays/s (" << numHitsAny << " hits)";
+        std::cout << stream.str() << std::endl;
+
+        MY_ASSERT(numHitsClosest == numHitsAny); // Both queries must agree on the visibility.
+      };
+
+      // Prints the build time, the SAH cost and the average traversal steps of the closest hit query, then measures the binary BVH.
+      auto report = [&](std::string const& name, BVH const& hierarchy, const double seconds)
+      {
+        std::vector<BVHTraversalStats> stats(numJobs);
+
+        threadPool.parallelFor(numJobs, [&](const unsigned int job, const unsigned int threadIndex)
+        {
+          for (unsigned int r = job * raysPerJob; r < (job + 1) * raysPerJob; ++r)
+          {
+            BVHHit hit;
+            hierarchy.intersect(rays[r], hit, stats[job]);
+          }
+        });
+
+        BVHTraversalStats total;
+        for (unsigned int job = 0; job < numJobs; ++job)
+        {
+          total.rays      += stats[job].rays;
+          total.nodes     += stats[job].nodes;
+          total.triangles += stats[job].triangles;
+        }
+
+        const double numTraced = double(std::max(total.rays, 1ull));
+
+        std::ostringstream stream;
+        stream.precision(3); // Precision is # digits in fraction part.
+        stream << std::fixed << "  " << name << " build " << seconds << " s = " << double(hierarchy.getNumTriangles()) * 1.0e-6 / seconds << " Mtris/s, "
+               << hierarchy.getNumReferences() << " references, SAH cost " << hierarchy.getCost() << ", "
+               << double(total.nodes) / numTraced << " nodes and " << double(total.triangles) / numTraced << " triangles per ray";
+        std::cout << stream.str() << std::endl;
+
+        std::ostringstream nameBinary;
+        nameBinary.precision(3);
+        nameBinary << std::fixed << name << " binary BVH, " << hierarchy.getNumNodes() << " nodes, " << double(hierarchy.getMemorySize()) / (1024.0 * 1024.0) << " MiB";
+
+        measure(nameBinary.str(),
+                [&hierarchy](BVHRay const& ray, BVHHit& hit) { return hierarchy.intersect(ray, hit); },
+                [&hierarchy](BVHRay const& ray) { return hierarchy.occluded(ray); });
+      };
+
+      std::cout << meshes[i].first << ": " << bvh.getNumTriangles() << " triangles" << std::endl;
+
+      report("SAH", bvh, secondsBuild);
+
+      std::ostringstream nameSplit;
+      nameSplit << "SBVH alpha " << optionsSplit.splitAlpha;
+
+      report(nameSplit.str(), bvhSplit, secondsBuildSplit);
+      report("LBVH", bvhLinear, secondsBuildLinear);
+      report("LBVH treelets", bvhTreelets, secondsBuildTreelets);
+
+      // Leaf triangles fetched through the indices versus the precomputed triangle blocks, each with full and quantized nodes.
+      for (int nodes = BVH8_NODES_FULL; nodes <= BVH8_NODES_COMPRESSED; ++nodes)
+      {
+        for (int triangles = BVH8_TRIANGLES_INDEXED; triangles <= BVH8_TRIANGLES_BLOCKS; ++triangles)
+        {
+          BVH8 bvh8;
+
+          m_timer.restart();
+          bvh8.build(bvh, static_cast<BVH8Triangles>(triangles), static_cast<BVH8Nodes>(nodes));
+          const double secondsCollapse = m_timer.getTime();
+
+          for (int isa = BVH8_ISA_SCALAR; isa <= BVH8::getSupportedIsa(); ++isa)
+          {
+            bvh8.setIsa(static_cast<BVH8Isa>(isa));
+
+            std::ostringstream nameWide;
+            nameWide.precision(3);
+            nameWide << std::fixed << "BVH8 " << BVH8::getIsaName(bvh8.getIsa())
+                     << ((nodes == BVH8_NODES_COMPRESSED) ? " compressed nodes," : "")
+                     << ((triangles == BVH8_TRIANGLES_BLOCKS) ? " triangle blocks, " : " indexed triangles, ") << bvh8.getNumNodes() << " nodes, "
+                     << double(bvh8.getMemorySize()) / (1024.0 * 1024.0) << " MiB = " << bvh8.getBytesPerTriangle() << " bytes/triangle, collapse " << secondsCollapse << " s";
+
+            measure(nameWide.str(),
+                    [&bvh8](BVHRay const& ray, BVHHit& hit) { return bvh8.intersect(ray, hit); },
+                    [&bvh8](BVHRay const& ray) { return bvh8.occluded(ray); });
+          }
+        }
+      }
+
+      // The SBVH collapsed into the same BVH8 the DeviceCPU renders with.
+      {
+        BVH8 bvh8;
+
+        bvh8.build(bvhSplit, BVH8_TRIANGLES_BLOCKS);
+
+        std::ostringstream nameWide;
+        nameWide.precision(3);
+        nameWide << std::fixed << nameSplit.str() << " BVH8 " << BVH8::getIsaName(bvh8.getIsa()) << " triangle blocks, "
+                 << bvh8.getNumNodes() << " nodes, " << double(bvh8.getMemorySize()) / (1024.0 * 1024.0) << " MiB";
+
+        measure(nameWide.str(),
+                [&bvh8](BVHRay const& ray, BVHHit& hit) { return bvh8.intersect(ray, hit); },
+                [&bvh8](BVHRay const& ray) { return bvh8.occluded(ray); });
+      }
+    }
+  }
+  catch (std::exception const& e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+
+// Measures the host scene graph with one million instances: 1000 groups with 1000 box instances each, all under the root.
+// Reports the arena build, the flattening into the InstanceTable, the incremental update after moving 1% of the instances, and the memory.
+// The DeviceCPU applies both updates to its TLAS: a small move which refits it and scattering the same instances which forces a rebuild.
+void Application::benchmarkSceneGraph()
+{
+  try
+  {
+    const unsigned int numGroups    = 1000;
+    const unsigned int numPerGroup  = 1000;
+    const unsigned int numInstances = numGroups * numPerGroup;
+
+    std::shared_ptr<sg::Triangles> box = std::make_shared<sg::Triangles>(0); // Own scene, own geometry IDs.
+    box->createBox();
+
+    sg::Scene scene;
+
+    m_timer.restart();
+
+    const sg::NodeHandle root     = scene.createGroup();
+    const sg::NodeHandle geometry = scene.addTriangles(box);
+
+    std::vector<sg::NodeHandle> leaves;
+    leaves.reserve(numInstances);
+
+    for (unsigned int g = 0; g < numGroups; ++g)
+    {
+      const sg::NodeHandle group = scene.createGroup();
+
+      for (unsigned int i = 0; i < numPerGroup; ++i)
+      {
+        const float trafo[12] =
+        {
+          1.0f, 0.0f, 0.0f, float(i),
+          0.0f, 1.0f, 0.0f, 0.0f,
+          0.0f, 0.0f, 1.0f, 0.0f
+        };
+
+        const sg::NodeHandle instance = scene.createInstance();
+
+        scene.setTransform(instance, trafo);
+        scene.setChild(instance, geometry);
+        scene.setMaterial(instance, 0);
+
+        scene.addChild(group, instance);
+
+        leaves.push_back(instance);
+      }
+
+      const float trafo[12] =
+      {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, float(g)
+      };
+
+      const sg::NodeHandle instance = scene.createInstance();
+
+      scene.setTransform(instance, trafo);
+      scene.setChild(instance, group);
+
+      scene.addChild(root, instance);
+    }
+
+    const double secondsCreate = m_timer.getTime();
+
+    InstanceTable table;
+
+    m_timer.restart();
+    table.build(scene, root);
+    const double secondsBuild = m_timer.getTime();
+
+    MY_ASSERT(table.getNumInstances() == numInstances);
+
+    DeviceCPU device(m_numThreads, 0, 0); // No miss shader and no display texture, only the acceleration structures are used.
+
+    m_timer.restart();
+    device.initScene(table, 1);
+    const double secondsInit = m_timer.getTime();
+
+    // Move every 100th leaf instance.
+    for (unsigned int i = 0; i < numInstances; i += 100)
+    {
+      float trafo[12];
+
+      memcpy(trafo, scene.getTransform(leaves[i]), sizeof(float) * 12);
+      trafo[7] += 1.0f;
+
+      scene.setTransform(leaves[i], trafo);
+    }
+
+    m_timer.restart();
+    table.update();
+    const double secondsUpdate = m_timer.getTime();
+
+    MY_ASSERT(table.getChanged().size() == numInstances / 100);
+
+    m_timer.restart();
+    const bool isRebuildMove = device.updateInstances(table);
+    const double secondsMove = m_timer.getTime();
+
+    // Scatter the same instances over the whole scene height, which makes the refitted TLAS boxes overlap.
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(0.0f, float(numPerGroup));
+
+    for (unsigned int i = 0; i < numInstances; i += 100)
+    {
+      float trafo[12];
+
+      memcpy(trafo, scene.getTransform(leaves[i]), sizeof(float) * 12);
+      trafo[7] = distribution(generator);
+
+      scene.setTransform(leaves[i], trafo);
+    }
+
+    table.update();
+
+    m_timer.restart();
+    const bool isRebuildScatter = device.updateInstances(table);
+    const double secondsScatter = m_timer.getTime();
+
+    std::ostringstream stream;
+    stream.precision(3); // Precision is # digits in fraction part.
+    stream << std::fixed << "benchmarkSceneGraph() " << scene.getNumGroups() << " groups, " << scene.getNumInstances() << " instance nodes, " << numInstances << " instances" << std::endl
+           << "  create  " << secondsCreate * 1000.0 << " ms = " << double(scene.getNumInstances()) * 1.0e-6 / secondsCreate << " Mnodes/s" << std::endl
+           << "  flatten " << secondsBuild  * 1000.0 << " ms = " << double(numInstances) * 1.0e-6 / secondsBuild << " Minstances/s" << std::endl
+           << "  update  " << secondsUpdate * 1000.0 << " ms, " << table.getChanged().size() << " instances changed" << std::endl
+           << "  TLAS    init " << secondsInit * 1000.0 << " ms, move " << secondsMove * 1000.0 << " ms (" << ((isRebuildMove) ? "rebuild" : "refit")
+           << "), scatter " << secondsScatter * 1000.0 << " ms (" << ((isRebuildScatter) ? "rebuild" : "refit") << ")" << std::endl
+           << "  memory  " << double(scene.getMemorySize()) / (1024.0 * 1024.0) << " MiB, " << double(scene.getMemorySize()) / double(scene.getNumInstances()) << " bytes per instance node";
+    std::cout << stream.str() << std::endl;
+  }
+  catch (std::exception const& e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+// Tokenizes a generated scene description with one million lines, once with the copied source, std::string tokens and atof()
+// like loadSceneDescription() did before, and once with the mapped file, ParserToken views and ParserToken::toFloat().
+void Application::benchmarkParser()
+{
+  try
+  {
+    const unsigned int numLines = 1000000;
+
+    const std::string filename = std::string("benchmark_parser_") + getDateTime() + std::string(".txt");
+
+    {
+      std::mt19937 generator(42);
+      std::uniform_real_distribution<float> distribution(-100.0f, 100.0f);
+
+      std::ofstream file(filename);
+      if (!file)
+      {
+        std::cerr << "ERROR: benchmarkParser() failed to open " << filename << std::endl;
+        return;
+      }
+
+      for (unsigned int i = 0; i < numLines; ++i)
+      {
+        switch (i % 8)
+        {
+          case 0:
+            file << "push" << std::endl;
+            break;
+          case 1:
+            file << "translate " << distribution(generator) << " " << distribution(generator) << " " << distribution(generator) << std::endl;
+            break;
+          case 2:
+            file << "rotate 0 1 0 " << distribution(generator) << std::endl;
+            break;
+          case 3:
+            file << "scale " << std::fabs(distribution(generator)) * 0.01f << " 1.5e-1 1" << std::endl;
+            break;
+          case 4:
+            file << "albedo " << std::fabs(distribution(generator)) * 0.01f << " 0.25 .5" << std::endl;
+            break;
+          case 5:
+            file << "# Comment line " << i << std::endl;
+            break;
+          case 6:
+            file << "box default" << std::endl;
+            break;
+          case 7:
+            file << "pop" << std::endl;
+            break;
+        }
+      }
+    }
+
+    // Sum of all values and count of identifiers. Both runs must match exactly.
+    double       sumCopy      = 0.0;
+    double       sumMapped    = 0.0;
+    unsigned int numIdsCopy   = 0;
+    unsigned int numIdsMapped = 0;
+    size_t       size         = 0;
+
+    m_timer.restart();
+    {
+      Parser parser;
+      if (parser.load(filename, false))
+      {
+        std::string token;
+        ParserTokenType tokenType;
+        while ((tokenType = parser.getNextToken(token)) != PTT_EOF)
+        {
+          if (tokenType == PTT_VAL)
+          {
+            sumCopy += (float) atof(token.c_str());
+          }
+          else if (tokenType == PTT_ID)
+          {
+            ++numIdsCopy;
+          }
+        }
+        size = parser.getSize();
+      }
+    }
+    const double secondsCopy = m_timer.getTime();
+
+    m_timer.restart();
+    {
+      Parser parser;
+      if (parser.load(filename))
+      {
+        ParserToken token;
+        ParserTokenType tokenType;
+        while ((tokenType = parser.getNextToken(token)) != PTT_EOF)
+        {
+          if (tokenType == PTT_VAL)
+          {
+            sumMapped += token.toFloat();
+          }
+          else if (tokenType == PTT_ID)
+          {
+            ++numIdsMapped;
+          }
+        }
+      }
+    }
+    const double secondsMapped = m_timer.getTime();
+
+    std::remove(filename.c_str());
+
+    if (sumCopy != sumMapped || numIdsCopy != numIdsMapped)
+    {
+      std::cerr << "ERROR: benchmarkParser() results differ: " << sumCopy << " != " << sumMapped << " or " << numIdsCopy << " != " << numIdsMapped << std::endl;
+    }
+
+    const double megabytes = double(size) / (1024.0 * 1024.0);
+
+    std::ostringstream stream;
+    stream.precision(3); // Precision is # digits in fraction part.
+    stream << std::fixed << "benchmarkParser() " << numLines << " lines, " << megabytes << " MiB, " << numIdsMapped << " identifiers" << std::endl
+           << "  copy   " << secondsCopy   * 1000.0 << " ms = " << megabytes / secondsCopy   << " MiB/s" << std::endl
+           << "  mapped " << secondsMapped * 1000.0 << " ms = " << megabytes / secondsMapped << " MiB/s, " << secondsCopy / secondsMapped << "x";
+    std::cout << stream.str() << std::endl;
+  }
+  catch (std::exception const& e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
 void Application::display()
 {
   m_rasterizer->display();
@@ -658,21 +1228,21 @@ void Application::createLights()
 
     m_mapMaterialReferences[reference] = indexMaterial;
 
-    // Create the Triangles for this parallelogram light.
-    m_mapGeometries[reference] = m_idGeometry;
+    // Create the analytic Primitive for this parallelogram light.
+    m_mapPrimitives[reference] = static_cast<unsigned int>(m_primitives.size());
 
-    std::shared_ptr<sg::Triangles> geometry(new sg::Triangles(m_idGeometry++));
-    geometry->createParallelogram(light.position, light.vecU, light.vecV, light.normal);
+    std::shared_ptr<sg::Primitive> primitive(new sg::Primitive(m_idGeometry++));
+    primitive->createParallelogram(light.position, light.vecU, light.vecV, light.normal);
 
-    m_geometries.push_back(geometry);
+    m_primitives.push_back(primitive);
 
-    std::shared_ptr<sg::Instance> instance(new sg::Instance(m_idInstance++));
-    // instance->setTransform(trafo); // Instance default matrix is identity.
-    instance->setChild(geometry);
-    instance->setMaterial(indexMaterial);
-    instance->setLight(indexLight);
+    const sg::NodeHandle instance = m_scene.createInstance();
+    // m_scene.setTransform(instance, trafo); // Instance default matrix is identity.
+    m_scene.setChild(instance, m_scene.addPrimitive(primitive));
+    m_scene.setMaterial(instance, indexMaterial);
+    m_scene.setLight(instance, indexLight);
 
-    m_scene->addChild(instance);
+    m_scene.addChild(m_root, instance);
   }
 }
 
@@ -1019,28 +1589,96 @@ void Application::guiWindow()
   }
 }
 
-void Application::guiRenderingIndicator(const bool isRendering)
+void Application::reportStatistics()
 {
-  // NVIDIA Green when rendering is complete.
-  float r = 0.462745f;
-  float g = 0.72549f;
-  float b = 0.0f;
+  SceneStatistics statistics;
 
-  if (isRendering)
+  statistics.numGroups         = m_scene.getNumGroups();
+  statistics.numInstances      = m_scene.getNumInstances();
+  statistics.numInstanceArrays = m_scene.getNumInstanceArrays();
+  statistics.numTriangles      = static_cast<unsigned int>(m_geometries.size());
+  statistics.numPrimitives     = static_cast<unsigned int>(m_primitives.size());
+
+  for (std::shared_ptr<sg::Triangles> const& geometry : m_geometries)
   {
-    // Neutral grey while rendering.
-    r = 1.0f;
-    g = 1.0f;
-    b = 1.0f;
+    std::vector<TriangleAttributes> const& attributes = geometry->getAttributes();
+    std::vector<unsigned int>       const& indices    = geometry->getIndices();
+
+    statistics.uniqueVertices  += attributes.size();
+    statistics.uniqueTriangles += indices.size() / 3;
+    statistics.attributes      += attributes.capacity() * sizeof(TriangleAttributes);
+    statistics.indices         += indices.capacity() * sizeof(unsigned int);
   }
 
-  ImGuiStyle& style = ImGui::GetStyle();
+  InstanceTable const& table = m_raytracer->m_instanceTable;
 
-  // Use the GUI window title bar color as rendering indicator. Green when rendering is completed.
-  style.Colors[ImGuiCol_TitleBg]          = ImVec4(r * 0.6f, g * 0.6f, b * 0.6f, 0.6f);
-  style.Colors[ImGuiCol_TitleBgCollapsed] = ImVec4(r * 0.4f, g * 0.4f, b * 0.4f, 0.4f);
-  style.Colors[ImGuiCol_TitleBgActive]    = ImVec4(r * 0.8f, g * 0.8f, b * 0.8f, 0.8f);
-}
+  statistics.numTableInstances = table.getNumInstances();
+
+  for (unsigned int i = 0; i < statistics.numTableInstances; ++i)
+  {
+    std::shared_ptr<sg::Triangles> geometry = table.getTriangles(table.getGeometry(i));
+    if (geometry)
+    {
+      statistics.instancedTriangles += geometry->getIndices().size() / 3;
+    }
+  }
+
+  statistics.sceneGraph    = m_scene.getMemorySize();
+  statistics.instanceTable = table.getMemorySize();
+
+  for (std::map<std::string, Picture*>::const_iterator it = m_mapPictures.begin(); it != m_mapPictures.end(); ++it)
+  {
+    const Picture* picture = it->second;
+
+    size_t size = 0;
+
+    for (unsigned int indexImage = 0; indexImage < picture->getNumberOfImages(); ++indexImage)
+    {
+      for (unsigned int indexLevel = 0; indexLevel < picture->getNumberOfLevels(indexImage); ++indexLevel)
+      {
+        size += picture->getImageLevel(indexImage, indexLevel)->m_nob;
+      }
+    }
+    statistics.pictures[it->first] = size;
+  }
+
+  // The output buffers are allocated lazily by the first render() and reported for the resolution set by initState().
+  m_raytracer->getMemoryStatistics(statistics.devices);
+
+  statistics.print(std::cout);
+
+  if (!m_prefixStatistics.empty())
+  {
+    const std::string filename = m_prefixStatistics + std::string("_") + getDateTime() + std::string(".json");
+    if (statistics.writeJSON(filename))
+    {
+      std::cout << filename << std::endl; // Print out the filename to indicate success.
+    }
+  }
+}
+
+void Application::guiRenderingIndicator(const bool isRendering)
+{
+  // NVIDIA Green when rendering is complete.
+  float r = 0.462745f;
+  float g = 0.72549f;
+  float b = 0.0f;
+
+  if (isRendering)
+  {
+    // Neutral grey while rendering.
+    r = 1.0f;
+    g = 1.0f;
+    b = 1.0f;
+  }
+
+  ImGuiStyle& style = ImGui::GetStyle();
+
+  // Use the GUI window title bar color as rendering indicator. Green when rendering is completed.
+  style.Colors[ImGuiCol_TitleBg]          = ImVec4(r * 0.6f, g * 0.6f, b * 0.6f, 0.6f);
+  style.Colors[ImGuiCol_TitleBgCollapsed] = ImVec4(r * 0.4f, g * 0.4f, b * 0.4f, 0.4f);
+  style.Colors[ImGuiCol_TitleBgActive]    = ImVec4(r * 0.8f, g * 0.8f, b * 0.8f, 0.8f);
+}
 
 
 bool Application::loadSystemDescription(std::string const& filename)
@@ -1087,6 +1725,12 @@ bool Application::loadSystemDescription(std::string const& filename)
         MY_ASSERT(tokenType == PTT_VAL);
         m_devicesMask = atoi(token.c_str());
       }
+      else if (token == "threads")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_numThreads = std::max(0, atoi(token.c_str()));
+      }
       else if (token == "interop")
       {
         tokenType = parser.getNextToken(token);
@@ -1104,6 +1748,47 @@ bool Application::loadSystemDescription(std::string const& filename)
         MY_ASSERT(tokenType == PTT_VAL);
         m_present = (atoi(token.c_str()) != 0);
       }
+      else if (token == "compressedNodes")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_compressedNodes = (atoi(token.c_str()) != 0);
+      }
+      else if (token == "builder")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_builder = atoi(token.c_str());
+      }
+      else if (token == "geometryFormat")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_geometryFormat = atoi(token.c_str());
+        if (m_geometryFormat < 0 || NUM_GEOMETRY_FORMATS <= m_geometryFormat)
+        {
+          std::cerr << "WARNING: loadSystemDescription() Invalid geometryFormat value " << m_geometryFormat << ", using geometryFormat 0 (full)." << std::endl;
+          m_geometryFormat = GEOMETRY_FORMAT_FULL;
+        }
+      }
+      else if (token == "optimizeMeshes")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_optimizeMeshes = (atoi(token.c_str()) != 0);
+      }
+      else if (token == "tessellationLod")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_tessellationLod = std::max(0.0f, (float) atof(token.c_str()));
+      }
+      else if (token == "triangleBudget")
+      {
+        tokenType = parser.getNextToken(token);
+        MY_ASSERT(tokenType == PTT_VAL);
+        m_triangleBudget = static_cast<unsigned int>(std::max(0, atoi(token.c_str())));
+      }
       else if (token == "resolution")
       {
         tokenType = parser.getNextToken(token);
@@ -1241,6 +1926,20 @@ bool Application::loadSystemDescription(std::string const& filename)
         convertPath(token);
         m_prefixScreenshot = token;
       }
+      else if (token == "prefixStatistics")
+      {
+        tokenType = parser.getNextLine(token);
+        MY_ASSERT(tokenType == PTT_ID);
+        convertPath(token);
+        m_prefixStatistics = token;
+      }
+      else if (token == "cachePath")
+      {
+        tokenType = parser.getNextLine(token);
+        MY_ASSERT(tokenType == PTT_ID);
+        convertPath(token);
+        m_geometryCache.setPath(token);
+      }
       else if (token == "gamma")
       {
         tokenType = parser.getNextToken(token);
@@ -1305,8 +2004,15 @@ bool Application::saveSystemDescription()
 
   description << "strategy " << m_strategy << std::endl;
   description << "devicesMask " << m_devicesMask << std::endl;
+  description << "threads " << m_numThreads << std::endl;
   description << "interop " << m_interop << std::endl;
   description << "present " << ((m_present) ? "1" : "0") << std::endl;
+  description << "compressedNodes " << ((m_compressedNodes) ? "1" : "0") << std::endl;
+  description << "builder " << m_builder << std::endl;
+  description << "geometryFormat " << m_geometryFormat << std::endl;
+  description << "optimizeMeshes " << ((m_optimizeMeshes) ? "1" : "0") << std::endl;
+  description << "tessellationLod " << m_tessellationLod << std::endl;
+  description << "triangleBudget " << m_triangleBudget << std::endl;
   description << "resolution " << m_resolution.x << " " << m_resolution.y << std::endl;
   description << "tileSize " << m_tileSize.x << " " << m_tileSize.y << std::endl;
   description << "samplesSqrt " << m_samplesSqrt << std::endl;
@@ -1327,6 +2033,14 @@ bool Application::saveSystemDescription()
   {
     description << "prefixScreenshot " << m_prefixScreenshot << std::endl;
   }
+  if (!m_prefixStatistics.empty())
+  {
+    description << "prefixStatistics " << m_prefixStatistics << std::endl;
+  }
+  if (m_geometryCache.isEnabled())
+  {
+    description << "cachePath " << m_geometryCache.getPath() << std::endl;
+  }
   description << "gamma " << m_tonemapperGUI.gamma << std::endl;
   description << "colorBalance " << m_tonemapperGUI.colorBalance[0] << " " << m_tonemapperGUI.colorBalance[1] << " " << m_tonemapperGUI.colorBalance[2] << std::endl;
   description << "whitePoint " << m_tonemapperGUI.whitePoint << std::endl;
@@ -1341,56 +2055,502 @@ bool Application::saveSystemDescription()
   {
     std::cout << filename  << std::endl; // Print out the filename to indicate success.
   }
-  return success;
+  return success;
+}
+
+int Application::getMaterialIndex(std::string const& reference) const
+{
+  int indexMaterial = -1;
+  std::map<std::string, int>::const_iterator itm = m_mapMaterialReferences.find(reference);
+  if (itm != m_mapMaterialReferences.end())
+  {
+    indexMaterial = itm->second;
+  }
+  else
+  {
+    std::cerr << "WARNING: loadSceneDescription() No material found for " << reference << ". Trying default." << std::endl;
+
+    std::map<std::string, int>::const_iterator itmd = m_mapMaterialReferences.find(std::string("default"));
+    if (itmd != m_mapMaterialReferences.end())
+    {
+      indexMaterial = itmd->second;
+    }
+    else
+    {
+      std::cerr << "ERROR: loadSceneDescription() No default material found" << std::endl;
+    }
+  }
+  return indexMaterial;
+}
+
+void Application::appendInstance(const sg::NodeHandle group,
+                                 const sg::NodeHandle geometry,
+                                 dp::math::Mat44f const& matrix,
+                                 std::string const& reference)
+{
+  appendInstance(group, geometry, matrix, getMaterialIndex(reference));
+}
+
+void Application::appendInstance(const sg::NodeHandle group,
+                                 const sg::NodeHandle geometry,
+                                 dp::math::Mat44f const& matrix,
+                                 const int indexMaterial)
+{
+  // nvpro-pipeline matrices are row-major multiplied from the right, means the translation is in the last row. Transpose!
+  const float trafo[12] =
+  {
+    matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0],
+    matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1],
+    matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]
+  };
+
+  MY_ASSERT(matrix[0][3] == 0.0f &&
+            matrix[1][3] == 0.0f &&
+            matrix[2][3] == 0.0f &&
+            matrix[3][3] == 1.0f);
+
+  sg::NodeHandle child = geometry; // The sg::Triangles or sg::Primitive handle.
+
+  // A pending grid or scatter directive places all copies below this one instance.
+  if (!m_arrayTransforms.empty())
+  {
+    child = m_scene.createInstanceArray(geometry, m_arrayTransforms.data(), static_cast<unsigned int>(m_arrayTransforms.size() / 12));
+    m_arrayTransforms.clear();
+  }
+
+  const sg::NodeHandle instance = m_scene.createInstance();
+  m_scene.setTransform(instance, trafo);
+  m_scene.setChild(instance, child);
+  m_scene.setMaterial(instance, indexMaterial);
+
+  m_scene.addChild(group, instance);
+}
+
+
+// Appends one 3x4 row-major transform with the columns axisX, axisY, axisZ and position.
+static void appendTransform(std::vector<float>& transforms, float3 const& axisX, float3 const& axisY, float3 const& axisZ, float3 const& position)
+{
+  const float m[12] =
+  {
+    axisX.x, axisY.x, axisZ.x, position.x,
+    axisX.y, axisY.y, axisZ.y, position.y,
+    axisX.z, axisY.z, axisZ.z, position.z
+  };
+
+  transforms.insert(transforms.end(), m, m + 12);
+}
+
+// count.x * count.y * count.z translated copies centered around the origin of the current transformation.
+void Application::createGrid(const int3 count, const float3 spacing)
+{
+  m_arrayTransforms.clear();
+  m_arrayTransforms.reserve(size_t(count.x) * size_t(count.y) * size_t(count.z) * 12);
+
+  const float3 origin = make_float3(float(count.x - 1) * -0.5f * spacing.x,
+                                    float(count.y - 1) * -0.5f * spacing.y,
+                                    float(count.z - 1) * -0.5f * spacing.z);
+
+  for (int z = 0; z < count.z; ++z)
+  {
+    for (int y = 0; y < count.y; ++y)
+    {
+      for (int x = 0; x < count.x; ++x)
+      {
+        const float3 position = origin + make_float3(float(x) * spacing.x, float(y) * spacing.y, float(z) * spacing.z);
+
+        appendTransform(m_arrayTransforms, make_float3(1.0f, 0.0f, 0.0f), make_float3(0.0f, 1.0f, 0.0f), make_float3(0.0f, 0.0f, 1.0f), position);
+      }
+    }
+  }
+}
+
+// Uniformly distributed copies with random rotation around the local y-axis and uniform scale in [minScale, maxScale].
+// "plane": On the square [-1, 1] of the xz-plane (the plane model with upAxis 1). "sphere": On the unit sphere with the y-axis along the normal.
+// The same seed generates the same placement.
+void Application::createScatter(const std::string& surface, const unsigned int count, const unsigned int seed, const float minScale, const float maxScale)
+{
+  m_arrayTransforms.clear();
+
+  const bool isSphere = (surface == "sphere");
+  if (!isSphere && surface != "plane")
+  {
+    std::cerr << "WARNING: createScatter() Unknown surface " << surface << ", using plane." << std::endl;
+  }
+
+  m_arrayTransforms.reserve(size_t(count) * 12);
+
+  std::mt19937 generator(seed);
+
+  // Not std::uniform_real_distribution, its results differ between standard library implementations.
+  auto uniform = [&generator]() -> float
+  {
+    return float(generator() >> 8) / float(0x01000000u); // [0.0f, 1.0f)
+  };
+
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    const float u     = uniform();
+    const float v     = uniform();
+    const float phi   = uniform() * 2.0f * M_PIf;
+    const float scale = minScale + uniform() * (maxScale - minScale);
+
+    float3 position;
+    float3 normal;
+    float3 tangent;
+
+    if (isSphere)
+    {
+      const float cosTheta = 1.0f - 2.0f * u;
+      const float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+      const float angle    = v * 2.0f * M_PIf;
+
+      position = make_float3(sinTheta * cosf(angle), cosTheta, sinTheta * sinf(angle));
+      normal   = position;
+      tangent  = (fabsf(normal.x) < 0.9f) ? normalize(cross(make_float3(1.0f, 0.0f, 0.0f), normal))
+                                          : normalize(cross(make_float3(0.0f, 0.0f, 1.0f), normal));
+    }
+    else
+    {
+      position = make_float3(u * 2.0f - 1.0f, 0.0f, v * 2.0f - 1.0f);
+      normal   = make_float3(0.0f, 1.0f, 0.0f);
+      tangent  = make_float3(0.0f, 0.0f, 1.0f);
+    }
+
+    const float3 bitangent = cross(normal, tangent); // The bitangent, normal, tangent frame is right-handed like x, y, z.
+
+    // Rotate the tangent frame around the normal.
+    const float3 axisX = cosf(phi) * bitangent - sinf(phi) * tangent;
+    const float3 axisZ = sinf(phi) * bitangent + cosf(phi) * tangent;
+
+    appendTransform(m_arrayTransforms, axisX * scale, normal * scale, axisZ * scale, position);
+  }
+}
+
+// Returns the shared mesh for these construction parameters. Generates or loads it from the geometry cache on first use.
+std::shared_ptr<sg::Triangles> Application::getProceduralGeometry(ProceduralGeometry const& procedural)
+{
+  std::ostringstream keyGeometry;
+  switch (procedural.type)
+  {
+    case PROCEDURAL_PLANE:
+      keyGeometry << "plane_" << procedural.tessU << "_" << procedural.tessV << "_" << procedural.upAxis;
+      break;
+    case PROCEDURAL_SPHERE:
+      keyGeometry << "sphere_" << procedural.tessU << "_" << procedural.tessV << "_" << procedural.theta;
+      break;
+    case PROCEDURAL_TORUS:
+      keyGeometry << "torus_" << procedural.tessU << "_" << procedural.tessV << "_" << procedural.innerRadius << "_" << procedural.outerRadius;
+      break;
+  }
+  if (procedural.spatialSplitAlpha != 0.0f)
+  {
+    keyGeometry << "_sbvh_" << procedural.spatialSplitAlpha;
+  }
+
+  std::map<std::string, unsigned int>::const_iterator itg = m_mapGeometries.find(keyGeometry.str());
+  if (itg != m_mapGeometries.end())
+  {
+    return m_geometries[itg->second];
+  }
+
+  m_mapGeometries[keyGeometry.str()] = static_cast<unsigned int>(m_geometries.size()); // Not m_idGeometry, the analytic primitives share the identifiers.
+
+  std::shared_ptr<sg::Triangles> geometry = std::make_shared<sg::Triangles>(m_idGeometry++);
+
+  const float radius   = 1.0f;                     // sphere
+  const float maxTheta = procedural.theta * M_PIf; // sphere
+
+  unsigned long long key = 0;
+  switch (procedural.type)
+  {
+    case PROCEDURAL_PLANE:
+      key = GeometryCache::hash("plane", 5);
+      key = GeometryCache::hashValue(procedural.tessU, key);
+      key = GeometryCache::hashValue(procedural.tessV, key);
+      key = GeometryCache::hashValue(procedural.upAxis, key);
+      break;
+    case PROCEDURAL_SPHERE:
+      key = GeometryCache::hash("sphere", 6);
+      key = GeometryCache::hashValue(procedural.tessU, key);
+      key = GeometryCache::hashValue(procedural.tessV, key);
+      key = GeometryCache::hashValue(radius, key);
+      key = GeometryCache::hashValue(maxTheta, key);
+      break;
+    case PROCEDURAL_TORUS:
+      key = GeometryCache::hash("torus", 5);
+      key = GeometryCache::hashValue(procedural.tessU, key);
+      key = GeometryCache::hashValue(procedural.tessV, key);
+      key = GeometryCache::hashValue(procedural.innerRadius, key);
+      key = GeometryCache::hashValue(procedural.outerRadius, key);
+      break;
+  }
+  key = GeometryCache::hashValue(getMeshOptimizerVersion(), key);
+
+  if (!loadGeometry(key, geometry))
+  {
+    switch (procedural.type)
+    {
+      case PROCEDURAL_PLANE:
+        geometry->createPlane(procedural.tessU, procedural.tessV, procedural.upAxis);
+        break;
+      case PROCEDURAL_SPHERE:
+        geometry->createSphere(procedural.tessU, procedural.tessV, radius, maxTheta);
+        break;
+      case PROCEDURAL_TORUS:
+        geometry->createTorus(procedural.tessU, procedural.tessV, procedural.innerRadius, procedural.outerRadius);
+        break;
+    }
+    optimizeGeometry(geometry);
+    storeGeometry(key, geometry);
+  }
+  geometry->setSpatialSplitAlpha(procedural.spatialSplitAlpha);
+
+  m_geometries.push_back(geometry);
+
+  return geometry;
+}
+
+void Application::appendProcedural(ProceduralGeometry const& procedural, dp::math::Mat44f const& matrix, std::string const& reference)
+{
+  // InstanceArrays share one mesh for all elements and use the scene tessellation.
+  if (m_tessellationLod <= 0.0f || !m_arrayTransforms.empty())
+  {
+    appendInstance(m_root, m_scene.addTriangles(getProceduralGeometry(procedural)), matrix, reference);
+    return;
+  }
+
+  ProceduralInstance instance;
+
+  instance.geometry      = procedural;
+  instance.matrix        = matrix;
+  instance.indexMaterial = getMaterialIndex(reference);
+  instance.level         = getTessellationLevel(procedural, matrix);
+
+  m_proceduralInstances.push_back(instance);
+}
+
+// Minimum tessellation per procedural type. The tessellation is only halved down to these.
+static unsigned int getMinimumTessellation(const ProceduralType type)
+{
+  return (type == PROCEDURAL_PLANE) ? 1 : 3;
+}
+
+static unsigned int getTessellation(const unsigned int tess, const unsigned int level, const ProceduralType type)
+{
+  return std::max(getMinimumTessellation(type), (level < 32) ? (tess >> level) : 0);
+}
+
+static unsigned int getNumTriangles(ProceduralGeometry const& procedural)
+{
+  const unsigned int rows = (procedural.type == PROCEDURAL_SPHERE) ? procedural.tessV - 1 : procedural.tessV; // The sphere has tessV latitudes incl. the poles.
+
+  return 2 * procedural.tessU * rows;
+}
+
+// Picks the number of tessellation halvings which keeps the triangle edges around m_tessellationLod pixels long at the initial camera.
+unsigned int Application::getTessellationLevel(ProceduralGeometry const& procedural, dp::math::Mat44f const& matrix) const
+{
+  MY_ASSERT(!m_cameras.empty());
+
+  // Object space bounding sphere radius and length of the parameter direction u.
+  float radius = 1.0f;
+  float span   = 2.0f * M_PIf;
+  switch (procedural.type)
+  {
+    case PROCEDURAL_PLANE:
+      radius = sqrtf(2.0f);
+      span   = 2.0f;
+      break;
+    case PROCEDURAL_SPHERE:
+      break;
+    case PROCEDURAL_TORUS:
+      radius = procedural.innerRadius + procedural.outerRadius;
+      span   = 2.0f * M_PIf * radius;
+      break;
+  }
+
+  // Row-major matrix, the rows are the transformed axes. Use the largest scale.
+  float scale = 0.0f;
+  for (int i = 0; i < 3; ++i)
+  {
+    scale = std::max(scale, sqrtf(matrix[i][0] * matrix[i][0] + matrix[i][1] * matrix[i][1] + matrix[i][2] * matrix[i][2]));
+  }
+
+  CameraDefinition const& camera = m_cameras[0];
+
+  const float3 center   = make_float3(matrix[3][0], matrix[3][1], matrix[3][2]);
+  const float  distance = length(center - camera.P) - radius * scale; // To the nearest point of the bounding sphere.
+
+  if (distance <= 0.0f)
+  {
+    return 0; // Camera inside the bounding sphere, full tessellation.
+  }
+
+  const float tanFovHalf    = length(camera.V); // The camera W is normalized.
+  const float pixelsPerUnit = float(m_resolution.y) * 0.5f / (distance * tanFovHalf);
+  const float tessNeeded    = span * scale * pixelsPerUnit / m_tessellationLod;
+
+  unsigned int level = 0;
+  while (level < 31 &&
+         float(procedural.tessU >> (level + 1)) >= tessNeeded &&
+         getMinimumTessellation(procedural.type) <= (procedural.tessU >> (level + 1)) &&
+         getMinimumTessellation(procedural.type) <= (procedural.tessV >> (level + 1)))
+  {
+    ++level;
+  }
+  return level;
+}
+
+// Creates the deferred procedural instances. Coarsens all levels uniformly until the unique meshes fit into the triangle budget.
+void Application::appendProceduralInstances()
+{
+  if (m_proceduralInstances.empty())
+  {
+    return;
+  }
+
+  std::vector<ProceduralGeometry> variants(m_proceduralInstances.size());
+
+  unsigned int bias = 0;
+  unsigned long long numTriangles = 0;
+  unsigned long long numTrianglesPrevious = ~0ull;
+
+  while (true)
+  {
+    std::map<std::string, unsigned int> unique; // Count each shared variant only once.
+
+    numTriangles = 0;
+    for (size_t i = 0; i < m_proceduralInstances.size(); ++i)
+    {
+      ProceduralInstance const& instance = m_proceduralInstances[i];
+
+      ProceduralGeometry& variant = variants[i];
+
+      variant = instance.geometry;
+      variant.tessU = getTessellation(instance.geometry.tessU, instance.level + bias, variant.type);
+      variant.tessV = getTessellation(instance.geometry.tessV, instance.level + bias, variant.type);
+
+      std::ostringstream keyVariant;
+      keyVariant << variant.type << "_" << variant.tessU << "_" << variant.tessV << "_" << variant.upAxis << "_"
+                 << variant.theta << "_" << variant.innerRadius << "_" << variant.outerRadius << "_" << variant.spatialSplitAlpha;
+      if (unique.find(keyVariant.str()) == unique.end())
+      {
+        unique[keyVariant.str()] = 1;
+        numTriangles += getNumTriangles(variant);
+      }
+    }
+
+    // Stop when within budget or when the minimum tessellations have been reached.
+    if (numTriangles <= m_triangleBudget || numTriangles == numTrianglesPrevious)
+    {
+      break;
+    }
+    numTrianglesPrevious = numTriangles;
+    ++bias;
+  }
+
+  if (m_triangleBudget < numTriangles)
+  {
+    std::cerr << "WARNING: appendProceduralInstances() " << numTriangles << " triangles at minimum tessellation exceed the triangleBudget " << m_triangleBudget << std::endl;
+  }
+
+  for (size_t i = 0; i < m_proceduralInstances.size(); ++i)
+  {
+    ProceduralInstance const& instance = m_proceduralInstances[i];
+
+    appendInstance(m_root, m_scene.addTriangles(getProceduralGeometry(variants[i])), instance.matrix, instance.indexMaterial);
+  }
+
+  std::cout << "appendProceduralInstances(): " << m_proceduralInstances.size() << " instances, " << numTriangles << " triangles, bias " << bias << std::endl;
+
+  m_proceduralInstances.clear();
+}
+
+
+// Copies the attributes and indices from two consecutive blobs of the cache file into the geometry.
+bool Application::loadTriangles(CacheFile const& file, const unsigned int first, std::shared_ptr<sg::Triangles> geometry)
+{
+  size_t sizeAttributes;
+  size_t sizeIndices;
+
+  const TriangleAttributes* attributes = static_cast<const TriangleAttributes*>(file.getBlob(first, sizeAttributes));
+  const unsigned int*       indices    = static_cast<const unsigned int*>(file.getBlob(first + 1, sizeIndices));
+
+  if (attributes == nullptr || indices == nullptr ||
+      sizeAttributes % sizeof(TriangleAttributes) != 0 ||
+      sizeIndices % (3 * sizeof(unsigned int)) != 0)
+  {
+    return false;
+  }
+
+  const size_t numAttributes = sizeAttributes / sizeof(TriangleAttributes);
+  const size_t numIndices    = sizeIndices / sizeof(unsigned int);
+
+  for (size_t i = 0; i < numIndices; ++i)
+  {
+    if (numAttributes <= indices[i])
+    {
+      return false;
+    }
+  }
+
+  geometry->setAttributes(attributes, numAttributes);
+  geometry->setIndices(indices, numIndices);
+
+  return true;
 }
 
-void Application::appendInstance(std::shared_ptr<sg::Group>& group,
-                                 std::shared_ptr<sg::Triangles> geometry,
-                                 dp::math::Mat44f const& matrix,
-                                 std::string const& reference,
-                                 unsigned int& idInstance)
+void Application::appendTriangles(std::shared_ptr<sg::Triangles> geometry, std::vector<CacheBlob>& blobs)
 {
-  // nvpro-pipeline matrices are row-major multiplied from the right, means the translation is in the last row. Transpose!
-  const float trafo[12] =
-  {
-    matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0],
-    matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1],
-    matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]
-  };
+  std::vector<TriangleAttributes> const& attributes = geometry->getAttributes();
+  std::vector<unsigned int>       const& indices    = geometry->getIndices();
 
-  MY_ASSERT(matrix[0][3] == 0.0f &&
-            matrix[1][3] == 0.0f &&
-            matrix[2][3] == 0.0f &&
-            matrix[3][3] == 1.0f);
+  CacheBlob blob;
 
-  std::shared_ptr<sg::Instance> instance(new sg::Instance(idInstance++));
-  instance->setTransform(trafo);
-  instance->setChild(geometry);
+  blob.data = attributes.data();
+  blob.size = attributes.size() * sizeof(TriangleAttributes);
+  blobs.push_back(blob);
 
-  int indexMaterial = -1;
-  std::map<std::string, int>::const_iterator itm = m_mapMaterialReferences.find(reference);
-  if (itm != m_mapMaterialReferences.end())
+  blob.data = indices.data();
+  blob.size = indices.size() * sizeof(unsigned int);
+  blobs.push_back(blob);
+}
+
+// The generated geometries are keyed by a hash of their construction parameters.
+bool Application::loadGeometry(const unsigned long long key, std::shared_ptr<sg::Triangles> geometry)
+{
+  std::shared_ptr<CacheFile> file = m_geometryCache.load(key);
+
+  return (file && file->getNumBlobs() == 2 && loadTriangles(*file, 0, geometry));
+}
+
+// Runs before storing into the geometry cache, so cached geometries are loaded already optimized.
+void Application::optimizeGeometry(std::shared_ptr<sg::Triangles> geometry)
+{
+  if (m_optimizeMeshes)
   {
-    indexMaterial = itm->second;
+    geometry->optimize();
   }
-  else
-  {
-    std::cerr << "WARNING: loadSceneDescription() No material found for " << reference << ". Trying default." << std::endl;
+}
 
-    std::map<std::string, int>::const_iterator itmd = m_mapMaterialReferences.find(std::string("default"));
-    if (itmd != m_mapMaterialReferences.end())
-    {
-      indexMaterial = itmd->second;
-    }
-    else
-    {
-      std::cerr << "ERROR: loadSceneDescription() No default material found" << std::endl;
-    }
+// Part of all geometry cache keys. Optimized and unoptimized data must not share cache entries.
+unsigned int Application::getMeshOptimizerVersion() const
+{
+  return (m_optimizeMeshes) ? SG_MESH_OPTIMIZER_VERSION : 0;
+}
+
+void Application::storeGeometry(const unsigned long long key, std::shared_ptr<sg::Triangles> geometry)
+{
+  if (!m_geometryCache.isEnabled())
+  {
+    return;
   }
 
-  instance->setMaterial(indexMaterial);
+  std::vector<CacheBlob> blobs;
+
+  appendTriangles(geometry, blobs);
 
-  group->addChild(instance);
+  m_geometryCache.store(key, blobs);
 }
 
 
@@ -1405,7 +2565,8 @@ bool Application::loadSceneDescription(std::string const& filename)
   }
 
   ParserTokenType tokenType;
-  std::string token;
+  ParserToken     token; // Views into the mapped file. Only the keywords and names are copied.
+  std::string     name;
 
   // Reusing some math routines from the NVIDIA nvpro-pipeline https://github.com/nvpro-pipeline/pipeline
   // Note that matrices in the nvpro-pipeline are defined row-major but are multiplied from the right,
@@ -1429,6 +2590,9 @@ bool Application::loadSceneDescription(std::string const& filename)
   float  curIOR             = 1.5f;
   bool   curThinwalled      = false;
 
+  // Host BVH build option for the following models. 0.0f means off, else the SBVH overlap threshold.
+  float curSpatialSplitAlpha = 0.0f;
+
   // FIXME Add a mechanism to specify albedo textures per material and make that resetable or add a push/pop mechanism for materials.
   // E.g. special case filename "none" which translates to empty filename, which switches off albedo textures.
   // Get rid of the single hardcoded texture and the toggle.
@@ -1444,7 +2608,9 @@ bool Application::loadSceneDescription(std::string const& filename)
 
     if (tokenType == PTT_ID)
     {
-      std::map<std::string, KeywordScene>::const_iterator it = m_mapKeywordScene.find(token);
+      token.assign(name);
+
+      std::map<std::string, KeywordScene>::const_iterator it = m_mapKeywordScene.find(name);
       if (it == m_mapKeywordScene.end())
       {
         std::cerr << "loadSceneDescription(): Unknown token " << token << " ignored." << std::endl;
@@ -1459,52 +2625,113 @@ bool Application::loadSceneDescription(std::string const& filename)
         case KS_ALBEDO:
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAlbedo.x = (float) atof(token.c_str());
+          curAlbedo.x = token.toFloat();
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAlbedo.y = (float) atof(token.c_str());
+          curAlbedo.y = token.toFloat();
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAlbedo.z = (float) atof(token.c_str());
+          curAlbedo.z = token.toFloat();
           break;
 
         case KS_ROUGHNESS:
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curRoughness.x = (float) atof(token.c_str());
+          curRoughness.x = token.toFloat();
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curRoughness.y = (float) atof(token.c_str());
+          curRoughness.y = token.toFloat();
           break;
 
         case KS_ABSORPTION: // For convenience this is an absoption color used to calculate the absorption coefficient.
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAbsorptionColor.x = (float) atof(token.c_str());
+          curAbsorptionColor.x = token.toFloat();
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAbsorptionColor.y = (float) atof(token.c_str());
+          curAbsorptionColor.y = token.toFloat();
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAbsorptionColor.z = (float) atof(token.c_str());
+          curAbsorptionColor.z = token.toFloat();
           break;
 
         case KS_ABSORPTION_SCALE:
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curAbsorptionScale = (float) atof(token.c_str());
+          curAbsorptionScale = token.toFloat();
           break;
 
         case KS_IOR:
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curIOR = (float) atof(token.c_str());
+          curIOR = token.toFloat();
+          break;
+
+        case KS_SPATIAL_SPLITS:
+          tokenType = parser.getNextToken(token);
+          MY_ASSERT(tokenType == PTT_VAL);
+          curSpatialSplitAlpha = std::max(0.0f, token.toFloat());
+          break;
+
+        case KS_GRID:
+          {
+            int3 count;
+            float3 spacing;
+
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            count.x = std::max(1, token.toInt());
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            count.y = std::max(1, token.toInt());
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            count.z = std::max(1, token.toInt());
+
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            spacing.x = token.toFloat();
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            spacing.y = token.toFloat();
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            spacing.z = token.toFloat();
+
+            createGrid(count, spacing);
+          }
+          break;
+
+        case KS_SCATTER:
+          {
+            std::string surface;
+            tokenType = parser.getNextToken(surface);
+            MY_ASSERT(tokenType == PTT_ID);
+
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            const unsigned int count = static_cast<unsigned int>(std::max(1, token.toInt()));
+
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            const unsigned int seed = static_cast<unsigned int>(token.toInt());
+
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            const float minScale = token.toFloat();
+
+            tokenType = parser.getNextToken(token);
+            MY_ASSERT(tokenType == PTT_VAL);
+            const float maxScale = token.toFloat();
+
+            createScatter(surface, count, seed, minScale, maxScale);
+          }
           break;
 
         case KS_THINWALLED:
           tokenType = parser.getNextToken(token);
           MY_ASSERT(tokenType == PTT_VAL);
-          curThinwalled = (atoi(token.c_str()) != 0);
+          curThinwalled = (token.toInt() != 0);
           break;
 
         case KS_MATERIAL:
@@ -1605,18 +2832,18 @@ bool Application::loadSceneDescription(std::string const& filename)
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            axis[0] = (float) atof(token.c_str());
+            axis[0] = token.toFloat();
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            axis[1] = (float) atof(token.c_str());
+            axis[1] = token.toFloat();
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            axis[2] = (float) atof(token.c_str());
+            axis[2] = token.toFloat();
             axis.normalize();
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const float angle = dp::math::degToRad((float) atof(token.c_str()));
+            const float angle = dp::math::degToRad(token.toFloat());
 
             dp::math::Quatf rotation(axis, angle);
             curOrientation *= rotation;
@@ -1637,13 +2864,13 @@ bool Application::loadSceneDescription(std::string const& filename)
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            scaling[0][0] = (float) atof(token.c_str());
+            scaling[0][0] = token.toFloat();
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            scaling[1][1] = (float) atof(token.c_str());
+            scaling[1][1] = token.toFloat();
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            scaling[2][2] = (float) atof(token.c_str());
+            scaling[2][2] = token.toFloat();
 
             curMatrix *= scaling;
 
@@ -1663,13 +2890,13 @@ bool Application::loadSceneDescription(std::string const& filename)
             // Translation is in the third row in dp::math::Mat44f.
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            translation[3][0] = (float) atof(token.c_str());
+            translation[3][0] = token.toFloat();
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            translation[3][1] = (float) atof(token.c_str());
+            translation[3][1] = token.toFloat();
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            translation[3][2] = (float) atof(token.c_str());
+            translation[3][2] = token.toFloat();
 
             curMatrix *= translation;
 
@@ -1689,40 +2916,31 @@ bool Application::loadSceneDescription(std::string const& filename)
           {
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int tessU = atoi(token.c_str());
+            const unsigned int tessU = token.toInt();
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int tessV = atoi(token.c_str());
+            const unsigned int tessV = token.toInt();
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int upAxis = atoi(token.c_str());
+            const unsigned int upAxis = token.toInt();
 
             std::string nameMaterialReference;
             tokenType = parser.getNextToken(nameMaterialReference);
 
-            std::ostringstream keyGeometry;
-            keyGeometry << "plane_" << tessU << "_" << tessV << "_" << upAxis;
-
-            std::shared_ptr<sg::Triangles> geometry;
-
-            std::map<std::string, unsigned int>::const_iterator itg = m_mapGeometries.find(keyGeometry.str());
-            if (itg == m_mapGeometries.end())
-            {
-              m_mapGeometries[keyGeometry.str()] = m_idGeometry; // PERF Equal to static_cast<unsigned int>(m_geometries.size());
-
-              geometry = std::make_shared<sg::Triangles>(m_idGeometry++);
-              geometry->createPlane(tessU, tessV, upAxis);
+            ProceduralGeometry procedural;
 
-              m_geometries.push_back(geometry);
-            }
-            else
-            {
-              geometry = m_geometries[itg->second];
-            }
+            procedural.type              = PROCEDURAL_PLANE;
+            procedural.tessU             = tessU;
+            procedural.tessV             = tessV;
+            procedural.upAxis            = upAxis;
+            procedural.theta             = 0.0f;
+            procedural.innerRadius       = 0.0f;
+            procedural.outerRadius       = 0.0f;
+            procedural.spatialSplitAlpha = curSpatialSplitAlpha;
 
-            appendInstance(m_scene, geometry, curMatrix, nameMaterialReference, m_idInstance);
+            appendProcedural(procedural, curMatrix, nameMaterialReference);
           }
           else if (token == "box")
           {
@@ -1730,17 +2948,32 @@ bool Application::loadSceneDescription(std::string const& filename)
             tokenType = parser.getNextToken(nameMaterialReference);
 
             // FIXME Implement tessellation. Must be a single value to get even distributions across edges.
-            std::string keyGeometry("box_1_1");
+            std::ostringstream keyGeometry;
+            keyGeometry << "box_1_1";
+            if (curSpatialSplitAlpha != 0.0f)
+            {
+              keyGeometry << "_sbvh_" << curSpatialSplitAlpha;
+            }
 
             std::shared_ptr<sg::Triangles> geometry;
 
-            std::map<std::string, unsigned int>::const_iterator itg = m_mapGeometries.find(keyGeometry);
+            std::map<std::string, unsigned int>::const_iterator itg = m_mapGeometries.find(keyGeometry.str());
             if (itg == m_mapGeometries.end())
             {
-              m_mapGeometries[keyGeometry] = m_idGeometry;
+              m_mapGeometries[keyGeometry.str()] = static_cast<unsigned int>(m_geometries.size());
 
               geometry = std::make_shared<sg::Triangles>(m_idGeometry++);
-              geometry->createBox();
+
+              unsigned long long key = GeometryCache::hash("box", 3);
+              key = GeometryCache::hashValue(getMeshOptimizerVersion(), key);
+
+              if (!loadGeometry(key, geometry))
+              {
+                geometry->createBox();
+                optimizeGeometry(geometry);
+                storeGeometry(key, geometry);
+              }
+              geometry->setSpatialSplitAlpha(curSpatialSplitAlpha);
 
               m_geometries.push_back(geometry);
             }
@@ -1749,90 +2982,97 @@ bool Application::loadSceneDescription(std::string const& filename)
               geometry = m_geometries[itg->second];
             }
 
-            appendInstance(m_scene, geometry, curMatrix, nameMaterialReference, m_idInstance);
+            appendInstance(m_root, m_scene.addTriangles(geometry), curMatrix, nameMaterialReference);
           }
           else if (token == "sphere")
           {
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int tessU = atoi(token.c_str());
+            const unsigned int tessU = token.toInt();
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int tessV = atoi(token.c_str());
+            const unsigned int tessV = token.toInt();
 
             // Theta is in the range [0.0f, 1.0f] and 1.0f means closed sphere, smaller values open the noth pole.
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const float theta = float(atof(token.c_str()));
+            const float theta = float(token.toFloat());
 
             std::string nameMaterialReference;
             tokenType = parser.getNextToken(nameMaterialReference);
 
-            std::ostringstream keyGeometry;
-            keyGeometry << "sphere_" << tessU << "_" << tessV << "_" << theta;
+            // Closed spheres are analytic primitives. The tessellation is ignored.
+            if (1.0f <= theta)
+            {
+              std::shared_ptr<sg::Primitive> primitive;
 
-            std::shared_ptr<sg::Triangles> geometry;
+              std::map<std::string, unsigned int>::const_iterator itp = m_mapPrimitives.find(std::string("sphere"));
+              if (itp == m_mapPrimitives.end())
+              {
+                m_mapPrimitives[std::string("sphere")] = static_cast<unsigned int>(m_primitives.size());
 
-            std::map<std::string, unsigned int>::const_iterator itg = m_mapGeometries.find(keyGeometry.str());
-            if (itg == m_mapGeometries.end())
-            {
-              m_mapGeometries[keyGeometry.str()] = m_idGeometry;
+                primitive = std::make_shared<sg::Primitive>(m_idGeometry++);
+                primitive->createSphere(1.0f);
 
-              geometry = std::make_shared<sg::Triangles>(m_idGeometry++);
-              geometry->createSphere(tessU, tessV, 1.0f, theta * M_PIf);
+                m_primitives.push_back(primitive);
+              }
+              else
+              {
+                primitive = m_primitives[itp->second];
+              }
 
-              m_geometries.push_back(geometry);
+              appendInstance(m_root, m_scene.addPrimitive(primitive), curMatrix, nameMaterialReference);
             }
             else
             {
-              geometry = m_geometries[itg->second];
+              ProceduralGeometry procedural;
+
+              procedural.type              = PROCEDURAL_SPHERE;
+              procedural.tessU             = tessU;
+              procedural.tessV             = tessV;
+              procedural.upAxis            = 0;
+              procedural.theta             = theta;
+              procedural.innerRadius       = 0.0f;
+              procedural.outerRadius       = 0.0f;
+              procedural.spatialSplitAlpha = curSpatialSplitAlpha;
+
+              appendProcedural(procedural, curMatrix, nameMaterialReference);
             }
-
-            appendInstance(m_scene, geometry, curMatrix, nameMaterialReference, m_idInstance);
           }
           else if (token == "torus")
           {
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int tessU = atoi(token.c_str());
+            const unsigned int tessU = token.toInt();
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const unsigned int tessV = atoi(token.c_str());
+            const unsigned int tessV = token.toInt();
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const float innerRadius = float(atof(token.c_str()));
+            const float innerRadius = float(token.toFloat());
 
             tokenType = parser.getNextToken(token);
             MY_ASSERT(tokenType == PTT_VAL);
-            const float outerRadius = float(atof(token.c_str()));
+            const float outerRadius = float(token.toFloat());
 
             std::string nameMaterialReference;
             tokenType = parser.getNextToken(nameMaterialReference);
 
-            std::ostringstream keyGeometry;
-            keyGeometry << "torus_" << tessU << "_" << tessV << "_" << innerRadius << "_" << outerRadius;
-
-            std::shared_ptr<sg::Triangles> geometry;
-
-            std::map<std::string, unsigned int>::const_iterator itg = m_mapGeometries.find(keyGeometry.str());
-            if (itg == m_mapGeometries.end())
-            {
-              m_mapGeometries[keyGeometry.str()] = m_idGeometry;
-
-              geometry = std::make_shared<sg::Triangles>(m_idGeometry++);
-              geometry->createTorus(tessU, tessV, innerRadius, outerRadius);
+            ProceduralGeometry procedural;
 
-              m_geometries.push_back(geometry);
-            }
-            else
-            {
-              geometry = m_geometries[itg->second];
-            }
+            procedural.type              = PROCEDURAL_TORUS;
+            procedural.tessU             = tessU;
+            procedural.tessV             = tessV;
+            procedural.upAxis            = 0;
+            procedural.theta             = 0.0f;
+            procedural.innerRadius       = innerRadius;
+            procedural.outerRadius       = outerRadius;
+            procedural.spatialSplitAlpha = curSpatialSplitAlpha;
 
-            appendInstance(m_scene, geometry, curMatrix, nameMaterialReference, m_idInstance);
+            appendProcedural(procedural, curMatrix, nameMaterialReference);
           }
           else if (token == "assimp")
           {
@@ -1841,7 +3081,10 @@ bool Application::loadSceneDescription(std::string const& filename)
             MY_ASSERT(tokenType == PTT_ID);
             convertPath(filenameModel);
 
-            std::shared_ptr<sg::Group> model = createASSIMP(filenameModel);
+            m_sceneDependencies.push_back(filenameModel);
+
+            // Instanced models keep the spatial split option of their first use.
+            const sg::NodeHandle model = createASSIMP(filenameModel, curSpatialSplitAlpha);
 
             // nvpro-pipeline matrices are row-major multiplied from the right, means the translation is in the last row. Transpose!
             const float trafo[12] =
@@ -1856,11 +3099,29 @@ bool Application::loadSceneDescription(std::string const& filename)
                       curMatrix[2][3] == 0.0f &&
                       curMatrix[3][3] == 1.0f);
 
-            std::shared_ptr<sg::Instance> instance(new sg::Instance(m_idInstance++));
-            instance->setTransform(trafo);
-            instance->setChild(model);
+            sg::NodeHandle child = model;
+
+            // InstanceArrays only hold geometry. Grids and scatters of whole models are one Instance per element below a Group.
+            if (!m_arrayTransforms.empty())
+            {
+              child = m_scene.createGroup();
+
+              for (size_t i = 0; i < m_arrayTransforms.size(); i += 12)
+              {
+                const sg::NodeHandle element = m_scene.createInstance();
+                m_scene.setTransform(element, &m_arrayTransforms[i]);
+                m_scene.setChild(element, model);
 
-            m_scene->addChild(instance);
+                m_scene.addChild(child, element);
+              }
+              m_arrayTransforms.clear();
+            }
+
+            const sg::NodeHandle instance = m_scene.createInstance();
+            m_scene.setTransform(instance, trafo);
+            m_scene.setChild(instance, child);
+
+            m_scene.addChild(m_root, instance);
           }
           break;
 
@@ -1872,7 +3133,17 @@ bool Application::loadSceneDescription(std::string const& filename)
     }
   }
 
-  std::cout << "loadSceneDescription(): m_idGroup = " << m_idGroup << ", m_idInstance = " << m_idInstance << ", m_idGeometry = " << m_idGeometry << std::endl;
+  if (!m_arrayTransforms.empty())
+  {
+    std::cerr << "WARNING: loadSceneDescription() grid or scatter without following model ignored." << std::endl;
+    m_arrayTransforms.clear();
+  }
+
+  importModels(); // Fills the groups of all models.
+
+  appendProceduralInstances(); // The deferred instances of the tessellation level-of-detail.
+
+  std::cout << "loadSceneDescription(): groups = " << m_scene.getNumGroups() << ", instances = " << m_scene.getNumInstances() << ", instance arrays = " << m_scene.getNumInstanceArrays() << ", m_idGeometry = " << m_idGeometry << std::endl;
 
   return true;
 }
@@ -2012,36 +3283,6 @@ std::string Application::getDateTime()
 }
 
 
-static void updateAABB(float3& minimum, float3& maximum, float3 const& v)
-{
-  if (v.x < minimum.x)
-  {
-    minimum.x = v.x;
-  }
-  else if (maximum.x < v.x)
-  {
-    maximum.x = v.x;
-  }
-
-  if (v.y < minimum.y)
-  {
-    minimum.y = v.y;
-  }
-  else if (maximum.y < v.y)
-  {
-    maximum.y = v.y;
-  }
-
-  if (v.z < minimum.z)
-  {
-    minimum.z = v.z;
-  }
-  else if (maximum.z < v.z)
-  {
-    maximum.z = v.z;
-  }
-}
-
 //static void calculateTexcoordsSpherical(std::vector<InterleavedHost>& attributes, std::vector<unsigned int> const& indices)
 //{
 //  dp::math::Vec3f center(0.0f, 0.0f, 0.0f);
@@ -2145,27 +3386,47 @@ static void updateAABB(float3& minimum, float3& maximum, float3 const& v)
 //}
 
 
-// Calculate (geometry) tangents with the global tangent direction aligned to the biggest AABB extend of this part.
-void Application::calculateTangents(std::vector<TriangleAttributes>& attributes, std::vector<unsigned int> const& indices)
+// Bounds of the vertices referenced by the triangles [first, last). Accumulates into aabbLo and aabbHi, so ranges can be merged.
+// With SSE each gathered vertex costs one load, min and max. The fourth lane holds the tangent.x behind the vertex and is ignored.
+void Application::getIndexedBounds(std::vector<TriangleAttributes> const& attributes, std::vector<unsigned int> const& indices,
+                                   const size_t first, const size_t last, float3& aabbLo, float3& aabbHi)
 {
-  MY_ASSERT(3 <= indices.size());
+#if defined(APPLICATION_SSE)
+  const TriangleAttributes* src = attributes.data();
 
-  // Initialize with the first vertex to be able to use else-if comparisons in updateAABB().
-  float3 aabbLo = attributes[indices[0]].vertex;
-  float3 aabbHi = attributes[indices[0]].vertex;
+  __m128 lo = _mm_setr_ps(aabbLo.x, aabbLo.y, aabbLo.z, aabbLo.z);
+  __m128 hi = _mm_setr_ps(aabbHi.x, aabbHi.y, aabbHi.z, aabbHi.z);
 
-  // Build an axis aligned bounding box.
-  for (size_t i = 0; i < indices.size(); i += 3)
+  for (size_t i = first * 3; i < last * 3; ++i)
+  {
+    const __m128 v = _mm_loadu_ps(&src[indices[i]].vertex.x);
+
+    // The second operand is returned for NaN inputs, which ignores NaN vertices like fminf() and fmaxf().
+    lo = _mm_min_ps(v, lo);
+    hi = _mm_max_ps(v, hi);
+  }
+
+  float bounds[8];
+
+  _mm_storeu_ps(bounds,     lo);
+  _mm_storeu_ps(bounds + 4, hi);
+
+  aabbLo = make_float3(bounds[0], bounds[1], bounds[2]);
+  aabbHi = make_float3(bounds[4], bounds[5], bounds[6]);
+#else
+  for (size_t i = first * 3; i < last * 3; ++i)
   {
-    unsigned int i0 = indices[i    ];
-    unsigned int i1 = indices[i + 1];
-    unsigned int i2 = indices[i + 2];
+    float3 const& v = attributes[indices[i]].vertex;
 
-    updateAABB(aabbLo, aabbHi, attributes[i0].vertex);
-    updateAABB(aabbLo, aabbHi, attributes[i1].vertex);
-    updateAABB(aabbLo, aabbHi, attributes[i2].vertex);
+    aabbLo = fminf(aabbLo, v);
+    aabbHi = fmaxf(aabbHi, v);
   }
+#endif
+}
 
+// The global tangent direction is aligned to the biggest AABB extend.
+void Application::getTangentDirections(float3 const& aabbLo, float3 const& aabbHi, float3& direction, float3& bidirection)
+{
   // Get the longest extend and use that as general tangent direction.
   const float3 extents = aabbHi - aabbLo;
 
@@ -2182,9 +3443,6 @@ void Application::calculateTangents(std::vector<TriangleAttributes>& attributes,
     maxComponent = 2;
   }
 
-  float3 direction;
-  float3 bidirection;
-
   switch (maxComponent)
   {
   case 0: // x-axis
@@ -2201,9 +3459,134 @@ void Application::calculateTangents(std::vector<TriangleAttributes>& attributes,
     bidirection = make_float3(0.0f, 1.0f,  0.0f);
     break;
   }
+}
+
+#if defined(APPLICATION_SSE)
+namespace
+{
+  // Four float3 in SoA layout.
+  struct Float3x4
+  {
+    __m128 x;
+    __m128 y;
+    __m128 z;
+  };
+
+  // Same operation order as the float3 functions, so the results match the scalar code exactly.
+  inline Float3x4 cross(Float3x4 const& a, Float3x4 const& b)
+  {
+    Float3x4 r;
+
+    r.x = _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y));
+    r.y = _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z));
+    r.z = _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x));
+
+    return r;
+  }
+
+  inline __m128 dot(Float3x4 const& a, Float3x4 const& b)
+  {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+  }
+
+  inline Float3x4 normalize(Float3x4 const& v)
+  {
+    const __m128 invLen = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot(v, v)));
+
+    Float3x4 r;
+
+    r.x = _mm_mul_ps(v.x, invLen);
+    r.y = _mm_mul_ps(v.y, invLen);
+    r.z = _mm_mul_ps(v.z, invLen);
+
+    return r;
+  }
+
+  inline Float3x4 splat(float3 const& v)
+  {
+    Float3x4 r;
+
+    r.x = _mm_set1_ps(v.x);
+    r.y = _mm_set1_ps(v.y);
+    r.z = _mm_set1_ps(v.z);
+
+    return r;
+  }
+
+  // Lanes with the mask set take a, the others b.
+  inline __m128 blend(const __m128 mask, const __m128 a, const __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  // 1.0f - fabsf(d) greater than 0.001f.
+  inline __m128 isNotCollinear(const __m128 d)
+  {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    return _mm_cmplt_ps(_mm_set1_ps(0.001f), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_and_ps(d, absMask)));
+  }
+} // namespace
+#endif
+
+// Build an ortho-normal basis with the existing normal of the vertices [first, last).
+// With SSE four vertices at a time: The normals are transposed into SoA layout, both cases of the scalar branch are evaluated and blended.
+void Application::setTangents(std::vector<TriangleAttributes>& attributes, const size_t first, const size_t last, float3 const& direction, float3 const& bidirection)
+{
+  size_t i = first;
+
+#if defined(APPLICATION_SSE)
+  const Float3x4 tangent4   = splat(direction);
+  const Float3x4 bitangent4 = splat(bidirection);
+
+  for (; i + 4 <= last; i += 4)
+  {
+    // The fourth lane of each load is the texcoord.x behind the normal.
+    __m128 n0 = _mm_loadu_ps(&attributes[i    ].normal.x);
+    __m128 n1 = _mm_loadu_ps(&attributes[i + 1].normal.x);
+    __m128 n2 = _mm_loadu_ps(&attributes[i + 2].normal.x);
+    __m128 n3 = _mm_loadu_ps(&attributes[i + 3].normal.x);
+
+    _MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+
+    Float3x4 normal;
+
+    normal.x = n0;
+    normal.y = n1;
+    normal.z = n2;
+
+    const __m128 mask = isNotCollinear(dot(normal, tangent4));
+
+    MY_ASSERT((_mm_movemask_ps(_mm_or_ps(mask, isNotCollinear(dot(bitangent4, normal)))) & 15) == 15);
+
+    // Not collinear.
+    const Float3x4 bitangent = normalize(cross(normal, tangent4));
+    const Float3x4 tangentA  = normalize(cross(bitangent, normal));
+    // Normal and tangent direction too collinear.
+    const Float3x4 tangentB  = normalize(cross(bitangent4, normal));
+
+    __m128 t0 = blend(mask, tangentA.x, tangentB.x);
+    __m128 t1 = blend(mask, tangentA.y, tangentB.y);
+    __m128 t2 = blend(mask, tangentA.z, tangentB.z);
+    __m128 t3 = _mm_setzero_ps();
+
+    _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+    float tangents[16];
+
+    _mm_storeu_ps(tangents,      t0);
+    _mm_storeu_ps(tangents +  4, t1);
+    _mm_storeu_ps(tangents +  8, t2);
+    _mm_storeu_ps(tangents + 12, t3);
+
+    for (size_t k = 0; k < 4; ++k)
+    {
+      attributes[i + k].tangent = make_float3(tangents[k * 4], tangents[k * 4 + 1], tangents[k * 4 + 2]);
+    }
+  }
+#endif
 
-  // Build an ortho-normal basis with the existing normal.
-  for (size_t i = 0; i < attributes.size(); ++i)
+  for (; i < last; ++i)
   {
     float3 tangent   = direction;
     float3 bitangent = bidirection;
@@ -2228,6 +3611,27 @@ void Application::calculateTangents(std::vector<TriangleAttributes>& attributes,
   }
 }
 
+// Calculate (geometry) tangents with the global tangent direction aligned to the biggest AABB extend of this part.
+// The model import runs the same three steps in parallel chunks.
+void Application::calculateTangents(std::vector<TriangleAttributes>& attributes, std::vector<unsigned int> const& indices)
+{
+  MY_ASSERT(3 <= indices.size());
+
+  // Initialize with the first vertex.
+  float3 aabbLo = attributes[indices[0]].vertex;
+  float3 aabbHi = attributes[indices[0]].vertex;
+
+  // Build an axis aligned bounding box.
+  getIndexedBounds(attributes, indices, 0, indices.size() / 3, aabbLo, aabbHi);
+
+  float3 direction;
+  float3 bidirection;
+
+  getTangentDirections(aabbLo, aabbHi, direction, bidirection);
+
+  setTangents(attributes, 0, attributes.size(), direction, bidirection);
+}
+
 bool Application::screenshot(const bool tonemap)
 {
   ILboolean hasImage = false;
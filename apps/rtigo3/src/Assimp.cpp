@@ -27,6 +27,8 @@
  */
 
 #include "inc/Application.h"
+#include "inc/AssimpModel.h"
+#include "inc/ThreadPool.h"
 
 #include <dp/math/math.h>
 #include <dp/math/Vecnt.h>
@@ -34,6 +36,7 @@
 #include <dp/math/Quatt.h>
 #include <dp/math/Trafo.h>
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -44,37 +47,124 @@
 #include "inc/MyAssert.h"
 
 
-std::shared_ptr<sg::Group> Application::createASSIMP(std::string const& filename)
+// Flattens the node hierarchy in the same depth first order traverseModel() consumes it.
+static void gatherNodes(const struct aiNode* node, std::vector<AssimpCacheNode>& nodes, std::vector<unsigned int>& nodeMeshes)
 {
-  std::map< std::string, std::shared_ptr<sg::Group> >::const_iterator itGroup = m_mapGroups.find(filename);
-  if (itGroup != m_mapGroups.end())
+  aiMatrix4x4 const& m = node->mTransformation;
+
+  AssimpCacheNode cacheNode;
+
+  cacheNode.trafo[ 0] = float(m.a1);
+  cacheNode.trafo[ 1] = float(m.a2);
+  cacheNode.trafo[ 2] = float(m.a3);
+  cacheNode.trafo[ 3] = float(m.a4);
+  cacheNode.trafo[ 4] = float(m.b1);
+  cacheNode.trafo[ 5] = float(m.b2);
+  cacheNode.trafo[ 6] = float(m.b3);
+  cacheNode.trafo[ 7] = float(m.b4);
+  cacheNode.trafo[ 8] = float(m.c1);
+  cacheNode.trafo[ 9] = float(m.c2);
+  cacheNode.trafo[10] = float(m.c3);
+  cacheNode.trafo[11] = float(m.c4);
+
+  cacheNode.numChildren = node->mNumChildren;
+  cacheNode.firstMesh   = static_cast<unsigned int>(nodeMeshes.size());
+  cacheNode.numMeshes   = node->mNumMeshes;
+
+  nodes.push_back(cacheNode);
+
+  for (unsigned int iMesh = 0; iMesh < node->mNumMeshes; ++iMesh)
   {
-    return itGroup->second; // Full model instancing under an Instance node.
+    nodeMeshes.push_back(node->mMeshes[iMesh]);
   }
 
-  std::ifstream fin(filename);
-  if (!fin.fail())
+  for (unsigned int iChild = 0; iChild < node->mNumChildren; ++iChild)
   {
-    fin.close(); // Ok, file found.
+    gatherNodes(node->mChildren[iChild], nodes, nodeMeshes);
   }
-  else
+}
+
+
+// Only reserves the group of the model while parsing. importModels() fills it after the scene description has been parsed.
+sg::NodeHandle Application::createASSIMP(std::string const& filename, const float spatialSplitAlpha)
+{
+  std::map<std::string, sg::NodeHandle>::const_iterator itGroup = m_mapGroups.find(filename);
+  if (itGroup != m_mapGroups.end())
   {
-    std::cerr << "createASSIMP() could not open " << filename << std::endl;
+    return itGroup->second; // Full model instancing under an Instance node.
+  }
+
+  std::shared_ptr<AssimpModel> model(new AssimpModel);
+
+  model->filename          = filename;
+  model->group             = m_scene.createGroup();
+  model->spatialSplitAlpha = spatialSplitAlpha;
+  model->references        = m_mapMaterialReferences; // Later material definitions with the same name must not change this model.
+
+  m_models.push_back(model);
+
+  m_mapGroups[filename] = model->group; // Allow instancing of this whole model.
+
+  return model->group;
+}
 
-    // Generate a Group node in any case. It will not have children when the file loading fails. 
-    std::shared_ptr<sg::Group> group(new sg::Group(m_idGroup++));
-    m_mapGroups[filename] = group; // Allow instancing of this whole model (to fail again quicker next time).
-    return group;
+// Imports all models of the scene description concurrently, then creates their geometries and nodes in scene description order.
+// That keeps the geometry IDs and the scene graph independent of the thread timing.
+void Application::importModels()
+{
+  if (m_models.empty())
+  {
+    return;
   }
 
   Assimp::Logger::LogSeverity severity = Assimp::Logger::NORMAL; // or Assimp::Logger::VERBOSE;
 
+  // The logger is global. Create it once for all importer threads.
   Assimp::DefaultLogger::create("", severity, aiDefaultLogStream_STDOUT);               // Create a logger instance for Console Output
   //Assimp::DefaultLogger::create("assimp_log.txt", severity, aiDefaultLogStream_FILE); // Create a logger instance for File Output (found in project folder or near .exe)
 
   Assimp::DefaultLogger::get()->info("Assimp::DefaultLogger initialized."); // Will add message with "info" tag.
   // Assimp::DefaultLogger::get()->debug(""); // Will add message with "debug" tag.
 
+  // The "threads" option is the budget for all importer threads together.
+  const unsigned int numModels  = static_cast<unsigned int>(m_models.size());
+  const unsigned int numCores   = (0 < m_numThreads) ? static_cast<unsigned int>(m_numThreads) : std::max(1u, std::thread::hardware_concurrency());
+  const unsigned int numThreads = std::min(numModels, numCores);
+
+  // The remaining budget splits the meshes inside each model. At most numCores threads run at any time.
+  const unsigned int numThreadsModel = std::max(1u, numCores / numThreads);
+
+  ThreadPool pool(numThreads);
+
+  pool.parallelFor(numModels, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    importASSIMP(*m_models[index], numThreadsModel);
+  });
+
+  Assimp::DefaultLogger::kill(); // Kill it after the work is done
+
+  for (unsigned int i = 0; i < numModels; ++i)
+  {
+    resolveASSIMP(*m_models[i]);
+  }
+
+  m_models.clear();
+}
+
+// Runs on the worker threads. Must not touch the scene graph, the geometry IDs or the materials.
+void Application::importASSIMP(AssimpModel& model, const unsigned int numThreads)
+{
+  std::ifstream fin(model.filename);
+  if (!fin.fail())
+  {
+    fin.close(); // Ok, file found.
+  }
+  else
+  {
+    std::cerr << "createASSIMP() could not open " << model.filename << std::endl;
+    return; // The group of the model stays empty.
+  }
+
   unsigned int postProcessSteps = 
       //aiProcess_CalcTangentSpace       |
       //aiProcess_JoinIdenticalVertices  |
@@ -107,27 +197,203 @@ std::shared_ptr<sg::Group> Application::createASSIMP(std::string const& filename
       //aiProcess_ForceGenNormals        |
       //aiProcess_DropNormals            |
 
-  Assimp::Importer importer;
+  std::string extension;
+  std::string::size_type last = model.filename.find_last_of('.');
+  if (last != std::string::npos)
+  {
+    extension = model.filename.substr(last, std::string::npos);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c){ return std::tolower(c); });
+  }
+
+  // OBJ and binary PLY files are read by the native importers in NativeImport.cpp, everything else by assimp.
+  const bool isNative = (extension == std::string(".obj") || extension == std::string(".ply"));
+
+  // The cache key covers the file contents and everything which changes the conversion.
+  // Files referenced by the model, like OBJ material libraries, are not part of the key.
+  unsigned long long key = 0;
+  bool isKeyValid = false;
+
+  if (m_geometryCache.isEnabled())
+  {
+    key = GeometryCache::hash("assimp", 6);
+    key = GeometryCache::hashValue(postProcessSteps, key);
+    key = GeometryCache::hashValue((isNative) ? NATIVE_IMPORT_VERSION : 0, key);
+    key = GeometryCache::hashValue(getMeshOptimizerVersion(), key);
+
+    isKeyValid = GeometryCache::hashFile(model.filename, key);
+    if (isKeyValid && loadASSIMP(key, model))
+    {
+      return;
+    }
+  }
+
+  Timer timer;
+  timer.start();
+
+  ThreadPool pool(numThreads); // The threads of this model.
+
+  std::vector< std::vector<TriangleAttributes> > attributes; // Per geometry.
+  std::vector< std::vector<unsigned int> >       indices;
+  std::vector<unsigned char>                     needsTangents;
 
-  const aiScene* scene = importer.ReadFile(filename, postProcessSteps);
+  bool isRead = false;
+
+  if (isNative)
+  {
+    // Falls back to assimp for files the native importers do not handle, like ASCII PLY.
+    isRead = (extension == std::string(".obj")) ? readOBJ(model, pool, attributes, indices) : readPLY(model, pool, attributes, indices);
+
+    needsTangents.assign(attributes.size(), 1); // Neither format stores tangents.
+  }
+  if (!isRead)
+  {
+    isRead = readASSIMP(model, pool, postProcessSteps, attributes, indices, needsTangents);
+  }
+  if (!isRead)
+  {
+    return; // The group of the model stays empty.
+  }
+
+  const double timeRead = timer.getTime();
+
+  const unsigned int numGeometries = static_cast<unsigned int>(attributes.size());
+
+  std::vector<AssimpImportChunk> chunksVertices;
+  std::vector<AssimpImportChunk> chunksTriangles;
+
+  for (unsigned int i = 0; i < numGeometries; ++i)
+  {
+    appendChunks(i, static_cast<unsigned int>(attributes[i].size()), chunksVertices);
+    appendChunks(i, static_cast<unsigned int>(indices[i].size() / 3), chunksTriangles);
+
+    needsTangents[i] = (needsTangents[i] && !indices[i].empty()) ? 1 : 0;
+  }
+
+  const unsigned int numChunksVertices  = static_cast<unsigned int>(chunksVertices.size());
+  const unsigned int numChunksTriangles = static_cast<unsigned int>(chunksTriangles.size());
+
+  // Geometry tangents for the meshes without tangents. Same result as calculateTangents(), split into chunks:
+  // The bounds per triangle chunk, reduced per geometry to the tangent directions, then the tangents per vertex chunk.
+  std::vector<float3> chunksLo(numChunksTriangles);
+  std::vector<float3> chunksHi(numChunksTriangles);
+
+  pool.parallelFor(numChunksTriangles, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksTriangles[index];
+
+    if (needsTangents[chunk.geometry])
+    {
+      std::vector<TriangleAttributes> const& src = attributes[chunk.geometry];
+
+      chunksLo[index] = src[indices[chunk.geometry][size_t(chunk.first) * 3]].vertex;
+      chunksHi[index] = chunksLo[index];
+
+      getIndexedBounds(src, indices[chunk.geometry], chunk.first, size_t(chunk.first) + chunk.count, chunksLo[index], chunksHi[index]);
+    }
+  });
+
+  std::vector<float3> directions(numGeometries);
+  std::vector<float3> bidirections(numGeometries);
+
+  for (unsigned int i = 0; i < numChunksTriangles; ++i)
+  {
+    const unsigned int geometry = chunksTriangles[i].geometry;
+
+    if (needsTangents[geometry])
+    {
+      // The chunks of a geometry are consecutive. Store the reduced bounds in the directions until all chunks are done.
+      if (chunksTriangles[i].first == 0)
+      {
+        directions[geometry]   = chunksLo[i];
+        bidirections[geometry] = chunksHi[i];
+      }
+      else
+      {
+        directions[geometry]   = fminf(directions[geometry], chunksLo[i]);
+        bidirections[geometry] = fmaxf(bidirections[geometry], chunksHi[i]);
+      }
+    }
+  }
+  for (unsigned int i = 0; i < numGeometries; ++i)
+  {
+    if (needsTangents[i])
+    {
+      const float3 aabbLo = directions[i];
+      const float3 aabbHi = bidirections[i];
+
+      getTangentDirections(aabbLo, aabbHi, directions[i], bidirections[i]);
+    }
+  }
+
+  pool.parallelFor(numChunksVertices, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksVertices[index];
+
+    if (needsTangents[chunk.geometry])
+    {
+      setTangents(attributes[chunk.geometry], chunk.first, size_t(chunk.first) + chunk.count, directions[chunk.geometry], bidirections[chunk.geometry]);
+    }
+  });
+
+  const double timeTangents = timer.getTime();
+
+  model.geometries.resize(numGeometries);
+
+  pool.parallelFor(numGeometries, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    std::shared_ptr<sg::Triangles> geometry(new sg::Triangles(0));
+    geometry->setAttributes(attributes[index]);
+    geometry->setIndices(indices[index]);
+
+    // Release the converted data before the mesh optimizer allocates its buffers.
+    std::vector<TriangleAttributes>().swap(attributes[index]);
+    std::vector<unsigned int>().swap(indices[index]);
+
+    optimizeGeometry(geometry);
+
+    model.geometries[index] = geometry;
+  });
+
+  const double timeOptimize = timer.getTime();
+
+  if (isKeyValid)
+  {
+    storeASSIMP(key, model);
+  }
+
+  // One output per model, the imports run concurrently.
+  std::ostringstream timing;
+
+  timing << "importASSIMP() " << model.filename << " (" << pool.getNumThreads() << " threads): read = " << timeRead
+         << " s, tangents = " << timeTangents - timeRead
+         << " s, optimize = " << timeOptimize - timeTangents
+         << " s, store = " << timer.getTime() - timeOptimize << " s" << std::endl;
+
+  std::cout << timing.str();
+}
+
+// Converts the model with the assimp importer. Returns false when assimp could not read the file.
+bool Application::readASSIMP(AssimpModel& model, ThreadPool& pool, const unsigned int postProcessSteps,
+                             std::vector< std::vector<TriangleAttributes> >& attributes,
+                             std::vector< std::vector<unsigned int> >& indices,
+                             std::vector<unsigned char>& needsTangents)
+{
+  Assimp::Importer importer; // One importer per thread.
+
+  const aiScene* scene = importer.ReadFile(model.filename, postProcessSteps);
 
   // If the import failed, report it
   if (!scene)
   {
     Assimp::DefaultLogger::get()->info(importer.GetErrorString());
-    Assimp::DefaultLogger::kill(); // Kill it after the work is done
-
-    std::shared_ptr<sg::Group> group(new sg::Group(m_idGroup++));
-    m_mapGroups[filename] = group; // Allow instancing of this whole model (to fail again quicker next time).
-    return group;
+    return false;
   }
 
-  // Each scene needs to know where its geometries begin in the m_geometries to calculate the correct mesh index in traverseScene()
-  const unsigned int indexSceneBase = static_cast<unsigned int>(m_geometries.size());
+  // Create all geometries in the assimp scene with triangle data. Ignore the others and remap their geometry indices.
+  std::vector<const aiMesh*> sources; // The assimp mesh of each geometry.
 
-  m_remappedMeshIndices.clear(); // Clear the local remapping vector from iMesh to m_geometries index.
+  model.meshes.resize(scene->mNumMeshes);
 
-  // Create all geometries in the assimp scene with triangle data. Ignore the others and remap their geometry indices.
   for (unsigned int iMesh = 0; iMesh < scene->mNumMeshes; ++iMesh)
   {
     const aiMesh* mesh = scene->mMeshes[iMesh];
@@ -137,182 +403,363 @@ std::shared_ptr<sg::Group> Application::createASSIMP(std::string const& filename
     // The post-processor took care of meshes per primitive type.
     if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE && 2 < mesh->mNumVertices)
     {
-      std::vector<TriangleAttributes> attributes(mesh->mNumVertices);
-      
-      bool needsTangents  = false;
-      bool needsNormals   = false;
-      bool needsTexcoords = false;
+      remapMeshToGeometry = static_cast<unsigned int>(sources.size());
 
-      for (unsigned int iVertex = 0; iVertex < mesh->mNumVertices; ++iVertex)
-      {
-        TriangleAttributes& attrib = attributes[iVertex];
-
-        aiVector3D const& v = mesh->mVertices[iVertex];
-        attrib.vertex = make_float3(v.x, v.y, v.z);
-
-        if (mesh->HasTangentsAndBitangents())
-        {
-          aiVector3D const& t = mesh->mTangents[iVertex];
-          attrib.tangent = make_float3(t.x, t.y, t.z);
-        }
-        else
-        {
-          needsTangents = true;
-          attrib.tangent = make_float3(1.0f, 0.0f, 0.0f);
-        }
-
-        if (mesh->HasNormals())
-        {
-          aiVector3D const& n = mesh->mNormals[iVertex];
-          attrib.normal = make_float3(n.x, n.y, n.z);
-        }
-        else
-        {
-          needsNormals = true;
-          attrib.normal = make_float3(0.0f, 0.0f, 1.0f);
-        }
-
-        if (mesh->HasTextureCoords(0))
-        {
-          aiVector3D const& t = mesh->mTextureCoords[0][iVertex];
-          attrib.texcoord = make_float3(t.x, t.y, t.z);
-        }
-        else
-        {
-          needsTexcoords = true;
-          attrib.texcoord = make_float3(0.0f, 0.0f, 0.0f);
-        }
-      }
+      sources.push_back(mesh);
+    }
+
+    model.meshes[iMesh].geometry = remapMeshToGeometry;
+    model.meshes[iMesh].material = mesh->mMaterialIndex;
+  }
+
+  const unsigned int numGeometries = static_cast<unsigned int>(sources.size());
+
+  attributes.resize(numGeometries);
+  indices.resize(numGeometries);
+  needsTangents.resize(numGeometries);
+
+  std::vector<AssimpImportChunk> chunksVertices;
+  std::vector<AssimpImportChunk> chunksTriangles;
+
+  for (unsigned int i = 0; i < numGeometries; ++i)
+  {
+    attributes[i].resize(sources[i]->mNumVertices);
+    indices[i].resize(size_t(sources[i]->mNumFaces) * 3); // aiProcess_Triangulate, three indices per face.
+
+    needsTangents[i] = (sources[i]->HasTangentsAndBitangents()) ? 0 : 1;
+
+    appendChunks(i, sources[i]->mNumVertices, chunksVertices);
+    appendChunks(i, sources[i]->mNumFaces, chunksTriangles);
+  }
+
+  const unsigned int numChunksVertices  = static_cast<unsigned int>(chunksVertices.size());
+  const unsigned int numChunksTriangles = static_cast<unsigned int>(chunksTriangles.size());
+
+  pool.parallelFor(numChunksVertices, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksVertices[index];
+
+    const aiMesh* mesh = sources[chunk.geometry];
+
+    const bool hasTangents  = mesh->HasTangentsAndBitangents();
+    const bool hasNormals   = mesh->HasNormals(); // Assimp generates missing normals with the aiProcess_GenSmoothNormals flag.
+    const bool hasTexcoords = mesh->HasTextureCoords(0);
 
-      std::vector<unsigned int> indices;
+    TriangleAttributes* dst = attributes[chunk.geometry].data();
 
-      for (unsigned int iFace = 0; iFace < mesh->mNumFaces; ++iFace)
+    for (unsigned int iVertex = chunk.first; iVertex < chunk.first + chunk.count; ++iVertex)
+    {
+      TriangleAttributes& attrib = dst[iVertex];
+
+      aiVector3D const& v = mesh->mVertices[iVertex];
+      attrib.vertex = make_float3(v.x, v.y, v.z);
+
+      if (hasTangents)
+      {
+        aiVector3D const& t = mesh->mTangents[iVertex];
+        attrib.tangent = make_float3(t.x, t.y, t.z);
+      }
+      else
       {
-        const struct aiFace* face = &mesh->mFaces[iFace];
-        MY_ASSERT(face->mNumIndices == 3);
+        attrib.tangent = make_float3(1.0f, 0.0f, 0.0f); // Replaced by the geometry tangents below.
+      }
 
-        for (unsigned int iIndex = 0; iIndex < face->mNumIndices; ++iIndex)
-        {
-          indices.push_back(face->mIndices[iIndex]);
-        }
+      if (hasNormals)
+      {
+        aiVector3D const& n = mesh->mNormals[iVertex];
+        attrib.normal = make_float3(n.x, n.y, n.z);
+      }
+      else
+      {
+        attrib.normal = make_float3(0.0f, 0.0f, 1.0f);
       }
 
-      //if (needsNormals) // Assimp handled that via the aiProcess_GenSmoothNormals flag.
-      //{
-      //  calculateNormals(attributes, indices);
-      //}
-      if (needsTangents)
+      if (hasTexcoords)
+      {
+        aiVector3D const& t = mesh->mTextureCoords[0][iVertex];
+        attrib.texcoord = make_float3(t.x, t.y, t.z);
+      }
+      else
       {
-        calculateTangents(attributes, indices); // This calculates geometry tangents though.
+        attrib.texcoord = make_float3(0.0f, 0.0f, 0.0f);
       }
+    }
+  });
+
+  pool.parallelFor(numChunksTriangles, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksTriangles[index];
+
+    const aiMesh* mesh = sources[chunk.geometry];
 
-      remapMeshToGeometry = static_cast<unsigned int>(m_geometries.size());
+    unsigned int* dst = indices[chunk.geometry].data() + size_t(chunk.first) * 3;
 
-      std::shared_ptr<sg::Triangles> geometry(new sg::Triangles(m_idGeometry++));
-      geometry->setAttributes(attributes);
-      geometry->setIndices(indices);
-      
-      m_geometries.push_back(geometry);
+    for (unsigned int iFace = chunk.first; iFace < chunk.first + chunk.count; ++iFace)
+    {
+      const struct aiFace* face = &mesh->mFaces[iFace];
+      MY_ASSERT(face->mNumIndices == 3);
+
+      dst[0] = face->mIndices[0];
+      dst[1] = face->mIndices[1];
+      dst[2] = face->mIndices[2];
+      dst += 3;
     }
+  });
+
+  model.materials.resize(scene->mNumMaterials);
 
-    m_remappedMeshIndices.push_back(remapMeshToGeometry); 
+  for (unsigned int iMaterial = 0; iMaterial < scene->mNumMaterials; ++iMaterial)
+  {
+    const struct aiMaterial* material = scene->mMaterials[iMaterial];
+
+    // Allow to specify different materials per assimp model by using the material name.
+    std::string name;
+    aiString materialName;
+    if (material->Get(AI_MATKEY_NAME, materialName) == aiReturn_SUCCESS)
+    {
+      name = std::string(materialName.C_Str());
+    }
+
+    aiColor4D diffuse;
+    const bool hasDiffuse = (material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == aiReturn_SUCCESS);
+
+    model.materials[iMaterial].diffuse    = make_float3(diffuse.r, diffuse.g, diffuse.b);
+    model.materials[iMaterial].hasDiffuse = (hasDiffuse) ? 1 : 0;
+    model.materials[iMaterial].offsetName = static_cast<unsigned int>(model.names.size());
+    model.materials[iMaterial].lengthName = static_cast<unsigned int>(name.size());
+
+    model.names += name;
   }
 
-  std::shared_ptr<sg::Group> group = traverseScene(scene, indexSceneBase, scene->mRootNode);
-  m_mapGroups[filename] = group; // Allow instancing of this whole model.
-  
-  Assimp::DefaultLogger::kill(); // Kill it after the work is done
+  gatherNodes(scene->mRootNode, model.nodes, model.nodeMeshes);
 
-  return group;
+  return true;
 }
-  
-std::shared_ptr<sg::Group> Application::traverseScene(const struct aiScene *scene, const unsigned int indexSceneBase, const struct aiNode* node)
+
+// Main thread, in scene description order.
+void Application::resolveASSIMP(AssimpModel& model)
 {
-  // Create a group to hold all children and all meshes of this node.
-  std::shared_ptr<sg::Group> group(new sg::Group(m_idGroup++));
+  if (model.nodes.empty())
+  {
+    return; // Failed import. Instances of the model get an empty group.
+  }
 
-  aiMatrix4x4 const& m = node->mTransformation;
+  const unsigned int indexSceneBase = static_cast<unsigned int>(m_geometries.size());
 
-  const float trafo[12] =
+  for (size_t i = 0; i < model.geometries.size(); ++i)
   {
-    float(m.a1), float(m.a2), float(m.a3), float(m.a4),
-    float(m.b1), float(m.b2), float(m.b3), float(m.b4),
-    float(m.c1), float(m.c2), float(m.c3), float(m.c4)
-  };
+    model.geometries[i]->setId(m_idGeometry++);
+    model.geometries[i]->setSpatialSplitAlpha(model.spatialSplitAlpha);
 
-  // Need to do a depth first traversal here to attach the bottom most nodes to each node's group.
-  for (unsigned int iChild = 0; iChild < node->mNumChildren; ++iChild)
+    m_geometries.push_back(model.geometries[i]);
+  }
+
+  // The material references as they were when the model appeared in the scene description.
+  m_mapMaterialReferences.swap(model.references);
+
+  unsigned int indexNode = 0;
+
+  traverseModel(model, indexSceneBase, indexNode, model.group);
+
+  m_mapMaterialReferences.swap(model.references);
+}
+
+int Application::getMaterialReference(std::string const& name, const float3* diffuse)
+{
+  int indexMaterial = -1;
+
+  std::map<std::string, int>::const_iterator itm = m_mapMaterialReferences.find(name);
+  if (itm != m_mapMaterialReferences.end())
   {
-    std::shared_ptr<sg::Group> child = traverseScene(scene, indexSceneBase, node->mChildren[iChild]);
+    indexMaterial = itm->second;
 
+    // The materials had been created with default albedo colors.
+    // Change it to the diffuse color of the assimp material.
+    if (diffuse != nullptr)
+    {
+      m_materialsGUI[indexMaterial].albedo = *diffuse;
+    }
+  }
+  else
+  {
+    std::cerr << "WARNING: traverseModel() No material found for " << name << ". Trying default." << std::endl;
+
+    std::map<std::string, int>::const_iterator itmd = m_mapMaterialReferences.find(std::string("default"));
+    if (itmd != m_mapMaterialReferences.end())
+    {
+      indexMaterial = itmd->second;
+    }
+    else 
+    {
+      std::cerr << "ERROR: loadSceneDescription() No default material found" << std::endl;
+    }
+  }
+
+  return indexMaterial;
+}
+
+
+// Fills the model from the cache without running the assimp importer. Runs on the worker threads.
+bool Application::loadASSIMP(const unsigned long long key, AssimpModel& model)
+{
+  std::shared_ptr<CacheFile> file = m_geometryCache.load(key);
+  if (!file || file->getNumBlobs() < ASSIMP_CACHE_FIRST_GEOMETRY || (file->getNumBlobs() - ASSIMP_CACHE_FIRST_GEOMETRY) % 2 != 0)
+  {
+    return false;
+  }
+
+  const unsigned int numGeometries = (file->getNumBlobs() - ASSIMP_CACHE_FIRST_GEOMETRY) / 2;
+
+  size_t sizeMeshes;
+  size_t sizeMaterials;
+  size_t sizeNames;
+  size_t sizeNodes;
+  size_t sizeNodeMeshes;
+
+  const AssimpCacheMesh*     meshes     = static_cast<const AssimpCacheMesh*>(file->getBlob(0, sizeMeshes));
+  const AssimpCacheMaterial* materials  = static_cast<const AssimpCacheMaterial*>(file->getBlob(1, sizeMaterials));
+  const char*                names      = static_cast<const char*>(file->getBlob(2, sizeNames));
+  const AssimpCacheNode*     nodes      = static_cast<const AssimpCacheNode*>(file->getBlob(3, sizeNodes));
+  const unsigned int*        nodeMeshes = static_cast<const unsigned int*>(file->getBlob(4, sizeNodeMeshes));
+
+  const size_t numMeshes     = sizeMeshes / sizeof(AssimpCacheMesh);
+  const size_t numMaterials  = sizeMaterials / sizeof(AssimpCacheMaterial);
+  const size_t numNodes      = sizeNodes / sizeof(AssimpCacheNode);
+  const size_t numNodeMeshes = sizeNodeMeshes / sizeof(unsigned int);
+
+  // Validate all indices before the model is filled.
+  bool isValid = (sizeMeshes     % sizeof(AssimpCacheMesh)     == 0 &&
+                  sizeMaterials  % sizeof(AssimpCacheMaterial) == 0 &&
+                  sizeNodes      % sizeof(AssimpCacheNode)     == 0 &&
+                  sizeNodeMeshes % sizeof(unsigned int)        == 0 &&
+                  numNodes != 0);
+
+  for (size_t i = 0; isValid && i < numMeshes; ++i)
+  {
+    isValid = (meshes[i].geometry < numGeometries || meshes[i].geometry == ~0u) && meshes[i].material < numMaterials;
+  }
+  for (size_t i = 0; isValid && i < numMaterials; ++i)
+  {
+    isValid = materials[i].offsetName <= sizeNames && materials[i].lengthName <= sizeNames - materials[i].offsetName;
+  }
+  for (size_t i = 0; isValid && i < numNodeMeshes; ++i)
+  {
+    isValid = nodeMeshes[i] < numMeshes;
+  }
+
+  // The depth first order is consistent when the tree closes exactly at the last node.
+  unsigned long long open = 1;
+  for (size_t i = 0; isValid && i < numNodes; ++i)
+  {
+    AssimpCacheNode const& node = nodes[i];
+
+    isValid = open != 0 && node.firstMesh <= numNodeMeshes && node.numMeshes <= numNodeMeshes - node.firstMesh;
+    open    = open - 1 + node.numChildren;
+  }
+  isValid = isValid && open == 0;
+
+  if (!isValid)
+  {
+    std::cerr << "ERROR: loadASSIMP() invalid cache entry " << std::hex << key << std::dec << std::endl;
+    return false;
+  }
+
+  std::vector< std::shared_ptr<sg::Triangles> > geometries(numGeometries);
+
+  for (unsigned int i = 0; i < numGeometries; ++i)
+  {
+    geometries[i] = std::make_shared<sg::Triangles>(0);
+
+    if (!loadTriangles(*file, ASSIMP_CACHE_FIRST_GEOMETRY + i * 2, geometries[i]))
+    {
+      std::cerr << "ERROR: loadASSIMP() invalid geometry in cache entry " << std::hex << key << std::dec << std::endl;
+      return false;
+    }
+  }
+
+  model.meshes.assign(meshes, meshes + numMeshes);
+  model.materials.assign(materials, materials + numMaterials);
+  model.names.assign(names, sizeNames);
+  model.nodes.assign(nodes, nodes + numNodes);
+  model.nodeMeshes.assign(nodeMeshes, nodeMeshes + numNodeMeshes);
+  model.geometries.swap(geometries);
+
+  return true;
+}
+
+void Application::storeASSIMP(const unsigned long long key, AssimpModel const& model)
+{
+  std::vector<CacheBlob> blobs(ASSIMP_CACHE_FIRST_GEOMETRY);
+
+  blobs[0].data = model.meshes.data();
+  blobs[0].size = model.meshes.size() * sizeof(AssimpCacheMesh);
+  blobs[1].data = model.materials.data();
+  blobs[1].size = model.materials.size() * sizeof(AssimpCacheMaterial);
+  blobs[2].data = model.names.data();
+  blobs[2].size = model.names.size();
+  blobs[3].data = model.nodes.data();
+  blobs[3].size = model.nodes.size() * sizeof(AssimpCacheNode);
+  blobs[4].data = model.nodeMeshes.data();
+  blobs[4].size = model.nodeMeshes.size() * sizeof(unsigned int);
+
+  for (size_t i = 0; i < model.geometries.size(); ++i)
+  {
+    appendTriangles(model.geometries[i], blobs);
+  }
+
+  m_geometryCache.store(key, blobs);
+}
+
+// Need to do a depth first traversal here to attach the bottom most nodes to each node's group.
+// The root node fills the group reserved by createASSIMP(), all other nodes create their own group after their subtrees.
+sg::NodeHandle Application::traverseModel(AssimpModel const& model, const unsigned int indexSceneBase, unsigned int& indexNode, sg::NodeHandle group)
+{
+  AssimpCacheNode const& node = model.nodes[indexNode++];
+
+  std::vector<sg::NodeHandle> children(node.numChildren);
+
+  for (unsigned int iChild = 0; iChild < node.numChildren; ++iChild)
+  {
+    children[iChild] = traverseModel(model, indexSceneBase, indexNode, SG_HANDLE_INVALID);
+  }
+
+  // Create a group to hold all children and all meshes of this node.
+  if (group == SG_HANDLE_INVALID)
+  {
+    group = m_scene.createGroup();
+  }
+
+  for (unsigned int iChild = 0; iChild < node.numChildren; ++iChild)
+  {
     // Create an instance which holds the subtree.
-    std::shared_ptr<sg::Instance> instance(new sg::Instance(m_idInstance++));
+    const sg::NodeHandle instance = m_scene.createInstance();
 
-    instance->setTransform(trafo);
-    instance->setChild(child);
+    m_scene.setTransform(instance, node.trafo);
+    m_scene.setChild(instance, children[iChild]);
 
-    group->addChild(instance); 
+    m_scene.addChild(group, instance); 
   }
 
   // Now also gather all meshes assigned to this node.
-  for (unsigned int iMesh = 0; iMesh < node->mNumMeshes; ++iMesh)
+  for (unsigned int iMesh = 0; iMesh < node.numMeshes; ++iMesh)
   {
-    const unsigned int indexMesh = node->mMeshes[iMesh];  // Original mesh index in the assimp scene.
-    MY_ASSERT(indexMesh < m_remappedMeshIndices.size())
+    AssimpCacheMesh const& mesh = model.meshes[model.nodeMeshes[node.firstMesh + iMesh]];
 
-    if (m_remappedMeshIndices[indexMesh] != ~0) // If there exists a Triangles geometry for this assimp mesh, then build the Instance.
+    if (mesh.geometry != ~0u) // If there exists a Triangles geometry for this assimp mesh, then build the Instance.
     {
-      const unsigned int indexGeometry = m_remappedMeshIndices[indexMesh];
-      
       // Create an instance with the current nodes transformation and append it to the parent group.
-      std::shared_ptr<sg::Instance> instance(new sg::Instance(m_idInstance++));
-      
-      instance->setTransform(trafo);
-      instance->setChild(m_geometries[indexGeometry]);
+      const sg::NodeHandle instance = m_scene.createInstance();
 
-      const struct aiMesh* mesh = scene->mMeshes[indexMesh];
+      m_scene.setTransform(instance, node.trafo);
+      m_scene.setChild(instance, m_scene.addTriangles(m_geometries[indexSceneBase + mesh.geometry]));
 
-      // Allow to specify different materials per assimp model by using the filename (no path no extension) and the material index.
-      struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+      AssimpCacheMaterial const& material = model.materials[mesh.material];
 
-      std::string nameMaterialReference;
-      aiString materialName;
-      if (material->Get(AI_MATKEY_NAME, materialName) == aiReturn_SUCCESS)
-      {
-        nameMaterialReference = std::string(materialName.C_Str());
-      }
+      const std::string nameMaterialReference(model.names.data() + material.offsetName, material.lengthName);
 
-      int indexMaterial = -1;
-      std::map<std::string, int>::const_iterator itm = m_mapMaterialReferences.find(nameMaterialReference);
-      if (itm != m_mapMaterialReferences.end())
-      {
-        indexMaterial = itm->second;
-        
-        // The materials had been created with default albedo colors.
-        // Change it to the diffuse color of the assimp material.
-        aiColor4D diffuse;
-        if (material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == aiReturn_SUCCESS)
-        {
-          m_materialsGUI[indexMaterial].albedo = make_float3(diffuse.r, diffuse.g, diffuse.b);
-        }
-      }
-      else
-      {
-        std::cerr << "WARNING: traverseScene() No material found for " << nameMaterialReference << ". Trying default." << std::endl;
-
-        std::map<std::string, int>::const_iterator itmd = m_mapMaterialReferences.find(std::string("default"));
-        if (itmd != m_mapMaterialReferences.end())
-        {
-          indexMaterial = itmd->second;
-        }
-        else 
-        {
-          std::cerr << "ERROR: loadSceneDescription() No default material found" << std::endl;
-        }
-      }
-      instance->setMaterial(indexMaterial);
+      m_scene.setMaterial(instance, getMaterialReference(nameMaterialReference, (material.hasDiffuse) ? &material.diffuse : nullptr));
 
-      group->addChild(instance);
+      m_scene.addChild(group, instance);
     }
   }
   return group;
@@ -0,0 +1,2978 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/BVH.h"
+
+#include "shaders/vector_math.h"
+
+#include "inc/MyAssert.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+
+// Triangles per chunk for the parallel bounds calculation and binning.
+#define BVH_CHUNK_SIZE 4096
+// Spatial splits stop when the references exceed this multiple of the triangles.
+#define BVH_MAX_REFERENCE_RATIO 1.5
+// Linear builds use Morton codes with 10 bits per axis up to this many primitives, 21 bits per axis above.
+#define BVH_MORTON_30_BIT_LIMIT (1u << 20)
+// Maximum leaves of the treelets which are restructured.
+#define BVH_TREELET_SIZE 9
+// Restructuring passes. The first one restructures all subtrees with at least BVH_TREELET_MIN_SIZE primitives, each further pass doubles that.
+#define BVH_TREELET_ROUNDS 2
+#define BVH_TREELET_MIN_SIZE 7
+
+
+// PERF Without fast math, fminf() and fmaxf() are library calls because of their NaN handling.
+// These compile to single min and max instructions. All values inside the build and the traversal are finite, safeInverse() clamps the ray direction reciprocals.
+static inline float minf(const float a, const float b)
+{
+  return (a < b) ? a : b;
+}
+
+static inline float maxf(const float a, const float b)
+{
+  return (a > b) ? a : b;
+}
+
+static inline float3 minf(float3 const& a, float3 const& b)
+{
+  return make_float3(minf(a.x, b.x), minf(a.y, b.y), minf(a.z, b.z));
+}
+
+static inline float3 maxf(float3 const& a, float3 const& b)
+{
+  return make_float3(maxf(a.x, b.x), maxf(a.y, b.y), maxf(a.z, b.z));
+}
+
+
+// ========== Build data
+
+struct BVHBounds
+{
+  BVHBounds()
+  : lo(make_float3(std::numeric_limits<float>::max()))
+  , hi(make_float3(-std::numeric_limits<float>::max()))
+  {
+  }
+
+  void grow(float3 const& p)
+  {
+    lo = minf(lo, p);
+    hi = maxf(hi, p);
+  }
+
+  void grow(BVHBounds const& b)
+  {
+    lo = minf(lo, b.lo);
+    hi = maxf(hi, b.hi);
+  }
+
+  float area() const
+  {
+    const float3 d = hi - lo;
+    if (d.x < 0.0f) // Empty.
+    {
+      return 0.0f;
+    }
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+
+  float3 lo;
+  float3 hi;
+};
+
+struct BVHBin
+{
+  BVHBin()
+  : count(0)
+  {
+  }
+
+  BVHBounds    bounds; // Triangle bounds.
+  unsigned int count;
+};
+
+// Temporary node of the build. Converted into the flattened BVHNode layout at the end.
+struct BVHBuildNode
+{
+  BVHBuildNode()
+  : left(0)
+  , right(0)
+  , begin(0)
+  , count(0)
+  , task(-1)
+  {
+  }
+
+  BVHBounds    bounds;
+  unsigned int left;   // Inner node children inside the same node vector.
+  unsigned int right;
+  unsigned int begin;  // Leaf primitive range.
+  unsigned int count;  // 0 for inner nodes.
+  int          task;   // Only in the top levels: Index of the task which built the subtree of this node.
+};
+
+// The range of primitives of a node which still needs to be split.
+struct BVHRange
+{
+  unsigned int node;
+  unsigned int begin;
+  unsigned int count;
+  unsigned int depth;
+  BVHBounds    bounds;
+  BVHBounds    centroids;
+};
+
+// Subtree built independently by one thread.
+struct BVHBuildTask
+{
+  BVHRange                  range;
+  std::vector<BVHBuildNode> nodes;
+};
+
+
+static inline int computeBin(const float centroid, const float lo, const float scale, const int numBins)
+{
+  const int bin = static_cast<int>((centroid - lo) * scale);
+  return std::min(std::max(bin, 0), numBins - 1);
+}
+
+// Inner node levels of a balanced subtree over count primitives with leaves of at most BVH_MAX_LEAF_SIZE.
+static inline unsigned int getBalancedLevels(const unsigned int count)
+{
+  unsigned int levels = 0;
+  while ((static_cast<unsigned long long>(BVH_MAX_LEAF_SIZE) << levels) < count)
+  {
+    ++levels;
+  }
+  return levels;
+}
+
+// Nodes split in the middle of their list once the remaining depth would not suffice for a balanced subtree anymore.
+// Leaves are never deeper than BVH_MAX_DEPTH - 2 and never bigger than BVH_MAX_LEAF_SIZE this way.
+static inline bool needsBalancing(const unsigned int count, const unsigned int depth)
+{
+  return BVH_MAX_DEPTH - 2 <= depth + getBalancedLevels(count);
+}
+
+static inline float getComponent(float3 const& v, const int axis)
+{
+  return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+}
+
+
+class BVHBuilder
+{
+public:
+  BVHBuilder(std::vector<BVHBounds> const& boxes,
+             std::vector<float3> const& centroids,
+             std::vector<unsigned int>& primitives,
+             ThreadPool* threadPool)
+  : m_boxes(boxes)
+  , m_centroids(centroids)
+  , m_primitives(primitives)
+  , m_threadPool(threadPool)
+  {
+  }
+
+  // Splits the range into two children. Returns false when the range should become a leaf.
+  bool split(BVHRange const& range, const bool parallel, BVHRange children[2]);
+
+  // Builds all nodes below the range. With a threshold, ranges with fewer primitives are not built but returned as tasks.
+  void build(BVHRange const& root, std::vector<BVHBuildNode>& nodes, const unsigned int threshold, std::vector<BVHBuildTask>* tasks);
+
+private:
+  void binPrimitives(BVHRange const& range, const float3 scale, const int numBins, const bool parallel, BVHBin bins[3][BVH_NUM_BINS]);
+
+private:
+  std::vector<BVHBounds>    const& m_boxes;
+  std::vector<float3>       const& m_centroids;
+  std::vector<unsigned int>&       m_primitives;
+  ThreadPool*                      m_threadPool;
+};
+
+
+void BVHBuilder::binPrimitives(BVHRange const& range, const float3 scale, const int numBins, const bool parallel, BVHBin bins[3][BVH_NUM_BINS])
+{
+  const float3 lo = range.centroids.lo;
+
+  const unsigned int numChunks = (range.count + BVH_CHUNK_SIZE - 1) / BVH_CHUNK_SIZE;
+
+  if (!parallel || m_threadPool == nullptr || numChunks < 2)
+  {
+    for (unsigned int i = range.begin; i < range.begin + range.count; ++i)
+    {
+      const unsigned int primitive = m_primitives[i];
+      const float3 c = m_centroids[primitive];
+
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        BVHBin& bin = bins[axis][computeBin(getComponent(c, axis), getComponent(lo, axis), getComponent(scale, axis), numBins)];
+        bin.bounds.grow(m_boxes[primitive]);
+        ++bin.count;
+      }
+    }
+    return;
+  }
+
+  // Each chunk bins into its own set of bins, which are reduced afterwards.
+  std::vector<BVHBin> chunkBins(numChunks * 3 * BVH_NUM_BINS);
+
+  m_threadPool->parallelFor(numChunks, [&](const unsigned int chunk, const unsigned int threadIndex)
+  {
+    BVHBin* local = &chunkBins[chunk * 3 * BVH_NUM_BINS];
+
+    const unsigned int begin = range.begin + chunk * BVH_CHUNK_SIZE;
+    const unsigned int end   = std::min(begin + BVH_CHUNK_SIZE, range.begin + range.count);
+
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      const unsigned int primitive = m_primitives[i];
+      const float3 c = m_centroids[primitive];
+
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        BVHBin& bin = local[axis * BVH_NUM_BINS + computeBin(getComponent(c, axis), getComponent(lo, axis), getComponent(scale, axis), numBins)];
+        bin.bounds.grow(m_boxes[primitive]);
+        ++bin.count;
+      }
+    }
+  });
+
+  for (unsigned int chunk = 0; chunk < numChunks; ++chunk)
+  {
+    const BVHBin* local = &chunkBins[chunk * 3 * BVH_NUM_BINS];
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      for (int b = 0; b < numBins; ++b)
+      {
+        BVHBin const& src = local[axis * BVH_NUM_BINS + b];
+        BVHBin&       dst = bins[axis][b];
+
+        dst.bounds.grow(src.bounds);
+        dst.count += src.count;
+      }
+    }
+  }
+}
+
+bool BVHBuilder::split(BVHRange const& range, const bool parallel, BVHRange children[2])
+{
+  if (range.count <= 1)
+  {
+    return false;
+  }
+
+  const float3 extent = range.centroids.hi - range.centroids.lo;
+
+  int   bestAxis = -1;
+  int   bestBin  = 0;
+  float bestCost = std::numeric_limits<float>::max();
+
+  if (!needsBalancing(range.count, range.depth) && (0.0f < extent.x || 0.0f < extent.y || 0.0f < extent.z))
+  {
+    // PERF Small ranges don't need all bins. Initializing and sweeping the bins dominates the build time of the lower levels.
+    const int numBins = std::min(static_cast<int>(range.count), BVH_NUM_BINS);
+
+    // Scale slightly below numBins to keep the maximum centroid inside the last bin.
+    const float f = float(numBins) * (1.0f - 1.0e-6f);
+    const float3 scale = make_float3((0.0f < extent.x) ? f / extent.x : 0.0f,
+                                     (0.0f < extent.y) ? f / extent.y : 0.0f,
+                                     (0.0f < extent.z) ? f / extent.z : 0.0f);
+
+    BVHBin bins[3][BVH_NUM_BINS];
+
+    binPrimitives(range, scale, numBins, parallel, bins);
+
+    const float invArea = 1.0f / std::max(range.bounds.area(), std::numeric_limits<float>::min());
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (getComponent(extent, axis) <= 0.0f)
+      {
+        continue;
+      }
+
+      // Sweep from the right to get the area and count of all right sides.
+      float        areaRight[BVH_NUM_BINS];
+      unsigned int countRight[BVH_NUM_BINS];
+
+      BVHBounds    bounds;
+      unsigned int count = 0;
+      for (int b = numBins - 1; 0 < b; --b)
+      {
+        bounds.grow(bins[axis][b].bounds);
+        count += bins[axis][b].count;
+        areaRight[b]  = bounds.area();
+        countRight[b] = count;
+      }
+
+      // Sweep from the left and evaluate the SAH for the split plane between bin b - 1 and b.
+      bounds = BVHBounds();
+      count  = 0;
+      for (int b = 1; b < numBins; ++b)
+      {
+        bounds.grow(bins[axis][b - 1].bounds);
+        count += bins[axis][b - 1].count;
+
+        if (count == 0 || countRight[b] == 0)
+        {
+          continue;
+        }
+
+        // Traversal cost 1, intersection cost 1 per triangle.
+        const float cost = 1.0f + (bounds.area() * float(count) + areaRight[b] * float(countRight[b])) * invArea;
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin  = b;
+        }
+      }
+    }
+
+    if (0 <= bestAxis)
+    {
+      if (range.count <= BVH_MAX_LEAF_SIZE && float(range.count) <= bestCost)
+      {
+        return false; // The SAH prefers the leaf.
+      }
+
+      BVHRange& left  = children[0];
+      BVHRange& right = children[1];
+
+      left.bounds     = BVHBounds();
+      left.centroids  = BVHBounds();
+      right.bounds    = BVHBounds();
+      right.centroids = BVHBounds();
+
+      for (int b = 0; b < numBins; ++b)
+      {
+        if (b < bestBin)
+        {
+          left.bounds.grow(bins[bestAxis][b].bounds);
+        }
+        else
+        {
+          right.bounds.grow(bins[bestAxis][b].bounds);
+        }
+      }
+
+      // Partition with the identical bin calculation as during binning to get the same counts.
+      // The children's centroid bounds are gathered on the way.
+      const float lo = getComponent(range.centroids.lo, bestAxis);
+      const float s  = getComponent(scale, bestAxis);
+
+      unsigned int* primitives = &m_primitives[range.begin];
+
+      unsigned int countLeft = 0;
+      unsigned int end       = range.count;
+
+      while (countLeft < end)
+      {
+        const float3 c = m_centroids[primitives[countLeft]];
+        if (computeBin(getComponent(c, bestAxis), lo, s, numBins) < bestBin)
+        {
+          left.centroids.grow(c);
+          ++countLeft;
+        }
+        else
+        {
+          right.centroids.grow(c);
+          std::swap(primitives[countLeft], primitives[--end]);
+        }
+      }
+
+      left.begin  = range.begin;
+      left.count  = countLeft;
+      right.begin = range.begin + countLeft;
+      right.count = range.count - countLeft;
+      left.depth  = range.depth + 1;
+      right.depth = range.depth + 1;
+      return true;
+    }
+  }
+
+  // All centroids are identical or the depth runs out, no SAH split possible.
+  if (range.count <= BVH_MAX_LEAF_SIZE)
+  {
+    return false;
+  }
+
+  // Split in the middle of the list to keep the leaves small.
+  BVHRange& left  = children[0];
+  BVHRange& right = children[1];
+
+  left.begin  = range.begin;
+  left.count  = range.count / 2;
+  right.begin = left.begin + left.count;
+  right.count = range.count - left.count;
+  left.depth  = range.depth + 1;
+  right.depth = range.depth + 1;
+
+  for (int i = 0; i < 2; ++i)
+  {
+    BVHRange& child = children[i];
+
+    child.bounds    = BVHBounds();
+    child.centroids = BVHBounds();
+    for (unsigned int j = child.begin; j < child.begin + child.count; ++j)
+    {
+      child.bounds.grow(m_boxes[m_primitives[j]]);
+      child.centroids.grow(m_centroids[m_primitives[j]]);
+    }
+  }
+  return true;
+}
+
+void BVHBuilder::build(BVHRange const& root, std::vector<BVHBuildNode>& nodes, const unsigned int threshold, std::vector<BVHBuildTask>* tasks)
+{
+  const bool parallel = (tasks != nullptr); // Only the top levels are built by the calling thread and can use the ThreadPool.
+
+  nodes.push_back(BVHBuildNode());
+  nodes.back().bounds = root.bounds;
+
+  std::vector<BVHRange> stack;
+
+  stack.push_back(root);
+  stack.back().node = 0;
+
+  while (!stack.empty())
+  {
+    const BVHRange range = stack.back();
+    stack.pop_back();
+
+    if (tasks != nullptr && range.count <= threshold)
+    {
+      nodes[range.node].task = static_cast<int>(tasks->size());
+
+      tasks->push_back(BVHBuildTask());
+      tasks->back().range      = range;
+      tasks->back().range.node = 0;
+      continue;
+    }
+
+    BVHRange children[2];
+
+    if (!split(range, parallel, children))
+    {
+      BVHBuildNode& leaf = nodes[range.node];
+      leaf.begin = range.begin;
+      leaf.count = range.count;
+      continue;
+    }
+
+    const unsigned int index = static_cast<unsigned int>(nodes.size());
+
+    nodes.push_back(BVHBuildNode());
+    nodes.push_back(BVHBuildNode());
+
+    nodes[index    ].bounds = children[0].bounds;
+    nodes[index + 1].bounds = children[1].bounds;
+
+    nodes[range.node].left  = index;
+    nodes[range.node].right = index + 1;
+
+    children[0].node = index;
+    children[1].node = index + 1;
+
+    stack.push_back(children[1]);
+    stack.push_back(children[0]);
+  }
+}
+
+
+// Flattens the top nodes and the task subtrees into the final node array with sibling pairs on cache line boundaries.
+static void flattenHierarchy(std::vector<BVHBuildNode> const& topNodes,
+                             std::vector<BVHBuildTask> const& tasks,
+                             std::vector< BVHNode, AlignedAllocator<BVHNode, 64> >& nodes)
+{
+  size_t numNodes = 1; // Padding. The root is either a top node or the root of the only task.
+  for (size_t i = 0; i < topNodes.size(); ++i)
+  {
+    numNodes += (topNodes[i].task < 0) ? 1 : 0;
+  }
+  for (size_t i = 0; i < tasks.size(); ++i)
+  {
+    numNodes += tasks[i].nodes.size();
+  }
+
+  nodes.reserve(numNodes);
+  nodes.resize(2);
+
+  struct FlattenItem
+  {
+    unsigned int dst;   // Index inside nodes.
+    int          task;  // -1 for the top nodes.
+    unsigned int src;   // Index inside the top nodes or task nodes.
+  };
+
+  std::vector<FlattenItem> stack;
+
+  FlattenItem item;
+  item.dst  = 0;
+  item.task = -1;
+  item.src  = 0;
+  stack.push_back(item);
+
+  while (!stack.empty())
+  {
+    item = stack.back();
+    stack.pop_back();
+
+    const BVHBuildNode* src = (item.task < 0) ? &topNodes[item.src] : &tasks[item.task].nodes[item.src];
+    if (0 <= src->task) // Placeholder of a subtree in the top nodes. Continue with the subtree root.
+    {
+      item.task = src->task;
+      item.src  = 0;
+      src = &tasks[item.task].nodes[0];
+    }
+
+    BVHNode& dst = nodes[item.dst];
+
+    dst.aabbMin = src->bounds.lo;
+    dst.aabbMax = src->bounds.hi;
+
+    if (src->count != 0)
+    {
+      dst.index = src->begin;
+      dst.count = src->count;
+    }
+    else
+    {
+      const unsigned int index = static_cast<unsigned int>(nodes.size());
+
+      dst.index = index;
+      dst.count = 0;
+
+      const unsigned int left  = src->left;
+      const unsigned int right = src->right;
+
+      nodes.resize(index + 2); // Invalidates dst and src is not used anymore.
+
+      FlattenItem child;
+      child.task = item.task;
+
+      child.dst = index + 1;
+      child.src = right;
+      stack.push_back(child);
+
+      child.dst = index;
+      child.src = left;
+      stack.push_back(child);
+    }
+  }
+
+  // Clear the unused padding node.
+  nodes[1].aabbMin = make_float3(0.0f);
+  nodes[1].aabbMax = make_float3(0.0f);
+  nodes[1].index   = 0;
+  nodes[1].count   = 0;
+
+  MY_ASSERT(nodes.size() == numNodes);
+}
+
+// Builds the hierarchy over the prepared primitive bounds and flattens it into the final node layout.
+static void buildHierarchy(std::vector<BVHBounds> const& boxes,
+                           std::vector<float3> const& centroids,
+                           BVHRange const& root,
+                           std::vector<unsigned int>& primitives,
+                           std::vector< BVHNode, AlignedAllocator<BVHNode, 64> >& nodes,
+                           ThreadPool* threadPool)
+{
+  const bool isParallel = (threadPool != nullptr && 1 < threadPool->getNumThreads());
+
+  BVHBuilder builder(boxes, centroids, primitives, threadPool);
+
+  // The top levels are split by this thread with parallel binning until the ranges are small enough to be distributed as subtree tasks.
+  // Aim for several tasks per thread to balance the uneven subtree sizes.
+  std::vector<BVHBuildNode> topNodes;
+  std::vector<BVHBuildTask> tasks;
+
+  if (isParallel)
+  {
+    const unsigned int threshold = std::max(root.count / (threadPool->getNumThreads() * 8), 1024u);
+
+    builder.build(root, topNodes, threshold, &tasks);
+
+    // Start the biggest tasks first.
+    std::vector<unsigned int> order(tasks.size());
+    for (unsigned int i = 0; i < static_cast<unsigned int>(order.size()); ++i)
+    {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&tasks](const unsigned int a, const unsigned int b)
+    {
+      return tasks[b].range.count < tasks[a].range.count;
+    });
+
+    threadPool->parallelFor(static_cast<unsigned int>(tasks.size()), [&](const unsigned int index, const unsigned int threadIndex)
+    {
+      BVHBuildTask& task = tasks[order[index]];
+      builder.build(task.range, task.nodes, 0, nullptr);
+    });
+  }
+  else
+  {
+    builder.build(root, topNodes, 0, nullptr);
+  }
+
+  flattenHierarchy(topNodes, tasks, nodes);
+}
+
+
+// ========== Spatial split BVH
+
+// Part of a triangle inside a node. Spatial splits clip the bounds, so one triangle can be referenced by several leaves.
+struct BVHReference
+{
+  BVHBounds    bounds;
+  unsigned int primitive;
+};
+
+struct BVHSpatialBin
+{
+  BVHSpatialBin()
+  : enter(0)
+  , exit(0)
+  {
+  }
+
+  BVHBounds    bounds; // Clipped reference bounds.
+  unsigned int enter;  // References starting in this bin.
+  unsigned int exit;   // References ending in this bin.
+};
+
+// Subtree of the SBVH built independently by one thread. The leaves index into the task's own primitive list until the lists are concatenated.
+struct SBVHTask
+{
+  std::vector<BVHReference> references;
+  BVHBounds                 bounds;
+  unsigned int              depth;
+  std::vector<BVHBuildNode> nodes;
+  std::vector<unsigned int> primitives;
+};
+
+static inline void setComponent(float3& v, const int axis, const float value)
+{
+  if (axis == 0)
+  {
+    v.x = value;
+  }
+  else if (axis == 1)
+  {
+    v.y = value;
+  }
+  else
+  {
+    v.z = value;
+  }
+}
+
+static inline float getOverlapArea(BVHBounds const& a, BVHBounds const& b)
+{
+  BVHBounds overlap;
+
+  overlap.lo = maxf(a.lo, b.lo);
+  overlap.hi = minf(a.hi, b.hi);
+
+  return (overlap.lo.x <= overlap.hi.x && overlap.lo.y <= overlap.hi.y && overlap.lo.z <= overlap.hi.z) ? overlap.area() : 0.0f;
+}
+
+
+// Binned SAH build which also evaluates spatial splits when the children of the best object split overlap too much.
+// (Stich, Friedrich, Dietrich, "Spatial Splits in Bounding Volume Hierarchies", HPG 2009.)
+class SBVHBuilder
+{
+public:
+  SBVHBuilder(const TriangleAttributes* attributes,
+              const unsigned int* indices,
+              const float minOverlap,
+              const size_t maxReferences)
+  : m_attributes(attributes)
+  , m_indices(indices)
+  , m_minOverlap(minOverlap)
+  , m_maxReferences(maxReferences)
+  , m_numReferences(0)
+  {
+  }
+
+  // Builds all nodes below the references, which are consumed. The leaves append their primitives.
+  // With tasks, subtrees with at most threshold references are not built but returned as tasks.
+  void build(std::vector<BVHReference>& references, BVHBounds const& bounds, const unsigned int depth,
+             std::vector<BVHBuildNode>& nodes, std::vector<unsigned int>& primitives,
+             const unsigned int threshold, std::vector<SBVHTask>* tasks);
+
+private:
+  struct ObjectSplit
+  {
+    float     cost;
+    int       axis; // -1 when all centroids are identical.
+    int       bin;
+    int       numBins;
+    float     lo;
+    float     scale;
+    BVHBounds left;
+    BVHBounds right;
+  };
+
+  struct SpatialSplit
+  {
+    float        cost;
+    int          axis; // -1 when no spatial split was found.
+    float        position;
+    BVHBounds    left;
+    BVHBounds    right;
+    unsigned int countLeft;
+    unsigned int countRight;
+  };
+
+  bool split(std::vector<BVHReference>& references, BVHBounds const& bounds, const unsigned int depth,
+             std::vector<BVHReference>& left, std::vector<BVHReference>& right);
+
+  void findObjectSplit(std::vector<BVHReference> const& references, BVHBounds const& bounds, ObjectSplit& split) const;
+  void findSpatialSplit(std::vector<BVHReference> const& references, BVHBounds const& bounds, SpatialSplit& split) const;
+  bool partitionSpatial(std::vector<BVHReference> const& references, SpatialSplit const& split,
+                        std::vector<BVHReference>& left, std::vector<BVHReference>& right);
+  void splitReference(BVHReference const& reference, const int axis, const float position, BVHReference& left, BVHReference& right) const;
+
+private:
+  const TriangleAttributes* m_attributes;
+  const unsigned int*       m_indices;
+  float                     m_minOverlap;    // splitAlpha times the root surface area.
+  size_t                    m_maxReferences; // Spatial splits stop when all references together exceed this budget.
+  std::atomic<size_t>       m_numReferences;
+};
+
+
+void SBVHBuilder::splitReference(BVHReference const& reference, const int axis, const float position, BVHReference& left, BVHReference& right) const
+{
+  left.primitive  = reference.primitive;
+  right.primitive = reference.primitive;
+
+  left.bounds  = BVHBounds();
+  right.bounds = BVHBounds();
+
+  const unsigned int* tri = &m_indices[reference.primitive * 3];
+
+  const float3 v[3] =
+  {
+    m_attributes[tri[0]].vertex,
+    m_attributes[tri[1]].vertex,
+    m_attributes[tri[2]].vertex
+  };
+
+  // Clip the triangle edges against the split plane.
+  for (int i = 0; i < 3; ++i)
+  {
+    float3 const& a = v[i];
+    float3 const& b = v[(i + 1) % 3];
+
+    const float pa = getComponent(a, axis);
+    const float pb = getComponent(b, axis);
+
+    if (pa <= position)
+    {
+      left.bounds.grow(a);
+    }
+    if (position <= pa)
+    {
+      right.bounds.grow(a);
+    }
+
+    if ((pa < position && position < pb) || (pb < position && position < pa))
+    {
+      const float t = (position - pa) / (pb - pa);
+
+      float3 p = a + (b - a) * t;
+      setComponent(p, axis, position);
+
+      left.bounds.grow(p);
+      right.bounds.grow(p);
+    }
+  }
+
+  // Only the part of the triangle inside the reference bounds belongs to the node.
+  setComponent(left.bounds.hi, axis, position);
+  setComponent(right.bounds.lo, axis, position);
+
+  left.bounds.lo  = maxf(left.bounds.lo,  reference.bounds.lo);
+  left.bounds.hi  = minf(left.bounds.hi,  reference.bounds.hi);
+  right.bounds.lo = maxf(right.bounds.lo, reference.bounds.lo);
+  right.bounds.hi = minf(right.bounds.hi, reference.bounds.hi);
+}
+
+void SBVHBuilder::findObjectSplit(std::vector<BVHReference> const& references, BVHBounds const& bounds, ObjectSplit& split) const
+{
+  split.cost = std::numeric_limits<float>::max();
+  split.axis = -1;
+
+  BVHBounds centroids;
+  for (BVHReference const& reference : references)
+  {
+    centroids.grow((reference.bounds.lo + reference.bounds.hi) * 0.5f);
+  }
+
+  const float3 extent = centroids.hi - centroids.lo;
+
+  const int numBins = std::min(static_cast<int>(references.size()), BVH_NUM_BINS);
+
+  // Scale slightly below numBins to keep the maximum centroid inside the last bin.
+  const float f = float(numBins) * (1.0f - 1.0e-6f);
+
+  const float invArea = 1.0f / std::max(bounds.area(), std::numeric_limits<float>::min());
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const float e = getComponent(extent, axis);
+    if (e <= 0.0f)
+    {
+      continue;
+    }
+
+    const float lo    = getComponent(centroids.lo, axis);
+    const float scale = f / e;
+
+    BVHBin bins[BVH_NUM_BINS];
+
+    for (BVHReference const& reference : references)
+    {
+      const float c = (getComponent(reference.bounds.lo, axis) + getComponent(reference.bounds.hi, axis)) * 0.5f;
+
+      BVHBin& bin = bins[computeBin(c, lo, scale, numBins)];
+      bin.bounds.grow(reference.bounds);
+      ++bin.count;
+    }
+
+    BVHBounds    boundsRight[BVH_NUM_BINS];
+    unsigned int countRight[BVH_NUM_BINS];
+
+    BVHBounds    accumulated;
+    unsigned int count = 0;
+    for (int b = numBins - 1; 0 < b; --b)
+    {
+      accumulated.grow(bins[b].bounds);
+      count += bins[b].count;
+      boundsRight[b] = accumulated;
+      countRight[b]  = count;
+    }
+
+    accumulated = BVHBounds();
+    count       = 0;
+    for (int b = 1; b < numBins; ++b)
+    {
+      accumulated.grow(bins[b - 1].bounds);
+      count += bins[b - 1].count;
+
+      if (count == 0 || countRight[b] == 0)
+      {
+        continue;
+      }
+
+      const float cost = 1.0f + (accumulated.area() * float(count) + boundsRight[b].area() * float(countRight[b])) * invArea;
+      if (cost < split.cost)
+      {
+        split.cost    = cost;
+        split.axis    = axis;
+        split.bin     = b;
+        split.numBins = numBins;
+        split.lo      = lo;
+        split.scale   = scale;
+        split.left    = accumulated;
+        split.right   = boundsRight[b];
+      }
+    }
+  }
+}
+
+void SBVHBuilder::findSpatialSplit(std::vector<BVHReference> const& references, BVHBounds const& bounds, SpatialSplit& split) const
+{
+  split.cost = std::numeric_limits<float>::max();
+  split.axis = -1;
+
+  const float3 extent = bounds.hi - bounds.lo;
+
+  const float invArea = 1.0f / std::max(bounds.area(), std::numeric_limits<float>::min());
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const float e = getComponent(extent, axis);
+    if (e <= 0.0f)
+    {
+      continue;
+    }
+
+    const float lo    = getComponent(bounds.lo, axis);
+    const float width = e / float(BVH_NUM_SPATIAL_BINS);
+    const float scale = float(BVH_NUM_SPATIAL_BINS) * (1.0f - 1.0e-6f) / e;
+
+    BVHSpatialBin bins[BVH_NUM_SPATIAL_BINS];
+
+    // Chop each reference into the bins it overlaps.
+    for (BVHReference const& reference : references)
+    {
+      const int first = computeBin(getComponent(reference.bounds.lo, axis), lo, scale, BVH_NUM_SPATIAL_BINS);
+      const int last  = computeBin(getComponent(reference.bounds.hi, axis), lo, scale, BVH_NUM_SPATIAL_BINS);
+
+      BVHReference current = reference;
+
+      for (int b = first; b < last; ++b)
+      {
+        BVHReference left;
+        BVHReference right;
+
+        splitReference(current, axis, lo + width * float(b + 1), left, right);
+
+        bins[b].bounds.grow(left.bounds);
+        current = right;
+      }
+      bins[last].bounds.grow(current.bounds);
+
+      ++bins[first].enter;
+      ++bins[last].exit;
+    }
+
+    BVHBounds    boundsRight[BVH_NUM_SPATIAL_BINS];
+    unsigned int countRight[BVH_NUM_SPATIAL_BINS];
+
+    BVHBounds    accumulated;
+    unsigned int count = 0;
+    for (int b = BVH_NUM_SPATIAL_BINS - 1; 0 < b; --b)
+    {
+      accumulated.grow(bins[b].bounds);
+      count += bins[b].exit;
+      boundsRight[b] = accumulated;
+      countRight[b]  = count;
+    }
+
+    accumulated = BVHBounds();
+    count       = 0;
+    for (int b = 1; b < BVH_NUM_SPATIAL_BINS; ++b)
+    {
+      accumulated.grow(bins[b - 1].bounds);
+      count += bins[b - 1].enter;
+
+      if (count == 0 || countRight[b] == 0)
+      {
+        continue;
+      }
+
+      const float cost = 1.0f + (accumulated.area() * float(count) + boundsRight[b].area() * float(countRight[b])) * invArea;
+      if (cost < split.cost)
+      {
+        split.cost       = cost;
+        split.axis       = axis;
+        split.position   = lo + width * float(b);
+        split.left       = accumulated;
+        split.right      = boundsRight[b];
+        split.countLeft  = count;
+        split.countRight = countRight[b];
+      }
+    }
+  }
+}
+
+bool SBVHBuilder::partitionSpatial(std::vector<BVHReference> const& references, SpatialSplit const& split,
+                                   std::vector<BVHReference>& left, std::vector<BVHReference>& right)
+{
+  const int   axis     = split.axis;
+  const float position = split.position;
+
+  BVHBounds boundsLeft  = split.left;
+  BVHBounds boundsRight = split.right;
+  float     countLeft   = float(split.countLeft);
+  float     countRight  = float(split.countRight);
+
+  size_t numSplits = 0;
+
+  for (BVHReference const& reference : references)
+  {
+    if (getComponent(reference.bounds.hi, axis) <= position)
+    {
+      left.push_back(reference);
+    }
+    else if (position <= getComponent(reference.bounds.lo, axis))
+    {
+      right.push_back(reference);
+    }
+    else
+    {
+      // Reference unsplitting: Keep the whole reference on one side when that is cheaper than the duplicate.
+      BVHBounds unsplitLeft = boundsLeft;
+      unsplitLeft.grow(reference.bounds);
+
+      BVHBounds unsplitRight = boundsRight;
+      unsplitRight.grow(reference.bounds);
+
+      const float areaLeft  = boundsLeft.area();
+      const float areaRight = boundsRight.area();
+
+      const float costSplit = areaLeft * countLeft + areaRight * countRight;
+      const float costLeft  = unsplitLeft.area() * countLeft + areaRight * (countRight - 1.0f);
+      const float costRight = areaLeft * (countLeft - 1.0f) + unsplitRight.area() * countRight;
+
+      if (costLeft < costSplit && costLeft <= costRight)
+      {
+        left.push_back(reference);
+        boundsLeft = unsplitLeft;
+        countRight -= 1.0f;
+      }
+      else if (costRight < costSplit)
+      {
+        right.push_back(reference);
+        boundsRight = unsplitRight;
+        countLeft -= 1.0f;
+      }
+      else
+      {
+        BVHReference referenceLeft;
+        BVHReference referenceRight;
+
+        splitReference(reference, axis, position, referenceLeft, referenceRight);
+
+        left.push_back(referenceLeft);
+        right.push_back(referenceRight);
+        ++numSplits;
+      }
+    }
+  }
+
+  m_numReferences += numSplits;
+
+  return !left.empty() && !right.empty();
+}
+
+bool SBVHBuilder::split(std::vector<BVHReference>& references, BVHBounds const& bounds, const unsigned int depth,
+                        std::vector<BVHReference>& left, std::vector<BVHReference>& right)
+{
+  const unsigned int count = static_cast<unsigned int>(references.size());
+
+  if (count <= 1)
+  {
+    return false;
+  }
+
+  if (needsBalancing(count, depth))
+  {
+    if (count <= BVH_MAX_LEAF_SIZE)
+    {
+      return false;
+    }
+    left.assign(references.begin(), references.begin() + count / 2);
+    right.assign(references.begin() + count / 2, references.end());
+    return true;
+  }
+
+  ObjectSplit object;
+  findObjectSplit(references, bounds, object);
+
+  SpatialSplit spatial;
+  spatial.cost = std::numeric_limits<float>::max();
+  spatial.axis = -1;
+
+  // The chopping into spatial bins is the expensive part. Skip it for nodes which can become leaves.
+  if (BVH_MAX_LEAF_SIZE < count && m_numReferences < m_maxReferences &&
+      (object.axis < 0 || m_minOverlap < getOverlapArea(object.left, object.right)))
+  {
+    findSpatialSplit(references, bounds, spatial);
+  }
+
+  if (count <= BVH_MAX_LEAF_SIZE && float(count) <= std::min(object.cost, spatial.cost))
+  {
+    return false; // The SAH prefers the leaf.
+  }
+
+  if (0 <= spatial.axis && spatial.cost < object.cost)
+  {
+    if (partitionSpatial(references, spatial, left, right))
+    {
+      return true;
+    }
+    left.clear();
+    right.clear();
+  }
+
+  if (0 <= object.axis)
+  {
+    // Same bin calculation as during binning.
+    for (BVHReference const& reference : references)
+    {
+      const float c = (getComponent(reference.bounds.lo, object.axis) + getComponent(reference.bounds.hi, object.axis)) * 0.5f;
+
+      if (computeBin(c, object.lo, object.scale, object.numBins) < object.bin)
+      {
+        left.push_back(reference);
+      }
+      else
+      {
+        right.push_back(reference);
+      }
+    }
+    return true;
+  }
+
+  // All centroids are identical, no SAH split possible.
+  if (count <= BVH_MAX_LEAF_SIZE)
+  {
+    return false;
+  }
+
+  // Split in the middle of the list to keep the leaves small.
+  left.assign(references.begin(), references.begin() + count / 2);
+  right.assign(references.begin() + count / 2, references.end());
+  return true;
+}
+
+void SBVHBuilder::build(std::vector<BVHReference>& references, BVHBounds const& bounds, const unsigned int depth,
+                        std::vector<BVHBuildNode>& nodes, std::vector<unsigned int>& primitives,
+                        const unsigned int threshold, std::vector<SBVHTask>* tasks)
+{
+  struct BuildItem
+  {
+    std::vector<BVHReference> references;
+    BVHBounds                 bounds;
+    unsigned int              depth;
+    unsigned int              node;
+  };
+
+  nodes.push_back(BVHBuildNode());
+  nodes.back().bounds = bounds;
+
+  std::vector<BuildItem> stack(1);
+
+  stack.back().references.swap(references);
+  stack.back().bounds = bounds;
+  stack.back().depth  = depth;
+  stack.back().node   = 0;
+
+  while (!stack.empty())
+  {
+    BuildItem item;
+
+    item.references.swap(stack.back().references);
+    item.bounds = stack.back().bounds;
+    item.depth  = stack.back().depth;
+    item.node   = stack.back().node;
+    stack.pop_back();
+
+    if (tasks != nullptr && item.references.size() <= threshold)
+    {
+      nodes[item.node].task = static_cast<int>(tasks->size());
+
+      tasks->push_back(SBVHTask());
+      tasks->back().references.swap(item.references);
+      tasks->back().bounds = item.bounds;
+      tasks->back().depth  = item.depth;
+      continue;
+    }
+
+    BuildItem children[2];
+
+    if (!split(item.references, item.bounds, item.depth, children[0].references, children[1].references))
+    {
+      BVHBuildNode& leaf = nodes[item.node];
+      leaf.begin = static_cast<unsigned int>(primitives.size());
+      leaf.count = static_cast<unsigned int>(item.references.size());
+
+      for (BVHReference const& reference : item.references)
+      {
+        primitives.push_back(reference.primitive);
+      }
+      continue;
+    }
+
+    std::vector<BVHReference>().swap(item.references); // Free the parent references before descending.
+
+    const unsigned int index = static_cast<unsigned int>(nodes.size());
+
+    nodes.push_back(BVHBuildNode());
+    nodes.push_back(BVHBuildNode());
+
+    nodes[item.node].left  = index;
+    nodes[item.node].right = index + 1;
+
+    // Push the right child first to build the left one next.
+    for (int i = 1; 0 <= i; --i)
+    {
+      BuildItem& child = children[i];
+
+      for (BVHReference const& reference : child.references)
+      {
+        child.bounds.grow(reference.bounds);
+      }
+      child.depth = item.depth + 1;
+      child.node  = index + i;
+
+      nodes[child.node].bounds = child.bounds;
+
+      stack.push_back(BuildItem());
+      stack.back().references.swap(child.references);
+      stack.back().bounds = child.bounds;
+      stack.back().depth  = child.depth;
+      stack.back().node   = child.node;
+    }
+  }
+}
+
+
+// Same task distribution as buildHierarchy(). The subtrees get their own primitive lists which are concatenated before flattening.
+static void buildSpatialHierarchy(const TriangleAttributes* attributes,
+                                  const unsigned int* indices,
+                                  std::vector<BVHBounds> const& boxes,
+                                  BVHBounds const& bounds,
+                                  const float splitAlpha,
+                                  std::vector<unsigned int>& primitives,
+                                  std::vector< BVHNode, AlignedAllocator<BVHNode, 64> >& nodes,
+                                  ThreadPool* threadPool)
+{
+  const bool isParallel = (threadPool != nullptr && 1 < threadPool->getNumThreads());
+
+  const unsigned int numTriangles = static_cast<unsigned int>(boxes.size());
+
+  SBVHBuilder builder(attributes, indices, splitAlpha * bounds.area(), size_t(double(numTriangles) * BVH_MAX_REFERENCE_RATIO));
+
+  std::vector<BVHReference> references(numTriangles);
+  for (unsigned int i = 0; i < numTriangles; ++i)
+  {
+    references[i].bounds    = boxes[i];
+    references[i].primitive = i;
+  }
+
+  primitives.clear();
+
+  std::vector<BVHBuildNode> topNodes;
+  std::vector<SBVHTask>     tasks;
+
+  if (isParallel)
+  {
+    const unsigned int threshold = std::max(numTriangles / (threadPool->getNumThreads() * 8), 1024u);
+
+    builder.build(references, bounds, 0, topNodes, primitives, threshold, &tasks);
+
+    std::vector<unsigned int> order(tasks.size());
+    for (unsigned int i = 0; i < static_cast<unsigned int>(order.size()); ++i)
+    {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&tasks](const unsigned int a, const unsigned int b)
+    {
+      return tasks[b].references.size() < tasks[a].references.size();
+    });
+
+    threadPool->parallelFor(static_cast<unsigned int>(tasks.size()), [&](const unsigned int index, const unsigned int threadIndex)
+    {
+      SBVHTask& task = tasks[order[index]];
+      builder.build(task.references, task.bounds, task.depth, task.nodes, task.primitives, 0, nullptr);
+    });
+  }
+  else
+  {
+    builder.build(references, bounds, 0, topNodes, primitives, 0, nullptr);
+  }
+
+  std::vector<BVHBuildTask> buildTasks(tasks.size());
+
+  for (size_t i = 0; i < tasks.size(); ++i)
+  {
+    const unsigned int offset = static_cast<unsigned int>(primitives.size());
+
+    primitives.insert(primitives.end(), tasks[i].primitives.begin(), tasks[i].primitives.end());
+
+    for (BVHBuildNode& node : tasks[i].nodes)
+    {
+      node.begin += (node.count != 0) ? offset : 0;
+    }
+    buildTasks[i].nodes.swap(tasks[i].nodes);
+  }
+
+  flattenHierarchy(topNodes, buildTasks, nodes);
+}
+
+
+// ========== Linear BVH
+
+// Sort key of one primitive.
+struct BVHMortonCode
+{
+  unsigned long long code;
+  unsigned int       primitive;
+};
+
+// Node of the radix tree. The inner nodes are [0, n - 1), the leaves [n - 1, 2n - 1) in Morton order. The root is node 0 in both cases.
+struct LBVHNode
+{
+  BVHBounds    bounds;
+  unsigned int left;     // Inner node: Children. Leaf: The primitive.
+  unsigned int right;
+  unsigned int parent;   // ~0u at the root.
+  unsigned int count;    // Primitives in the subtree.
+  float        cost;     // SAH cost of the subtree, scaled by the surface area, with the cheaper of leaf and inner node per node.
+  bool         collapse; // The subtree becomes a single leaf.
+};
+
+static inline int countLeadingZeros64(const unsigned long long mask)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, mask);
+  return 63 - static_cast<int>(index);
+#else
+  return __builtin_clzll(mask);
+#endif
+}
+
+// Inserts two zero bits above each of the lower 10 bits.
+static inline unsigned long long expandBits10(unsigned long long v)
+{
+  v &= 0x3FFull;
+  v = (v | (v << 16)) & 0x030000FFull;
+  v = (v | (v <<  8)) & 0x0300F00Full;
+  v = (v | (v <<  4)) & 0x030C30C3ull;
+  v = (v | (v <<  2)) & 0x09249249ull;
+  return v;
+}
+
+// Same for the lower 21 bits.
+static inline unsigned long long expandBits21(unsigned long long v)
+{
+  v &= 0x1FFFFFull;
+  v = (v | (v << 32)) & 0x001F00000000FFFFull;
+  v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+  v = (v | (v <<  8)) & 0x100F00F00F00F00Full;
+  v = (v | (v <<  4)) & 0x10C30C30C30C30C3ull;
+  v = (v | (v <<  2)) & 0x1249249249249249ull;
+  return v;
+}
+
+
+// Linear BVH. The primitives are sorted along the Morton curve through their centroids and each inner node of the radix tree
+// over the sorted codes is found independently. (Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees", HPG 2012.)
+// The optional treelet restructuring rebuilds small subtrees with a better SAH cost during bottom-up passes.
+// (Karras, Aila, "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies", HPG 2013.)
+class LBVHBuilder
+{
+public:
+  LBVHBuilder(std::vector<BVHBounds> const& boxes, ThreadPool* threadPool)
+  : m_boxes(boxes)
+  , m_threadPool(threadPool)
+  , m_count(static_cast<unsigned int>(boxes.size()))
+  , m_bits((m_count <= BVH_MORTON_30_BIT_LIMIT) ? 30 : 63)
+  {
+  }
+
+  void build(BVHBounds const& centroids, const bool restructure, std::vector<BVHBuildNode>& nodes, std::vector<unsigned int>& primitives);
+
+private:
+  // Calls func for the chunks of [0, count), in parallel when the ThreadPool has several threads.
+  void forEachChunk(const unsigned int count, std::function<void(const unsigned int chunk, const unsigned int begin, const unsigned int end)> const& func) const;
+
+  void computeCodes(BVHBounds const& centroids);
+  void sortCodes();
+
+  int  delta(const int i, const int j) const;
+  void buildInnerNode(const int i);
+
+  void refit(const unsigned int minTreeletSize);
+  void updateNode(const unsigned int index);
+  void restructureTreelet(const unsigned int root);
+
+  void gatherPrimitives(const unsigned int index, std::vector<unsigned int>& stack, std::vector<unsigned int>& primitives) const;
+  void emitBalanced(const unsigned int node, const unsigned int begin, const unsigned int count,
+                    std::vector<BVHBuildNode>& nodes, std::vector<unsigned int> const& primitives) const;
+
+private:
+  std::vector<BVHBounds> const& m_boxes;
+  ThreadPool*                   m_threadPool;
+  unsigned int                  m_count;
+  unsigned int                  m_bits; // 30 or 63 bit Morton codes.
+
+  std::vector<BVHMortonCode>             m_codes;
+  std::vector<LBVHNode>                  m_nodes;
+  std::vector< std::atomic<unsigned int> > m_visits; // Per inner node. The second thread arriving from the children continues upwards.
+};
+
+
+void LBVHBuilder::forEachChunk(const unsigned int count, std::function<void(const unsigned int chunk, const unsigned int begin, const unsigned int end)> const& func) const
+{
+  const unsigned int numChunks = (count + BVH_CHUNK_SIZE - 1) / BVH_CHUNK_SIZE;
+
+  auto run = [&](const unsigned int chunk, const unsigned int threadIndex)
+  {
+    const unsigned int begin = chunk * BVH_CHUNK_SIZE;
+    func(chunk, begin, std::min(begin + BVH_CHUNK_SIZE, count));
+  };
+
+  if (m_threadPool != nullptr && 1 < m_threadPool->getNumThreads() && 1 < numChunks)
+  {
+    m_threadPool->parallelFor(numChunks, run);
+  }
+  else
+  {
+    for (unsigned int chunk = 0; chunk < numChunks; ++chunk)
+    {
+      run(chunk, 0);
+    }
+  }
+}
+
+void LBVHBuilder::computeCodes(BVHBounds const& centroids)
+{
+  const float cells = (m_bits == 30) ? 1024.0f : 2097152.0f;
+
+  const float3 extent = centroids.hi - centroids.lo;
+  const float3 scale  = make_float3((0.0f < extent.x) ? cells / extent.x : 0.0f,
+                                    (0.0f < extent.y) ? cells / extent.y : 0.0f,
+                                    (0.0f < extent.z) ? cells / extent.z : 0.0f);
+
+  m_codes.resize(m_count);
+
+  forEachChunk(m_count, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+  {
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      const float3 c = ((m_boxes[i].lo + m_boxes[i].hi) * 0.5f - centroids.lo) * scale;
+
+      // Clamped because the maximum centroid lands exactly on the number of cells.
+      const unsigned long long x = static_cast<unsigned long long>(minf(maxf(c.x, 0.0f), cells - 1.0f));
+      const unsigned long long y = static_cast<unsigned long long>(minf(maxf(c.y, 0.0f), cells - 1.0f));
+      const unsigned long long z = static_cast<unsigned long long>(minf(maxf(c.z, 0.0f), cells - 1.0f));
+
+      m_codes[i].code = (m_bits == 30) ? (expandBits10(x) << 2) | (expandBits10(y) << 1) | expandBits10(z)
+                                       : (expandBits21(x) << 2) | (expandBits21(y) << 1) | expandBits21(z);
+      m_codes[i].primitive = i;
+    }
+  });
+}
+
+// Least significant digit radix sort with 8 bit digits. Each chunk scatters into its own ranges, which keeps every pass stable.
+void LBVHBuilder::sortCodes()
+{
+  const unsigned int numChunks = (m_count + BVH_CHUNK_SIZE - 1) / BVH_CHUNK_SIZE;
+
+  std::vector<BVHMortonCode> sorted(m_count);
+  std::vector<unsigned int>  offsets(numChunks * 256);
+
+  for (unsigned int shift = 0; shift < m_bits; shift += 8)
+  {
+    forEachChunk(m_count, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+    {
+      unsigned int* histogram = &offsets[chunk * 256];
+
+      std::fill(histogram, histogram + 256, 0u);
+      for (unsigned int i = begin; i < end; ++i)
+      {
+        ++histogram[(m_codes[i].code >> shift) & 255];
+      }
+    });
+
+    // Exclusive prefix sum, digit major and chunk minor.
+    unsigned int offset   = 0;
+    bool         isSorted = false;
+
+    for (unsigned int digit = 0; digit < 256; ++digit)
+    {
+      const unsigned int first = offset;
+      for (unsigned int chunk = 0; chunk < numChunks; ++chunk)
+      {
+        const unsigned int count = offsets[chunk * 256 + digit];
+        offsets[chunk * 256 + digit] = offset;
+        offset += count;
+      }
+      isSorted |= (offset - first == m_count); // All codes have the same digit, the pass wouldn't change the order.
+    }
+
+    if (isSorted)
+    {
+      continue;
+    }
+
+    forEachChunk(m_count, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+    {
+      unsigned int* offset = &offsets[chunk * 256];
+
+      for (unsigned int i = begin; i < end; ++i)
+      {
+        sorted[offset[(m_codes[i].code >> shift) & 255]++] = m_codes[i];
+      }
+    });
+
+    m_codes.swap(sorted);
+  }
+}
+
+// Length of the common prefix of the sorted codes i and j. Duplicate codes are made unique by appending the positions.
+int LBVHBuilder::delta(const int i, const int j) const
+{
+  if (j < 0 || static_cast<int>(m_count) <= j)
+  {
+    return -1;
+  }
+
+  const unsigned long long a = m_codes[i].code;
+  const unsigned long long b = m_codes[j].code;
+
+  if (a != b)
+  {
+    return countLeadingZeros64(a ^ b);
+  }
+  return 64 + countLeadingZeros64(static_cast<unsigned long long>(i ^ j)) - 32;
+}
+
+// Finds the range of sorted primitives covered by the inner node i and the split position inside it.
+void LBVHBuilder::buildInnerNode(const int i)
+{
+  // The direction of the range is towards the neighbour with the longer common prefix.
+  const int d = (delta(i, i + 1) < delta(i, i - 1)) ? -1 : 1;
+
+  // Exponential and binary search for the other end j of the range.
+  const int deltaMin = delta(i, i - d);
+
+  int lengthMax = 2;
+  while (deltaMin < delta(i, i + lengthMax * d))
+  {
+    lengthMax *= 2;
+  }
+
+  int length = 0;
+  for (int t = lengthMax / 2; 1 <= t; t /= 2)
+  {
+    if (deltaMin < delta(i, i + (length + t) * d))
+    {
+      length += t;
+    }
+  }
+
+  const int j = i + length * d;
+
+  // Binary search for the last position sharing the longer prefix with i.
+  const int deltaNode = delta(i, j);
+
+  int s = 0;
+  int t = length;
+  do
+  {
+    t = (t + 1) / 2;
+    if (deltaNode < delta(i, i + (s + t) * d))
+    {
+      s += t;
+    }
+  }
+  while (1 < t);
+
+  const int split = i + s * d + std::min(d, 0);
+
+  const unsigned int numInner = m_count - 1;
+
+  LBVHNode& node = m_nodes[i];
+
+  node.left  = (std::min(i, j) == split)     ? numInner + split     : static_cast<unsigned int>(split);
+  node.right = (std::max(i, j) == split + 1) ? numInner + split + 1 : static_cast<unsigned int>(split + 1);
+
+  m_nodes[node.left].parent  = i;
+  m_nodes[node.right].parent = i;
+}
+
+void LBVHBuilder::updateNode(const unsigned int index)
+{
+  LBVHNode&       node  = m_nodes[index];
+  LBVHNode const& left  = m_nodes[node.left];
+  LBVHNode const& right = m_nodes[node.right];
+
+  node.bounds = left.bounds;
+  node.bounds.grow(right.bounds);
+  node.count = left.count + right.count;
+
+  // Same weights as the binned SAH build.
+  const float area      = node.bounds.area();
+  const float costInner = area + left.cost + right.cost;
+  const float costLeaf  = area * float(node.count);
+
+  node.collapse = (node.count <= BVH_MAX_LEAF_SIZE && costLeaf <= costInner);
+  node.cost     = (node.collapse) ? costLeaf : costInner;
+}
+
+// Bottom-up pass over the inner nodes. Treelets are restructured at the roots with at least minTreeletSize primitives, 0 disables it.
+// Lower treelets are always finished before the treelets above them are formed.
+void LBVHBuilder::refit(const unsigned int minTreeletSize)
+{
+  const unsigned int numInner = m_count - 1;
+
+  forEachChunk(numInner, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+  {
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      m_visits[i].store(0, std::memory_order_relaxed);
+    }
+  });
+
+  forEachChunk(m_count, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+  {
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      unsigned int index = m_nodes[numInner + i].parent;
+
+      // The first thread arriving at a node stops, the second one has both children finished and continues.
+      while (index != ~0u && m_visits[index].fetch_add(1, std::memory_order_acq_rel) != 0)
+      {
+        updateNode(index);
+
+        if (minTreeletSize != 0 && minTreeletSize <= m_nodes[index].count)
+        {
+          restructureTreelet(index);
+        }
+
+        index = m_nodes[index].parent;
+      }
+    }
+  });
+}
+
+// Rebuilds the treelet below the root by agglomerative clustering, joining the two subtrees with the smallest combined surface area first.
+// Much cheaper than the exhaustive search over all partitions of the treelet leaves with nearly the same quality.
+// (Domingues, Pedrini, "Bounding Volume Hierarchy Optimization through Agglomerative Treelet Restructuring", HPG 2015.)
+void LBVHBuilder::restructureTreelet(const unsigned int root)
+{
+  const unsigned int numInner = m_count - 1;
+
+  unsigned int leaves[BVH_TREELET_SIZE];
+  unsigned int inner[BVH_TREELET_SIZE - 1]; // inner[0] is the treelet root.
+
+  inner[0]  = root;
+  leaves[0] = m_nodes[root].left;
+  leaves[1] = m_nodes[root].right;
+
+  unsigned int numLeaves = 2;
+
+  // Grow the treelet by opening the inner leaf with the biggest surface area.
+  while (numLeaves < BVH_TREELET_SIZE)
+  {
+    int   best     = -1;
+    float bestArea = -1.0f;
+
+    for (unsigned int i = 0; i < numLeaves; ++i)
+    {
+      if (leaves[i] < numInner && bestArea < m_nodes[leaves[i]].bounds.area())
+      {
+        best     = static_cast<int>(i);
+        bestArea = m_nodes[leaves[i]].bounds.area();
+      }
+    }
+
+    if (best < 0)
+    {
+      break;
+    }
+
+    const unsigned int opened = leaves[best];
+
+    inner[numLeaves - 1] = opened;
+    leaves[best]         = m_nodes[opened].left;
+    leaves[numLeaves++]  = m_nodes[opened].right;
+  }
+
+  if (numLeaves < 3) // Two leaves have only one topology.
+  {
+    return;
+  }
+
+  // The clusters start as the treelet leaves. Each join stores the new subtree in the slot of its first cluster.
+  BVHBounds    bounds[BVH_TREELET_SIZE];
+  unsigned int count[BVH_TREELET_SIZE];
+  float        cost[BVH_TREELET_SIZE];
+  unsigned int node[BVH_TREELET_SIZE];
+  float        area[BVH_TREELET_SIZE][BVH_TREELET_SIZE]; // Surface area of the union of the clusters i < j.
+
+  for (unsigned int i = 0; i < numLeaves; ++i)
+  {
+    LBVHNode const& leaf = m_nodes[leaves[i]];
+
+    bounds[i] = leaf.bounds;
+    count[i]  = leaf.count;
+    cost[i]   = leaf.cost;
+    node[i]   = leaves[i];
+  }
+
+  auto updateArea = [&](const unsigned int a, const unsigned int numClusters)
+  {
+    for (unsigned int i = 0; i < numClusters; ++i)
+    {
+      if (i != a)
+      {
+        BVHBounds joined = bounds[i];
+        joined.grow(bounds[a]);
+        area[std::min(i, a)][std::max(i, a)] = joined.area();
+      }
+    }
+  };
+
+  for (unsigned int i = 0; i < numLeaves; ++i)
+  {
+    updateArea(i, numLeaves);
+  }
+
+  struct Join
+  {
+    unsigned int left;
+    unsigned int right;
+    unsigned int parent;
+  };
+
+  Join joins[BVH_TREELET_SIZE - 1];
+
+  unsigned int numClusters = numLeaves;
+
+  for (unsigned int k = 0; k < numLeaves - 1; ++k)
+  {
+    unsigned int a = 0;
+    unsigned int b = 1;
+
+    for (unsigned int i = 0; i < numClusters; ++i)
+    {
+      for (unsigned int j = i + 1; j < numClusters; ++j)
+      {
+        if (area[i][j] < area[a][b])
+        {
+          a = i;
+          b = j;
+        }
+      }
+    }
+
+    // The last join creates the treelet root. The others reuse the remaining inner nodes.
+    joins[k].left   = node[a];
+    joins[k].right  = node[b];
+    joins[k].parent = (k == numLeaves - 2) ? root : inner[k + 1];
+
+    const float costInner = area[a][b] + cost[a] + cost[b];
+    const float costLeaf  = area[a][b] * float(count[a] + count[b]);
+
+    bounds[a].grow(bounds[b]);
+    count[a] += count[b];
+    cost[a]   = (count[a] <= BVH_MAX_LEAF_SIZE && costLeaf <= costInner) ? costLeaf : costInner;
+    node[a]   = joins[k].parent;
+
+    // Close the gap with the last cluster.
+    --numClusters;
+    if (b != numClusters)
+    {
+      bounds[b] = bounds[numClusters];
+      count[b]  = count[numClusters];
+      cost[b]   = cost[numClusters];
+      node[b]   = node[numClusters];
+
+      updateArea(b, numClusters);
+    }
+    updateArea(a, numClusters);
+  }
+
+  if (m_nodes[root].cost <= cost[0])
+  {
+    return;
+  }
+
+  // Children are always joined before their parent.
+  for (unsigned int k = 0; k < numLeaves - 1; ++k)
+  {
+    LBVHNode& parent = m_nodes[joins[k].parent];
+
+    parent.left  = joins[k].left;
+    parent.right = joins[k].right;
+
+    m_nodes[joins[k].left].parent  = joins[k].parent;
+    m_nodes[joins[k].right].parent = joins[k].parent;
+
+    updateNode(joins[k].parent);
+  }
+}
+
+// Appends the primitives of the subtree in depth first order. The stack is only passed in to be reused.
+void LBVHBuilder::gatherPrimitives(const unsigned int index, std::vector<unsigned int>& stack, std::vector<unsigned int>& primitives) const
+{
+  const unsigned int numInner = m_count - 1;
+
+  stack.assign(1, index);
+
+  while (!stack.empty())
+  {
+    const unsigned int i = stack.back();
+    stack.pop_back();
+
+    if (numInner <= i)
+    {
+      primitives.push_back(m_nodes[i].left);
+    }
+    else
+    {
+      stack.push_back(m_nodes[i].right);
+      stack.push_back(m_nodes[i].left);
+    }
+  }
+}
+
+// Splits the primitive range in the middle down to the leaf size. The height is the minimum for the count.
+void LBVHBuilder::emitBalanced(const unsigned int node, const unsigned int begin, const unsigned int count,
+                               std::vector<BVHBuildNode>& nodes, std::vector<unsigned int> const& primitives) const
+{
+  struct BalanceItem
+  {
+    unsigned int node;
+    unsigned int begin;
+    unsigned int count;
+  };
+
+  std::vector<BalanceItem> stack;
+
+  BalanceItem item;
+  item.node  = node;
+  item.begin = begin;
+  item.count = count;
+  stack.push_back(item);
+
+  while (!stack.empty())
+  {
+    item = stack.back();
+    stack.pop_back();
+
+    BVHBuildNode& dst = nodes[item.node];
+
+    dst.bounds = BVHBounds();
+    for (unsigned int i = item.begin; i < item.begin + item.count; ++i)
+    {
+      dst.bounds.grow(m_boxes[primitives[i]]);
+    }
+
+    if (item.count <= BVH_MAX_LEAF_SIZE)
+    {
+      dst.begin = item.begin;
+      dst.count = item.count;
+      continue;
+    }
+
+    const unsigned int index = static_cast<unsigned int>(nodes.size());
+
+    dst.left  = index;
+    dst.right = index + 1;
+
+    nodes.push_back(BVHBuildNode()); // Invalidates dst.
+    nodes.push_back(BVHBuildNode());
+
+    BalanceItem child;
+
+    child.node  = index + 1;
+    child.begin = item.begin + item.count / 2;
+    child.count = item.count - item.count / 2;
+    stack.push_back(child);
+
+    child.node  = index;
+    child.begin = item.begin;
+    child.count = item.count / 2;
+    stack.push_back(child);
+  }
+}
+
+void LBVHBuilder::build(BVHBounds const& centroids, const bool restructure, std::vector<BVHBuildNode>& nodes, std::vector<unsigned int>& primitives)
+{
+  const unsigned int numInner = m_count - 1;
+
+  computeCodes(centroids);
+  sortCodes();
+
+  m_nodes.resize(numInner + m_count);
+  m_visits = std::vector< std::atomic<unsigned int> >(numInner);
+
+  m_nodes[0].parent = ~0u; // The root. Inner node 0, or the only leaf.
+
+  forEachChunk(m_count, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+  {
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      LBVHNode& leaf = m_nodes[numInner + i];
+
+      leaf.bounds   = m_boxes[m_codes[i].primitive];
+      leaf.left     = m_codes[i].primitive;
+      leaf.right    = 0;
+      leaf.count    = 1;
+      leaf.cost     = leaf.bounds.area();
+      leaf.collapse = true;
+    }
+  });
+
+  forEachChunk(numInner, [&](const unsigned int chunk, const unsigned int begin, const unsigned int end)
+  {
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      buildInnerNode(static_cast<int>(i));
+    }
+  });
+
+  std::vector<BVHMortonCode>().swap(m_codes);
+
+  refit(0);
+
+  if (restructure)
+  {
+    for (unsigned int round = 0; round < BVH_TREELET_ROUNDS; ++round)
+    {
+      refit(BVH_TREELET_MIN_SIZE << round);
+    }
+  }
+
+  // Depth first emission into the build nodes. Collapsed subtrees become leaves with their primitives gathered in order.
+  struct EmitItem
+  {
+    unsigned int source; // Index inside m_nodes.
+    unsigned int node;   // Index inside nodes.
+    unsigned int depth;
+  };
+
+  primitives.clear();
+  primitives.reserve(m_count);
+
+  nodes.reserve(2 * size_t(m_count)); // Upper bound with single primitive leaves.
+  nodes.push_back(BVHBuildNode());
+
+  std::vector<EmitItem>     stack;
+  std::vector<unsigned int> gather;
+
+  EmitItem item;
+  item.source = 0;
+  item.node   = 0;
+  item.depth  = 0;
+  stack.push_back(item);
+
+  while (!stack.empty())
+  {
+    item = stack.back();
+    stack.pop_back();
+
+    LBVHNode const& src = m_nodes[item.source];
+
+    nodes[item.node].bounds = src.bounds;
+
+    if (src.collapse)
+    {
+      nodes[item.node].begin = static_cast<unsigned int>(primitives.size());
+      nodes[item.node].count = src.count;
+
+      gatherPrimitives(item.source, gather, primitives);
+      continue;
+    }
+
+    // Radix trees get deep for clustered codes. The subtree is balanced once the remaining depth would not suffice for that anymore.
+    if (needsBalancing(src.count, item.depth))
+    {
+      const unsigned int begin = static_cast<unsigned int>(primitives.size());
+
+      gatherPrimitives(item.source, gather, primitives);
+      emitBalanced(item.node, begin, src.count, nodes, primitives);
+      continue;
+    }
+
+    const unsigned int index = static_cast<unsigned int>(nodes.size());
+
+    nodes.push_back(BVHBuildNode());
+    nodes.push_back(BVHBuildNode());
+
+    nodes[item.node].left  = index;
+    nodes[item.node].right = index + 1;
+
+    EmitItem child;
+
+    child.depth = item.depth + 1;
+
+    child.source = src.right;
+    child.node   = index + 1;
+    stack.push_back(child);
+
+    child.source = src.left;
+    child.node   = index;
+    stack.push_back(child);
+  }
+
+  MY_ASSERT(primitives.size() == m_count);
+}
+
+
+// ========== BVH
+
+// Bounds of a box hierarchy node from its boxes or from its already refitted children.
+static BVHBounds getRefitBounds(BVHNode const& node, const BVHNode* nodes, const unsigned int* primitives, std::vector<float3> const& aabbs)
+{
+  BVHBounds bounds;
+
+  if (node.count != 0)
+  {
+    for (unsigned int j = node.index; j < node.index + node.count; ++j)
+    {
+      const unsigned int primitive = primitives[j];
+
+      bounds.grow(aabbs[primitive * 2]);
+      bounds.grow(aabbs[primitive * 2 + 1]);
+    }
+  }
+  else
+  {
+    bounds.grow(nodes[node.index].aabbMin);
+    bounds.grow(nodes[node.index].aabbMax);
+    bounds.grow(nodes[node.index + 1].aabbMin);
+    bounds.grow(nodes[node.index + 1].aabbMax);
+  }
+
+  return bounds;
+}
+
+
+BVH::BVH()
+: m_attributes(nullptr)
+, m_indices(nullptr)
+, m_numTriangles(0)
+, m_costSum(0.0)
+{
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::build(std::shared_ptr<sg::Triangles> geometry, ThreadPool* threadPool)
+{
+  BVHBuildOptions options;
+
+  options.splitAlpha = geometry->getSpatialSplitAlpha();
+
+  build(geometry, threadPool, options);
+}
+
+void BVH::build(std::shared_ptr<sg::Triangles> geometry, ThreadPool* threadPool, BVHBuildOptions const& options)
+{
+  m_nodes.clear();
+  m_primitives.clear();
+  m_parents.clear();
+  m_leaves.clear();
+  m_costSum = 0.0;
+  m_numTriangles = 0;
+
+  m_geometry = geometry;
+
+  std::vector<TriangleAttributes> const& attributes = geometry->getAttributes();
+  std::vector<unsigned int>       const& indices    = geometry->getIndices();
+
+  MY_ASSERT(!indices.empty()); // Same as the Device, only indexed triangles are supported.
+
+  m_attributes = attributes.data();
+  m_indices    = indices.data();
+
+  const unsigned int numTriangles = static_cast<unsigned int>(indices.size()) / 3;
+  if (numTriangles == 0)
+  {
+    return;
+  }
+
+  m_numTriangles = numTriangles;
+
+  const bool isParallel = (threadPool != nullptr && 1 < threadPool->getNumThreads());
+
+  // Per triangle bounds and centroids, plus the root bounds per chunk.
+  std::vector<BVHBounds> boxes(numTriangles);
+  std::vector<float3>    centroids(numTriangles);
+
+  m_primitives.resize(numTriangles);
+
+  const unsigned int numChunks = (numTriangles + BVH_CHUNK_SIZE - 1) / BVH_CHUNK_SIZE;
+
+  std::vector<BVHBounds> chunkBounds(numChunks);
+  std::vector<BVHBounds> chunkCentroids(numChunks);
+
+  auto prepare = [&](const unsigned int chunk, const unsigned int threadIndex)
+  {
+    const unsigned int begin = chunk * BVH_CHUNK_SIZE;
+    const unsigned int end   = std::min(begin + BVH_CHUNK_SIZE, numTriangles);
+
+    for (unsigned int i = begin; i < end; ++i)
+    {
+      const unsigned int* tri = &m_indices[i * 3];
+
+      BVHBounds& box = boxes[i];
+      box.grow(m_attributes[tri[0]].vertex);
+      box.grow(m_attributes[tri[1]].vertex);
+      box.grow(m_attributes[tri[2]].vertex);
+
+      centroids[i] = (box.lo + box.hi) * 0.5f;
+
+      m_primitives[i] = i;
+
+      chunkBounds[chunk].grow(box);
+      chunkCentroids[chunk].grow(centroids[i]);
+    }
+  };
+
+  if (isParallel)
+  {
+    threadPool->parallelFor(numChunks, prepare);
+  }
+  else
+  {
+    for (unsigned int chunk = 0; chunk < numChunks; ++chunk)
+    {
+      prepare(chunk, 0);
+    }
+  }
+
+  BVHRange root;
+
+  root.node  = 0;
+  root.begin = 0;
+  root.count = numTriangles;
+  root.depth = 0;
+  for (unsigned int chunk = 0; chunk < numChunks; ++chunk)
+  {
+    root.bounds.grow(chunkBounds[chunk]);
+    root.centroids.grow(chunkCentroids[chunk]);
+  }
+
+  if (options.method == BVH_BUILD_LBVH)
+  {
+    LBVHBuilder builder(boxes, threadPool);
+
+    std::vector<BVHBuildNode> topNodes;
+
+    builder.build(root.centroids, options.restructure, topNodes, m_primitives);
+
+    flattenHierarchy(topNodes, std::vector<BVHBuildTask>(), m_nodes);
+  }
+  else if (0.0f < options.splitAlpha)
+  {
+    buildSpatialHierarchy(m_attributes, m_indices, boxes, root.bounds, options.splitAlpha, m_primitives, m_nodes, threadPool);
+  }
+  else
+  {
+    buildHierarchy(boxes, centroids, root, m_primitives, m_nodes, threadPool);
+  }
+}
+
+void BVH::build(std::vector<float3> const& aabbs, ThreadPool* threadPool)
+{
+  m_nodes.clear();
+  m_primitives.clear();
+  m_parents.clear();
+  m_leaves.clear();
+  m_costSum = 0.0;
+
+  m_geometry.reset();
+  m_attributes = nullptr;
+  m_indices    = nullptr;
+
+  const unsigned int numBoxes = static_cast<unsigned int>(aabbs.size()) / 2;
+
+  m_numTriangles = numBoxes;
+
+  if (numBoxes == 0)
+  {
+    return;
+  }
+
+  std::vector<BVHBounds> boxes(numBoxes);
+  std::vector<float3>    centroids(numBoxes);
+
+  m_primitives.resize(numBoxes);
+
+  BVHRange root;
+
+  root.node  = 0;
+  root.begin = 0;
+  root.count = numBoxes;
+  root.depth = 0;
+
+  for (unsigned int i = 0; i < numBoxes; ++i)
+  {
+    boxes[i].lo  = aabbs[i * 2];
+    boxes[i].hi  = aabbs[i * 2 + 1];
+    centroids[i] = (boxes[i].lo + boxes[i].hi) * 0.5f;
+
+    m_primitives[i] = i;
+
+    root.bounds.grow(boxes[i]);
+    root.centroids.grow(centroids[i]);
+  }
+
+  buildHierarchy(boxes, centroids, root, m_primitives, m_nodes, threadPool);
+
+  initRefit();
+}
+
+void BVH::refit(std::vector<float3> const& aabbs)
+{
+  MY_ASSERT(!m_geometry && aabbs.size() == size_t(m_numTriangles) * 2);
+
+  // The children are always stored behind their parent, so the reverse order updates them first.
+  for (size_t i = m_nodes.size(); 0 < i--; )
+  {
+    if (i == 1) // Padding.
+    {
+      continue;
+    }
+
+    BVHNode& node = m_nodes[i];
+
+    const BVHBounds bounds = getRefitBounds(node, m_nodes.data(), m_primitives.data(), aabbs);
+
+    node.aabbMin = bounds.lo;
+    node.aabbMax = bounds.hi;
+  }
+
+  m_costSum = getCostSum();
+}
+
+void BVH::refit(std::vector<float3> const& aabbs, std::vector<unsigned int> const& moved)
+{
+  MY_ASSERT(!m_geometry && aabbs.size() == size_t(m_numTriangles) * 2 && m_leaves.size() == m_numTriangles);
+
+  for (const unsigned int primitive : moved)
+  {
+    unsigned int index = m_leaves[primitive];
+
+    while (index != ~0u)
+    {
+      BVHNode& node = m_nodes[index];
+
+      const BVHBounds bounds = getRefitBounds(node, m_nodes.data(), m_primitives.data(), aabbs);
+
+      // Unchanged bounds don't change any ancestor. Other moved boxes below them walk up on their own.
+      if (bounds.lo.x == node.aabbMin.x && bounds.lo.y == node.aabbMin.y && bounds.lo.z == node.aabbMin.z &&
+          bounds.hi.x == node.aabbMax.x && bounds.hi.y == node.aabbMax.y && bounds.hi.z == node.aabbMax.z)
+      {
+        break;
+      }
+
+      BVHBounds previous;
+
+      previous.lo = node.aabbMin;
+      previous.hi = node.aabbMax;
+
+      const float weight = (node.count != 0) ? float(node.count) : 1.0f;
+
+      m_costSum += double(bounds.area() - previous.area()) * weight;
+
+      node.aabbMin = bounds.lo;
+      node.aabbMax = bounds.hi;
+
+      index = m_parents[index];
+    }
+  }
+}
+
+// Links the nodes and boxes of a box hierarchy to their parents for the partial refit.
+void BVH::initRefit()
+{
+  m_parents.assign(m_nodes.size(), ~0u);
+  m_leaves.assign(m_numTriangles, ~0u);
+
+  for (size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    if (i == 1) // Padding.
+    {
+      continue;
+    }
+
+    BVHNode const& node = m_nodes[i];
+
+    if (node.count != 0)
+    {
+      for (unsigned int j = node.index; j < node.index + node.count; ++j)
+      {
+        m_leaves[m_primitives[j]] = static_cast<unsigned int>(i);
+      }
+    }
+    else
+    {
+      m_parents[node.index    ] = static_cast<unsigned int>(i);
+      m_parents[node.index + 1] = static_cast<unsigned int>(i);
+    }
+  }
+
+  m_costSum = getCostSum();
+}
+
+
+float3 BVH::getAabbMin() const
+{
+  return (m_nodes.empty()) ? make_float3(0.0f) : m_nodes[0].aabbMin;
+}
+
+float3 BVH::getAabbMax() const
+{
+  return (m_nodes.empty()) ? make_float3(0.0f) : m_nodes[0].aabbMax;
+}
+
+unsigned int BVH::getNumTriangles() const
+{
+  return m_numTriangles;
+}
+
+unsigned int BVH::getNumReferences() const
+{
+  return static_cast<unsigned int>(m_primitives.size());
+}
+
+unsigned int BVH::getNumNodes() const
+{
+  return static_cast<unsigned int>(m_nodes.size());
+}
+
+size_t BVH::getMemorySize() const
+{
+  return m_nodes.size() * sizeof(BVHNode) + m_primitives.size() * sizeof(unsigned int);
+}
+
+float BVH::getCost() const
+{
+  if (m_nodes.empty())
+  {
+    return 0.0f;
+  }
+
+  BVHBounds root;
+
+  root.lo = m_nodes[0].aabbMin;
+  root.hi = m_nodes[0].aabbMax;
+
+  const float area = root.area();
+
+  // Box hierarchies track the sum through the refits, the TLAS checks its cost after every update.
+  const double cost = (m_geometry) ? getCostSum() : m_costSum;
+
+  return (0.0f < area) ? float(cost / area) : 0.0f;
+}
+
+double BVH::getCostSum() const
+{
+  double cost = 0.0;
+
+  for (size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    BVHBounds bounds;
+
+    bounds.lo = m_nodes[i].aabbMin;
+    bounds.hi = m_nodes[i].aabbMax;
+
+    // Same weights as the build: Traversal cost 1, intersection cost 1 per primitive. The padding node has no area.
+    cost += double(bounds.area()) * ((m_nodes[i].count != 0) ? float(m_nodes[i].count) : 1.0f);
+  }
+
+  return cost;
+}
+
+std::shared_ptr<sg::Triangles> BVH::getGeometry() const
+{
+  return m_geometry;
+}
+
+std::vector< BVHNode, AlignedAllocator<BVHNode, 64> > const& BVH::getNodes() const
+{
+  return m_nodes;
+}
+
+std::vector<unsigned int> const& BVH::getPrimitives() const
+{
+  return m_primitives;
+}
+
+
+// ========== Queries
+
+// Slab test. Returns the entry distance in tNear when the interval [tmin, tmax] overlaps the box.
+static inline bool intersectNode(BVHNode const& node, float3 const& origin, float3 const& invDirection, const float tmin, const float tmax, float& tNear)
+{
+  const float tx0 = (node.aabbMin.x - origin.x) * invDirection.x;
+  const float tx1 = (node.aabbMax.x - origin.x) * invDirection.x;
+  const float ty0 = (node.aabbMin.y - origin.y) * invDirection.y;
+  const float ty1 = (node.aabbMax.y - origin.y) * invDirection.y;
+  const float tz0 = (node.aabbMin.z - origin.z) * invDirection.z;
+  const float tz1 = (node.aabbMax.z - origin.z) * invDirection.z;
+
+  tNear = maxf(maxf(minf(tx0, tx1), minf(ty0, ty1)), maxf(minf(tz0, tz1), tmin));
+
+  const float tFar = minf(minf(maxf(tx0, tx1), maxf(ty0, ty1)), minf(maxf(tz0, tz1), tmax));
+
+  return tNear <= tFar;
+}
+
+// Avoid infinities for axis aligned directions. The huge value still lets the slab test reject or accept correctly.
+static inline float3 safeInverse(float3 const& d)
+{
+  const float eps = 1.0e-20f;
+  return make_float3(1.0f / ((eps < fabsf(d.x)) ? d.x : copysignf(eps, d.x)),
+                     1.0f / ((eps < fabsf(d.y)) ? d.y : copysignf(eps, d.y)),
+                     1.0f / ((eps < fabsf(d.z)) ? d.z : copysignf(eps, d.z)));
+}
+
+void BVHRayPacket::prepare()
+{
+  for (unsigned int r = 0; r < count; ++r)
+  {
+    invDirection[r] = safeInverse(direction[r]);
+  }
+}
+
+// The largest tmax of the active rays. Nodes behind that can be culled for the whole packet.
+static float getMaxDistance(BVHRayPacket const& packet, const unsigned long long active)
+{
+  float tmax = -std::numeric_limits<float>::max();
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    if (active & (1ull << r))
+    {
+      tmax = maxf(tmax, packet.tmax[r]);
+    }
+  }
+  return tmax;
+}
+
+void BVHPacketBounds::set(BVHRayPacket const& packet, const unsigned long long active)
+{
+  originMin       = make_float3(std::numeric_limits<float>::max());
+  originMax       = make_float3(-std::numeric_limits<float>::max());
+  invDirectionMin = make_float3(std::numeric_limits<float>::max());
+  invDirectionMax = make_float3(-std::numeric_limits<float>::max());
+
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    if (active & (1ull << r))
+    {
+      originMin       = minf(originMin, packet.origin[r]);
+      originMax       = maxf(originMax, packet.origin[r]);
+      invDirectionMin = minf(invDirectionMin, packet.invDirection[r]);
+      invDirectionMax = maxf(invDirectionMax, packet.invDirection[r]);
+    }
+  }
+
+  tmin = packet.tmin;
+  tmax = getMaxDistance(packet, active);
+}
+
+// Individual slab tests of the active rays. Returns the mask of the rays which hit the node.
+static unsigned long long intersectNodeRays(BVHNode const& node, BVHRayPacket const& packet, const unsigned long long active)
+{
+  unsigned long long mask = 0;
+
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    float tNear;
+    if ((active & (1ull << r)) && intersectNode(node, packet.origin[r], packet.invDirection[r], packet.tmin, packet.tmax[r], tNear))
+    {
+      mask |= 1ull << r;
+    }
+  }
+  return mask;
+}
+
+// Moeller-Trumbore ray-triangle intersection without backface culling.
+bool BVH::intersectTriangle(const unsigned int primitive, float3 const& origin, float3 const& direction, const float tmin, const float tmax, float& t, float2& barycentrics) const
+{
+  const unsigned int* tri = &m_indices[primitive * 3];
+
+  const float3 v0 = m_attributes[tri[0]].vertex;
+  const float3 e1 = m_attributes[tri[1]].vertex - v0;
+  const float3 e2 = m_attributes[tri[2]].vertex - v0;
+
+  const float3 p   = cross(direction, e2);
+  const float  det = dot(e1, p);
+
+  if (det == 0.0f) // Ray parallel to the triangle plane.
+  {
+    return false;
+  }
+
+  const float invDet = 1.0f / det;
+
+  const float3 s    = origin - v0;
+  const float  beta = dot(s, p) * invDet;
+  if (beta < 0.0f || 1.0f < beta)
+  {
+    return false;
+  }
+
+  const float3 q     = cross(s, e1);
+  const float  gamma = dot(direction, q) * invDet;
+  if (gamma < 0.0f || 1.0f < beta + gamma)
+  {
+    return false;
+  }
+
+  t = dot(e2, q) * invDet;
+  if (t < tmin || tmax < t)
+  {
+    return false;
+  }
+
+  barycentrics = make_float2(beta, gamma);
+  return true;
+}
+
+// The regular queries compile the counters away.
+struct BVHNoStats
+{
+};
+
+static inline void countRay(BVHNoStats&)
+{
+}
+
+static inline void countNode(BVHNoStats&)
+{
+}
+
+static inline void countTriangle(BVHNoStats&)
+{
+}
+
+static inline void countRay(BVHTraversalStats& stats)
+{
+  ++stats.rays;
+}
+
+static inline void countNode(BVHTraversalStats& stats)
+{
+  ++stats.nodes;
+}
+
+static inline void countTriangle(BVHTraversalStats& stats)
+{
+  ++stats.triangles;
+}
+
+bool BVH::intersect(BVHRay const& ray, BVHHit& hit, BVHFilter const* filter) const
+{
+  BVHNoStats stats;
+
+  return intersectClosest(ray, hit, filter, stats);
+}
+
+bool BVH::intersect(BVHRay const& ray, BVHHit& hit, BVHTraversalStats& stats) const
+{
+  return intersectClosest(ray, hit, nullptr, stats);
+}
+
+template<typename Stats>
+bool BVH::intersectClosest(BVHRay const& ray, BVHHit& hit, BVHFilter const* filter, Stats& stats) const
+{
+  if (m_nodes.empty())
+  {
+    return false;
+  }
+
+  countRay(stats);
+
+  const float3 invDirection = safeInverse(ray.direction);
+
+  float tmax  = ray.tmax;
+  bool  found = false;
+
+  float tNear;
+  if (!intersectNode(m_nodes[0], ray.origin, invDirection, ray.tmin, tmax, tNear))
+  {
+    return false;
+  }
+
+  struct StackEntry
+  {
+    unsigned int node;
+    float        tNear;
+  };
+
+  StackEntry stack[BVH_MAX_DEPTH];
+  int        top = 0;
+
+  unsigned int current = 0;
+
+  for (;;)
+  {
+    BVHNode const& node = m_nodes[current];
+
+    countNode(stats);
+
+    if (node.count != 0)
+    {
+      for (unsigned int i = node.index; i < node.index + node.count; ++i)
+      {
+        const unsigned int primitive = m_primitives[i];
+
+        float  t;
+        float2 barycentrics;
+
+        countTriangle(stats);
+
+        if (intersectTriangle(primitive, ray.origin, ray.direction, ray.tmin, tmax, t, barycentrics) &&
+            (filter == nullptr || (*filter)(primitive, barycentrics)))
+        {
+          tmax  = t;
+          found = true;
+
+          hit.distance     = t;
+          hit.barycentrics = barycentrics;
+          hit.primitive    = primitive;
+        }
+      }
+    }
+    else
+    {
+      unsigned int left  = node.index;
+      unsigned int right = left + 1;
+
+      float tLeft;
+      float tRight;
+
+      const bool isLeft  = intersectNode(m_nodes[left],  ray.origin, invDirection, ray.tmin, tmax, tLeft);
+      const bool isRight = intersectNode(m_nodes[right], ray.origin, invDirection, ray.tmin, tmax, tRight);
+
+      if (isLeft && isRight)
+      {
+        // Visit the nearer child first, the farther child is culled later if a hit was found in front of it.
+        if (tRight < tLeft)
+        {
+          std::swap(left, right);
+          std::swap(tLeft, tRight);
+        }
+        MY_ASSERT(top < BVH_MAX_DEPTH);
+        stack[top].node  = right;
+        stack[top].tNear = tRight;
+        ++top;
+
+        current = left;
+        continue;
+      }
+      if (isLeft)
+      {
+        current = left;
+        continue;
+      }
+      if (isRight)
+      {
+        current = right;
+        continue;
+      }
+    }
+
+    // Pop the next node which is still in front of the closest hit.
+    for (;;)
+    {
+      if (top == 0)
+      {
+        return found;
+      }
+      --top;
+      if (stack[top].tNear <= tmax)
+      {
+        current = stack[top].node;
+        break;
+      }
+    }
+  }
+}
+
+bool BVH::occluded(BVHRay const& ray, BVHFilter const* filter) const
+{
+  if (m_nodes.empty())
+  {
+    return false;
+  }
+
+  const float3 invDirection = safeInverse(ray.direction);
+
+  float tNear;
+  if (!intersectNode(m_nodes[0], ray.origin, invDirection, ray.tmin, ray.tmax, tNear))
+  {
+    return false;
+  }
+
+  unsigned int stack[BVH_MAX_DEPTH];
+  int          top = 0;
+
+  unsigned int current = 0;
+
+  for (;;)
+  {
+    BVHNode const& node = m_nodes[current];
+
+    if (node.count != 0)
+    {
+      for (unsigned int i = node.index; i < node.index + node.count; ++i)
+      {
+        const unsigned int primitive = m_primitives[i];
+
+        float  t;
+        float2 barycentrics;
+
+        if (intersectTriangle(primitive, ray.origin, ray.direction, ray.tmin, ray.tmax, t, barycentrics) &&
+            (filter == nullptr || (*filter)(primitive, barycentrics)))
+        {
+          return true; // Any hit terminates.
+        }
+      }
+    }
+    else
+    {
+      const unsigned int left  = node.index;
+      const unsigned int right = left + 1;
+
+      float tLeft;
+      float tRight;
+
+      const bool isLeft  = intersectNode(m_nodes[left],  ray.origin, invDirection, ray.tmin, ray.tmax, tLeft);
+      const bool isRight = intersectNode(m_nodes[right], ray.origin, invDirection, ray.tmin, ray.tmax, tRight);
+
+      if (isLeft && isRight)
+      {
+        MY_ASSERT(top < BVH_MAX_DEPTH);
+        stack[top++] = right;
+        current = left;
+        continue;
+      }
+      if (isLeft)
+      {
+        current = left;
+        continue;
+      }
+      if (isRight)
+      {
+        current = right;
+        continue;
+      }
+    }
+
+    if (top == 0)
+    {
+      return false;
+    }
+    current = stack[--top];
+  }
+}
+
+void BVH::traverse(BVHRay const& ray, BVHVisitor const& visitor) const
+{
+  if (m_nodes.empty())
+  {
+    return;
+  }
+
+  const float3 invDirection = safeInverse(ray.direction);
+
+  float tmax = ray.tmax;
+
+  float tNear;
+  if (!intersectNode(m_nodes[0], ray.origin, invDirection, ray.tmin, tmax, tNear))
+  {
+    return;
+  }
+
+  struct StackEntry
+  {
+    unsigned int node;
+    float        tNear;
+  };
+
+  StackEntry stack[BVH_MAX_DEPTH];
+  int        top = 0;
+
+  unsigned int current = 0;
+
+  for (;;)
+  {
+    BVHNode const& node = m_nodes[current];
+
+    if (node.count != 0)
+    {
+      for (unsigned int i = node.index; i < node.index + node.count; ++i)
+      {
+        tmax = visitor(m_primitives[i], tmax);
+        if (tmax < 0.0f)
+        {
+          return; // Terminated by the visitor.
+        }
+      }
+    }
+    else
+    {
+      unsigned int left  = node.index;
+      unsigned int right = left + 1;
+
+      float tLeft;
+      float tRight;
+
+      const bool isLeft  = intersectNode(m_nodes[left],  ray.origin, invDirection, ray.tmin, tmax, tLeft);
+      const bool isRight = intersectNode(m_nodes[right], ray.origin, invDirection, ray.tmin, tmax, tRight);
+
+      if (isLeft && isRight)
+      {
+        if (tRight < tLeft)
+        {
+          std::swap(left, right);
+          std::swap(tLeft, tRight);
+        }
+        MY_ASSERT(top < BVH_MAX_DEPTH);
+        stack[top].node  = right;
+        stack[top].tNear = tRight;
+        ++top;
+
+        current = left;
+        continue;
+      }
+      if (isLeft)
+      {
+        current = left;
+        continue;
+      }
+      if (isRight)
+      {
+        current = right;
+        continue;
+      }
+    }
+
+    for (;;)
+    {
+      if (top == 0)
+      {
+        return;
+      }
+      --top;
+      if (stack[top].tNear <= tmax)
+      {
+        current = stack[top].node;
+        break;
+      }
+    }
+  }
+}
+
+void BVH::traversePacket(BVHRayPacket& packet, const unsigned long long active, BVHPacketVisitor const& visitor) const
+{
+  if (m_nodes.empty() || active == 0)
+  {
+    return;
+  }
+
+  BVHPacketBounds bounds;
+  bounds.set(packet, active);
+
+  float tNear;
+  if (!bounds.intersect(m_nodes[0].aabbMin, m_nodes[0].aabbMax, tNear))
+  {
+    return;
+  }
+
+  struct StackEntry
+  {
+    unsigned int node;
+    float        tNear;
+  };
+
+  StackEntry stack[BVH_MAX_DEPTH];
+  int        top = 0;
+
+  unsigned int current = 0;
+
+  for (;;)
+  {
+    BVHNode const& node = m_nodes[current];
+
+    if (node.count != 0)
+    {
+      // The interval arithmetic test is conservative. Only hand the rays which really hit the leaf to the visitor.
+      const unsigned long long mask = intersectNodeRays(node, packet, active);
+      if (mask != 0)
+      {
+        for (unsigned int i = node.index; i < node.index + node.count; ++i)
+        {
+          visitor(m_primitives[i], mask, packet);
+        }
+        bounds.tmax = getMaxDistance(packet, active);
+      }
+    }
+    else
+    {
+      unsigned int left  = node.index;
+      unsigned int right = left + 1;
+
+      float tLeft;
+      float tRight;
+
+      const bool isLeft  = bounds.intersect(m_nodes[left].aabbMin,  m_nodes[left].aabbMax,  tLeft);
+      const bool isRight = bounds.intersect(m_nodes[right].aabbMin, m_nodes[right].aabbMax, tRight);
+
+      if (isLeft && isRight)
+      {
+        if (tRight < tLeft)
+        {
+          std::swap(left, right);
+          std::swap(tLeft, tRight);
+        }
+        MY_ASSERT(top < BVH_MAX_DEPTH);
+        stack[top].node  = right;
+        stack[top].tNear = tRight;
+        ++top;
+
+        current = left;
+        continue;
+      }
+      if (isLeft)
+      {
+        current = left;
+        continue;
+      }
+      if (isRight)
+      {
+        current = right;
+        continue;
+      }
+    }
+
+    for (;;)
+    {
+      if (top == 0)
+      {
+        return;
+      }
+      --top;
+      if (stack[top].tNear <= bounds.tmax)
+      {
+        current = stack[top].node;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,1078 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/BVH8.h"
+#include "inc/BVH8Traversal.h"
+
+#include "shaders/vector_math.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BVH8_X86 1
+#endif
+
+
+bool callBVH8Filter(BVHFilter const* filter, const unsigned int primitive, float2 const& barycentrics)
+{
+  return (*filter)(primitive, barycentrics);
+}
+
+
+// ========== Scalar kernel
+
+namespace
+{
+  struct NodeTestScalar : NodeAccessFull
+  {
+    static unsigned int intersectChildren(BVH8Node const& node, BVH8RayData const& rayData, const float tmin, const float tmax, float* tNear)
+    {
+      // Near and far plane per axis depending on the ray direction octant.
+      const float* nearX = (rayData.octant[0]) ? node.upperX : node.lowerX;
+      const float* farX  = (rayData.octant[0]) ? node.lowerX : node.upperX;
+      const float* nearY = (rayData.octant[1]) ? node.upperY : node.lowerY;
+      const float* farY  = (rayData.octant[1]) ? node.lowerY : node.upperY;
+      const float* nearZ = (rayData.octant[2]) ? node.upperZ : node.lowerZ;
+      const float* farZ  = (rayData.octant[2]) ? node.lowerZ : node.upperZ;
+
+      unsigned int mask = 0;
+
+      for (int i = 0; i < 8; ++i)
+      {
+        const float tx0 = (nearX[i] - rayData.origin[0]) * rayData.invDirection[0];
+        const float tx1 = (farX[i]  - rayData.origin[0]) * rayData.invDirection[0];
+        const float ty0 = (nearY[i] - rayData.origin[1]) * rayData.invDirection[1];
+        const float ty1 = (farY[i]  - rayData.origin[1]) * rayData.invDirection[1];
+        const float tz0 = (nearZ[i] - rayData.origin[2]) * rayData.invDirection[2];
+        const float tz1 = (farZ[i]  - rayData.origin[2]) * rayData.invDirection[2];
+
+        const float t0 = (tx0 > ty0) ? tx0 : ty0;
+        const float t1 = (tz0 > tmin) ? tz0 : tmin;
+        const float t2 = (tx1 < ty1) ? tx1 : ty1;
+        const float t3 = (tz1 < tmax) ? tz1 : tmax;
+
+        tNear[i] = (t0 > t1) ? t0 : t1;
+
+        const float tFar = (t2 < t3) ? t2 : t3;
+
+        mask |= (tNear[i] <= tFar) ? (1u << i) : 0u;
+      }
+
+      return mask;
+    }
+  };
+
+  struct NodeTestCompressedScalar : NodeAccessCompressed
+  {
+    static unsigned int intersectChildren(BVH8CompressedNode const& node, BVH8RayData const& rayData, const float tmin, const float tmax, float* tNear)
+    {
+      BVH8Node decoded;
+      decodeNode(node, decoded);
+
+      return NodeTestScalar::intersectChildren(decoded, rayData, tmin, tmax, tNear);
+    }
+  };
+} // namespace
+
+bool intersectBVH8Scalar(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter)
+{
+  return intersectBVH8<NodeTestScalar>(data, ray, hit, filter);
+}
+
+bool occludedBVH8Scalar(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter)
+{
+  return occludedBVH8<NodeTestScalar>(data, ray, filter);
+}
+
+bool intersectBVH8CompressedScalar(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter)
+{
+  return intersectBVH8<NodeTestCompressedScalar>(data, ray, hit, filter);
+}
+
+bool occludedBVH8CompressedScalar(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter)
+{
+  return occludedBVH8<NodeTestCompressedScalar>(data, ray, filter);
+}
+
+
+// ========== CPU detection
+
+static BVH8Isa detectIsa()
+{
+#if defined(BVH8_X86)
+#if defined(_MSC_VER)
+  int info[4];
+
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+
+  __cpuid(info, 1);
+  const bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+  const bool hasAVX     = (info[2] & (1 << 28)) != 0;
+
+  if (!hasOSXSAVE || !hasAVX || maxLeaf < 7)
+  {
+    return BVH8_ISA_SCALAR;
+  }
+
+  // The OS must save the YMM registers, and the opmask and ZMM registers for AVX-512.
+  const unsigned long long xcr0 = _xgetbv(0);
+
+  __cpuidex(info, 7, 0);
+  const bool hasAVX2    = (info[1] & (1 << 5))  != 0;
+  const bool hasAVX512F = (info[1] & (1 << 16)) != 0;
+
+  if (hasAVX512F && (xcr0 & 0xE6) == 0xE6)
+  {
+    return BVH8_ISA_AVX512;
+  }
+  if (hasAVX2 && (xcr0 & 0x6) == 0x6)
+  {
+    return BVH8_ISA_AVX2;
+  }
+#else
+  // These check the OS support of the register state as well.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    return BVH8_ISA_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return BVH8_ISA_AVX2;
+  }
+#endif
+#endif
+  return BVH8_ISA_SCALAR;
+}
+
+
+// ========== BVH8
+
+BVH8::BVH8()
+: m_numTriangles(0)
+, m_numNodes(0)
+, m_memorySize(0)
+, m_aabbMin(make_float3(0.0f))
+, m_aabbMax(make_float3(0.0f))
+, m_triangles(BVH8_TRIANGLES_BLOCKS)
+, m_nodeFormat(BVH8_NODES_FULL)
+, m_isa(getSupportedIsa())
+{
+  memset(&m_data, 0, sizeof(BVH8Data));
+}
+
+BVH8::~BVH8()
+{
+}
+
+BVH8Isa BVH8::getSupportedIsa()
+{
+  static const BVH8Isa isa = detectIsa();
+  return isa;
+}
+
+const char* BVH8::getIsaName(const BVH8Isa isa)
+{
+  switch (isa)
+  {
+    case BVH8_ISA_SCALAR:
+      return "scalar";
+    case BVH8_ISA_AVX2:
+      return "AVX2";
+    case BVH8_ISA_AVX512:
+      return "AVX-512";
+  }
+  return "unknown";
+}
+
+void BVH8::setIsa(const BVH8Isa isa)
+{
+  m_isa = (isa <= getSupportedIsa()) ? isa : getSupportedIsa();
+}
+
+BVH8Isa BVH8::getIsa() const
+{
+  return m_isa;
+}
+
+static float getArea(BVHNode const& node)
+{
+  const float3 d = node.aabbMax - node.aabbMin;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+void BVH8::build(BVH const& bvh, const BVH8Triangles triangles, const BVH8Nodes nodeFormat)
+{
+  m_nodes.clear();
+  m_compressedNodes.clear();
+  m_blocks.clear();
+  m_file.reset();
+
+  m_numNodes   = 0;
+  m_memorySize = 0;
+
+  m_geometry     = bvh.getGeometry();
+  m_primitives   = bvh.getPrimitives();
+  m_numTriangles = bvh.getNumTriangles();
+  m_triangles    = triangles;
+  m_nodeFormat   = nodeFormat;
+
+  m_aabbMin = bvh.getAabbMin();
+  m_aabbMax = bvh.getAabbMax();
+
+  memset(&m_data, 0, sizeof(BVH8Data));
+
+  std::vector< BVHNode, AlignedAllocator<BVHNode, 64> > const& nodes = bvh.getNodes();
+  if (nodes.empty() || !m_geometry)
+  {
+    return;
+  }
+
+  // Bigger leaves fit neither into one BVH8TriangleBlock nor into the 3-bit triangle counts of the compressed nodes.
+  unsigned int maxLeafSize = 0;
+  for (BVHNode const& node : nodes)
+  {
+    maxLeafSize = std::max(maxLeafSize, node.count);
+  }
+  if (BVH_MAX_LEAF_SIZE < maxLeafSize && (m_triangles != BVH8_TRIANGLES_INDEXED || m_nodeFormat != BVH8_NODES_FULL))
+  {
+    std::cerr << "ERROR: BVH8::build() leaf with " << maxLeafSize << " triangles, using indexed triangles and full nodes" << std::endl;
+
+    m_triangles  = BVH8_TRIANGLES_INDEXED;
+    m_nodeFormat = BVH8_NODES_FULL;
+  }
+
+  struct CollapseItem
+  {
+    unsigned int binary; // Index of the binary node.
+    unsigned int wide;   // Index of the BVH8Node which receives the collapsed children of the binary node.
+  };
+
+  std::vector<CollapseItem> stack;
+
+  CollapseItem item;
+  item.binary = 0;
+  item.wide   = 0;
+  stack.push_back(item);
+
+  m_nodes.resize(1);
+
+  while (!stack.empty())
+  {
+    item = stack.back();
+    stack.pop_back();
+
+    unsigned int children[8];
+    int          numChildren = 0;
+
+    if (nodes[item.binary].count != 0)
+    {
+      children[numChildren++] = item.binary; // Only the root can be a leaf here.
+    }
+    else
+    {
+      children[numChildren++] = nodes[item.binary].index;
+      children[numChildren++] = nodes[item.binary].index + 1;
+
+      // Open the inner child with the biggest surface area until all 8 slots are used.
+      while (numChildren < 8)
+      {
+        int   best     = -1;
+        float bestArea = -1.0f;
+
+        for (int i = 0; i < numChildren; ++i)
+        {
+          BVHNode const& child = nodes[children[i]];
+          if (child.count == 0 && bestArea < getArea(child))
+          {
+            best     = i;
+            bestArea = getArea(child);
+          }
+        }
+
+        if (best < 0) // All leaves.
+        {
+          break;
+        }
+
+        const unsigned int opened = children[best];
+
+        children[best]          = nodes[opened].index;
+        children[numChildren++] = nodes[opened].index + 1;
+      }
+    }
+
+    BVH8Node node;
+
+    for (int i = 0; i < 8; ++i)
+    {
+      // Inverted bounds for the unused slots.
+      node.lowerX[i] = std::numeric_limits<float>::max();
+      node.lowerY[i] = std::numeric_limits<float>::max();
+      node.lowerZ[i] = std::numeric_limits<float>::max();
+      node.upperX[i] = -std::numeric_limits<float>::max();
+      node.upperY[i] = -std::numeric_limits<float>::max();
+      node.upperZ[i] = -std::numeric_limits<float>::max();
+      node.index[i]  = 0;
+      node.count[i]  = 0;
+    }
+
+    for (int i = 0; i < numChildren; ++i)
+    {
+      BVHNode const& child = nodes[children[i]];
+
+      node.lowerX[i] = child.aabbMin.x;
+      node.lowerY[i] = child.aabbMin.y;
+      node.lowerZ[i] = child.aabbMin.z;
+      node.upperX[i] = child.aabbMax.x;
+      node.upperY[i] = child.aabbMax.y;
+      node.upperZ[i] = child.aabbMax.z;
+
+      if (child.count != 0)
+      {
+        node.index[i] = child.index;
+        node.count[i] = child.count;
+      }
+      else
+      {
+        node.index[i] = static_cast<unsigned int>(m_nodes.size());
+
+        CollapseItem next;
+        next.binary = children[i];
+        next.wide   = node.index[i];
+        stack.push_back(next);
+
+        m_nodes.push_back(BVH8Node());
+      }
+    }
+
+    m_nodes[item.wide] = node;
+  }
+
+  std::vector<TriangleAttributes> const& attributes = m_geometry->getAttributes();
+  std::vector<unsigned int>       const& indices    = m_geometry->getIndices();
+
+  if (m_triangles == BVH8_TRIANGLES_BLOCKS)
+  {
+    // Copy the vertices of each leaf into its own block. The leaf index references the block afterwards.
+    for (BVH8Node& node : m_nodes)
+    {
+      for (int i = 0; i < 8; ++i)
+      {
+        if (node.count[i] == 0)
+        {
+          continue;
+        }
+
+        MY_ASSERT(node.count[i] <= 4);
+
+        BVH8TriangleBlock block;
+        memset(&block, 0, sizeof(BVH8TriangleBlock));
+
+        for (unsigned int lane = 0; lane < node.count[i]; ++lane)
+        {
+          const unsigned int primitive = m_primitives[node.index[i] + lane];
+
+          for (int k = 0; k < 3; ++k)
+          {
+            const float3 v = attributes[indices[primitive * 3 + k]].vertex;
+
+            block.vertex[k][0][lane] = v.x;
+            block.vertex[k][1][lane] = v.y;
+            block.vertex[k][2][lane] = v.z;
+          }
+          block.primitive[lane] = primitive;
+        }
+
+        node.index[i] = static_cast<unsigned int>(m_blocks.size());
+        m_blocks.push_back(block);
+      }
+    }
+
+    // The blocks contain the primitive indices.
+    std::vector<unsigned int>().swap(m_primitives);
+  }
+
+  if (m_nodeFormat == BVH8_NODES_COMPRESSED)
+  {
+    compressNodes();
+  }
+
+  m_data.nodes           = (m_nodes.empty()) ? nullptr : m_nodes.data();
+  m_data.compressedNodes = (m_compressedNodes.empty()) ? nullptr : m_compressedNodes.data();
+  m_data.primitives      = m_primitives.data();
+  m_data.attributes      = attributes.data();
+  m_data.indices         = indices.data();
+  m_data.blocks          = (m_blocks.empty()) ? nullptr : m_blocks.data();
+  m_data.root            = 0;
+
+  m_numNodes   = static_cast<unsigned int>(m_nodes.size() + m_compressedNodes.size());
+  m_memorySize = m_nodes.size() * sizeof(BVH8Node) + m_compressedNodes.size() * sizeof(BVH8CompressedNode) +
+                 m_primitives.size() * sizeof(unsigned int) + m_blocks.size() * sizeof(BVH8TriangleBlock);
+}
+
+// The grid coordinate q of a plane dequantizes to origin + float(q) * scale. Checked with and without fused multiply-add,
+// the kernels are compiled with different instruction sets.
+static bool isBelow(const float origin, const float scale, const unsigned int q, const float value)
+{
+  const volatile float product = float(q) * scale; // Prevents the contraction into a fused multiply-add.
+  return origin + product <= value && fmaf(float(q), scale, origin) <= value;
+}
+
+static bool isAbove(const float origin, const float scale, const unsigned int q, const float value)
+{
+  const volatile float product = float(q) * scale;
+  return value <= origin + product && value <= fmaf(float(q), scale, origin);
+}
+
+// Quantizes the child planes of one axis with the smallest exponent which keeps all children conservative.
+static void quantizeAxis(const float* lower, const float* upper, const int numChildren, const float origin, const float extent,
+                         signed char& exponent, unsigned char* qlo, unsigned char* qhi)
+{
+  // 255 * 2^e >= extent.
+  int e = -126;
+  if (0.0f < extent)
+  {
+    frexpf(extent / 255.0f, &e);
+    e = std::max(-126, std::min(127, e));
+  }
+
+  for (;;)
+  {
+    const unsigned int bits  = static_cast<unsigned int>(e + 127) << 23;
+
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+
+    bool isConservative = true;
+
+    for (int i = 0; i < numChildren && isConservative; ++i)
+    {
+      // Rounded outwards, then corrected for the rounding of the dequantization.
+      unsigned int lo = static_cast<unsigned int>(std::max(0.0f, std::min(255.0f, floorf((lower[i] - origin) / scale))));
+      unsigned int hi = static_cast<unsigned int>(std::max(0.0f, std::min(255.0f, ceilf((upper[i] - origin) / scale))));
+
+      while (0 < lo && !isBelow(origin, scale, lo, lower[i]))
+      {
+        --lo;
+      }
+      while (hi < 255 && !isAbove(origin, scale, hi, upper[i]))
+      {
+        ++hi;
+      }
+
+      isConservative = isBelow(origin, scale, lo, lower[i]) && isAbove(origin, scale, hi, upper[i]);
+
+      qlo[i] = static_cast<unsigned char>(lo);
+      qhi[i] = static_cast<unsigned char>(hi);
+    }
+
+    if (isConservative || e == 127)
+    {
+      MY_ASSERT(isConservative);
+      exponent = static_cast<signed char>(e);
+      return;
+    }
+    ++e; // Coarser grid.
+  }
+}
+
+// Converts the full nodes into compressed nodes in depth first order. The inner children of each node become consecutive nodes,
+// the blocks or primitive list entries of its leaf children are copied into consecutive ranges.
+void BVH8::compressNodes()
+{
+  MY_STATIC_ASSERT(sizeof(BVH8CompressedNode) == 80);
+
+  std::vector< BVH8TriangleBlock, AlignedAllocator<BVH8TriangleBlock, 16> > blocks;
+  std::vector<unsigned int> primitives;
+
+  blocks.reserve(m_blocks.size());
+  primitives.reserve(m_primitives.size());
+
+  struct CompressItem
+  {
+    unsigned int full;       // Index of the BVH8Node.
+    unsigned int compressed; // Index of the BVH8CompressedNode which receives it.
+  };
+
+  std::vector<CompressItem> stack;
+
+  CompressItem item;
+  item.full       = 0;
+  item.compressed = 0;
+  stack.push_back(item);
+
+  m_compressedNodes.resize(1);
+
+  while (!stack.empty())
+  {
+    item = stack.back();
+    stack.pop_back();
+
+    BVH8Node const& src = m_nodes[item.full];
+
+    BVH8CompressedNode dst;
+    memset(&dst, 0, sizeof(BVH8CompressedNode));
+
+    // The used slots are at the front, unused ones have inverted bounds.
+    int numChildren = 0;
+    while (numChildren < 8 && src.lowerX[numChildren] <= src.upperX[numChildren])
+    {
+      ++numChildren;
+    }
+
+    float3 lo = make_float3(std::numeric_limits<float>::max());
+    float3 hi = make_float3(-std::numeric_limits<float>::max());
+
+    for (int i = 0; i < numChildren; ++i)
+    {
+      lo = fminf(lo, make_float3(src.lowerX[i], src.lowerY[i], src.lowerZ[i]));
+      hi = fmaxf(hi, make_float3(src.upperX[i], src.upperY[i], src.upperZ[i]));
+    }
+
+    dst.origin[0] = lo.x;
+    dst.origin[1] = lo.y;
+    dst.origin[2] = lo.z;
+
+    quantizeAxis(src.lowerX, src.upperX, numChildren, lo.x, hi.x - lo.x, dst.exponent[0], dst.qlo[0], dst.qhi[0]);
+    quantizeAxis(src.lowerY, src.upperY, numChildren, lo.y, hi.y - lo.y, dst.exponent[1], dst.qlo[1], dst.qhi[1]);
+    quantizeAxis(src.lowerZ, src.upperZ, numChildren, lo.z, hi.z - lo.z, dst.exponent[2], dst.qlo[2], dst.qhi[2]);
+
+    dst.childBase     = static_cast<unsigned int>(m_compressedNodes.size());
+    dst.primitiveBase = static_cast<unsigned int>((m_triangles == BVH8_TRIANGLES_BLOCKS) ? blocks.size() : primitives.size());
+
+    unsigned int offset = 0;
+
+    for (int i = 0; i < numChildren; ++i)
+    {
+      if (src.count[i] == 0)
+      {
+        dst.imask |= static_cast<unsigned char>(1u << i);
+
+        CompressItem next;
+        next.full       = src.index[i];
+        next.compressed = static_cast<unsigned int>(m_compressedNodes.size());
+        stack.push_back(next);
+
+        m_compressedNodes.push_back(BVH8CompressedNode());
+        continue;
+      }
+
+      MY_ASSERT(src.count[i] <= 7 && offset <= 31);
+
+      dst.meta[i] = static_cast<unsigned char>(src.count[i] | (offset << 3));
+
+      if (m_triangles == BVH8_TRIANGLES_BLOCKS)
+      {
+        blocks.push_back(m_blocks[src.index[i]]); // One block per leaf.
+        offset += 1;
+      }
+      else
+      {
+        primitives.insert(primitives.end(), m_primitives.begin() + src.index[i], m_primitives.begin() + src.index[i] + src.count[i]);
+        offset += src.count[i];
+      }
+    }
+
+    m_compressedNodes[item.compressed] = dst;
+  }
+
+  m_blocks.swap(blocks);
+  m_primitives.swap(primitives);
+
+  std::vector< BVH8Node, AlignedAllocator<BVH8Node, 64> >().swap(m_nodes);
+}
+
+// Blob 0 of a cached BVH8, followed by the nodes, the primitive list and the triangle blocks.
+struct BVH8CacheInfo
+{
+  float3       aabbMin;
+  unsigned int numTriangles;
+  float3       aabbMax;
+  unsigned int triangles;
+  unsigned int nodes;    // BVH8Nodes, the element type of blob 1.
+  unsigned int unused[3];
+};
+
+bool BVH8::load(GeometryCache const& cache, const unsigned long long key, std::shared_ptr<sg::Triangles> geometry)
+{
+  std::shared_ptr<CacheFile> file = cache.load(key);
+  if (!file || file->getNumBlobs() != 4 || !geometry)
+  {
+    return false;
+  }
+
+  size_t sizeInfo;
+  size_t sizeNodes;
+  size_t sizePrimitives;
+  size_t sizeBlocks;
+
+  const BVH8CacheInfo*     info       = static_cast<const BVH8CacheInfo*>(file->getBlob(0, sizeInfo));
+  const void*              nodes      = file->getBlob(1, sizeNodes);
+  const unsigned int*      primitives = static_cast<const unsigned int*>(file->getBlob(2, sizePrimitives));
+  const BVH8TriangleBlock* blocks     = static_cast<const BVH8TriangleBlock*>(file->getBlob(3, sizeBlocks));
+
+  std::vector<TriangleAttributes> const& attributes = geometry->getAttributes();
+  std::vector<unsigned int>       const& indices    = geometry->getIndices();
+
+  if (sizeInfo != sizeof(BVH8CacheInfo) ||
+      (info->nodes != BVH8_NODES_FULL && info->nodes != BVH8_NODES_COMPRESSED))
+  {
+    std::cerr << "ERROR: BVH8::load() invalid cache entry " << std::hex << key << std::dec << std::endl;
+    return false;
+  }
+
+  const size_t sizeNode = (info->nodes == BVH8_NODES_COMPRESSED) ? sizeof(BVH8CompressedNode) : sizeof(BVH8Node);
+
+  if (sizeNodes == 0 || sizeNodes % sizeNode != 0 ||
+      sizePrimitives % sizeof(unsigned int) != 0 ||
+      sizeBlocks % sizeof(BVH8TriangleBlock) != 0 ||
+      info->numTriangles != static_cast<unsigned int>(indices.size()) / 3 ||
+      (info->triangles == BVH8_TRIANGLES_INDEXED && (sizePrimitives < info->numTriangles * sizeof(unsigned int) || sizeBlocks != 0)) ||
+      (info->triangles == BVH8_TRIANGLES_BLOCKS && sizeBlocks == 0) ||
+      (info->triangles != BVH8_TRIANGLES_INDEXED && info->triangles != BVH8_TRIANGLES_BLOCKS))
+  {
+    std::cerr << "ERROR: BVH8::load() invalid cache entry " << std::hex << key << std::dec << std::endl;
+    return false;
+  }
+
+  m_nodes.clear();
+  m_compressedNodes.clear();
+  m_primitives.clear();
+  m_blocks.clear();
+
+  m_file     = file;
+  m_geometry = geometry;
+
+  m_numTriangles = info->numTriangles;
+  m_numNodes     = static_cast<unsigned int>(sizeNodes / sizeNode);
+  m_memorySize   = sizeNodes + sizePrimitives + sizeBlocks;
+  m_triangles    = static_cast<BVH8Triangles>(info->triangles);
+  m_nodeFormat   = static_cast<BVH8Nodes>(info->nodes);
+
+  m_aabbMin = info->aabbMin;
+  m_aabbMax = info->aabbMax;
+
+  m_data.nodes           = (m_nodeFormat == BVH8_NODES_FULL) ? static_cast<const BVH8Node*>(nodes) : nullptr;
+  m_data.compressedNodes = (m_nodeFormat == BVH8_NODES_COMPRESSED) ? static_cast<const BVH8CompressedNode*>(nodes) : nullptr;
+  m_data.primitives      = (sizePrimitives != 0) ? primitives : nullptr;
+  m_data.attributes      = attributes.data();
+  m_data.indices         = indices.data();
+  m_data.blocks          = (sizeBlocks != 0) ? blocks : nullptr;
+  m_data.root            = 0;
+
+  return true;
+}
+
+bool BVH8::store(GeometryCache const& cache, const unsigned long long key) const
+{
+  if (m_numNodes == 0)
+  {
+    return false;
+  }
+
+  BVH8CacheInfo info;
+
+  info.aabbMin      = m_aabbMin;
+  info.numTriangles = m_numTriangles;
+  info.aabbMax      = m_aabbMax;
+  info.triangles    = m_triangles;
+  info.nodes        = m_nodeFormat;
+  info.unused[0]    = 0;
+  info.unused[1]    = 0;
+  info.unused[2]    = 0;
+
+  std::vector<CacheBlob> blobs(4);
+
+  blobs[0].data = &info;
+  blobs[0].size = sizeof(BVH8CacheInfo);
+  if (m_nodeFormat == BVH8_NODES_COMPRESSED)
+  {
+    blobs[1].data = m_data.compressedNodes;
+    blobs[1].size = m_numNodes * sizeof(BVH8CompressedNode);
+  }
+  else
+  {
+    blobs[1].data = m_data.nodes;
+    blobs[1].size = m_numNodes * sizeof(BVH8Node);
+  }
+  blobs[2].data = m_data.primitives;
+  blobs[2].size = (m_triangles == BVH8_TRIANGLES_INDEXED) ? m_memorySize - blobs[1].size : 0; // Spatial splits can reference triangles more than once.
+  blobs[3].data = m_data.blocks;
+  blobs[3].size = m_memorySize - blobs[1].size - blobs[2].size;
+
+  return cache.store(key, blobs);
+}
+
+bool BVH8::intersectKernel(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter) const
+{
+  if (data.compressedNodes != nullptr)
+  {
+    // The dequantization dominates the child test, the AVX2 kernel serves AVX-512 CPUs as well.
+#if defined(BVH8_X86)
+    if (m_isa != BVH8_ISA_SCALAR)
+    {
+      return intersectBVH8CompressedAVX2(data, ray, hit, filter);
+    }
+#endif
+    return intersectBVH8CompressedScalar(data, ray, hit, filter);
+  }
+
+  switch (m_isa)
+  {
+#if defined(BVH8_X86)
+    case BVH8_ISA_AVX512:
+      return intersectBVH8AVX512(data, ray, hit, filter);
+    case BVH8_ISA_AVX2:
+      return intersectBVH8AVX2(data, ray, hit, filter);
+#endif
+    default:
+      return intersectBVH8Scalar(data, ray, hit, filter);
+  }
+}
+
+bool BVH8::intersect(BVHRay const& ray, BVHHit& hit, BVHFilter const* filter) const
+{
+  if (m_numNodes == 0)
+  {
+    return false;
+  }
+
+  return intersectKernel(m_data, ray, hit, filter);
+}
+
+bool BVH8::occluded(BVHRay const& ray, BVHFilter const* filter) const
+{
+  if (m_numNodes == 0)
+  {
+    return false;
+  }
+
+  if (m_data.compressedNodes != nullptr)
+  {
+#if defined(BVH8_X86)
+    if (m_isa != BVH8_ISA_SCALAR)
+    {
+      return occludedBVH8CompressedAVX2(m_data, ray, filter);
+    }
+#endif
+    return occludedBVH8CompressedScalar(m_data, ray, filter);
+  }
+
+  switch (m_isa)
+  {
+#if defined(BVH8_X86)
+    case BVH8_ISA_AVX512:
+      return occludedBVH8AVX512(m_data, ray, filter);
+    case BVH8_ISA_AVX2:
+      return occludedBVH8AVX2(m_data, ray, filter);
+#endif
+    default:
+      return occludedBVH8Scalar(m_data, ray, filter);
+  }
+}
+
+static unsigned int popcount64(const unsigned long long mask)
+{
+#if defined(_MSC_VER)
+  return static_cast<unsigned int>(__popcnt64(mask));
+#else
+  return static_cast<unsigned int>(__builtin_popcountll(mask));
+#endif
+}
+
+static unsigned int findLowestBit64(const unsigned long long mask)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return static_cast<unsigned int>(index);
+#else
+  return static_cast<unsigned int>(__builtin_ctzll(mask));
+#endif
+}
+
+// Individual slab tests of the active rays against one child. Same operations as intersectNode() in BVH.cpp.
+static unsigned long long intersectChildRays(BVH8Node const& node, const int i, BVHRayPacket const& packet, const unsigned long long active)
+{
+  unsigned long long mask = 0;
+
+  unsigned long long bits = active;
+  while (bits != 0)
+  {
+    const unsigned int r = findLowestBit64(bits);
+    bits &= bits - 1;
+
+    float3 const& o   = packet.origin[r];
+    float3 const& inv = packet.invDirection[r];
+
+    const float tx0 = (node.lowerX[i] - o.x) * inv.x;
+    const float tx1 = (node.upperX[i] - o.x) * inv.x;
+    const float ty0 = (node.lowerY[i] - o.y) * inv.y;
+    const float ty1 = (node.upperY[i] - o.y) * inv.y;
+    const float tz0 = (node.lowerZ[i] - o.z) * inv.z;
+    const float tz1 = (node.upperZ[i] - o.z) * inv.z;
+
+    const float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), packet.tmin));
+    const float tFar  = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), packet.tmax[r]));
+
+    if (tNear <= tFar)
+    {
+      mask |= 1ull << r;
+    }
+  }
+  return mask;
+}
+
+// The largest tmax of the active rays.
+static float getMaxDistance(BVHRayPacket const& packet, const unsigned long long active)
+{
+  float tmax = -std::numeric_limits<float>::max();
+
+  unsigned long long bits = active;
+  while (bits != 0)
+  {
+    const unsigned int r = findLowestBit64(bits);
+    bits &= bits - 1;
+
+    tmax = std::max(tmax, packet.tmax[r]);
+  }
+  return tmax;
+}
+
+// Front to back traversal with the interval arithmetic bounds of the packet.
+// The leaf children store the rays which really hit them, so the triangles are only tested for these.
+unsigned long long BVH8::intersectPacket(BVHRayPacket& packet, const unsigned long long active, BVHHit* hits) const
+{
+  if (m_numNodes == 0 || active == 0)
+  {
+    return 0;
+  }
+
+  BVHPacketBounds bounds;
+  bounds.set(packet, active);
+
+  // The watertight triangle test needs the per ray setup. Done on demand for the rays reaching a leaf.
+  BVH8RayData        rayData[BVH_PACKET_SIZE];
+  unsigned long long hasRayData = 0;
+
+  struct StackEntry
+  {
+    unsigned int       index;
+    unsigned int       count; // != 0 for leaves.
+    float              tNear;
+    unsigned long long mask;  // Rays to test inside the leaves.
+  };
+
+  StackEntry stack[BVH8_STACK_SIZE];
+  int        top = 0;
+
+  stack[top].index = 0;
+  stack[top].count = 0;
+  stack[top].tNear = packet.tmin;
+  stack[top].mask  = active;
+  ++top;
+
+  unsigned long long found = 0;
+  bool               updateTmax = false;
+
+  while (0 < top)
+  {
+    if (updateTmax)
+    {
+      bounds.tmax = getMaxDistance(packet, active);
+      updateTmax  = false;
+    }
+
+    const StackEntry entry = stack[--top];
+
+    if (bounds.tmax < entry.tNear) // Behind the closest hits of all rays.
+    {
+      continue;
+    }
+
+    if (entry.count != 0)
+    {
+      unsigned long long bits = entry.mask;
+      while (bits != 0)
+      {
+        const unsigned int r = findLowestBit64(bits);
+        bits &= bits - 1;
+
+        if (!(hasRayData & (1ull << r)))
+        {
+          BVHRay ray;
+
+          ray.origin    = packet.origin[r];
+          ray.tmin      = packet.tmin;
+          ray.direction = packet.direction[r];
+          ray.tmax      = packet.tmax[r];
+
+          setupRay(ray, rayData[r]);
+          hasRayData |= 1ull << r;
+        }
+
+        if (intersectLeaf(m_data, entry.index, entry.count, rayData[r], packet.tmin, packet.tmax[r], hits[r], nullptr))
+        {
+          found |= 1ull << r;
+        }
+      }
+
+      updateTmax = (entry.mask & found) != 0;
+      continue;
+    }
+
+    // The packet test works on the full node layout, compressed nodes are dequantized first.
+    BVH8Node decoded;
+    if (m_data.compressedNodes != nullptr)
+    {
+      decodeNode(m_data.compressedNodes[entry.index], decoded);
+    }
+    BVH8Node const& node = (m_data.compressedNodes != nullptr) ? decoded : m_data.nodes[entry.index];
+
+    const int first = top;
+    for (int i = 0; i < 8; ++i)
+    {
+      if (node.upperX[i] < node.lowerX[i]) // Unused slot.
+      {
+        continue;
+      }
+
+      float tNear;
+      if (!bounds.intersect(make_float3(node.lowerX[i], node.lowerY[i], node.lowerZ[i]),
+                            make_float3(node.upperX[i], node.upperY[i], node.upperZ[i]), tNear))
+      {
+        continue;
+      }
+
+      const unsigned long long mask = intersectChildRays(node, i, packet, entry.mask);
+      if (mask == 0)
+      {
+        continue;
+      }
+
+      // Deeper down the packet rays diverge. Finish subtrees with only a few rays with the single ray kernel.
+      if (node.count[i] == 0 && popcount64(mask) <= BVH8_PACKET_MIN_RAYS)
+      {
+        BVH8Data data = m_data;
+        data.root = node.index[i];
+
+        unsigned long long bits = mask;
+        while (bits != 0)
+        {
+          const unsigned int r = findLowestBit64(bits);
+          bits &= bits - 1;
+
+          BVHRay ray;
+
+          ray.origin    = packet.origin[r];
+          ray.tmin      = packet.tmin;
+          ray.direction = packet.direction[r];
+          ray.tmax      = packet.tmax[r];
+
+          if (intersectKernel(data, ray, hits[r], nullptr))
+          {
+            packet.tmax[r] = hits[r].distance;
+            found |= 1ull << r;
+          }
+        }
+        updateTmax = true;
+        continue;
+      }
+
+      MY_ASSERT(top < BVH8_STACK_SIZE);
+
+      // Farthest first, to pop the nearest child next.
+      int j = top++;
+      while (first < j && stack[j - 1].tNear < tNear)
+      {
+        stack[j] = stack[j - 1];
+        --j;
+      }
+      stack[j].index = node.index[i];
+      stack[j].count = node.count[i];
+      stack[j].tNear = tNear;
+      stack[j].mask  = mask;
+    }
+  }
+
+  return found;
+}
+
+float3 BVH8::getAabbMin() const
+{
+  return m_aabbMin;
+}
+
+float3 BVH8::getAabbMax() const
+{
+  return m_aabbMax;
+}
+
+unsigned int BVH8::getNumTriangles() const
+{
+  return m_numTriangles;
+}
+
+unsigned int BVH8::getNumNodes() const
+{
+  return m_numNodes;
+}
+
+size_t BVH8::getMemorySize() const
+{
+  return m_memorySize;
+}
+
+BVH8Triangles BVH8::getTriangles() const
+{
+  return m_triangles;
+}
+
+BVH8Nodes BVH8::getNodeFormat() const
+{
+  return m_nodeFormat;
+}
+
+float BVH8::getBytesPerTriangle() const
+{
+  return float(m_memorySize) / float(std::max(m_numTriangles, 1u));
+}
+
+std::shared_ptr<sg::Triangles> BVH8::getGeometry() const
+{
+  return m_geometry;
+}
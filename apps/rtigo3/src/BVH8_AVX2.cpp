@@ -0,0 +1,129 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compiled with AVX2 code generation. Only called when BVH8::getSupportedIsa() reports AVX2 or better.
+
+#include "inc/BVH8Traversal.h"
+
+#include <immintrin.h>
+
+
+namespace
+{
+  // Slab test of 8 children against their near and far planes per axis.
+  inline unsigned int intersectPlanes(const __m256 nearX, const __m256 farX, const __m256 nearY, const __m256 farY, const __m256 nearZ, const __m256 farZ,
+                                      BVH8RayData const& rayData, const float tmin, const float tmax, float* tNear)
+  {
+    const __m256 ox = _mm256_set1_ps(rayData.origin[0]);
+    const __m256 oy = _mm256_set1_ps(rayData.origin[1]);
+    const __m256 oz = _mm256_set1_ps(rayData.origin[2]);
+    const __m256 ix = _mm256_set1_ps(rayData.invDirection[0]);
+    const __m256 iy = _mm256_set1_ps(rayData.invDirection[1]);
+    const __m256 iz = _mm256_set1_ps(rayData.invDirection[2]);
+
+    const __m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(nearX, ox), ix);
+    const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(farX,  ox), ix);
+    const __m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(nearY, oy), iy);
+    const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(farY,  oy), iy);
+    const __m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(nearZ, oz), iz);
+    const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(farZ,  oz), iz);
+
+    const __m256 t0 = _mm256_max_ps(_mm256_max_ps(tx0, ty0), _mm256_max_ps(tz0, _mm256_set1_ps(tmin)));
+    const __m256 t1 = _mm256_min_ps(_mm256_min_ps(tx1, ty1), _mm256_min_ps(tz1, _mm256_set1_ps(tmax)));
+
+    _mm256_store_ps(tNear, t0);
+
+    return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+  }
+
+  struct NodeTestAVX2 : NodeAccessFull
+  {
+    static unsigned int intersectChildren(BVH8Node const& node, BVH8RayData const& rayData, const float tmin, const float tmax, float* tNear)
+    {
+      const float* nearX = (rayData.octant[0]) ? node.upperX : node.lowerX;
+      const float* farX  = (rayData.octant[0]) ? node.lowerX : node.upperX;
+      const float* nearY = (rayData.octant[1]) ? node.upperY : node.lowerY;
+      const float* farY  = (rayData.octant[1]) ? node.lowerY : node.upperY;
+      const float* nearZ = (rayData.octant[2]) ? node.upperZ : node.lowerZ;
+      const float* farZ  = (rayData.octant[2]) ? node.lowerZ : node.upperZ;
+
+      return intersectPlanes(_mm256_load_ps(nearX), _mm256_load_ps(farX),
+                             _mm256_load_ps(nearY), _mm256_load_ps(farY),
+                             _mm256_load_ps(nearZ), _mm256_load_ps(farZ), rayData, tmin, tmax, tNear);
+    }
+  };
+
+  struct NodeTestCompressedAVX2 : NodeAccessCompressed
+  {
+    // Same calculation as decodeNode(): origin + float(q) * scale, separate multiply and add.
+    static __m256 dequantize(const unsigned char* q, const float origin, const float scale)
+    {
+      const __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q))));
+      return _mm256_add_ps(_mm256_set1_ps(origin), _mm256_mul_ps(f, _mm256_set1_ps(scale)));
+    }
+
+    // The unused slots are not masked here. getChild() skips them.
+    static unsigned int intersectChildren(BVH8CompressedNode const& node, BVH8RayData const& rayData, const float tmin, const float tmax, float* tNear)
+    {
+      const float scaleX = getScale(node.exponent[0]);
+      const float scaleY = getScale(node.exponent[1]);
+      const float scaleZ = getScale(node.exponent[2]);
+
+      const __m256 lowerX = dequantize(node.qlo[0], node.origin[0], scaleX);
+      const __m256 upperX = dequantize(node.qhi[0], node.origin[0], scaleX);
+      const __m256 lowerY = dequantize(node.qlo[1], node.origin[1], scaleY);
+      const __m256 upperY = dequantize(node.qhi[1], node.origin[1], scaleY);
+      const __m256 lowerZ = dequantize(node.qlo[2], node.origin[2], scaleZ);
+      const __m256 upperZ = dequantize(node.qhi[2], node.origin[2], scaleZ);
+
+      return intersectPlanes((rayData.octant[0]) ? upperX : lowerX, (rayData.octant[0]) ? lowerX : upperX,
+                             (rayData.octant[1]) ? upperY : lowerY, (rayData.octant[1]) ? lowerY : upperY,
+                             (rayData.octant[2]) ? upperZ : lowerZ, (rayData.octant[2]) ? lowerZ : upperZ, rayData, tmin, tmax, tNear);
+    }
+  };
+} // namespace
+
+bool intersectBVH8AVX2(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter)
+{
+  return intersectBVH8<NodeTestAVX2>(data, ray, hit, filter);
+}
+
+bool occludedBVH8AVX2(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter)
+{
+  return occludedBVH8<NodeTestAVX2>(data, ray, filter);
+}
+
+bool intersectBVH8CompressedAVX2(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter)
+{
+  return intersectBVH8<NodeTestCompressedAVX2>(data, ray, hit, filter);
+}
+
+bool occludedBVH8CompressedAVX2(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter)
+{
+  return occludedBVH8<NodeTestCompressedAVX2>(data, ray, filter);
+}
@@ -0,0 +1,90 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compiled with AVX-512 code generation. Only called when BVH8::getSupportedIsa() reports AVX-512.
+
+#include "inc/BVH8Traversal.h"
+
+#include <immintrin.h>
+
+
+namespace
+{
+  struct NodeTestAVX512 : NodeAccessFull
+  {
+    // The lower and upper planes of one axis are 16 adjacent floats, one ZMM register.
+    // Swapping the 256-bit halves for negative directions puts the near planes into the lower half and the far planes into the upper half.
+    // Then a masked max on the lower half and a masked min on the upper half reduce all three axes.
+    static unsigned int intersectChildren(BVH8Node const& node, BVH8RayData const& rayData, const float tmin, const float tmax, float* tNear)
+    {
+      const __m512 tx = slabs(node.lowerX, rayData, 0);
+      const __m512 ty = slabs(node.lowerY, rayData, 1);
+      const __m512 tz = slabs(node.lowerZ, rayData, 2);
+
+      const __mmask16 nearHalf = 0x00FF;
+      const __mmask16 farHalf  = 0xFF00;
+
+      // Start with tmin in the near half and tmax in the far half.
+      __m512 t = _mm512_mask_blend_ps(farHalf, _mm512_set1_ps(tmin), _mm512_set1_ps(tmax));
+
+      t = _mm512_mask_max_ps(t, nearHalf, t, tx);
+      t = _mm512_mask_min_ps(t, farHalf,  t, tx);
+      t = _mm512_mask_max_ps(t, nearHalf, t, ty);
+      t = _mm512_mask_min_ps(t, farHalf,  t, ty);
+      t = _mm512_mask_max_ps(t, nearHalf, t, tz);
+      t = _mm512_mask_min_ps(t, farHalf,  t, tz);
+
+      _mm256_store_ps(tNear, _mm512_castps512_ps256(t));
+
+      // Compare the near half against the far half moved into the lower lanes.
+      const __m512 tFar = _mm512_shuffle_f32x4(t, t, _MM_SHUFFLE(1, 0, 3, 2));
+
+      return static_cast<unsigned int>(_mm512_mask_cmp_ps_mask(nearHalf, t, tFar, _CMP_LE_OQ));
+    }
+
+    static __m512 slabs(const float* lowerUpper, BVH8RayData const& rayData, const int axis)
+    {
+      __m512 planes = _mm512_load_ps(lowerUpper);
+      if (rayData.octant[axis])
+      {
+        planes = _mm512_shuffle_f32x4(planes, planes, _MM_SHUFFLE(1, 0, 3, 2));
+      }
+      return _mm512_mul_ps(_mm512_sub_ps(planes, _mm512_set1_ps(rayData.origin[axis])), _mm512_set1_ps(rayData.invDirection[axis]));
+    }
+  };
+} // namespace
+
+bool intersectBVH8AVX512(BVH8Data const& data, BVHRay const& ray, BVHHit& hit, BVHFilter const* filter)
+{
+  return intersectBVH8<NodeTestAVX512>(data, ray, hit, filter);
+}
+
+bool occludedBVH8AVX512(BVH8Data const& data, BVHRay const& ray, BVHFilter const* filter)
+{
+  return occludedBVH8<NodeTestAVX512>(data, ray, filter);
+}
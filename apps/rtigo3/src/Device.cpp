@@ -236,6 +236,10 @@ Device::Device(const RendererStrategy strategy,
 , m_tex(tex)
 , m_pbo(pbo)
 , m_nodeMask(0)
+, m_d_tlas(0)
+, m_d_instances(0)
+, m_tlasCost(0.0f)
+, m_geometryFormat(GEOMETRY_FORMAT_FULL)
 , m_launchWidth(0)
 , m_ownsSharedBuffer(false)
 , m_textureAlbedo(nullptr)
@@ -346,6 +350,7 @@ Device::~Device()
   }
 
   CU_CHECK_NO_THROW( cuMemFree(m_d_tlas) );
+  CU_CHECK_NO_THROW( cuMemFree(m_d_instances) );
 
   CU_CHECK_NO_THROW( cuMemFree(reinterpret_cast<CUdeviceptr>(m_d_sbtRecordGeometryInstanceData)) ); // This holds all SBT records with istance data (hitgroup).
   CU_CHECK_NO_THROW( cuMemFree(m_d_sbtRecordHeaders) );                                             // This holds all SBT records without instance data.
@@ -590,6 +595,11 @@ void Device::initPipeline()
   ptx = readPTXFromInclude(closesthit_ptx, sizeof(closesthit_ptx), "closesthit.ptx");
   OPTIX_CHECK( m_api.optixModuleCreateFromPTX(m_optixContext, &mco, &pco, ptx.c_str(), ptx.size(), nullptr, nullptr, &moduleClosesthit) );
 
+  OptixModule moduleIntersection;
+  //ptx = readPTX("./rtigo3_core/intersection.ptx");
+  ptx = readPTXFromInclude(intersection_ptx, sizeof(intersection_ptx), "intersection.ptx");
+  OPTIX_CHECK( m_api.optixModuleCreateFromPTX(m_optixContext, &mco, &pco, ptx.c_str(), ptx.size(), nullptr, nullptr, &moduleIntersection) );
+
   OptixModule moduleAnyhit;
   // ptx = readPTX("./rtigo3_core/anyhit.ptx");
   ptx = readPTXFromInclude(anyhit_ptx, sizeof(anyhit_ptx), "anyhit.ptx");
@@ -798,6 +808,41 @@ void Device::initPipeline()
   pgd->hitgroup.moduleAH            = moduleAnyhit;
   pgd->hitgroup.entryFunctionNameAH = "__anyhit__shadow_cutout";
 
+  // The analytic primitives are OptiX custom primitives with the same closest hit and anyhit programs.
+  pgd = &programGroupDescriptions[PGID_HIT_RADIANCE_PRIMITIVE];
+  pgd->kind  = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
+  pgd->flags = OPTIX_PROGRAM_GROUP_FLAGS_NONE;
+  pgd->hitgroup.moduleCH            = moduleClosesthit;
+  pgd->hitgroup.entryFunctionNameCH = "__closesthit__radiance";
+  pgd->hitgroup.moduleIS            = moduleIntersection;
+  pgd->hitgroup.entryFunctionNameIS = "__intersection__primitive";
+
+  pgd = &programGroupDescriptions[PGID_HIT_SHADOW_PRIMITIVE];
+  pgd->kind  = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
+  pgd->flags = OPTIX_PROGRAM_GROUP_FLAGS_NONE;
+  pgd->hitgroup.moduleAH            = moduleAnyhit;
+  pgd->hitgroup.entryFunctionNameAH = "__anyhit__shadow";
+  pgd->hitgroup.moduleIS            = moduleIntersection;
+  pgd->hitgroup.entryFunctionNameIS = "__intersection__primitive";
+
+  pgd = &programGroupDescriptions[PGID_HIT_RADIANCE_PRIMITIVE_CUTOUT];
+  pgd->kind  = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
+  pgd->flags = OPTIX_PROGRAM_GROUP_FLAGS_NONE;
+  pgd->hitgroup.moduleCH            = moduleClosesthit;
+  pgd->hitgroup.entryFunctionNameCH = "__closesthit__radiance";
+  pgd->hitgroup.moduleAH            = moduleAnyhit;
+  pgd->hitgroup.entryFunctionNameAH = "__anyhit__radiance_cutout";
+  pgd->hitgroup.moduleIS            = moduleIntersection;
+  pgd->hitgroup.entryFunctionNameIS = "__intersection__primitive";
+
+  pgd = &programGroupDescriptions[PGID_HIT_SHADOW_PRIMITIVE_CUTOUT];
+  pgd->kind  = OPTIX_PROGRAM_GROUP_KIND_HITGROUP;
+  pgd->flags = OPTIX_PROGRAM_GROUP_FLAGS_NONE;
+  pgd->hitgroup.moduleAH            = moduleAnyhit;
+  pgd->hitgroup.entryFunctionNameAH = "__anyhit__shadow_cutout";
+  pgd->hitgroup.moduleIS            = moduleIntersection;
+  pgd->hitgroup.entryFunctionNameIS = "__intersection__primitive";
+
   OptixProgramGroupOptions pgo; // FIXME Not implementing anything, this is a placeholder.
   memset(&pgo, 0, sizeof(OptixProgramGroupOptions) );
 
@@ -863,6 +908,7 @@ void Device::initPipeline()
   }
 
   CU_CHECK( cuMemAlloc(&m_d_sbtRecordHeaders, sizeof(SbtRecordHeader) * numHeaders) );
+  m_memoryStatistics.sbt += sizeof(SbtRecordHeader) * numHeaders;
   CU_CHECK( cuMemcpyHtoDAsync(m_d_sbtRecordHeaders, sbtRecordHeaders.data(), sizeof(SbtRecordHeader) * numHeaders, m_cudaStream) );
 
   // Hit groups for radiance and shadow rays. These will be initialized later per instance.
@@ -875,6 +921,11 @@ void Device::initPipeline()
   OPTIX_CHECK( m_api.optixSbtRecordPackHeader(programGroups[PGID_HIT_RADIANCE_CUTOUT], &m_sbtRecordHitRadianceCutout) );
   OPTIX_CHECK( m_api.optixSbtRecordPackHeader(programGroups[PGID_HIT_SHADOW_CUTOUT],   &m_sbtRecordHitShadowCutout) );
 
+  OPTIX_CHECK( m_api.optixSbtRecordPackHeader(programGroups[PGID_HIT_RADIANCE_PRIMITIVE],        &m_sbtRecordHitRadiancePrimitive) );
+  OPTIX_CHECK( m_api.optixSbtRecordPackHeader(programGroups[PGID_HIT_SHADOW_PRIMITIVE],          &m_sbtRecordHitShadowPrimitive) );
+  OPTIX_CHECK( m_api.optixSbtRecordPackHeader(programGroups[PGID_HIT_RADIANCE_PRIMITIVE_CUTOUT], &m_sbtRecordHitRadiancePrimitiveCutout) );
+  OPTIX_CHECK( m_api.optixSbtRecordPackHeader(programGroups[PGID_HIT_SHADOW_PRIMITIVE_CUTOUT],   &m_sbtRecordHitShadowPrimitiveCutout) );
+
   // Setup the OptixShaderBindingTable.
 
   m_sbt.raygenRecord            = m_d_sbtRecordHeaders + sizeof(SbtRecordHeader) * PGID_RAYGENERATION;
@@ -1055,28 +1106,48 @@ void Device::initMaterials(std::vector<MaterialGUI> const& materialsGUI)
   m_isDirtySystemData = true;  // Trigger full update of the device system data on the next launch.
 }
 
-void Device::initScene(std::shared_ptr<sg::Group> root, const unsigned int numGeometries)
+void Device::initScene(InstanceTable const& table, const unsigned int numGeometries)
 {
   activateContext();
   synchronizeStream();
 
   m_geometryData.resize(numGeometries);
 
-  float matrix[12];
+  const unsigned int numInstances = table.getNumInstances();
 
-  // Set the affine matrix to identity by default.
-  memset(matrix, 0, sizeof(float) * 12);
-  matrix[ 0] = 1.0f;
-  matrix[ 5] = 1.0f;
-  matrix[10] = 1.0f;
-
-  InstanceData data(~0u, -1, -1);
+  for (unsigned int i = 0; i < numInstances; ++i)
+  {
+    InstanceData data(table.getGeometry(i), table.getMaterial(i), table.getLight(i));
 
-  traverseNode(root, matrix, data);
+    std::shared_ptr<sg::Triangles> geometry = table.getTriangles(data.idGeometry);
+    if (geometry)
+    {
+      createGeometry(geometry);
+    }
+    else
+    {
+      createGeometry(table.getPrimitive(data.idGeometry));
+    }
+    createInstance(m_geometryData[data.idGeometry].traversable, table.getMatrix(i), data);
+  }
 
   createTLAS();
 
   createHitGroupRecords();
+
+  size_t sizeAttributes = 0;
+
+  for (GeometryData const& geometryData : m_geometryData)
+  {
+    sizeAttributes += geometryData.numAttributes * getTriangleAttributesSize(geometryData.format);
+  }
+
+  std::cout << "Device::initScene() ordinal " << m_ordinal << ": attributes " << double(sizeAttributes) / (1024.0 * 1024.0) << " MiB (format " << m_geometryFormat << ")" << std::endl;
+}
+
+void Device::setGeometryFormat(const GeometryFormat format)
+{
+  m_geometryFormat = format;
 }
 
 
@@ -1146,17 +1217,9 @@ void Device::updateMaterial(const int idMaterial, MaterialGUI const& materialGUI
       {
         const unsigned int idx = inst * NUM_RAYTYPES;
 
-        if (!materialGUI.useCutoutTexture)
-        {
-          // Only update the header to switch the program hit group. The SBT record data field doesn't change.
-          memcpy(m_sbtRecordGeometryInstanceData[idx    ].header, m_sbtRecordHitRadiance.header, OPTIX_SBT_RECORD_HEADER_SIZE);
-          memcpy(m_sbtRecordGeometryInstanceData[idx + 1].header, m_sbtRecordHitShadow.header,   OPTIX_SBT_RECORD_HEADER_SIZE);
-        }
-        else
-        {
-          memcpy(m_sbtRecordGeometryInstanceData[idx    ].header, m_sbtRecordHitRadianceCutout.header, OPTIX_SBT_RECORD_HEADER_SIZE);
-          memcpy(m_sbtRecordGeometryInstanceData[idx + 1].header, m_sbtRecordHitShadowCutout.header,   OPTIX_SBT_RECORD_HEADER_SIZE);
-        }
+        // Switches the program hit group for the new cutout state. Picks the triangle or the analytic primitive programs per geometry.
+        setHitGroupRecords(inst);
+
         // PERF If the scene has many instances with few using the same material, this is faster. Otherwise the SBT can also be uploaded completely. See below.
         // Only copy the two SBT entries which changed.
         CU_CHECK( cuMemcpyHtoDAsync(reinterpret_cast<CUdeviceptr>(&m_d_sbtRecordGeometryInstanceData[idx]), &m_sbtRecordGeometryInstanceData[idx], sizeof(SbtRecordGeometryInstanceData) * NUM_RAYTYPES, m_cudaStream) );
@@ -1167,6 +1230,60 @@ void Device::updateMaterial(const int idMaterial, MaterialGUI const& materialGUI
   }
 }
 
+bool Device::updateInstances(InstanceTable const& table)
+{
+  activateContext();
+  synchronizeStream();
+
+  std::vector<unsigned int> const& changed = table.getChanged();
+
+  MY_ASSERT(table.getNumInstances() == m_instances.size()); // The scene structure must not have changed.
+
+  for (const unsigned int i : changed)
+  {
+    memcpy(m_instances[i].transform, table.getMatrix(i), sizeof(float) * 12);
+
+    getInstanceAabb(i, m_instanceAabbs[i * 2], m_instanceAabbs[i * 2 + 1]);
+
+    InstanceData& data = m_instanceData[i];
+
+    if (data.idMaterial != table.getMaterial(i) || data.idLight != table.getLight(i))
+    {
+      data.idMaterial = table.getMaterial(i);
+      data.idLight    = table.getLight(i);
+      MY_ASSERT(0 <= data.idMaterial);
+
+      setHitGroupRecords(i);
+
+      // Only copy the two SBT entries which changed.
+      const unsigned int idx = i * NUM_RAYTYPES;
+
+      CU_CHECK( cuMemcpyHtoDAsync(reinterpret_cast<CUdeviceptr>(&m_d_sbtRecordGeometryInstanceData[idx]), &m_sbtRecordGeometryInstanceData[idx], sizeof(SbtRecordGeometryInstanceData) * NUM_RAYTYPES, m_cudaStream) );
+    }
+  }
+
+  // The refit keeps the topology of the last build. Rebuild when the instances moved far enough to make the boxes overlap much more.
+  m_tlasBounds.refit(m_instanceAabbs, changed);
+
+  const bool isRebuild = (0.0f < TLAS_REBUILD_RATIO && m_tlasCost * TLAS_REBUILD_RATIO < m_tlasBounds.getCost());
+
+  if (isRebuild)
+  {
+    m_tlasBounds.build(m_instanceAabbs, nullptr);
+    m_tlasCost = m_tlasBounds.getCost();
+
+    buildTLAS(OPTIX_BUILD_OPERATION_BUILD);
+  }
+  else
+  {
+    buildTLAS(OPTIX_BUILD_OPERATION_UPDATE);
+  }
+
+  m_isDirtySystemData = true; // The topObject handle is the same after an update, but not necessarily after a rebuild.
+
+  return isRebuild;
+}
+
 
 
 static int2 calculateTileShift(const int2 tileSize)
@@ -1260,76 +1377,29 @@ void Device::compositor(Device* other)
 {
 }
 
-
-// m = a * b;
-static void multiplyMatrix(float* m, const float* a, const float* b)
+DeviceMemoryStatistics Device::getMemoryStatistics() const
 {
-  m[ 0] = a[0] * b[0] + a[1] * b[4] + a[ 2] * b[ 8]; // + a[3] * 0
-  m[ 1] = a[0] * b[1] + a[1] * b[5] + a[ 2] * b[ 9]; // + a[3] * 0
-  m[ 2] = a[0] * b[2] + a[1] * b[6] + a[ 2] * b[10]; // + a[3] * 0
-  m[ 3] = a[0] * b[3] + a[1] * b[7] + a[ 2] * b[11] + a[3]; // * 1
-
-  m[ 4] = a[4] * b[0] + a[5] * b[4] + a[ 6] * b[ 8]; // + a[7] * 0
-  m[ 5] = a[4] * b[1] + a[5] * b[5] + a[ 6] * b[ 9]; // + a[7] * 0
-  m[ 6] = a[4] * b[2] + a[5] * b[6] + a[ 6] * b[10]; // + a[7] * 0
-  m[ 7] = a[4] * b[3] + a[5] * b[7] + a[ 6] * b[11] + a[7]; // * 1
-
-  m[ 8] = a[8] * b[0] + a[9] * b[4] + a[10] * b[ 8]; // + a[11] * 0
-  m[ 9] = a[8] * b[1] + a[9] * b[5] + a[10] * b[ 9]; // + a[11] * 0
-  m[10] = a[8] * b[2] + a[9] * b[6] + a[10] * b[10]; // + a[11] * 0
-  m[11] = a[8] * b[3] + a[9] * b[7] + a[10] * b[11] + a[11]; // * 1
-}
+  DeviceMemoryStatistics statistics = m_memoryStatistics;
 
-void Device::traverseNode(std::shared_ptr<sg::Node> node, float matrix[12], InstanceData data)
-{
-  switch (node->getType())
-  {
-    case sg::NodeType::NT_GROUP:
-    {
-      std::shared_ptr<sg::Group> group = std::dynamic_pointer_cast<sg::Group>(node);
+  statistics.name = m_deviceName + " (ordinal " + std::to_string(m_ordinal) + ")";
 
-      for (size_t i = 0; i < group->getNumChildren(); ++i)
-      {
-        traverseNode(group->getChild(i), matrix, data);
-      }
-    }
-    break;
+  const Texture* textures[3] = { m_textureAlbedo, m_textureCutout, m_textureEnv };
 
-    case sg::NodeType::NT_INSTANCE:
+  for (const Texture* texture : textures)
+  {
+    if (texture)
     {
-      std::shared_ptr<sg::Instance> instance = std::dynamic_pointer_cast<sg::Instance>(node);
-
-      // Concatenate the transformations along the path.
-      float trafo[12];
-      multiplyMatrix(trafo, matrix, instance->getTransform());
-
-      int idMaterial = instance->getMaterial();
-      if (0 <= idMaterial)
-      {
-        data.idMaterial = idMaterial;
-      }
-
-      int idLight = instance->getLight();
-      if (0 <= idLight)
-      {
-        data.idLight = idLight;
-      }
-
-      traverseNode(instance->getChild(), trafo, data);
+      statistics.textures += texture->getSizeInBytes();
+      statistics.cdf      += texture->getCDFSizeInBytes();
     }
-    break;
+  }
 
-    case sg::NodeType::NT_TRIANGLES:
-    {
-      std::shared_ptr<sg::Triangles> geometry = std::dynamic_pointer_cast<sg::Triangles>(node);
-      data.idGeometry = createGeometry(geometry);
+  statistics.outputBuffers = getOutputBufferSize();
 
-      createInstance(m_geometryData[data.idGeometry].traversable, matrix, data);
-    }
-    break;
-  }
+  return statistics;
 }
 
+
 unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
 {
   const unsigned int idGeometry = geometry->getId();
@@ -1344,13 +1414,62 @@ unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
   std::vector<TriangleAttributes> const& attributes = geometry->getAttributes();
   std::vector<unsigned int>       const& indices    = geometry->getIndices();
 
-  const size_t attributesSizeInBytes = sizeof(TriangleAttributes) * attributes.size();
+  // Track the GeometryData to be able to set them in the SBT record GeometryInstanceData and free them on exit.
+  GeometryData geometryData;
+
+  geometryData.aabbMin = make_float3(RT_DEFAULT_MAX);
+  geometryData.aabbMax = make_float3(-RT_DEFAULT_MAX);
+
+  for (TriangleAttributes const& attribute : attributes)
+  {
+    geometryData.aabbMin = fminf(geometryData.aabbMin, attribute.vertex);
+    geometryData.aabbMax = fmaxf(geometryData.aabbMax, attribute.vertex);
+  }
+
+  geometryData.format = m_geometryFormat;
+
+  const void* data   = attributes.data();
+  size_t      stride = sizeof(TriangleAttributes);
+
+  std::vector<unsigned int> encoded;     // The compact formats.
+  float3                    vertexOffset; // Same as the geometryData.aabbMin.
+
+  if (geometryData.format != GEOMETRY_FORMAT_FULL)
+  {
+    stride = geometry->encodeAttributes(geometryData.format, encoded, vertexOffset, geometryData.vertexScale);
+    data   = encoded.data();
+  }
+
+  const size_t attributesSizeInBytes = stride * attributes.size();
 
   CUdeviceptr d_attributes;
 
   // DAR FIXME This all needs some Buffer class which maintains CUdeviceptr per Device, supporting separate allocations and peer-to-peer on multiple islands.
   CU_CHECK( cuMemAlloc(&d_attributes, attributesSizeInBytes) );
-  CU_CHECK( cuMemcpyHtoDAsync(d_attributes, attributes.data(), attributesSizeInBytes, m_cudaStream) );
+  CU_CHECK( cuMemcpyHtoDAsync(d_attributes, data, attributesSizeInBytes, m_cudaStream) );
+  m_memoryStatistics.attributes += attributesSizeInBytes;
+
+  // The full and compact formats start with the float3 vertex which the build input reads with the attribute stride.
+  // The quantized vertices are decoded into a temporary buffer, so that the GAS matches the vertices the closest hit program sees.
+  CUdeviceptr  d_vertices         = d_attributes;
+  unsigned int vertexStrideInBytes = static_cast<unsigned int>(stride);
+
+  if (geometryData.format == GEOMETRY_FORMAT_QUANTIZED)
+  {
+    const TriangleAttributesQuantized* quantized = reinterpret_cast<const TriangleAttributesQuantized*>(encoded.data());
+
+    std::vector<float3> vertices(attributes.size());
+
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+      vertices[i] = decodeQuantized(quantized[i].vertex, vertexOffset, geometryData.vertexScale);
+    }
+
+    CU_CHECK( cuMemAlloc(&d_vertices, sizeof(float3) * vertices.size()) );
+    CU_CHECK( cuMemcpyHtoDAsync(d_vertices, vertices.data(), sizeof(float3) * vertices.size(), m_cudaStream) );
+
+    vertexStrideInBytes = sizeof(float3);
+  }
 
   const size_t indicesSizeInBytes = sizeof(int) * indices.size();
 
@@ -1358,6 +1477,7 @@ unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
 
   CU_CHECK( cuMemAlloc(&d_indices, indicesSizeInBytes) );
   CU_CHECK( cuMemcpyHtoDAsync(d_indices, indices.data(), indicesSizeInBytes, m_cudaStream) );
+  m_memoryStatistics.indices += indicesSizeInBytes;
 
   OptixBuildInput buildInput;
   memset(&buildInput, 0, sizeof(OptixBuildInput));
@@ -1365,9 +1485,9 @@ unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
   buildInput.type = OPTIX_BUILD_INPUT_TYPE_TRIANGLES;
 
   buildInput.triangleArray.vertexFormat        = OPTIX_VERTEX_FORMAT_FLOAT3;
-  buildInput.triangleArray.vertexStrideInBytes = sizeof(TriangleAttributes);
+  buildInput.triangleArray.vertexStrideInBytes = vertexStrideInBytes;
   buildInput.triangleArray.numVertices         = static_cast<unsigned int>(attributes.size());
-  buildInput.triangleArray.vertexBuffers       = &d_attributes;
+  buildInput.triangleArray.vertexBuffers       = &d_vertices;
 
   buildInput.triangleArray.indexFormat        = OPTIX_INDICES_FORMAT_UNSIGNED_INT3;
   buildInput.triangleArray.indexStrideInBytes = sizeof(unsigned int) * 3;
@@ -1398,6 +1518,9 @@ unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
   CU_CHECK( cuMemAlloc(&d_temp, accelBufferSizes.tempSizeInBytes) );
   CU_CHECK( cuMemAlloc(&d_blas, accelBufferSizes.outputSizeInBytes) );
 
+  m_memoryStatistics.blas    += accelBufferSizes.outputSizeInBytes;
+  m_memoryStatistics.blasTemp = std::max(m_memoryStatistics.blasTemp, accelBufferSizes.tempSizeInBytes);
+
   OPTIX_CHECK( m_api.optixAccelBuild(m_optixContext, m_cudaStream,
                                      &accelBuildOptions, &buildInput, 1,
                                      d_temp, accelBufferSizes.tempSizeInBytes,
@@ -1408,9 +1531,10 @@ unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
 
   CU_CHECK( cuMemFree(d_temp) );
 
-  // Track the GeometryData to be able to set them in the SBT record GeometryInstanceData and free them on exit.
-  // FIXME Move this to the top and use the fields directly.
-  GeometryData geometryData;
+  if (d_vertices != d_attributes)
+  {
+    CU_CHECK( cuMemFree(d_vertices) );
+  }
 
   geometryData.traversable   = traversableHandle;
   geometryData.d_attributes  = d_attributes;
@@ -1424,7 +1548,101 @@ unsigned int Device::createGeometry(std::shared_ptr<sg::Triangles> geometry)
   return idGeometry;
 }
 
-void Device::createInstance( const OptixTraversableHandle traversable, float matrix[12], InstanceData const& data)
+// One OptiX custom primitive per GAS. Instancing the GAS replaces the tessellated Triangles at a few bytes per instance.
+unsigned int Device::createGeometry(std::shared_ptr<sg::Primitive> primitive)
+{
+  const unsigned int idGeometry = primitive->getId();
+  MY_ASSERT(idGeometry < m_geometryData.size());
+
+  if (m_geometryData[idGeometry].traversable != 0)
+  {
+    return idGeometry;
+  }
+
+  PrimitiveDefinition const& definition = primitive->getDefinition();
+
+  GeometryData geometryData;
+
+  getPrimitiveAabb(definition, geometryData.aabbMin, geometryData.aabbMax);
+
+  geometryData.primitiveType = static_cast<PrimitiveType>(definition.type);
+
+  // The closest hit and intersection programs read the PrimitiveDefinition through the SBT record attributes pointer.
+  CUdeviceptr d_attributes;
+
+  CU_CHECK( cuMemAlloc(&d_attributes, sizeof(PrimitiveDefinition)) );
+  CU_CHECK( cuMemcpyHtoDAsync(d_attributes, &definition, sizeof(PrimitiveDefinition), m_cudaStream) );
+  m_memoryStatistics.attributes += sizeof(PrimitiveDefinition);
+
+  OptixAabb aabb;
+
+  aabb.minX = geometryData.aabbMin.x;
+  aabb.minY = geometryData.aabbMin.y;
+  aabb.minZ = geometryData.aabbMin.z;
+  aabb.maxX = geometryData.aabbMax.x;
+  aabb.maxY = geometryData.aabbMax.y;
+  aabb.maxZ = geometryData.aabbMax.z;
+
+  CUdeviceptr d_aabb;
+
+  CU_CHECK( cuMemAlloc(&d_aabb, sizeof(OptixAabb)) );
+  CU_CHECK( cuMemcpyHtoDAsync(d_aabb, &aabb, sizeof(OptixAabb), m_cudaStream) );
+
+  OptixBuildInput buildInput;
+  memset(&buildInput, 0, sizeof(OptixBuildInput));
+
+  buildInput.type = OPTIX_BUILD_INPUT_TYPE_CUSTOM_PRIMITIVES;
+
+  buildInput.aabbArray.aabbBuffers   = &d_aabb;
+  buildInput.aabbArray.numPrimitives = 1;
+
+  unsigned int inputFlags[1] = { OPTIX_GEOMETRY_FLAG_NONE };
+
+  buildInput.aabbArray.flags         = inputFlags;
+  buildInput.aabbArray.numSbtRecords = 1;
+
+  OptixAccelBuildOptions accelBuildOptions;
+  memset(&accelBuildOptions, 0, sizeof(OptixAccelBuildOptions));
+
+  accelBuildOptions.buildFlags = OPTIX_BUILD_FLAG_NONE;
+  accelBuildOptions.operation  = OPTIX_BUILD_OPERATION_BUILD;
+
+  OptixAccelBufferSizes accelBufferSizes;
+
+  OPTIX_CHECK( m_api.optixAccelComputeMemoryUsage(m_optixContext, &accelBuildOptions, &buildInput, 1, &accelBufferSizes) );
+
+  CUdeviceptr d_temp;
+  CUdeviceptr d_blas;
+
+  OptixTraversableHandle traversableHandle = 0;
+
+  CU_CHECK( cuMemAlloc(&d_temp, accelBufferSizes.tempSizeInBytes) );
+  CU_CHECK( cuMemAlloc(&d_blas, accelBufferSizes.outputSizeInBytes) );
+
+  m_memoryStatistics.blas    += accelBufferSizes.outputSizeInBytes;
+  m_memoryStatistics.blasTemp = std::max(m_memoryStatistics.blasTemp, accelBufferSizes.tempSizeInBytes);
+
+  OPTIX_CHECK( m_api.optixAccelBuild(m_optixContext, m_cudaStream,
+                                     &accelBuildOptions, &buildInput, 1,
+                                     d_temp, accelBufferSizes.tempSizeInBytes,
+                                     d_blas, accelBufferSizes.outputSizeInBytes,
+                                     &traversableHandle, nullptr, 0) );
+
+  CU_CHECK( cuStreamSynchronize(m_cudaStream) );
+
+  CU_CHECK( cuMemFree(d_temp) );
+  CU_CHECK( cuMemFree(d_aabb) );
+
+  geometryData.traversable  = traversableHandle;
+  geometryData.d_attributes = d_attributes;
+  geometryData.d_blas       = d_blas;
+
+  m_geometryData[idGeometry] = geometryData;
+
+  return idGeometry;
+}
+
+void Device::createInstance( const OptixTraversableHandle traversable, const float* matrix, InstanceData const& data)
 {
   MY_ASSERT(0 <= data.idMaterial);
 
@@ -1446,46 +1664,110 @@ void Device::createInstance( const OptixTraversableHandle traversable, float mat
 void Device::createTLAS()
 {
   // Construct the TLAS by attaching all flattened instances.
-  CUdeviceptr d_instances;
-
   const size_t instancesSizeInBytes = sizeof(OptixInstance) * m_instances.size();
 
-  CU_CHECK( cuMemAlloc(&d_instances, instancesSizeInBytes) );
-  CU_CHECK( cuMemcpyHtoDAsync(d_instances, m_instances.data(), instancesSizeInBytes, m_cudaStream) );
+  // The instances stay allocated because the TLAS updates read them again.
+  CU_CHECK( cuMemAlloc(&m_d_instances, instancesSizeInBytes) );
+  m_memoryStatistics.instances = instancesSizeInBytes;
 
   OptixBuildInput instanceInput;
   memset(&instanceInput, 0, sizeof(OptixBuildInput));
 
   instanceInput.type = OPTIX_BUILD_INPUT_TYPE_INSTANCES;
-  instanceInput.instanceArray.instances    = d_instances;
+  instanceInput.instanceArray.instances    = m_d_instances;
   instanceInput.instanceArray.numInstances = static_cast<unsigned int>(m_instances.size());
 
   OptixAccelBuildOptions accelBuildOptions;
   memset(&accelBuildOptions, 0, sizeof(OptixAccelBuildOptions));
 
-  accelBuildOptions.buildFlags = OPTIX_BUILD_FLAG_NONE;
+  accelBuildOptions.buildFlags = OPTIX_BUILD_FLAG_ALLOW_UPDATE;
   accelBuildOptions.operation  = OPTIX_BUILD_OPERATION_BUILD;
 
-  OptixAccelBufferSizes tlasBufferSizes;
+  OPTIX_CHECK( m_api.optixAccelComputeMemoryUsage(m_optixContext, &accelBuildOptions, &instanceInput, 1, &m_tlasBufferSizes ) );
 
-  OPTIX_CHECK( m_api.optixAccelComputeMemoryUsage(m_optixContext, &accelBuildOptions, &instanceInput, 1, &tlasBufferSizes ) );
+  // Rebuilds and updates have the same instance count and reuse this buffer.
+  CU_CHECK( cuMemAlloc(&m_d_tlas, m_tlasBufferSizes.outputSizeInBytes) );
+  m_memoryStatistics.tlas = m_tlasBufferSizes.outputSizeInBytes;
+
+  // Only tracks the quality of the refitted TLAS.
+  getInstanceAabbs(m_instanceAabbs);
+
+  m_tlasBounds.build(m_instanceAabbs, nullptr);
+  m_tlasCost = m_tlasBounds.getCost();
+
+  buildTLAS(OPTIX_BUILD_OPERATION_BUILD);
+}
+
+void Device::buildTLAS(const OptixBuildOperation operation)
+{
+  const size_t instancesSizeInBytes = sizeof(OptixInstance) * m_instances.size();
+
+  CU_CHECK( cuMemcpyHtoDAsync(m_d_instances, m_instances.data(), instancesSizeInBytes, m_cudaStream) );
+
+  OptixBuildInput instanceInput;
+  memset(&instanceInput, 0, sizeof(OptixBuildInput));
+
+  instanceInput.type = OPTIX_BUILD_INPUT_TYPE_INSTANCES;
+  instanceInput.instanceArray.instances    = m_d_instances;
+  instanceInput.instanceArray.numInstances = static_cast<unsigned int>(m_instances.size());
+
+  OptixAccelBuildOptions accelBuildOptions;
+  memset(&accelBuildOptions, 0, sizeof(OptixAccelBuildOptions));
+
+  accelBuildOptions.buildFlags = OPTIX_BUILD_FLAG_ALLOW_UPDATE; // Must be the same for the build and its updates.
+  accelBuildOptions.operation  = operation;
+
+  const size_t tempSizeInBytes = (operation == OPTIX_BUILD_OPERATION_UPDATE) ? m_tlasBufferSizes.tempUpdateSizeInBytes : m_tlasBufferSizes.tempSizeInBytes;
 
   CUdeviceptr d_temp;
 
-  CU_CHECK( cuMemAlloc(&d_temp,   tlasBufferSizes.tempSizeInBytes) );
-  CU_CHECK( cuMemAlloc(&m_d_tlas, tlasBufferSizes.outputSizeInBytes) );
+  CU_CHECK( cuMemAlloc(&d_temp, tempSizeInBytes) );
+  m_memoryStatistics.tlasTemp = std::max(m_memoryStatistics.tlasTemp, tempSizeInBytes);
 
   OPTIX_CHECK( m_api.optixAccelBuild(m_optixContext, m_cudaStream,
                                      &accelBuildOptions, &instanceInput, 1,
-                                     d_temp,   tlasBufferSizes.tempSizeInBytes,
-                                     m_d_tlas, tlasBufferSizes.outputSizeInBytes,
+                                     d_temp,   tempSizeInBytes,
+                                     m_d_tlas, m_tlasBufferSizes.outputSizeInBytes,
                                      &m_systemData.topObject, nullptr, 0));
 
   CU_CHECK( cuStreamSynchronize(m_cudaStream) );
 
   CU_CHECK( cuMemFree(d_temp) );
+}
+
+// World space bounding box of one instance.
+void Device::getInstanceAabb(const unsigned int index, float3& aabbMin, float3& aabbMax) const
+{
+  const float*        m            = m_instances[index].transform;
+  GeometryData const& geometryData = m_geometryData[m_instanceData[index].idGeometry];
+
+  aabbMin = make_float3(RT_DEFAULT_MAX);
+  aabbMax = make_float3(-RT_DEFAULT_MAX);
+
+  for (int j = 0; j < 8; ++j)
+  {
+    const float3 corner = make_float3((j & 1) ? geometryData.aabbMax.x : geometryData.aabbMin.x,
+                                      (j & 2) ? geometryData.aabbMax.y : geometryData.aabbMin.y,
+                                      (j & 4) ? geometryData.aabbMax.z : geometryData.aabbMin.z);
 
-  CU_CHECK( cuMemFree(d_instances) ); // Don't need the instances anymore.
+    const float3 p = make_float3(m[0] * corner.x + m[1] * corner.y + m[ 2] * corner.z + m[ 3],
+                                 m[4] * corner.x + m[5] * corner.y + m[ 6] * corner.z + m[ 7],
+                                 m[8] * corner.x + m[9] * corner.y + m[10] * corner.z + m[11]);
+
+    aabbMin = fminf(aabbMin, p);
+    aabbMax = fmaxf(aabbMax, p);
+  }
+}
+
+// World space bounding boxes of the instances, the minimum and maximum corner per instance.
+void Device::getInstanceAabbs(std::vector<float3>& aabbs) const
+{
+  aabbs.resize(m_instances.size() * 2);
+
+  for (size_t i = 0; i < m_instances.size(); ++i)
+  {
+    getInstanceAabb(static_cast<unsigned int>(i), aabbs[i * 2], aabbs[i * 2 + 1]);
+  }
 }
 
 
@@ -1497,33 +1779,11 @@ void Device::createHitGroupRecords()
 
   for (unsigned int i = 0; i < numInstances; ++i)
   {
-    InstanceData const& data = m_instanceData[i];
-    const int idx = i * NUM_RAYTYPES; // idx == radiance ray, idx + 1 == shadow ray
-
-    if (m_materials[data.idMaterial].textureCutout == 0)
-    {
-      // Only update the header to switch the program hit group. The SBT record data field doesn't change.
-      memcpy(m_sbtRecordGeometryInstanceData[idx    ].header, m_sbtRecordHitRadiance.header, OPTIX_SBT_RECORD_HEADER_SIZE);
-      memcpy(m_sbtRecordGeometryInstanceData[idx + 1].header, m_sbtRecordHitShadow.header,   OPTIX_SBT_RECORD_HEADER_SIZE);
-    }
-    else
-    {
-      memcpy(m_sbtRecordGeometryInstanceData[idx    ].header, m_sbtRecordHitRadianceCutout.header, OPTIX_SBT_RECORD_HEADER_SIZE);
-      memcpy(m_sbtRecordGeometryInstanceData[idx + 1].header, m_sbtRecordHitShadowCutout.header,   OPTIX_SBT_RECORD_HEADER_SIZE);
-    }
-
-    m_sbtRecordGeometryInstanceData[idx    ].data.attributes    = m_geometryData[data.idGeometry].d_attributes;
-    m_sbtRecordGeometryInstanceData[idx    ].data.indices       = m_geometryData[data.idGeometry].d_indices;
-    m_sbtRecordGeometryInstanceData[idx    ].data.materialIndex = data.idMaterial;
-    m_sbtRecordGeometryInstanceData[idx    ].data.lightIndex    = data.idLight;
-
-    m_sbtRecordGeometryInstanceData[idx + 1].data.attributes    = m_geometryData[data.idGeometry].d_attributes;
-    m_sbtRecordGeometryInstanceData[idx + 1].data.indices       = m_geometryData[data.idGeometry].d_indices;
-    m_sbtRecordGeometryInstanceData[idx + 1].data.materialIndex = data.idMaterial;
-    m_sbtRecordGeometryInstanceData[idx + 1].data.lightIndex    = data.idLight;
+    setHitGroupRecords(i);
   }
 
   CU_CHECK( cuMemAlloc(reinterpret_cast<CUdeviceptr*>(&m_d_sbtRecordGeometryInstanceData), sizeof(SbtRecordGeometryInstanceData) * NUM_RAYTYPES * numInstances) );
+  m_memoryStatistics.sbt += sizeof(SbtRecordGeometryInstanceData) * NUM_RAYTYPES * numInstances;
   CU_CHECK( cuMemcpyHtoDAsync(reinterpret_cast<CUdeviceptr>(m_d_sbtRecordGeometryInstanceData), m_sbtRecordGeometryInstanceData.data(), sizeof(SbtRecordGeometryInstanceData) * NUM_RAYTYPES * numInstances, m_cudaStream) );
 
   m_sbt.hitgroupRecordBase          = reinterpret_cast<CUdeviceptr>(m_d_sbtRecordGeometryInstanceData);
@@ -1531,6 +1791,37 @@ void Device::createHitGroupRecords()
   m_sbt.hitgroupRecordCount         = NUM_RAYTYPES * numInstances;
 }
 
+// The radiance and shadow ray SBT records of one instance on the host.
+void Device::setHitGroupRecords(const unsigned int index)
+{
+  InstanceData const& data = m_instanceData[index];
+  const unsigned int idx = index * NUM_RAYTYPES; // idx == radiance ray, idx + 1 == shadow ray
+
+  GeometryData const& geometryData = m_geometryData[data.idGeometry];
+
+  const bool isCutout    = (m_materials[data.idMaterial].textureCutout != 0);
+  const bool isPrimitive = (geometryData.primitiveType != PRIMITIVE_TRIANGLES);
+
+  SbtRecordGeometryInstanceData const& radiance = (isPrimitive) ? ((isCutout) ? m_sbtRecordHitRadiancePrimitiveCutout : m_sbtRecordHitRadiancePrimitive)
+                                                                : ((isCutout) ? m_sbtRecordHitRadianceCutout         : m_sbtRecordHitRadiance);
+  SbtRecordGeometryInstanceData const& shadow   = (isPrimitive) ? ((isCutout) ? m_sbtRecordHitShadowPrimitiveCutout   : m_sbtRecordHitShadowPrimitive)
+                                                                : ((isCutout) ? m_sbtRecordHitShadowCutout           : m_sbtRecordHitShadow);
+
+  memcpy(m_sbtRecordGeometryInstanceData[idx    ].header, radiance.header, OPTIX_SBT_RECORD_HEADER_SIZE);
+  memcpy(m_sbtRecordGeometryInstanceData[idx + 1].header, shadow.header,   OPTIX_SBT_RECORD_HEADER_SIZE);
+
+  m_sbtRecordGeometryInstanceData[idx    ].data.attributes    = geometryData.d_attributes;
+  m_sbtRecordGeometryInstanceData[idx    ].data.indices       = geometryData.d_indices;
+  m_sbtRecordGeometryInstanceData[idx    ].data.materialIndex = data.idMaterial;
+  m_sbtRecordGeometryInstanceData[idx    ].data.lightIndex    = data.idLight;
+  m_sbtRecordGeometryInstanceData[idx    ].data.format        = geometryData.format;
+  m_sbtRecordGeometryInstanceData[idx    ].data.vertexOffset  = geometryData.aabbMin;
+  m_sbtRecordGeometryInstanceData[idx    ].data.vertexScale   = geometryData.vertexScale;
+  m_sbtRecordGeometryInstanceData[idx    ].data.primitiveType = geometryData.primitiveType;
+
+  m_sbtRecordGeometryInstanceData[idx + 1].data = m_sbtRecordGeometryInstanceData[idx].data; // Same data for the shadow ray.
+}
+
 // Given an OpenGL UUID find the matching CUDA device.
 bool Device::matchUUID(const char* uuid)
 {
@@ -0,0 +1,2343 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/DeviceCPU.h"
+
+// includes OpenGL headers
+#include "inc/OpenGL_loader.h"
+
+#include "shaders/shader_common.h"
+#include "shaders/random_number_generators.h"
+
+#include "inc/MyAssert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+
+// ========== Helper functions
+
+// Matrix3x4 * point. v.w == 1.0f
+static inline float3 transformPoint(const float* m, float3 const& v)
+{
+  return make_float3(m[0] * v.x + m[1] * v.y + m[ 2] * v.z + m[ 3],
+                     m[4] * v.x + m[5] * v.y + m[ 6] * v.z + m[ 7],
+                     m[8] * v.x + m[9] * v.y + m[10] * v.z + m[11]);
+}
+
+// Matrix3x4 * vector. v.w == 0.0f
+static inline float3 transformVector(const float* m, float3 const& v)
+{
+  return make_float3(m[0] * v.x + m[1] * v.y + m[ 2] * v.z,
+                     m[4] * v.x + m[5] * v.y + m[ 6] * v.z,
+                     m[8] * v.x + m[9] * v.y + m[10] * v.z);
+}
+
+// InverseMatrix3x4^T * normal. v.w == 0.0f
+// Get the inverse matrix as input and applies it as inverse transpose.
+static inline float3 transformNormal(const float* m, float3 const& v)
+{
+  return make_float3(m[0] * v.x + m[4] * v.y + m[ 8] * v.z,
+                     m[1] * v.x + m[5] * v.y + m[ 9] * v.z,
+                     m[2] * v.x + m[6] * v.y + m[10] * v.z);
+}
+
+// Inverse of an affine 3x4 matrix. OptiX calculates this for the instances internally.
+static void invertMatrix(float* inv, const float* m)
+{
+  const float a = m[0];
+  const float b = m[1];
+  const float c = m[2];
+  const float d = m[4];
+  const float e = m[5];
+  const float f = m[6];
+  const float g = m[8];
+  const float h = m[9];
+  const float i = m[10];
+
+  const float det = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+  MY_ASSERT(det != 0.0f); // Degenerate instance transform.
+
+  const float s = 1.0f / det;
+
+  inv[ 0] =  (e * i - f * h) * s;
+  inv[ 1] = -(b * i - c * h) * s;
+  inv[ 2] =  (b * f - c * e) * s;
+  inv[ 4] = -(d * i - f * g) * s;
+  inv[ 5] =  (a * i - c * g) * s;
+  inv[ 6] = -(a * f - c * d) * s;
+  inv[ 8] =  (d * h - e * g) * s;
+  inv[ 9] = -(a * h - b * g) * s;
+  inv[10] =  (a * e - b * d) * s;
+
+  inv[ 3] = -(inv[0] * m[3] + inv[1] * m[7] + inv[ 2] * m[11]);
+  inv[ 7] = -(inv[4] * m[3] + inv[5] * m[7] + inv[ 6] * m[11]);
+  inv[11] = -(inv[8] * m[3] + inv[9] * m[7] + inv[10] * m[11]);
+}
+
+static int2 calculateTileShift(const int2 tileSize)
+{
+  int xShift = 0;
+  while (xShift < 32 && (tileSize.x & (1 << xShift)) == 0)
+  {
+    ++xShift;
+  }
+
+  int yShift = 0;
+  while (yShift < 32 && (tileSize.y & (1 << yShift)) == 0)
+  {
+    ++yShift;
+  }
+
+  MY_ASSERT(xShift < 32 && yShift < 32); // Can only happen for zero input.
+
+  return make_int2(xShift, yShift);
+}
+
+// ========== Lens shaders (lens_shader.cu)
+
+// Note that all these lens shaders return the primary ray origin and direction in world space!
+static void lensShaderPinhole(CameraDefinition const& camera, const float2 screen, const float2 pixel, const float2 sample,
+                              float3& origin, float3& direction)
+{
+  const float2 fragment = pixel + sample;                    // Jitter the sub-pixel location
+  const float2 ndc      = (fragment / screen) * 2.0f - 1.0f; // Normalized device coordinates in range [-1, 1].
+
+  origin    = camera.P;
+  direction = normalize(camera.U * ndc.x +
+                        camera.V * ndc.y +
+                        camera.W);
+}
+
+static void lensShaderFisheye(CameraDefinition const& camera, const float2 screen, const float2 pixel, const float2 sample,
+                              float3& origin, float3& direction)
+{
+  const float2 fragment = pixel + sample; // x, y
+
+  // Implement a fisheye projection with 180 degrees angle across the image diagonal (=> all pixels rendered, not a circular fisheye).
+  const float2 center = screen * 0.5f;
+  const float2 uv     = (fragment - center) / length(center); // uv components are in the range [0, 1]. Both 1 in the corners of the image!
+  const float z       = cosf(length(uv) * 0.7071067812f * 0.5f * M_PIf); // Scale by 1.0f / sqrtf(2.0f) to get length into the range [0, 1]
+
+  const float3 U = normalize(camera.U);
+  const float3 V = normalize(camera.V);
+  const float3 W = normalize(camera.W);
+
+  origin    = camera.P;
+  direction = normalize(uv.x * U + uv.y * V + z * W);
+}
+
+static void lensShaderSphere(CameraDefinition const& camera, const float2 screen, const float2 pixel, const float2 sample,
+                             float3& origin, float3& direction)
+{
+  const float2 uv = (pixel + sample) / screen; // "texture coordinates"
+
+  // Convert the 2D index into a direction.
+  const float phi   = uv.x * 2.0f * M_PIf;
+  const float theta = uv.y * M_PIf;
+
+  const float sinTheta = sinf(theta);
+
+  const float3 v = make_float3(-sinf(phi) * sinTheta,
+                               -cosf(theta),
+                               -cosf(phi) * sinTheta);
+
+  const float3 U = normalize(camera.U);
+  const float3 V = normalize(camera.V);
+  const float3 W = normalize(camera.W);
+
+  origin    = camera.P;
+  direction = normalize(v.x * U + v.y * V + v.z * W);
+}
+
+
+// ========== Light sampling (light_sample.cu)
+
+static void unitSquareToSphere(const float u, const float v, float3& p, float& pdf)
+{
+  p.z = 1.0f - 2.0f * u;
+  float r = 1.0f - p.z * p.z;
+  r = (0.0f < r) ? sqrtf(r) : 0.0f;
+
+  const float phi = v * 2.0f * M_PIf;
+  p.x = r * cosf(phi);
+  p.y = r * sinf(phi);
+
+  pdf = 0.25f * M_1_PIf;  // == 1.0f / (4.0f * M_PIf)
+}
+
+
+// ========== BSDFs (bxdf_diffuse.cu, bxdf_specular.cu, bxdf_ggx_smith.cu)
+
+static void alignVector(float3 const& axis, float3& w)
+{
+  // Align w with axis.
+  const float s = copysignf(1.0f, axis.z);
+  w.z *= s;
+  const float3 h = make_float3(axis.x, axis.y, axis.z + s);
+  const float  k = dot(w, h) / (1.0f + fabsf(axis.z));
+  w = k * h - w;
+}
+
+static void unitSquareToCosineHemisphere(const float2 sample, float3 const& axis, float3& w, float& pdf)
+{
+  // Choose a point on the local hemisphere coordinates about +z.
+  const float theta = 2.0f * M_PIf * sample.x;
+  const float r = sqrtf(sample.y);
+  w.x = r * cosf(theta);
+  w.y = r * sinf(theta);
+  w.z = 1.0f - w.x * w.x - w.y * w.y;
+  w.z = (0.0f < w.z) ? sqrtf(w.z) : 0.0f;
+
+  pdf = w.z * M_1_PIf;
+
+  // Align with axis.
+  alignVector(axis, w);
+}
+
+// This function evaluates a Fresnel dielectric function when the transmitting cosine ("cost")
+// is unknown and the incident index of refraction is assumed to be 1.0f.
+// \param et     The transmitted index of refraction.
+// \param costIn The cosine of the angle between the incident direction and normal direction.
+static float evaluateFresnelDielectric(const float et, const float cosIn)
+{
+  const float cosi = fabsf(cosIn);
+
+  float sint = 1.0f - cosi * cosi;
+  sint = (0.0f < sint) ? sqrtf(sint) / et : 0.0f;
+
+  // Handle total internal reflection.
+  if (1.0f < sint)
+  {
+    return 1.0f;
+  }
+
+  float cost = 1.0f - sint * sint;
+  cost = (0.0f < cost) ? sqrtf(cost) : 0.0f;
+
+  const float et_cosi = et * cosi;
+  const float et_cost = et * cost;
+
+  const float rPerpendicular = (cosi - et_cost) / (cosi + et_cost);
+  const float rParallel      = (et_cosi - cost) / (et_cosi + cost);
+
+  const float result = (rParallel * rParallel + rPerpendicular * rPerpendicular) * 0.5f;
+
+  return (result <= 1.0f) ? result : 1.0f;
+}
+
+// Optimized version to calculate D and PDF reusing shared calculations.
+static float2 distribution_d_pdf(const float ax, const float ay, float3 const& wm)
+{
+  if (DENOMINATOR_EPSILON < wm.z) // Heaviside function: X_plus(wm * wg). (wm is in tangent space.)
+  {
+    const float cosThetaSqr = wm.z * wm.z;
+    const float tanThetaSqr = (1.0f - cosThetaSqr) / cosThetaSqr;
+
+    const float phiM    = atan2f(wm.y, wm.x);
+    const float cosPhiM = cosf(phiM);
+    const float sinPhiM = sinf(phiM);
+
+    const float term = 1.0f + tanThetaSqr * ((cosPhiM * cosPhiM) / (ax * ax) + (sinPhiM * sinPhiM) / (ay * ay));
+
+    const float d   = 1.0f / (M_PIf * ax * ay * cosThetaSqr * cosThetaSqr * term * term); // Heitz, Formula (85)
+    const float pdf = d * wm.z; // PDF with respect to the half-direction.
+
+    return make_float2(d, pdf);
+  }
+  return make_float2(0.0f);
+}
+
+// Return a sample direction in local tangent space coordinates.
+static float3 distribution_sample(const float ax, const float ay, const float u1, const float u2)
+{
+  // Made isotropic to ay. Output vector scales .x accordingly.
+  const float theta    = atanf(ay * sqrtf(u1) / sqrtf(1.0f - u1)); // Walter, Formula (35).
+  const float phi      = 2.0f * M_PIf * u2;                        // Walter, Formula (36).
+  const float sinTheta = sinf(theta);
+  return normalize(make_float3(cosf(phi) * sinTheta * ax / ay,     // Heitz, Formula (77)
+                               sinf(phi) * sinTheta,
+                               cosf(theta)));
+}
+
+static float smith_G1(const float alpha, float3 const& w, float3 const& wm)
+{
+  const float w_wm = dot(w, wm);
+  if (w_wm * w.z <= 0.0f) // X_plus(v * m / v * n) from Walter, Formula (34).
+  {
+    return 0.0f;
+  }
+  const float cosThetaSqr = w.z * w.z;
+  const float sinThetaSqr = 1.0f - cosThetaSqr;
+  const float tanThetaSqr = (0.0f < sinThetaSqr) ? sinThetaSqr / cosThetaSqr : 0.0f;
+  const float invASqr = alpha * alpha * tanThetaSqr;
+  return 2.0f / (1.0f + sqrtf(1.0f + invASqr)); // Optimized version is Walter, Formula (34)
+}
+
+static float distribution_G(const float ax, const float ay, float3 const& wo, float3 const& wi, float3 const& wm)
+{
+  float phi   = atan2f(wo.y, wo.x);
+  float c     = cosf(phi);
+  float s     = sinf(phi);
+  float alpha = sqrtf(c * c * ax * ax + s * s * ay * ay); // Heitz, Formula (80) for wo
+
+  const float g = smith_G1(alpha, wo, wm);
+
+  phi   = atan2f(wi.y, wi.x);
+  c     = cosf(phi);
+  s     = sinf(phi);
+  alpha = sqrtf(c * c * ax * ax + s * s * ay * ay); // Heitz, Formula (80) for wi.
+
+  return g * smith_G1(alpha, wi, wm);
+}
+
+// BRDF Diffuse (Lambert)
+static void sampleBrdfDiffuse(MaterialDefinition const& material, State const& state, PerRayData* prd)
+{
+  // Cosine weighted hemisphere sampling for Lambert material.
+  unitSquareToCosineHemisphere(rng2(prd->seed), state.normal, prd->wi, prd->pdf);
+
+  if (prd->pdf <= 0.0f || dot(prd->wi, state.normalGeo) <= 0.0f)
+  {
+    prd->flags |= FLAG_TERMINATE;
+    return;
+  }
+
+  // PERF Since the cosine-weighted hemisphere distribution is a perfect importance-sampling of the Lambert material,
+  // the whole term ((M_1_PIf * fabsf(dot(prd->wi, state.normal)) / prd->pdf) is always 1.0f here!
+  prd->f_over_pdf = state.albedo;
+
+  prd->flags |= FLAG_DIFFUSE; // Direct lighting will be done with multiple importance sampling.
+}
+
+// The parameter wiL is the lightSample.direction (direct lighting), not the next ray segment's direction prd.wi (indirect lighting).
+static float4 evalBrdfDiffuse(MaterialDefinition const& material, State const& state, PerRayData* const prd, float3 const& wiL)
+{
+  const float3 f   = state.albedo * M_1_PIf;
+  const float  pdf = fmaxf(0.0f, dot(wiL, state.normal) * M_1_PIf);
+
+  return make_float4(f, pdf);
+}
+
+// BRDF Specular (tinted mirror)
+static void sampleBrdfSpecular(MaterialDefinition const& material, State const& state, PerRayData* prd)
+{
+  prd->wi = reflect(-prd->wo, state.normal);
+
+  if (dot(prd->wi, state.normalGeo) <= 0.0f) // Do not sample opaque materials below the geometric surface.
+  {
+    prd->flags |= FLAG_TERMINATE;
+    return;
+  }
+
+  prd->f_over_pdf = state.albedo;
+  prd->pdf        = 1.0f; // Not 0.0f to make sure the path is not terminated. Otherwise unused for specular events.
+}
+
+// This function will be used for all specular materials.
+static float4 evalBrdfSpecular(MaterialDefinition const& material, State const& state, PerRayData* const prd, float3 const& wiL)
+{
+  return make_float4(0.0f);
+}
+
+// BSDF Specular (glass etc.)
+static void sampleBsdfSpecular(MaterialDefinition const& material, State const& state, PerRayData* prd)
+{
+  // Return the current material's absorption coefficient and ior to the integrator to be able to support nested materials.
+  prd->absorption_ior = make_float4(material.absorption, material.ior);
+
+  // Thin-walled materials have no volume, always use the frontface eta for them!
+  const float eta = (prd->flags & (FLAG_FRONTFACE | FLAG_THINWALLED))
+                    ? prd->absorption_ior.w / prd->ior.x
+                    : prd->ior.y / prd->absorption_ior.w;
+
+  const float3 R = reflect(-prd->wo, state.normal);
+
+  float reflective = 1.0f;
+
+  if (refract(prd->wi, -prd->wo, state.normal, eta))
+  {
+    if (prd->flags & FLAG_THINWALLED)
+    {
+      prd->wi = -prd->wo; // Straight through, no volume.
+    }
+    // Total internal reflection will leave this reflection probability at 1.0f.
+    reflective = evaluateFresnelDielectric(eta, dot(prd->wo, state.normal));
+  }
+
+  const float pseudo = rng(prd->seed);
+  if (pseudo < reflective)
+  {
+    prd->wi = R; // Fresnel reflection or total internal reflection.
+  }
+  else if (!(prd->flags & FLAG_THINWALLED)) // Only non-thinwalled materials have a volume and transmission events.
+  {
+    prd->flags |= FLAG_TRANSMISSION;
+  }
+
+  // No Fresnel factor here. The probability to pick one or the other side took care of that.
+  prd->f_over_pdf = state.albedo;
+  prd->pdf        = 1.0f; // Not 0.0f to make sure the path is not terminated. Otherwise unused for specular events.
+}
+
+// BRDF GGX with Smith shadowing
+static void sampleBrdfGgxSmith(MaterialDefinition const& material, State const& state, PerRayData* prd)
+{
+  // Sample a microfacet normal in local space, which effectively is a tangent space coordinate.
+  const float2 sample = rng2(prd->seed);
+
+  const float3 wm = distribution_sample(material.roughness.x,
+                                        material.roughness.y,
+                                        sample.x,
+                                        sample.y);
+
+  const TBN tangentSpace(state.tangent, state.normal); // Tangent space transformation, handles anisotropic rotation.
+
+  const float3 wh = tangentSpace.transformToWorld(wm); // wh is the microfacet normal in world space coordinates!
+
+  prd->wi = reflect(-prd->wo, wh);
+
+  if (dot(prd->wi, state.normalGeo) <= 0.0f) // Do not sample opaque materials below the geometric surface.
+  {
+    prd->flags |= FLAG_TERMINATE;
+    return;
+  }
+
+  const float3 wo = tangentSpace.transformToLocal(prd->wo);
+  const float3 wi = tangentSpace.transformToLocal(prd->wi);
+
+  const float wi_wh = dot(prd->wi, wh);
+
+  if (wo.z <= 0.0f || wi.z <= 0.0f || wi_wh <= 0.0f)
+  {
+    prd->flags |= FLAG_TERMINATE;
+    return;
+  }
+
+  const float2 D_PDF = distribution_d_pdf(material.roughness.x,
+                                          material.roughness.y,
+                                          wm);
+  if (D_PDF.y <= 0.0f)
+  {
+    prd->flags |= FLAG_TERMINATE;
+    return;
+  }
+
+  const float G = distribution_G(material.roughness.x,
+                                 material.roughness.y,
+                                 wo, wi, wm);
+
+  // Watch out: PBRT2 puts the factor 1.0f / (4.0f * cosThetaH) into the pdf() functions.
+  //            This is the density function with respect to the light vector.
+  prd->pdf = D_PDF.y / (4.0f * wi_wh);
+
+  prd->f_over_pdf = state.albedo * (G * D_PDF.x * wi_wh / (D_PDF.y * wo.z)); // Optimized version with all factors canceled out.
+
+  prd->flags |= FLAG_DIFFUSE; // Can handle direct lighting.
+}
+
+static float4 evalBrdfGgxSmith(MaterialDefinition const& material, State const& state, PerRayData* const prd, float3 const& wiL)
+{
+  const TBN tangentSpace(state.tangent, state.normal); // Tangent space transformation, handles anisotropic rotation.
+
+  const float3 wo = tangentSpace.transformToLocal(prd->wo);
+  const float3 wi = tangentSpace.transformToLocal(wiL);
+
+  if (wo.z <= 0.0f || wi.z <= 0.0f) // Either vector on the other side of the node.normal hemisphere?
+  {
+    return make_float4(0.0f);
+  }
+
+  float3 wm = wo + wi; // The half-vector is the microfacet normal, in tangent space
+  if (isNull(wm)) // Collinear in opposing directions?
+  {
+    return make_float4(0.0f);
+  }
+
+  wm = normalize(wm);
+
+  const float2 D_PDF = distribution_d_pdf(material.roughness.x,
+                                          material.roughness.y,
+                                          wm);
+
+  const float G = distribution_G(material.roughness.x,
+                                 material.roughness.y,
+                                 wo, wi, wm);
+
+  const float3 f = state.albedo * (D_PDF.x * G / (4.0f * wo.z * wi.z));
+
+  const float pdf = D_PDF.y / (4.0f * dot(wi, wm));
+
+  return make_float4(f, pdf);
+}
+
+// BSDF GGX with Smith shadowing
+static void sampleBsdfGgxSmith(MaterialDefinition const& material, State const& state, PerRayData* prd)
+{
+  // Return the current material's absorption coefficient and ior to the integrator to be able to support nested materials.
+  prd->absorption_ior = make_float4(material.absorption, material.ior);
+
+  // Thin-walled materials have no volume, always use the frontface eta for them!
+  const float eta = (prd->flags & (FLAG_FRONTFACE | FLAG_THINWALLED))
+                  ? prd->absorption_ior.w / prd->ior.x
+                  : prd->ior.y / prd->absorption_ior.w;
+
+  // Sample a microfacet normal in local space, which effectively is a tangent space coordinate.
+  const float2 sample = rng2(prd->seed);
+
+  const float3 wm = distribution_sample(material.roughness.x,
+                                        material.roughness.y,
+                                        sample.x,
+                                        sample.y);
+
+  const TBN tangentSpace(state.tangent, state.normal); // Tangent space transformation, handles anisotropic rotation.
+
+  const float3 wh = tangentSpace.transformToWorld(wm); // wh is the microfacet normal in world space coordinates!
+
+  const float3 R = reflect(-prd->wo, wh);
+
+  float reflective = 1.0f;
+
+  if (refract(prd->wi, -prd->wo, wh, eta))
+  {
+    if (prd->flags & FLAG_THINWALLED)
+    {
+      prd->wi = reflect(R, state.normal); // Flip the vector to the other side of the normal.
+    }
+    // Total internal reflection will leave this reflection probability at 1.0f.
+    reflective = evaluateFresnelDielectric(eta, dot(prd->wo, wh));
+  }
+
+  const float pseudo = rng(prd->seed);
+  if (pseudo < reflective)
+  {
+    prd->wi = R; // Fresnel reflection or total internal reflection.
+  }
+  else if (!(prd->flags & FLAG_THINWALLED)) // Only non-thinwalled materials have a volume and transmission events.
+  {
+    prd->flags |= FLAG_TRANSMISSION;
+  }
+
+  // No Fresnel factor here. The probability to pick one or the other side took care of that.
+  prd->f_over_pdf = state.albedo;
+  prd->pdf        = 1.0f; // Not 0.0f to make sure the path is not terminated. Otherwise unused for specular events.
+}
+
+// The host equivalent of the BSDF sample callables table. Returns nullptr for unknown BSDFs which terminate the path.
+static SampleBSDFFunc getSampleBSDF(const int indexBSDF)
+{
+  switch (indexBSDF)
+  {
+    case INDEX_BRDF_DIFFUSE:
+      return sampleBrdfDiffuse;
+    case INDEX_BRDF_SPECULAR:
+      return sampleBrdfSpecular;
+    case INDEX_BSDF_SPECULAR:
+      return sampleBsdfSpecular;
+    case INDEX_BRDF_GGX_SMITH:
+      return sampleBrdfGgxSmith;
+    case INDEX_BSDF_GGX_SMITH:
+      return sampleBsdfGgxSmith;
+    default:
+      return nullptr;
+  }
+}
+
+static EvalBSDFFunc getEvalBSDF(const int indexBSDF)
+{
+  switch (indexBSDF)
+  {
+    case INDEX_BRDF_DIFFUSE:
+      return evalBrdfDiffuse;
+    case INDEX_BRDF_GGX_SMITH:
+      return evalBrdfGgxSmith;
+    default: // All specular BSDFs use the same eval function as on the device.
+      return evalBrdfSpecular;
+  }
+}
+
+
+// ========== DeviceCPU
+
+DeviceCPU::DeviceCPU(const int numThreads,
+                     const int miss,
+                     const unsigned int tex)
+: m_miss(miss)
+, m_tex(tex)
+, m_isDirtyOutputBuffer(true) // First render call initializes it.
+, m_nodeFormat(BVH8_NODES_FULL)
+, m_geometryFormat(GEOMETRY_FORMAT_FULL)
+, m_tlasCost(0.0f)
+, m_textureAlbedo(nullptr)
+, m_textureCutout(nullptr)
+, m_textureEnv(nullptr)
+{
+  m_threadPool = std::make_unique<ThreadPool>(static_cast<unsigned int>(std::max(0, numThreads)));
+
+  // Initialize all renderer system data. Same defaults as the Device class.
+  memset(&m_systemData, 0, sizeof(SystemData));
+
+  m_systemData.rect                = make_int4(0, 0, 1, 1);
+  m_systemData.resolution          = make_int2(1, 1); // Deferred allocation after setResolution() when m_isDirtyOutputBuffer == true.
+  m_systemData.tileSize            = make_int2(8, 8); // Work distribution granularity of the host threads. Must be power-of-two values.
+  m_systemData.tileShift           = make_int2(3, 3); // The right-shift for the division by tileSize.
+  m_systemData.pathLengths         = make_int2(2, 5); // min, max
+  m_systemData.deviceCount         = 1; // All host threads work on one image like a single device.
+  m_systemData.deviceIndex         = 0;
+  m_systemData.distribution        = 0;
+  m_systemData.iterationIndex      = 0;
+  m_systemData.samplesSqrt         = 0; // Invalid value! Enforces that there is at least one setState() call before rendering.
+  m_systemData.sceneEpsilon        = 500.0f * SCENE_EPSILON_SCALE;
+  m_systemData.clockScale          = 1000.0f * CLOCK_FACTOR_SCALE;
+  m_systemData.lensShader          = 0;
+  m_systemData.numCameras          = 0;
+  m_systemData.numLights           = 0;
+  m_systemData.numMaterials        = 0;
+  m_systemData.envWidth            = 0;
+  m_systemData.envHeight           = 0;
+  m_systemData.envIntegral         = 1.0f;
+  m_systemData.envRotation         = 0.0f;
+}
+
+DeviceCPU::~DeviceCPU()
+{
+  m_threadPool.reset(); // Join the worker threads first.
+
+  delete m_textureEnv; // Allowed to be nullptr.
+  delete m_textureCutout;
+  delete m_textureAlbedo;
+}
+
+unsigned int DeviceCPU::getNumThreads() const
+{
+  return m_threadPool->getNumThreads();
+}
+
+void DeviceCPU::setCachePath(std::string const& path)
+{
+  m_geometryCache.setPath(path);
+}
+
+void DeviceCPU::setNodeFormat(const BVH8Nodes nodeFormat)
+{
+  m_nodeFormat = nodeFormat;
+}
+
+void DeviceCPU::setBuildMethod(const BVHBuildMethod method, const bool restructure)
+{
+  m_buildOptions.method      = method;
+  m_buildOptions.restructure = restructure;
+}
+
+void DeviceCPU::setGeometryFormat(const GeometryFormat format)
+{
+  m_geometryFormat = format;
+}
+
+// HACK FIXME Hardcocded textures.
+void DeviceCPU::initTextures(std::map<std::string, Picture*> const& mapOfPictures)
+{
+  std::map<std::string, Picture*>::const_iterator itAlbedo = mapOfPictures.find(std::string("albedo"));
+  MY_ASSERT(itAlbedo != mapOfPictures.end());
+
+  std::map<std::string, Picture*>::const_iterator itCutout = mapOfPictures.find(std::string("cutout"));
+  MY_ASSERT(itCutout != mapOfPictures.end());
+
+  std::map<std::string, Picture*>::const_iterator itEnv = mapOfPictures.find(std::string("environment"));
+
+  m_textureAlbedo = new TextureCPU();
+  m_textureAlbedo->create(itAlbedo->second, IMAGE_FLAG_2D);
+
+  m_textureCutout = new TextureCPU();
+  m_textureCutout->create(itCutout->second, IMAGE_FLAG_2D);
+
+  if (itEnv != mapOfPictures.end())
+  {
+    m_textureEnv = new TextureCPU();
+    if (m_textureEnv->create(itEnv->second, IMAGE_FLAG_2D | IMAGE_FLAG_ENV))
+    {
+      // The CDFs are read directly from m_textureEnv in sampleLight(), the SystemData pointers are for device memory only.
+      m_systemData.envTexture  = reinterpret_cast<cudaTextureObject_t>(m_textureEnv);
+      m_systemData.envWidth    = m_textureEnv->getWidth();
+      m_systemData.envHeight   = m_textureEnv->getHeight();
+      m_systemData.envIntegral = m_textureEnv->getIntegral();
+    }
+  }
+}
+
+void DeviceCPU::initCameras(std::vector<CameraDefinition> const& cameras)
+{
+  const int numCameras = static_cast<int>(cameras.size());
+  MY_ASSERT(0 < numCameras); // There must be at least one camera defintion or the lens shaders won't work.
+
+  m_cameras = cameras;
+
+  m_systemData.cameraDefinitions = m_cameras.data();
+  m_systemData.numCameras        = numCameras;
+}
+
+void DeviceCPU::initLights(std::vector<LightDefinition> const& lights)
+{
+  m_lights = lights; // This is allowed to be empty.
+
+  m_systemData.lightDefinitions = (m_lights.empty()) ? nullptr : m_lights.data();
+  m_systemData.numLights        = static_cast<int>(m_lights.size());
+}
+
+void DeviceCPU::setMaterial(MaterialDefinition& material, MaterialGUI const& materialGUI)
+{
+  MY_ASSERT(m_textureAlbedo != nullptr);
+  MY_ASSERT(m_textureCutout != nullptr);
+
+  // The texture objects are the TextureCPU pointers on the host.
+  material.textureAlbedo = (materialGUI.useAlbedoTexture) ? reinterpret_cast<cudaTextureObject_t>(m_textureAlbedo) : 0;
+  material.textureCutout = (materialGUI.useCutoutTexture) ? reinterpret_cast<cudaTextureObject_t>(m_textureCutout) : 0;
+  material.roughness     = materialGUI.roughness;
+  material.indexBSDF     = materialGUI.indexBSDF;
+  material.albedo        = materialGUI.albedo;
+  material.absorption    = make_float3(0.0f); // Null coefficient means no absorption active.
+  if (0.0f < materialGUI.absorptionScale)
+  {
+    // Calculate the effective absorption coefficient from the GUI parameters.
+    // Prevent logf(0.0f) which results in infinity.
+    const float x = -logf(fmax(0.0001f, materialGUI.absorptionColor.x));
+    const float y = -logf(fmax(0.0001f, materialGUI.absorptionColor.y));
+    const float z = -logf(fmax(0.0001f, materialGUI.absorptionColor.z));
+    material.absorption = make_float3(x, y, z) * materialGUI.absorptionScale;
+  }
+  material.ior   = materialGUI.ior;
+  material.flags = (materialGUI.thinwalled) ? FLAG_THINWALLED : 0;
+}
+
+void DeviceCPU::initMaterials(std::vector<MaterialGUI> const& materialsGUI)
+{
+  const int numMaterials = static_cast<int>(materialsGUI.size());
+  MY_ASSERT(0 < numMaterials); // There must be at least one material or the hit shaders won't work.
+
+  m_materials.resize(numMaterials);
+
+  for (int i = 0; i < numMaterials; ++i)
+  {
+    setMaterial(m_materials[i], materialsGUI[i]);
+  }
+
+  m_systemData.materialDefinitions = m_materials.data();
+  m_systemData.numMaterials        = numMaterials;
+}
+
+void DeviceCPU::initScene(InstanceTable const& table, const unsigned int numGeometries)
+{
+  m_geometryData.resize(numGeometries);
+
+  const unsigned int numInstances = table.getNumInstances();
+
+  m_instances.reserve(numInstances);
+
+  for (unsigned int i = 0; i < numInstances; ++i)
+  {
+    InstanceData data(table.getGeometry(i), table.getMaterial(i), table.getLight(i));
+
+    std::shared_ptr<sg::Triangles> geometry = table.getTriangles(data.idGeometry);
+    if (geometry)
+    {
+      createGeometry(geometry);
+    }
+    else
+    {
+      createGeometry(table.getPrimitive(data.idGeometry));
+    }
+    createInstance(table.getMatrix(i), data);
+  }
+
+  createTLAS();
+
+  unsigned int numTriangles   = 0;
+  unsigned int numPrimitives  = 0;
+  size_t       memorySize     = 0;
+  size_t       sizeAttributes = 0;
+
+  for (GeometryCPU const& geometryData : m_geometryData)
+  {
+    numPrimitives += (geometryData.primitive.type != PRIMITIVE_TRIANGLES) ? 1 : 0;
+    numTriangles  += geometryData.bvh.getNumTriangles();
+    memorySize   += geometryData.bvh.getMemorySize();
+
+    if (geometryData.geometry)
+    {
+      sizeAttributes += geometryData.geometry->getAttributes().size() * getTriangleAttributesSize(geometryData.format);
+    }
+  }
+
+  std::cout << "DeviceCPU::initScene() BLAS " << numTriangles << " triangles, "
+            << float(memorySize) / (1024.0f * 1024.0f) << " MiB, "
+            << float(memorySize) / float(std::max(numTriangles, 1u)) << " bytes/triangle"
+            << ((m_nodeFormat == BVH8_NODES_COMPRESSED) ? " (compressed nodes)" : "") << ", shading attributes "
+            << float(sizeAttributes) / (1024.0f * 1024.0f) << " MiB (format " << m_geometryFormat << "), "
+            << numPrimitives << " analytic primitives" << std::endl;
+}
+
+void DeviceCPU::updateCamera(const int idCamera, CameraDefinition const& camera)
+{
+  MY_ASSERT(idCamera < m_systemData.numCameras);
+  m_cameras[idCamera] = camera;
+}
+
+void DeviceCPU::updateLight(const int idLight, LightDefinition const& light)
+{
+  MY_ASSERT(idLight < m_systemData.numLights);
+  m_lights[idLight] = light;
+}
+
+bool DeviceCPU::updateInstances(InstanceTable const& table)
+{
+  std::vector<unsigned int> const& changed = table.getChanged();
+
+  MY_ASSERT(table.getNumInstances() == m_instances.size()); // The scene structure must not have changed.
+
+  for (const unsigned int i : changed)
+  {
+    InstanceCPU& instance = m_instances[i];
+
+    instance.data.idMaterial = table.getMaterial(i);
+    instance.data.idLight    = table.getLight(i);
+    MY_ASSERT(0 <= instance.data.idMaterial);
+
+    setTransform(instance, table.getMatrix(i));
+
+    m_instanceAabbs[i * 2    ] = instance.aabbMin;
+    m_instanceAabbs[i * 2 + 1] = instance.aabbMax;
+  }
+
+  // The refit keeps the topology of the last build. Rebuild when the instances moved far enough to make the boxes overlap much more.
+  m_tlas.refit(m_instanceAabbs, changed);
+
+  if (0.0f < TLAS_REBUILD_RATIO && m_tlasCost * TLAS_REBUILD_RATIO < m_tlas.getCost())
+  {
+    m_tlas.build(m_instanceAabbs, m_threadPool.get());
+    m_tlasCost = m_tlas.getCost();
+    return true;
+  }
+  return false;
+}
+
+void DeviceCPU::updateMaterial(const int idMaterial, MaterialGUI const& materialGUI)
+{
+  MY_ASSERT(idMaterial < static_cast<int>(m_materials.size()));
+  // No shader switch needed like on the Device. The cutout opacity is evaluated per hit when the material has a cutout texture.
+  setMaterial(m_materials[idMaterial], materialGUI);
+}
+
+void DeviceCPU::setState(DeviceState const& state)
+{
+  if (m_systemData.resolution != state.resolution)
+  {
+    m_systemData.resolution = state.resolution;
+    m_isDirtyOutputBuffer = true;
+  }
+
+  if (m_systemData.tileSize != state.tileSize)
+  {
+    m_systemData.tileSize  = state.tileSize;
+    m_systemData.tileShift = calculateTileShift(m_systemData.tileSize);
+  }
+
+  m_systemData.distribution = state.distribution;
+  m_systemData.samplesSqrt  = state.samplesSqrt;
+  m_systemData.lensShader   = state.lensShader;
+  m_systemData.pathLengths  = state.pathLengths;
+  m_systemData.sceneEpsilon = state.epsilonFactor * SCENE_EPSILON_SCALE;
+  m_systemData.envRotation  = state.envRotation; // FIXME Implement free rotation with a rotation matrix.
+}
+
+
+unsigned int DeviceCPU::createGeometry(std::shared_ptr<sg::Triangles> geometry)
+{
+  const unsigned int idGeometry = geometry->getId();
+  MY_ASSERT(idGeometry < m_geometryData.size());
+
+  GeometryCPU& geometryData = m_geometryData[idGeometry];
+
+  // Did we reference this Triangles node already?
+  if (geometryData.geometry)
+  {
+    return idGeometry;
+  }
+
+  std::vector<TriangleAttributes> const& attributes = geometry->getAttributes();
+  std::vector<unsigned int>       const& indices    = geometry->getIndices();
+
+  geometryData.geometry     = geometry;
+  geometryData.attributes   = attributes.data();
+  geometryData.format       = m_geometryFormat;
+  geometryData.indices      = indices.data();
+  geometryData.numTriangles = static_cast<unsigned int>(indices.size()) / 3;
+
+  // Build the BLAS only once per unique geometry, no matter how often it's instanced.
+  // With the geometry cache enabled, identical geometry contents reuse the BVH8 of a previous run.
+  unsigned long long key = 0;
+  bool isCached = false;
+
+  if (m_geometryCache.isEnabled())
+  {
+    key = GeometryCache::hash("BVH8", 4);
+    key = GeometryCache::hashValue(static_cast<unsigned int>(BVH_CACHE_VERSION), key);
+    key = GeometryCache::hashValue(static_cast<unsigned int>(BVH8_TRIANGLES_BLOCKS), key);
+    key = GeometryCache::hashValue(static_cast<unsigned int>(m_buildOptions.method), key);
+    key = GeometryCache::hashValue(static_cast<unsigned int>(m_buildOptions.restructure), key);
+    key = GeometryCache::hashValue(geometry->getSpatialSplitAlpha(), key);
+    key = GeometryCache::hashValue(static_cast<unsigned int>(m_nodeFormat), key);
+    key = GeometryCache::hash(attributes.data(), attributes.size() * sizeof(TriangleAttributes), key);
+    key = GeometryCache::hash(indices.data(), indices.size() * sizeof(unsigned int), key);
+
+    isCached = geometryData.bvh.load(m_geometryCache, key, geometry);
+  }
+
+  if (!isCached)
+  {
+    // The binary BVH is only needed to collapse it into the 8-wide BVH.
+    BVHBuildOptions options = m_buildOptions;
+
+    options.splitAlpha = geometry->getSpatialSplitAlpha();
+
+    BVH bvh;
+    bvh.build(geometry, m_threadPool.get(), options);
+
+    geometryData.bvh.build(bvh, BVH8_TRIANGLES_BLOCKS, m_nodeFormat);
+
+    if (m_geometryCache.isEnabled())
+    {
+      geometryData.bvh.store(m_geometryCache, key);
+    }
+  }
+
+  geometryData.aabbMin = geometryData.bvh.getAabbMin();
+  geometryData.aabbMax = geometryData.bvh.getAabbMax();
+
+  if (geometryData.format != GEOMETRY_FORMAT_FULL)
+  {
+    geometry->encodeAttributes(geometryData.format, geometryData.encoded, geometryData.vertexOffset, geometryData.vertexScale);
+
+    geometryData.attributes = geometryData.encoded.data();
+  }
+
+  return idGeometry;
+}
+
+// Analytic primitives need no BLAS. The instance traversal intersects them directly in object space.
+unsigned int DeviceCPU::createGeometry(std::shared_ptr<sg::Primitive> primitive)
+{
+  const unsigned int idGeometry = primitive->getId();
+  MY_ASSERT(idGeometry < m_geometryData.size());
+
+  GeometryCPU& geometryData = m_geometryData[idGeometry];
+
+  geometryData.primitive = primitive->getDefinition();
+
+  getPrimitiveAabb(geometryData.primitive, geometryData.aabbMin, geometryData.aabbMax);
+
+  return idGeometry;
+}
+
+void DeviceCPU::createInstance(const float* matrix, InstanceData const& data)
+{
+  MY_ASSERT(0 <= data.idMaterial);
+
+  InstanceCPU instance(data);
+
+  setTransform(instance, matrix);
+
+  m_instances.push_back(instance);
+}
+
+void DeviceCPU::setTransform(InstanceCPU& instance, const float* matrix) const
+{
+  memcpy(instance.matrix, matrix, sizeof(float) * 12);
+  invertMatrix(instance.inverse, instance.matrix);
+
+  // World space bounding box of the eight transformed object space box corners.
+  GeometryCPU const& geometryData = m_geometryData[instance.data.idGeometry];
+
+  instance.aabbMin = make_float3(RT_DEFAULT_MAX);
+  instance.aabbMax = make_float3(-RT_DEFAULT_MAX);
+
+  for (int i = 0; i < 8; ++i)
+  {
+    const float3 corner = make_float3((i & 1) ? geometryData.aabbMax.x : geometryData.aabbMin.x,
+                                      (i & 2) ? geometryData.aabbMax.y : geometryData.aabbMin.y,
+                                      (i & 4) ? geometryData.aabbMax.z : geometryData.aabbMin.z);
+    const float3 p = transformPoint(instance.matrix, corner);
+
+    instance.aabbMin = fminf(instance.aabbMin, p);
+    instance.aabbMax = fmaxf(instance.aabbMax, p);
+  }
+}
+
+void DeviceCPU::createTLAS()
+{
+  getInstanceAabbs(m_instanceAabbs);
+
+  m_tlas.build(m_instanceAabbs, m_threadPool.get());
+  m_tlasCost = m_tlas.getCost();
+}
+
+// The instance world space bounding boxes are the TLAS primitives. The primitive index is the index into m_instances.
+void DeviceCPU::getInstanceAabbs(std::vector<float3>& aabbs) const
+{
+  aabbs.resize(m_instances.size() * 2);
+
+  for (size_t i = 0; i < m_instances.size(); ++i)
+  {
+    aabbs[i * 2    ] = m_instances[i].aabbMin;
+    aabbs[i * 2 + 1] = m_instances[i].aabbMax;
+  }
+}
+
+
+// Emulates tex2D<float4>() on the host. The cudaTextureObject_t holds the TextureCPU pointer.
+float4 DeviceCPU::tex2D(const cudaTextureObject_t texture, const float u, const float v) const
+{
+  return reinterpret_cast<const TextureCPU*>(texture)->sample(u, v);
+}
+
+// The cutout opacity at the hit, see the anyhit.cu programs.
+float DeviceCPU::getOpacity(InstanceCPU const& instance, const unsigned int primitive, float2 const& barycentrics) const
+{
+  MaterialDefinition const& material = m_materials[instance.data.idMaterial];
+
+  if (material.textureCutout == 0)
+  {
+    return 1.0f;
+  }
+
+  GeometryCPU const& geometryData = m_geometryData[instance.data.idGeometry];
+
+  if (geometryData.primitive.type != PRIMITIVE_TRIANGLES)
+  {
+    return intensity(make_float3(tex2D(material.textureCutout, barycentrics.x, barycentrics.y))); // The surface coordinates are the texcoord.
+  }
+
+  const unsigned int* tri = &geometryData.indices[primitive * 3];
+
+  const float alpha = 1.0f - barycentrics.x - barycentrics.y;
+
+  const float3 texcoord = getTriangleTexcoord(geometryData.attributes, geometryData.format, tri[0]) * alpha +
+                          getTriangleTexcoord(geometryData.attributes, geometryData.format, tri[1]) * barycentrics.x +
+                          getTriangleTexcoord(geometryData.attributes, geometryData.format, tri[2]) * barycentrics.y;
+
+  return intensity(make_float3(tex2D(material.textureCutout, texcoord.x, texcoord.y)));
+}
+
+// Equivalent of optixTrace() with the radiance ray type. Returns true on a hit.
+// Two-level traversal: The TLAS visits the instances front to back and the object space ray is traced through the BLAS of the instanced geometry.
+bool DeviceCPU::traceRadiance(float3 const& origin, float3 const& direction, const float tmin, const float tmax, PerRayData* prd, HitCPU& hit) const
+{
+  hit.distance = tmax;
+  hit.instance = -1;
+
+  BVHRay ray;
+
+  ray.origin    = origin;
+  ray.tmin      = tmin;
+  ray.direction = direction;
+  ray.tmax      = tmax;
+
+  m_tlas.traverse(ray, [&](const unsigned int i, const float tmaxInstance) -> float
+  {
+    InstanceCPU const& instance = m_instances[i];
+
+    // Object space ray. The direction is not normalized to keep the same ray parameter t as in world space.
+    BVHRay rayObject;
+
+    rayObject.origin    = transformPoint(instance.inverse, origin);
+    rayObject.tmin      = tmin;
+    rayObject.direction = transformVector(instance.inverse, direction);
+    rayObject.tmax      = tmaxInstance;
+
+    BVHHit hitObject;
+
+    if (!intersectInstance(instance, rayObject, prd, hitObject))
+    {
+      return tmaxInstance;
+    }
+
+    hit.distance     = hitObject.distance;
+    hit.barycentrics = hitObject.barycentrics;
+    hit.instance     = static_cast<int>(i);
+    hit.primitive    = hitObject.primitive;
+
+    return hitObject.distance; // Culls the instances behind this hit.
+  });
+
+  return (0 <= hit.instance);
+}
+
+// Closest hit queries for a packet of primary rays. The packet.tmax receive the hit distances.
+// Instances with cutout opacity need the any hit filter and trace the affected rays individually, same as the analytic primitives.
+void DeviceCPU::traceRadiancePacket(BVHRayPacket& packet, PerRayData* prds, HitCPU* hits) const
+{
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    hits[r].distance = packet.tmax[r];
+    hits[r].instance = -1;
+  }
+
+  const unsigned long long active = (packet.count < BVH_PACKET_SIZE) ? (1ull << packet.count) - 1ull : ~0ull;
+
+  BVHRayPacket packetObject;
+  BVHHit       hitsObject[BVH_PACKET_SIZE];
+
+  m_tlas.traversePacket(packet, active, [&](const unsigned int i, const unsigned long long mask, BVHRayPacket& packetWorld)
+  {
+    InstanceCPU const& instance     = m_instances[i];
+    GeometryCPU const& geometryData = m_geometryData[instance.data.idGeometry];
+
+    if (m_materials[instance.data.idMaterial].textureCutout != 0 || geometryData.primitive.type != PRIMITIVE_TRIANGLES)
+    {
+      for (unsigned int r = 0; r < packetWorld.count; ++r)
+      {
+        if (!(mask & (1ull << r)))
+        {
+          continue;
+        }
+
+        BVHRay rayObject;
+
+        rayObject.origin    = transformPoint(instance.inverse, packetWorld.origin[r]);
+        rayObject.tmin      = packetWorld.tmin;
+        rayObject.direction = transformVector(instance.inverse, packetWorld.direction[r]);
+        rayObject.tmax      = packetWorld.tmax[r];
+
+        BVHHit hitObject;
+        if (intersectInstance(instance, rayObject, &prds[r], hitObject))
+        {
+          packetWorld.tmax[r] = hitObject.distance;
+
+          hits[r].distance     = hitObject.distance;
+          hits[r].barycentrics = hitObject.barycentrics;
+          hits[r].instance     = static_cast<int>(i);
+          hits[r].primitive    = hitObject.primitive;
+        }
+      }
+      return;
+    }
+
+    // Object space packet. The directions are not normalized to keep the same ray parameters t as in world space.
+    packetObject.count = packetWorld.count;
+    packetObject.tmin  = packetWorld.tmin;
+    for (unsigned int r = 0; r < packetWorld.count; ++r)
+    {
+      packetObject.origin[r]    = transformPoint(instance.inverse, packetWorld.origin[r]);
+      packetObject.direction[r] = transformVector(instance.inverse, packetWorld.direction[r]);
+      packetObject.tmax[r]      = packetWorld.tmax[r];
+    }
+    packetObject.prepare();
+
+    const unsigned long long found = geometryData.bvh.intersectPacket(packetObject, mask, hitsObject);
+
+    for (unsigned int r = 0; r < packetWorld.count; ++r)
+    {
+      if (found & (1ull << r))
+      {
+        packetWorld.tmax[r] = hitsObject[r].distance;
+
+        hits[r].distance     = hitsObject[r].distance;
+        hits[r].barycentrics = hitsObject[r].barycentrics;
+        hits[r].instance     = static_cast<int>(i);
+        hits[r].primitive    = hitsObject[r].primitive;
+      }
+    }
+  });
+}
+
+// Equivalent of optixTrace() with the shadow ray type. Returns true when the visibility test failed.
+bool DeviceCPU::traceShadow(float3 const& origin, float3 const& direction, const float tmin, const float tmax, PerRayData* prd) const
+{
+  BVHRay ray;
+
+  ray.origin    = origin;
+  ray.tmin      = tmin;
+  ray.direction = direction;
+  ray.tmax      = tmax;
+
+  bool isOccluded = false;
+
+  m_tlas.traverse(ray, [&](const unsigned int i, const float tmaxInstance) -> float
+  {
+    InstanceCPU const& instance = m_instances[i];
+
+    BVHRay rayObject;
+
+    rayObject.origin    = transformPoint(instance.inverse, origin);
+    rayObject.tmin      = tmin;
+    rayObject.direction = transformVector(instance.inverse, direction);
+    rayObject.tmax      = tmaxInstance;
+
+    GeometryCPU const& geometryData = m_geometryData[instance.data.idGeometry];
+
+    if (geometryData.primitive.type != PRIMITIVE_TRIANGLES)
+    {
+      BVHHit hitObject;
+      isOccluded = intersectPrimitive(instance, rayObject, prd, hitObject);
+    }
+    else if (m_materials[instance.data.idMaterial].textureCutout != 0)
+    {
+      // Stochastic alpha test, see __anyhit__shadow_cutout().
+      const BVHFilter filter = [&](const unsigned int primitive, float2 const& barycentrics) -> bool
+      {
+        const float opacity = getOpacity(instance, primitive, barycentrics);
+        return !(opacity < 1.0f && opacity <= rng(prd->seed));
+      };
+      isOccluded = geometryData.bvh.occluded(rayObject, &filter);
+    }
+    else
+    {
+      isOccluded = geometryData.bvh.occluded(rayObject);
+    }
+
+    return (isOccluded) ? -1.0f : tmaxInstance; // optixTerminateRay()
+  });
+
+  return isOccluded;
+}
+
+// Closest hit of the object space ray with the geometry of one instance, including the cutout opacity test.
+bool DeviceCPU::intersectInstance(InstanceCPU const& instance, BVHRay const& rayObject, PerRayData* prd, BVHHit& hit) const
+{
+  GeometryCPU const& geometryData = m_geometryData[instance.data.idGeometry];
+
+  if (geometryData.primitive.type != PRIMITIVE_TRIANGLES)
+  {
+    return intersectPrimitive(instance, rayObject, prd, hit);
+  }
+
+  if (m_materials[instance.data.idMaterial].textureCutout != 0)
+  {
+    // Stochastic alpha test to get an alpha blend effect, see __anyhit__radiance_cutout().
+    const BVHFilter filter = [&](const unsigned int primitive, float2 const& barycentrics) -> bool
+    {
+      const float opacity = getOpacity(instance, primitive, barycentrics);
+      return !(opacity < 1.0f && opacity <= rng(prd->seed)); // false means optixIgnoreIntersection()
+    };
+    return geometryData.bvh.intersect(rayObject, hit, &filter);
+  }
+
+  return geometryData.bvh.intersect(rayObject, hit);
+}
+
+// Equivalent of the __intersection__primitive program. Reports the nearer surface crossing inside the ray interval first,
+// the farther one only when the cutout opacity test ignored the nearer.
+bool DeviceCPU::intersectPrimitive(InstanceCPU const& instance, BVHRay const& rayObject, PerRayData* prd, BVHHit& hit) const
+{
+  float  t[2];
+  float2 uv[2];
+
+  const int count = ::intersectPrimitive(m_geometryData[instance.data.idGeometry].primitive, rayObject.origin, rayObject.direction, t, uv);
+
+  const bool isCutout = (m_materials[instance.data.idMaterial].textureCutout != 0);
+
+  for (int i = 0; i < count; ++i)
+  {
+    if (t[i] < rayObject.tmin || rayObject.tmax < t[i])
+    {
+      continue;
+    }
+    if (isCutout)
+    {
+      const float opacity = getOpacity(instance, 0, uv[i]);
+      if (opacity < 1.0f && opacity <= rng(prd->seed))
+      {
+        continue;
+      }
+    }
+
+    hit.distance     = t[i];
+    hit.barycentrics = uv[i];
+    hit.primitive    = 0;
+    return true;
+  }
+  return false;
+}
+
+
+void DeviceCPU::lensShader(const float2 screen, const float2 pixel, const float2 sample, float3& origin, float3& direction) const
+{
+  const CameraDefinition camera = m_systemData.cameraDefinitions[0];
+
+  switch (m_systemData.lensShader)
+  {
+    case LENS_SHADER_PINHOLE:
+    default:
+      lensShaderPinhole(camera, screen, pixel, sample, origin, direction);
+      break;
+    case LENS_SHADER_FISHEYE:
+      lensShaderFisheye(camera, screen, pixel, sample, origin, direction);
+      break;
+    case LENS_SHADER_SPHERE:
+      lensShaderSphere(camera, screen, pixel, sample, origin, direction);
+      break;
+  }
+}
+
+// Batch version of lensShader() for the primary rays of a pixel block. Selects the lens shader once for all rays.
+void DeviceCPU::lensShaderPacket(const float2 screen, const float2* pixels, const float2* samples, BVHRayPacket& packet) const
+{
+  const CameraDefinition camera = m_systemData.cameraDefinitions[0];
+
+  switch (m_systemData.lensShader)
+  {
+    case LENS_SHADER_PINHOLE:
+    default:
+      for (unsigned int r = 0; r < packet.count; ++r)
+      {
+        lensShaderPinhole(camera, screen, pixels[r], samples[r], packet.origin[r], packet.direction[r]);
+      }
+      break;
+    case LENS_SHADER_FISHEYE:
+      for (unsigned int r = 0; r < packet.count; ++r)
+      {
+        lensShaderFisheye(camera, screen, pixels[r], samples[r], packet.origin[r], packet.direction[r]);
+      }
+      break;
+    case LENS_SHADER_SPHERE:
+      for (unsigned int r = 0; r < packet.count; ++r)
+      {
+        lensShaderSphere(camera, screen, pixels[r], samples[r], packet.origin[r], packet.direction[r]);
+      }
+      break;
+  }
+}
+
+void DeviceCPU::sampleBSDF(MaterialDefinition const& material, State const& state, PerRayData* prd) const
+{
+  const SampleBSDFFunc sample = getSampleBSDF(material.indexBSDF);
+
+  if (sample == nullptr)
+  {
+    prd->flags |= FLAG_TERMINATE;
+    return;
+  }
+  sample(material, state, prd);
+}
+
+// Returns BSDF f in .xyz and the BSDF pdf in .w
+float4 DeviceCPU::evalBSDF(MaterialDefinition const& material, State const& state, PerRayData* const prd, float3 const& wiL) const
+{
+  return getEvalBSDF(material.indexBSDF)(material, state, prd, wiL);
+}
+
+// Note that all light sampling routines return lightSample.direction and lightSample.distance in world space!
+void DeviceCPU::sampleLight(float3 const& point, const float2 sample, LightSample& lightSample) const
+{
+  LightDefinition const& light = m_systemData.lightDefinitions[lightSample.index]; // The light index is picked by the caller!
+
+  if (light.type == LIGHT_ENVIRONMENT)
+  {
+    if (m_miss != 2 || m_textureEnv == nullptr) // miss == 0 is not a light, use constant program.
+    {
+      // __direct_callable__light_env_constant
+      unitSquareToSphere(sample.x, sample.y, lightSample.direction, lightSample.pdf);
+
+      // Environment lights do not set the light sample position!
+      lightSample.distance = RT_DEFAULT_MAX; // Environment light.
+
+      // Explicit light sample. White scaled by inverse probabilty to hit this light.
+      lightSample.emission = make_float3(float(m_systemData.numLights));
+      return;
+    }
+
+    // __direct_callable__light_env_sphere
+    // Importance-sample the spherical environment light direction.
+    // Note that the marginal CDF is one bigger than the texture height. As index this is the 1.0f at the end of the CDF.
+    const unsigned int sizeV = m_systemData.envHeight;
+
+    unsigned int ilo = 0;     // Use this for full spherical lighting. (This matches the result of indirect environment lighting.)
+    unsigned int ihi = sizeV; // Index on the last entry containing 1.0f. Can never be reached with the sample in the range [0.0f, 1.0f).
+
+    const float* cdfV = m_textureEnv->getCDF_V();
+
+    // Binary search the row index to look up.
+    while (ilo != ihi - 1) // When a pair of limits have been found, the lower index indicates the cell to use.
+    {
+      const unsigned int i = (ilo + ihi) >> 1;
+      if (sample.y < cdfV[i]) // If the cdf is greater than the sample, use that as new higher limit.
+      {
+        ihi = i;
+      }
+      else // If the sample is greater than or equal to the CDF value, use that as new lower limit.
+      {
+        ilo = i;
+      }
+    }
+
+    const unsigned int vIdx = ilo; // This is the row we found.
+
+    // Note that the horizontal CDF is one bigger than the texture width. As index this is the 1.0f at the end of the CDF.
+    const unsigned int sizeU = m_systemData.envWidth;
+
+    // Binary search the column index to look up.
+    ilo = 0;
+    ihi = sizeU; // Index on the last entry containing 1.0f. Can never be reached with the sample in the range [0.0f, 1.0f).
+
+    // Pointer to the indexY row!
+    const float* cdfU = &m_textureEnv->getCDF_U()[vIdx * (sizeU + 1)]; // Horizontal CDF is one bigger then the texture width!
+
+    while (ilo != ihi - 1) // When a pair of limits have been found, the lower index indicates the cell to use.
+    {
+      const unsigned int i = (ilo + ihi) >> 1;
+      if (sample.x < cdfU[i]) // If the CDF value is greater than the sample, use that as new higher limit.
+      {
+        ihi = i;
+      }
+      else // If the sample is greater than or equal to the CDF value, use that as new lower limit.
+      {
+        ilo = i;
+      }
+    }
+
+    const unsigned int uIdx = ilo; // The column result.
+
+    // Continuous sampling of the CDF.
+    const float cdfLowerU = cdfU[uIdx];
+    const float cdfUpperU = cdfU[uIdx + 1];
+    const float du = (sample.x - cdfLowerU) / (cdfUpperU - cdfLowerU);
+
+    const float cdfLowerV = cdfV[vIdx];
+    const float cdfUpperV = cdfV[vIdx + 1];
+    const float dv = (sample.y - cdfLowerV) / (cdfUpperV - cdfLowerV);
+
+    // Texture lookup coordinates.
+    const float u = (float(uIdx) + du) / float(sizeU);
+    const float v = (float(vIdx) + dv) / float(sizeV);
+
+    // Light sample direction vector polar coordinates. This is where the environment rotation happens!
+    const float phi   = (u - m_systemData.envRotation) * 2.0f * M_PIf;
+    const float theta = v * M_PIf; // theta == 0.0f is south pole, theta == M_PIf is north pole.
+
+    const float sinTheta = sinf(theta);
+    // The miss program places the 1->0 seam at the positive z-axis and looks from the inside.
+    lightSample.direction = make_float3(-sinf(phi) * sinTheta,  // Starting on positive z-axis going around clockwise (to negative x-axis).
+                                        -cosf(theta),           // From south pole to north pole.
+                                         cosf(phi) * sinTheta); // Starting on positive z-axis.
+
+    // Note that environment lights do not set the light sample position!
+    lightSample.distance = RT_DEFAULT_MAX; // Environment light.
+
+    const float3 emission = make_float3(tex2D(m_systemData.envTexture, u, v));
+    // Explicit light sample. The returned emission must be scaled by the inverse probability to select this light.
+    lightSample.emission = emission * float(m_systemData.numLights);
+    // For simplicity we pretend that we perfectly importance-sampled the actual texture-filtered environment map
+    // and not the Gaussian-smoothed one used to actually generate the CDFs and uniform sampling in the texel.
+    lightSample.pdf = intensity(emission) / m_systemData.envIntegral;
+    return;
+  }
+
+  // __direct_callable__light_parallelogram
+  lightSample.pdf = 0.0f; // Default return, invalid light sample (backface, edge on, or too near to the surface)
+
+  lightSample.position  = light.position + light.vecU * sample.x + light.vecV * sample.y; // The light sample position in world coordinates.
+  lightSample.direction = lightSample.position - point; // Sample direction from surface point to light sample position.
+  lightSample.distance  = length(lightSample.direction);
+
+  if (DENOMINATOR_EPSILON < lightSample.distance)
+  {
+    lightSample.direction /= lightSample.distance; // Normalized direction to light.
+
+    const float cosTheta = dot(-lightSample.direction, light.normal);
+    if (DENOMINATOR_EPSILON < cosTheta) // Only emit light on the front side.
+    {
+      // Explicit light sample, must scale the emission by inverse probabilty to hit this light.
+      lightSample.emission = light.emission * float(m_systemData.numLights);
+      lightSample.pdf      = (lightSample.distance * lightSample.distance) / (light.area * cosTheta); // Solid angle pdf. Assumes light.area != 0.0f.
+    }
+  }
+}
+
+// The miss programs (miss.cu) selected by m_miss like in Device::initPipeline().
+void DeviceCPU::miss(PerRayData* thePrd) const
+{
+  switch (m_miss)
+  {
+    case 0: // __miss__env_null
+    default:
+      thePrd->radiance = make_float3(0.0f);
+      break;
+
+    case 1: // __miss__env_constant
+    {
+#if USE_NEXT_EVENT_ESTIMATION
+      // If the last surface intersection was a diffuse which was directly lit with multiple importance sampling,
+      // then calculate light emission with multiple importance sampling as well.
+      const float weightMIS = (thePrd->flags & FLAG_DIFFUSE) ? powerHeuristic(thePrd->pdf, 0.25f * M_1_PIf) : 1.0f;
+      thePrd->radiance = make_float3(weightMIS); // Constant white emission multiplied by MIS weight.
+#else
+      thePrd->radiance = make_float3(1.0f); // Constant white emission.
+#endif
+    }
+    break;
+
+    case 2: // __miss__env_sphere
+    {
+      if (m_textureEnv == nullptr) // No environment map loaded.
+      {
+        thePrd->radiance = make_float3(0.0f);
+        break;
+      }
+
+      const float3 R = thePrd->wi; // theRay.direction;
+      // The seam u == 0.0 == 1.0 is in positive z-axis direction.
+      // Compensate for the environment rotation done inside the direct lighting.
+      const float u     = (atan2f(R.x, -R.z) + M_PIf) * 0.5f * M_1_PIf + m_systemData.envRotation;
+      const float theta = acosf(-R.y);     // theta == 0.0f is south pole, theta == M_PIf is north pole.
+      const float v     = theta * M_1_PIf; // Texture is with origin at lower left, v == 0.0f is south pole.
+
+      const float3 emission = make_float3(tex2D(m_systemData.envTexture, u, v));
+
+#if USE_NEXT_EVENT_ESTIMATION
+      float weightMIS = 1.0f;
+      // If the last surface intersection was a diffuse event which was directly lit with multiple importance sampling,
+      // then calculate light emission with multiple importance sampling for this implicit light hit as well.
+      if (thePrd->flags & FLAG_DIFFUSE)
+      {
+        const float pdfLight = intensity(emission) / m_systemData.envIntegral;
+        weightMIS = powerHeuristic(thePrd->pdf, pdfLight);
+      }
+      thePrd->radiance = emission * weightMIS;
+#else
+      thePrd->radiance = emission;
+#endif
+    }
+    break;
+  }
+
+  thePrd->flags |= FLAG_TERMINATE;
+}
+
+// The first half of __closesthit__radiance(). Calculates the world space state of the surface hit and handles the light emission.
+// Returns false when the path ended on a light. Otherwise the state is ready for the BSDF sampling.
+bool DeviceCPU::hitSurface(PerRayData* thePrd, HitCPU const& hit, State& state) const
+{
+  InstanceCPU const& instance     = m_instances[hit.instance];
+  GeometryCPU const& geometryData = m_geometryData[instance.data.idGeometry];
+
+  float3 ng;
+  float3 tg;
+  float3 ns;
+
+  if (geometryData.primitive.type != PRIMITIVE_TRIANGLES)
+  {
+    getPrimitiveAttributes(geometryData.primitive, hit.barycentrics, ng, tg, ns, state.texcoord);
+  }
+  else
+  {
+    const unsigned int* tri = &geometryData.indices[hit.primitive * 3];
+
+    const TriangleAttributes attr0 = getTriangleAttributes(geometryData.attributes, geometryData.format, tri[0], geometryData.vertexOffset, geometryData.vertexScale);
+    const TriangleAttributes attr1 = getTriangleAttributes(geometryData.attributes, geometryData.format, tri[1], geometryData.vertexOffset, geometryData.vertexScale);
+    const TriangleAttributes attr2 = getTriangleAttributes(geometryData.attributes, geometryData.format, tri[2], geometryData.vertexOffset, geometryData.vertexScale);
+
+    const float2 theBarycentrics = hit.barycentrics; // beta and gamma
+    const float  alpha = 1.0f - theBarycentrics.x - theBarycentrics.y;
+
+    ng = cross(attr1.vertex - attr0.vertex, attr2.vertex - attr0.vertex);
+    tg = attr0.tangent * alpha + attr1.tangent * theBarycentrics.x + attr2.tangent * theBarycentrics.y;
+    ns = attr0.normal  * alpha + attr1.normal  * theBarycentrics.x + attr2.normal  * theBarycentrics.y;
+
+    state.texcoord = attr0.texcoord * alpha + attr1.texcoord * theBarycentrics.x + attr2.texcoord * theBarycentrics.y;
+  }
+
+  // The state is in world space coordinates!
+
+  state.normalGeo = normalize(transformNormal(instance.inverse, ng));
+  state.tangent   = normalize(transformVector(instance.matrix, tg));
+  state.normal    = normalize(transformNormal(instance.inverse, ns));
+
+  thePrd->distance = hit.distance; // Return the current path segment distance, needed for absorption calculations in the integrator.
+
+  thePrd->pos = thePrd->pos + thePrd->wi * thePrd->distance;
+
+  // Explicitly include edge-on cases as frontface condition!
+  thePrd->flags |= (0.0f <= dot(thePrd->wo, state.normalGeo)) ? FLAG_FRONTFACE : 0;
+
+  if ((thePrd->flags & FLAG_FRONTFACE) == 0) // Looking at the backface?
+  {
+    // Means geometric normal and shading normal are always defined on the side currently looked at.
+    state.normalGeo = -state.normalGeo;
+    state.tangent   = -state.tangent;
+    state.normal    = -state.normal;
+    // Explicitly DO NOT recalculate the frontface condition!
+  }
+
+  thePrd->radiance = make_float3(0.0f);
+
+  // When hitting a geometric light, evaluate the emission first, because this needs the previous diffuse hit's pdf.
+  if (0 <= instance.data.idLight &&     // This material is emissive and
+      (thePrd->flags & FLAG_FRONTFACE)) // we're looking at the front face.
+  {
+    const float cosTheta = dot(thePrd->wo, state.normalGeo);
+    if (DENOMINATOR_EPSILON < cosTheta)
+    {
+      LightDefinition const& light = m_systemData.lightDefinitions[instance.data.idLight];
+
+      float3 emission = light.emission;
+
+#if USE_NEXT_EVENT_ESTIMATION
+      const float lightPdf = (thePrd->distance * thePrd->distance) / (light.area * cosTheta); // This assumes the light.area is greater than zero.
+
+      // If it's an implicit light hit from a diffuse scattering event and the light emission was not returning a zero pdf (e.g. backface or edge on).
+      if ((thePrd->flags & FLAG_DIFFUSE) && DENOMINATOR_EPSILON < lightPdf)
+      {
+        // Scale the emission with the power heuristic between the initial BSDF sample pdf and this implicit light sample pdf.
+        emission *= powerHeuristic(thePrd->pdf, lightPdf);
+      }
+#endif // USE_NEXT_EVENT_ESTIMATION
+
+      thePrd->radiance = emission;
+
+      // PERF End the path when hitting a light. Emissive materials with a non-black BSDF would normally just continue.
+      thePrd->flags |= FLAG_TERMINATE;
+      return false;
+    }
+  }
+
+  // Start fresh with the next BSDF sample. (Either of these values remaining zero is an end-of-path condition.)
+  thePrd->f_over_pdf = make_float3(0.0f);
+  thePrd->pdf        = 0.0f;
+
+  MaterialDefinition const& material = m_systemData.materialDefinitions[instance.data.idMaterial];
+
+  state.albedo = material.albedo;
+
+  if (material.textureAlbedo != 0)
+  {
+    const float3 texColor = make_float3(tex2D(material.textureAlbedo, state.texcoord.x, state.texcoord.y));
+
+    // Modulate the incoming color with the texture.
+    state.albedo *= texColor;
+  }
+
+  // Only the last diffuse hit is tracked for multiple importance sampling of implicit light hits.
+  thePrd->flags = (thePrd->flags & ~FLAG_DIFFUSE) | FLAG_HIT | material.flags; // FLAG_THINWALLED can be set directly from the material.
+
+  return true;
+}
+
+#if USE_NEXT_EVENT_ESTIMATION
+// The direct lighting part of __closesthit__radiance(). The eval function is the BSDF of the hit material.
+// Returns true when the light sample contributes. The visibility test of the shadowRay is left to the caller.
+bool DeviceCPU::sampleDirectLighting(PerRayData* thePrd, MaterialDefinition const& material, State const& state, EvalBSDFFunc eval, ShadowRayCPU& shadowRay) const
+{
+  // Direct lighting if the sampled BSDF was diffuse and any light is in the scene.
+  const int numLights = m_systemData.numLights;
+  if ((thePrd->flags & FLAG_DIFFUSE) == 0 || numLights <= 0)
+  {
+    return false;
+  }
+
+  const float2 sample = rng2(thePrd->seed); // Use lower dimension samples for the position. (Irrelevant for the LCG).
+
+  LightSample lightSample; // Sample one of many lights.
+
+  // The caller picks the light to sample. Make sure the index stays in the bounds of the sysData.lightDefinitions array.
+  lightSample.index = (1 < numLights) ? clamp(static_cast<int>(floorf(rng(thePrd->seed) * numLights)), 0, numLights - 1) : 0;
+
+  sampleLight(thePrd->pos, sample, lightSample);
+
+  if (lightSample.pdf <= 0.0f) // Useless light sample?
+  {
+    return false;
+  }
+
+  // Evaluate the BSDF in the light sample direction. Normally cheaper than shooting rays.
+  // Returns BSDF f in .xyz and the BSDF pdf in .w
+  const float4 bsdf_pdf = eval(material, state, thePrd, lightSample.direction);
+
+  if (bsdf_pdf.w <= 0.0f || !isNotNull(make_float3(bsdf_pdf)))
+  {
+    return false;
+  }
+
+  if (thePrd->flags & FLAG_VOLUME) // Supporting nested materials includes having lights inside a volume.
+  {
+    // Calculate the transmittance along the light sample's distance in case it's inside a volume.
+    // The light must be in the same volume or it would have been shadowed.
+    lightSample.emission *= expf(-lightSample.distance * thePrd->sigma_t);
+  }
+
+  const float weightMis = powerHeuristic(lightSample.pdf, bsdf_pdf.w);
+
+  // Note that the sysData.sceneEpsilon is applied on both sides of the shadow ray [t_min, t_max] interval
+  // to prevent self-intersections with the actual light geometry in the scene.
+  shadowRay.direction = lightSample.direction;
+  shadowRay.tmax      = lightSample.distance - m_systemData.sceneEpsilon;
+  shadowRay.radiance  = make_float3(bsdf_pdf) * lightSample.emission * (weightMis * dot(lightSample.direction, state.normal) / lightSample.pdf);
+
+  return true;
+}
+
+// Adds the direct lighting when the shadow ray is not occluded.
+void DeviceCPU::resolveShadowRay(PerRayData* thePrd, ShadowRayCPU const& shadowRay) const
+{
+  if (traceShadow(thePrd->pos, shadowRay.direction, m_systemData.sceneEpsilon, shadowRay.tmax, thePrd))
+  {
+    thePrd->flags |= FLAG_SHADOW; // Visbility check failed.
+    return;
+  }
+  thePrd->radiance += shadowRay.radiance;
+}
+#endif // USE_NEXT_EVENT_ESTIMATION
+
+// Host version of __closesthit__radiance().
+void DeviceCPU::closestHit(PerRayData* thePrd, HitCPU const& hit) const
+{
+  State state;
+
+  if (!hitSurface(thePrd, hit, state))
+  {
+    return;
+  }
+
+  MaterialDefinition const& material = m_systemData.materialDefinitions[m_instances[hit.instance].data.idMaterial];
+
+  // Sample a new path direction.
+  sampleBSDF(material, state, thePrd);
+
+#if USE_NEXT_EVENT_ESTIMATION
+  ShadowRayCPU shadowRay;
+
+  if (sampleDirectLighting(thePrd, material, state, getEvalBSDF(material.indexBSDF), shadowRay))
+  {
+    resolveShadowRay(thePrd, shadowRay);
+  }
+#endif // USE_NEXT_EVENT_ESTIMATION
+}
+
+// The path state initialization at the start of integrator() in raygeneration.cu.
+template<typename Path>
+void DeviceCPU::beginPath(Path& path, PerRayData& prd) const
+{
+  path.stackIdx   = MATERIAL_STACK_EMPTY; // Start with empty nested materials stack.
+  path.depth      = 0;                    // Russian Roulette path termination after a specified number of bounces needs the current depth.
+  path.radiance   = make_float3(0.0f);    // Start with black.
+  path.throughput = make_float3(1.0f);    // The throughput for the next radiance, starts with 1.0f.
+
+  // Assumes that the primary ray starts in vacuum.
+  prd.absorption_ior = make_float4(0.0f, 0.0f, 0.0f, 1.0f); // No absorption, IOR == 1.0f,
+  prd.sigma_t        = make_float3(0.0f);                   // No extinction.
+  prd.flags          = 0;
+}
+
+// Prepares the PerRayData for the next path segment before the radiance ray is traced.
+template<typename Path>
+void DeviceCPU::beginSegment(Path const& path, PerRayData& prd) const
+{
+  prd.wo        = -prd.wi;            // Direction to observer.
+  prd.ior       = make_float2(1.0f);  // Reset the volume IORs.
+  prd.distance  = RT_DEFAULT_MAX;     // Shoot the next ray with maximum length.
+  prd.flags    &= FLAG_CLEAR_MASK;    // Clear all non-persistent flags. In this demo only the last diffuse surface interaction stays.
+
+  // Special case for volume handling.
+  if (MATERIAL_STACK_FIRST <= path.stackIdx) // Inside a volume?
+  {
+    prd.flags  |= FLAG_VOLUME;                                      // Indicate that we're inside a volume. => At least absorption calculation needs to happen.
+    prd.sigma_t = make_float3(path.absorptionStack[path.stackIdx]); // There is only volume absorption in this demo, no volume scattering.
+    prd.ior.x   = path.absorptionStack[path.stackIdx].w;            // The IOR of the volume we're inside. Needed for eta calculations in transparent materials.
+    if (MATERIAL_STACK_FIRST <= path.stackIdx - 1)
+    {
+      prd.ior.y = path.absorptionStack[path.stackIdx - 1].w; // The IOR of the surrounding volume.
+    }
+  }
+}
+
+// Accumulates the radiance of the finished path segment after the closest hit or miss program.
+// Returns false when the path ends.
+template<typename Path>
+bool DeviceCPU::endSegment(Path& path, PerRayData& prd) const
+{
+  // This renderer supports nested volumes.
+  if (prd.flags & FLAG_VOLUME) // We're inside a volume?
+  {
+    // The transmittance along the current path segment inside a volume needs to attenuate the ray throughput with the extinction
+    // before it modulates the radiance of the hitpoint.
+    path.throughput *= expf(-prd.distance * prd.sigma_t);
+  }
+
+  path.radiance += path.throughput * prd.radiance;
+
+  // Path termination by miss shader or sample() routines.
+  // If terminate is true, f_over_pdf and pdf might be undefined.
+  if ((prd.flags & FLAG_TERMINATE) || prd.pdf <= 0.0f || isNull(prd.f_over_pdf))
+  {
+    return false;
+  }
+
+  // PERF f_over_pdf already contains the proper throughput adjustment for diffuse materials: f * (fabsf(dot(prd.wi, state.normal)) / prd.pdf);
+  path.throughput *= prd.f_over_pdf;
+
+  // Unbiased Russian Roulette path termination.
+  if (m_systemData.pathLengths.x <= path.depth) // Start termination after a minimum number of bounces.
+  {
+    const float probability = fmaxf(path.throughput);
+    if (probability < rng(prd.seed)) // Paths with lower probability to continue are terminated earlier.
+    {
+      return false;
+    }
+    path.throughput /= probability; // Path isn't terminated. Adjust the throughput so that the average is right again.
+  }
+
+  // Adjust the material volume stack if the geometry is not thin-walled but a border between two volumes and
+  // the outgoing ray direction was a transmission.
+  if ((prd.flags & (FLAG_THINWALLED | FLAG_TRANSMISSION)) == FLAG_TRANSMISSION)
+  {
+    // Transmission.
+    if (prd.flags & FLAG_FRONTFACE) // Entered a new volume?
+    {
+      // Push the entered material's volume properties onto the volume stack.
+      path.stackIdx = min(path.stackIdx + 1, MATERIAL_STACK_LAST);
+
+      path.absorptionStack[path.stackIdx] = prd.absorption_ior;
+    }
+    else // Exited the current volume?
+    {
+      // Pop the top of stack material volume.
+      path.stackIdx = max(path.stackIdx - 1, MATERIAL_STACK_EMPTY);
+    }
+  }
+
+  ++path.depth; // Next path segment.
+
+  return path.depth < m_systemData.pathLengths.y;
+}
+
+// Host version of integrator() in raygeneration.cu.
+float3 DeviceCPU::integrator(PerRayData& prd, HitCPU const* primaryHit) const
+{
+  PathCPU path;
+
+  beginPath(path, prd);
+
+  if (m_systemData.pathLengths.y <= 0)
+  {
+    return path.radiance;
+  }
+
+  do
+  {
+    beginSegment(path, prd);
+
+    HitCPU hit;
+
+    bool isHit;
+
+    if (path.depth == 0 && primaryHit != nullptr)
+    {
+      hit   = *primaryHit; // Traced with the primary ray packet.
+      isHit = (0 <= hit.instance);
+    }
+    else
+    {
+      isHit = traceRadiance(prd.pos, prd.wi, m_systemData.sceneEpsilon, prd.distance, &prd, hit);
+    }
+
+    if (isHit)
+    {
+      closestHit(&prd, hit);
+    }
+    else
+    {
+      miss(&prd);
+    }
+  }
+  while (endSegment(path, prd));
+
+  return path.radiance;
+}
+
+// Host version of __raygen__path_tracer() for the launch index (x, y).
+void DeviceCPU::raygeneration(const unsigned int x, const unsigned int y)
+{
+  PerRayData prd;
+
+  // Initialize the random number generator seed from the linear pixel index and the iteration index.
+  // Same seed as the single GPU strategy to get matching images.
+  const unsigned int seedIndex = m_systemData.resolution.x * y + x * m_systemData.deviceCount + m_systemData.deviceIndex;
+  prd.seed = tea<4>(seedIndex, m_systemData.iterationIndex);
+
+  const float2 screen = make_float2(m_systemData.resolution);
+  const float2 pixel  = make_float2(float(x), float(y));
+  const float2 sample = rng2(prd.seed); // Random per pixel jitter.
+
+  lensShader(screen, pixel, sample, prd.pos, prd.wi);
+
+  float3 radiance = integrator(prd);
+
+  accumulate(x, y, radiance);
+}
+
+// Same as raygeneration() for all pixels of a block of at most PACKET_BLOCK_SIZE x PACKET_BLOCK_SIZE pixels.
+// The coherent primary rays are traced as one packet, the remaining path segments individually.
+void DeviceCPU::raygenerationPacket(const unsigned int xBegin, const unsigned int yBegin, const unsigned int xEnd, const unsigned int yEnd)
+{
+  const unsigned int width = xEnd - xBegin;
+
+  PerRayData   prds[BVH_PACKET_SIZE];
+  float2       pixels[BVH_PACKET_SIZE];
+  float2       samples[BVH_PACKET_SIZE];
+  HitCPU       hits[BVH_PACKET_SIZE];
+  BVHRayPacket packet;
+
+  packet.count = width * (yEnd - yBegin);
+  packet.tmin  = m_systemData.sceneEpsilon;
+
+  MY_ASSERT(packet.count <= BVH_PACKET_SIZE);
+
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    const unsigned int x = xBegin + r % width;
+    const unsigned int y = yBegin + r / width;
+
+    // Same seed and jitter as raygeneration().
+    const unsigned int seedIndex = m_systemData.resolution.x * y + x * m_systemData.deviceCount + m_systemData.deviceIndex;
+    prds[r].seed = tea<4>(seedIndex, m_systemData.iterationIndex);
+
+    pixels[r]  = make_float2(float(x), float(y));
+    samples[r] = rng2(prds[r].seed);
+
+    packet.tmax[r] = RT_DEFAULT_MAX; // Same as the prd.distance of the first path segment.
+  }
+
+  lensShaderPacket(make_float2(m_systemData.resolution), pixels, samples, packet);
+
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    prds[r].pos = packet.origin[r];
+    prds[r].wi  = packet.direction[r];
+  }
+
+  packet.prepare();
+
+  traceRadiancePacket(packet, prds, hits);
+
+  for (unsigned int r = 0; r < packet.count; ++r)
+  {
+    const float3 radiance = integrator(prds[r], &hits[r]);
+
+    accumulate(xBegin + r % width, yBegin + r / width, radiance);
+  }
+}
+
+void DeviceCPU::accumulate(const unsigned int x, const unsigned int y, float3 radiance)
+{
+  // NaN values will never go away. Filter them out before they can arrive in the output buffer.
+  if (!(std::isnan(radiance.x) || std::isnan(radiance.y) || std::isnan(radiance.z)))
+  {
+    float4* buffer = m_bufferHost.data();
+
+    const unsigned int index = y * m_systemData.resolution.x + x;
+
+    // USE_TIME_VIEW is not supported on the host. Alpha stays 1.0f.
+    if (0 < m_systemData.iterationIndex)
+    {
+      const float4 dst = buffer[index]; // RGBA32F
+      radiance = lerp(make_float3(dst), radiance, 1.0f / float(m_systemData.iterationIndex + 1)); // Only accumulate the radiance, alpha stays 1.0f.
+    }
+    // iterationIndex 0 will fill the buffer.
+    buffer[index] = make_float4(radiance, 1.0f);
+  }
+}
+
+
+// ========== Wavefront path tracer
+
+// Instead of running each path from start to end inside the integrator(), a wavefront processes all its paths in flight stage by stage:
+// extend (radiance rays), shade (miss and per BSDF queues), shadow rays and continue (throughput, Russian Roulette, accumulation).
+// Every BSDF kernel runs over its own batch of paths without branching on the material.
+// Each thread runs whole wavefronts on its own WavefrontCPU, so the stages need no barriers and the queues are built without synchronization.
+void DeviceCPU::renderWavefront()
+{
+  const unsigned int blocksX = (m_systemData.resolution.x + PACKET_BLOCK_SIZE - 1) / PACKET_BLOCK_SIZE;
+  const unsigned int blocksY = (m_systemData.resolution.y + PACKET_BLOCK_SIZE - 1) / PACKET_BLOCK_SIZE;
+
+  const unsigned int numBlocks  = blocksX * blocksY;
+  const unsigned int numThreads = m_threadPool->getNumThreads();
+
+  // Smaller wavefronts when the image does not give every thread a full one.
+  const unsigned int blocksPerWavefront = std::max(1u, std::min(static_cast<unsigned int>(WAVEFRONT_BLOCKS), (numBlocks + numThreads - 1) / numThreads));
+  const unsigned int numWavefronts      = (numBlocks + blocksPerWavefront - 1) / blocksPerWavefront;
+
+  const size_t size = size_t(blocksPerWavefront) * BVH_PACKET_SIZE;
+
+  m_wavefronts.resize(numThreads);
+
+  for (WavefrontCPU& wavefront : m_wavefronts)
+  {
+    if (wavefront.prd.size() < size)
+    {
+      wavefront.resize(size);
+    }
+  }
+
+  // The wavefronts are handed out dynamically to the threads, which balances the different costs per wavefront.
+  m_threadPool->parallelFor(numWavefronts, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    WavefrontCPU& wavefront = m_wavefronts[threadIndex];
+
+    const unsigned int firstBlock = index * blocksPerWavefront;
+
+    generateWavefront(wavefront, firstBlock, std::min(numBlocks - firstBlock, blocksPerWavefront));
+
+    while (!wavefront.active.empty())
+    {
+      extendWavefront(wavefront);
+      shadeWavefront(wavefront);
+      continueWavefront(wavefront);
+    }
+  });
+}
+
+// Same as raygenerationPacket() without the integrator(). Starts the paths of numBlocks pixel blocks.
+void DeviceCPU::generateWavefront(WavefrontCPU& wavefront, const unsigned int firstBlock, const unsigned int numBlocks)
+{
+  const unsigned int width   = static_cast<unsigned int>(m_systemData.resolution.x);
+  const unsigned int height  = static_cast<unsigned int>(m_systemData.resolution.y);
+  const unsigned int blocksX = (width + PACKET_BLOCK_SIZE - 1) / PACKET_BLOCK_SIZE;
+
+  wavefront.active.clear();
+
+  for (unsigned int index = 0; index < numBlocks; ++index)
+  {
+    const unsigned int block = firstBlock + index;
+
+    const unsigned int xBegin = (block % blocksX) * PACKET_BLOCK_SIZE;
+    const unsigned int yBegin = (block / blocksX) * PACKET_BLOCK_SIZE;
+    const unsigned int xEnd   = std::min(xBegin + PACKET_BLOCK_SIZE, width);
+    const unsigned int yEnd   = std::min(yBegin + PACKET_BLOCK_SIZE, height);
+
+    const unsigned int blockWidth = xEnd - xBegin;
+    const unsigned int first      = index * BVH_PACKET_SIZE;
+
+    PerRayData* prds = &wavefront.prd[first];
+
+    float2       pixels[BVH_PACKET_SIZE];
+    float2       samples[BVH_PACKET_SIZE];
+    BVHRayPacket packet;
+
+    packet.count = blockWidth * (yEnd - yBegin);
+    packet.tmin  = m_systemData.sceneEpsilon;
+
+    for (unsigned int r = 0; r < packet.count; ++r)
+    {
+      const unsigned int x = xBegin + r % blockWidth;
+      const unsigned int y = yBegin + r / blockWidth;
+
+      // Same seed and jitter as raygeneration().
+      const unsigned int seedIndex = m_systemData.resolution.x * y + x * m_systemData.deviceCount + m_systemData.deviceIndex;
+      prds[r].seed = tea<4>(seedIndex, m_systemData.iterationIndex);
+
+      pixels[r]  = make_float2(float(x), float(y));
+      samples[r] = rng2(prds[r].seed);
+
+      packet.tmax[r] = RT_DEFAULT_MAX;
+
+      wavefront.pixel[first + r] = make_uint2(x, y);
+    }
+
+    lensShaderPacket(make_float2(m_systemData.resolution), pixels, samples, packet);
+
+    for (unsigned int r = 0; r < packet.count; ++r)
+    {
+      prds[r].pos = packet.origin[r];
+      prds[r].wi  = packet.direction[r];
+
+      PathRefCPU path = wavefront.getPath(first + r);
+
+      beginPath(path, prds[r]);
+    }
+
+#if USE_PRIMARY_RAY_PACKETS
+    packet.prepare();
+
+    traceRadiancePacket(packet, prds, &wavefront.hit[first]);
+#endif
+
+    for (unsigned int r = 0; r < packet.count; ++r)
+    {
+      if (m_systemData.pathLengths.y <= 0) // No path segments, same result as the integrator().
+      {
+        accumulate(xBegin + r % blockWidth, yBegin + r / blockWidth, make_float3(0.0f));
+        continue;
+      }
+      wavefront.active.push_back(first + r);
+    }
+  }
+}
+
+// Traces the radiance rays of the next path segment of all active paths.
+void DeviceCPU::extendWavefront(WavefrontCPU& wavefront) const
+{
+  for (const unsigned int i : wavefront.active)
+  {
+    PerRayData& prd  = wavefront.prd[i];
+    PathRefCPU  path = wavefront.getPath(i);
+
+    beginSegment(path, prd);
+
+    wavefront.hasShadowRay[i] = 0;
+
+#if USE_PRIMARY_RAY_PACKETS
+    if (path.depth == 0) // Already traced with the primary ray packets.
+    {
+      continue;
+    }
+#endif
+    traceRadiance(prd.pos, prd.wi, m_systemData.sceneEpsilon, prd.distance, &prd, wavefront.hit[i]);
+  }
+}
+
+// Sorts the paths into the miss and per BSDF queues and runs each queue as its own batch.
+// The direct lighting only generates the shadow rays, which are traced together afterwards.
+void DeviceCPU::shadeWavefront(WavefrontCPU& wavefront) const
+{
+  wavefront.queueMiss.clear();
+  for (int k = 0; k <= NUM_BSDF_INDICES; ++k)
+  {
+    wavefront.queueShade[k].clear();
+  }
+
+  for (const unsigned int i : wavefront.active)
+  {
+    HitCPU const& hit = wavefront.hit[i];
+
+    if (hit.instance < 0)
+    {
+      wavefront.queueMiss.push_back(i);
+      continue;
+    }
+
+    const int indexBSDF = m_systemData.materialDefinitions[m_instances[hit.instance].data.idMaterial].indexBSDF;
+
+    wavefront.queueShade[(0 <= indexBSDF && indexBSDF < NUM_BSDF_INDICES) ? indexBSDF : NUM_BSDF_INDICES].push_back(i);
+  }
+
+  for (const unsigned int i : wavefront.queueMiss)
+  {
+    miss(&wavefront.prd[i]);
+  }
+
+  for (int k = 0; k <= NUM_BSDF_INDICES; ++k)
+  {
+    // Same as closestHit() with the BSDF functions fixed per queue.
+    const SampleBSDFFunc sample = getSampleBSDF(k);
+    const EvalBSDFFunc   eval   = getEvalBSDF(k);
+
+    for (const unsigned int i : wavefront.queueShade[k])
+    {
+      PerRayData& prd = wavefront.prd[i];
+
+      State state;
+
+      if (!hitSurface(&prd, wavefront.hit[i], state))
+      {
+        continue;
+      }
+
+      if (sample == nullptr)
+      {
+        prd.flags |= FLAG_TERMINATE;
+        continue;
+      }
+
+      MaterialDefinition const& material = m_systemData.materialDefinitions[m_instances[wavefront.hit[i].instance].data.idMaterial];
+
+      sample(material, state, &prd);
+
+#if USE_NEXT_EVENT_ESTIMATION
+      wavefront.hasShadowRay[i] = sampleDirectLighting(&prd, material, state, eval, wavefront.shadowRay[i]) ? 1 : 0;
+#endif
+    }
+  }
+
+#if USE_NEXT_EVENT_ESTIMATION
+  wavefront.queueShadow.clear();
+
+  for (const unsigned int i : wavefront.active)
+  {
+    if (wavefront.hasShadowRay[i])
+    {
+      wavefront.queueShadow.push_back(i);
+    }
+  }
+
+  for (const unsigned int i : wavefront.queueShadow)
+  {
+    resolveShadowRay(&wavefront.prd[i], wavefront.shadowRay[i]);
+  }
+#endif
+}
+
+// Accumulates the path segment results. Finished paths write their pixel and leave the active list.
+void DeviceCPU::continueWavefront(WavefrontCPU& wavefront)
+{
+  // Stable compaction keeps the neighbouring pixels together.
+  size_t count = 0;
+
+  for (const unsigned int i : wavefront.active)
+  {
+    PathRefCPU path = wavefront.getPath(i);
+
+    if (endSegment(path, wavefront.prd[i]))
+    {
+      wavefront.active[count++] = i;
+    }
+    else
+    {
+      accumulate(wavefront.pixel[i].x, wavefront.pixel[i].y, path.radiance);
+    }
+  }
+  wavefront.active.resize(count);
+}
+
+
+void DeviceCPU::render(const unsigned int iterationIndex)
+{
+  m_systemData.iterationIndex = iterationIndex;
+
+  if (m_isDirtyOutputBuffer)
+  {
+    m_bufferHost.resize(m_systemData.resolution.x * m_systemData.resolution.y);
+    m_isDirtyOutputBuffer = false;
+  }
+
+#if USE_WAVEFRONT
+  renderWavefront();
+#else
+  const unsigned int width  = static_cast<unsigned int>(m_systemData.resolution.x);
+  const unsigned int height = static_cast<unsigned int>(m_systemData.resolution.y);
+
+  const int2 tileSize  = m_systemData.tileSize;
+  const int2 tileShift = m_systemData.tileShift;
+
+  const unsigned int tilesX = (width  + tileSize.x - 1) >> tileShift.x;
+  const unsigned int tilesY = (height + tileSize.y - 1) >> tileShift.y;
+
+  // The tiles are handed out dynamically to the threads, which balances the different costs per tile.
+  m_threadPool->parallelFor(tilesX * tilesY, [&](const unsigned int tile, const unsigned int threadIndex)
+  {
+    const unsigned int xBegin = (tile % tilesX) << tileShift.x;
+    const unsigned int yBegin = (tile / tilesX) << tileShift.y;
+
+    const unsigned int xEnd = std::min(xBegin + tileSize.x, width);
+    const unsigned int yEnd = std::min(yBegin + tileSize.y, height);
+
+#if USE_PRIMARY_RAY_PACKETS
+    for (unsigned int y = yBegin; y < yEnd; y += PACKET_BLOCK_SIZE)
+    {
+      for (unsigned int x = xBegin; x < xEnd; x += PACKET_BLOCK_SIZE)
+      {
+        raygenerationPacket(x, y, std::min(x + PACKET_BLOCK_SIZE, xEnd), std::min(y + PACKET_BLOCK_SIZE, yEnd));
+      }
+    }
+#else
+    for (unsigned int y = yBegin; y < yEnd; ++y)
+    {
+      for (unsigned int x = xBegin; x < xEnd; ++x)
+      {
+        raygeneration(x, y);
+      }
+    }
+#endif
+  });
+#endif // USE_WAVEFRONT
+}
+
+void DeviceCPU::updateDisplayTexture()
+{
+  MY_ASSERT(!m_isDirtyOutputBuffer && m_tex != 0);
+
+  // There is no interop on the host. Update the HDR texture image from the accumulation buffer directly.
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (GLsizei) m_systemData.resolution.x, (GLsizei) m_systemData.resolution.y, 0, GL_RGBA, GL_FLOAT, m_bufferHost.data()); // RGBA32F from host buffer data.
+}
+
+const void* DeviceCPU::getOutputBufferHost()
+{
+  MY_ASSERT(!m_isDirtyOutputBuffer);
+
+  return m_bufferHost.data();
+}
+
+template <typename T>
+static size_t getVectorSize(std::vector<T> const& v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+DeviceMemoryStatistics DeviceCPU::getMemoryStatistics() const
+{
+  DeviceMemoryStatistics statistics;
+
+  statistics.name = "CPU (" + std::to_string(getNumThreads()) + " threads)";
+
+  // GEOMETRY_FORMAT_FULL attributes and all indices are referenced from the sg::Triangles and counted on the host side.
+  for (GeometryCPU const& geometryData : m_geometryData)
+  {
+    statistics.attributes += getVectorSize(geometryData.encoded);
+    statistics.blas       += geometryData.bvh.getMemorySize();
+  }
+  statistics.tlas      = m_tlas.getMemorySize();
+  statistics.instances = getVectorSize(m_instances);
+
+  const TextureCPU* textures[3] = { m_textureAlbedo, m_textureCutout, m_textureEnv };
+
+  for (const TextureCPU* texture : textures)
+  {
+    if (texture)
+    {
+      statistics.textures += texture->getSizeInBytes();
+      statistics.cdf      += texture->getCDFSizeInBytes();
+    }
+  }
+
+  statistics.outputBuffers = getVectorSize(m_bufferHost);
+  for (WavefrontCPU const& wavefront : m_wavefronts)
+  {
+    statistics.outputBuffers += getVectorSize(wavefront.prd) + getVectorSize(wavefront.absorptionStack) + getVectorSize(wavefront.stackIdx) +
+                                getVectorSize(wavefront.depth) + getVectorSize(wavefront.radiance) + getVectorSize(wavefront.throughput) +
+                                getVectorSize(wavefront.hit) + getVectorSize(wavefront.shadowRay) + getVectorSize(wavefront.hasShadowRay) +
+                                getVectorSize(wavefront.pixel) + getVectorSize(wavefront.active) + getVectorSize(wavefront.queueMiss) +
+                                getVectorSize(wavefront.queueShadow);
+    for (std::vector<unsigned int> const& queue : wavefront.queueShade)
+    {
+      statistics.outputBuffers += getVectorSize(queue);
+    }
+  }
+
+  return statistics;
+}
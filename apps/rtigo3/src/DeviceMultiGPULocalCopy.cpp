@@ -275,6 +275,18 @@ const void* DeviceMultiGPULocalCopy::getOutputBufferHost()
   return m_bufferHost.data();
 }
 
+// Every device accumulates into its texelBuffer. The first device also holds the full resolution outputBuffer and the compositor's tileBuffer.
+size_t DeviceMultiGPULocalCopy::getOutputBufferSize() const
+{
+  const size_t sizeTexels = sizeof(float4) * m_launchWidth * m_systemData.resolution.y;
+
+  if (m_index != 0)
+  {
+    return sizeTexels;
+  }
+  return sizeof(float4) * m_systemData.resolution.x * m_systemData.resolution.y + sizeTexels * 2 + sizeof(CompositorData);
+}
+
 
 void DeviceMultiGPULocalCopy::compositor(Device* other)
 {
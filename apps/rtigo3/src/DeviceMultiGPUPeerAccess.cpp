@@ -263,3 +263,9 @@ const void* DeviceMultiGPUPeerAccess::getOutputBufferHost()
 
   return m_bufferHost.data();
 }
+
+// Only the first device holds the shared peer-to-peer outputBuffer.
+size_t DeviceMultiGPUPeerAccess::getOutputBufferSize() const
+{
+  return (m_index == 0) ? sizeof(float4) * m_systemData.resolution.x * m_systemData.resolution.y : 0;
+}
@@ -166,3 +166,9 @@ const void* DeviceMultiGPUZeroCopy::getOutputBufferHost()
 
   return reinterpret_cast<void*>(m_systemData.outputBuffer); // This buffer is in pinned memory on the host. Just return it.
 }
+
+// The shared outputBuffer is pinned host memory allocated by the first device.
+size_t DeviceMultiGPUZeroCopy::getOutputBufferSize() const
+{
+  return (m_index == 0) ? sizeof(float4) * m_systemData.resolution.x * m_systemData.resolution.y : 0;
+}
@@ -268,3 +268,9 @@ const void* DeviceSingleGPU::getOutputBufferHost()
 
   return m_bufferHost.data();
 }
+
+// The m_bufferHost copy for the screenshots is on the host and not counted.
+size_t DeviceSingleGPU::getOutputBufferSize() const
+{
+  return sizeof(float4) * m_systemData.resolution.x * m_systemData.resolution.y;
+}
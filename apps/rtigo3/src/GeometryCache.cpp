@@ -0,0 +1,398 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/GeometryCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+  #include <Windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+// "RTIGOGEO" in little endian.
+#define GEOMETRY_CACHE_MAGIC 0x4F45474F47495452ull
+// FNV-1a 64-bit prime.
+#define GEOMETRY_CACHE_HASH_PRIME 0x00000100000001B3ull
+
+
+CacheFile::CacheFile()
+#if defined(_WIN32)
+: m_file(INVALID_HANDLE_VALUE)
+, m_mapping(nullptr)
+#else
+: m_file(-1)
+#endif
+, m_data(nullptr)
+, m_size(0)
+, m_numBlobs(0)
+, m_blobs(nullptr)
+{
+}
+
+CacheFile::~CacheFile()
+{
+  close();
+}
+
+bool CacheFile::open(std::string const& filename, const unsigned long long key)
+{
+  close();
+
+#if defined(_WIN32)
+  m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+  {
+    close();
+    return false;
+  }
+  m_size = static_cast<size_t>(size.QuadPart);
+
+  m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr)
+  {
+    close();
+    return false;
+  }
+
+  m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr)
+  {
+    close();
+    return false;
+  }
+#else
+  m_file = ::open(filename.c_str(), O_RDONLY);
+  if (m_file < 0)
+  {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(m_file, &info) != 0 || info.st_size == 0)
+  {
+    close();
+    return false;
+  }
+  m_size = static_cast<size_t>(info.st_size);
+
+  void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+  if (data == MAP_FAILED)
+  {
+    close();
+    return false;
+  }
+  m_data = static_cast<const unsigned char*>(data);
+#endif
+
+  // Validate the header and the blob table before any blob is handed out.
+  if (m_size < sizeof(CacheFileHeader))
+  {
+    close();
+    return false;
+  }
+
+  const CacheFileHeader* header = reinterpret_cast<const CacheFileHeader*>(m_data);
+
+  if (header->magic != GEOMETRY_CACHE_MAGIC || header->version != GEOMETRY_CACHE_VERSION || header->key != key ||
+      m_size < sizeof(CacheFileHeader) + size_t(header->numBlobs) * sizeof(CacheFileBlob))
+  {
+    close();
+    return false;
+  }
+
+  m_numBlobs = header->numBlobs;
+  m_blobs    = reinterpret_cast<const CacheFileBlob*>(m_data + sizeof(CacheFileHeader));
+
+  for (unsigned int i = 0; i < m_numBlobs; ++i)
+  {
+    if (m_size < m_blobs[i].offset || m_size - m_blobs[i].offset < m_blobs[i].size)
+    {
+      std::cerr << "ERROR: CacheFile::open() truncated " << filename << std::endl;
+      close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void CacheFile::close()
+{
+#if defined(_WIN32)
+  if (m_data != nullptr)
+  {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping != nullptr)
+  {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m_file);
+  }
+  m_file    = INVALID_HANDLE_VALUE;
+  m_mapping = nullptr;
+#else
+  if (m_data != nullptr)
+  {
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+  }
+  if (0 <= m_file)
+  {
+    ::close(m_file);
+  }
+  m_file = -1;
+#endif
+
+  m_data     = nullptr;
+  m_size     = 0;
+  m_numBlobs = 0;
+  m_blobs    = nullptr;
+}
+
+unsigned int CacheFile::getNumBlobs() const
+{
+  return m_numBlobs;
+}
+
+const void* CacheFile::getBlob(const unsigned int index, size_t& size) const
+{
+  if (m_numBlobs <= index)
+  {
+    size = 0;
+    return nullptr;
+  }
+
+  size = static_cast<size_t>(m_blobs[index].size);
+  return m_data + m_blobs[index].offset;
+}
+
+
+GeometryCache::GeometryCache()
+{
+}
+
+GeometryCache::~GeometryCache()
+{
+}
+
+void GeometryCache::setPath(std::string const& path)
+{
+  m_path = path;
+
+  // Strip trailing separators, getFilename() adds one.
+  while (!m_path.empty() && (m_path.back() == '/' || m_path.back() == '\\'))
+  {
+    m_path.pop_back();
+  }
+}
+
+std::string const& GeometryCache::getPath() const
+{
+  return m_path;
+}
+
+bool GeometryCache::isEnabled() const
+{
+  return !m_path.empty();
+}
+
+std::string GeometryCache::getFilename(const unsigned long long key) const
+{
+  std::ostringstream filename;
+
+  filename << m_path << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+
+  return filename.str();
+}
+
+std::shared_ptr<CacheFile> GeometryCache::load(const unsigned long long key) const
+{
+  if (!isEnabled())
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<CacheFile> file = std::make_shared<CacheFile>();
+
+  if (!file->open(getFilename(key), key))
+  {
+    return nullptr;
+  }
+
+  return file;
+}
+
+bool GeometryCache::store(const unsigned long long key, std::vector<CacheBlob> const& blobs) const
+{
+  if (!isEnabled())
+  {
+    return false;
+  }
+
+  CacheFileHeader header;
+
+  header.magic    = GEOMETRY_CACHE_MAGIC;
+  header.key      = key;
+  header.version  = GEOMETRY_CACHE_VERSION;
+  header.numBlobs = static_cast<unsigned int>(blobs.size());
+
+  std::vector<CacheFileBlob> table(blobs.size());
+
+  unsigned long long offset = sizeof(CacheFileHeader) + blobs.size() * sizeof(CacheFileBlob);
+
+  for (size_t i = 0; i < blobs.size(); ++i)
+  {
+    offset = (offset + GEOMETRY_CACHE_ALIGNMENT - 1) & ~static_cast<unsigned long long>(GEOMETRY_CACHE_ALIGNMENT - 1);
+
+    table[i].offset = offset;
+    table[i].size   = blobs[i].size;
+
+    offset += blobs[i].size;
+  }
+
+  const std::string filename = getFilename(key);
+
+  // One temporary file per thread. Concurrently imported models with the same contents store the same key.
+  std::ostringstream temp;
+  temp << filename << "." << std::this_thread::get_id() << ".tmp";
+
+  const std::string filenameTemp = temp.str();
+
+  std::ofstream fout(filenameTemp, std::ios::binary | std::ios::trunc);
+  if (fout.fail())
+  {
+    std::cerr << "ERROR: GeometryCache::store() could not create " << filenameTemp << std::endl;
+    return false;
+  }
+
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(CacheFileHeader));
+  fout.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(CacheFileBlob));
+
+  static const char padding[GEOMETRY_CACHE_ALIGNMENT] = {};
+
+  unsigned long long position = sizeof(CacheFileHeader) + blobs.size() * sizeof(CacheFileBlob);
+
+  for (size_t i = 0; i < blobs.size(); ++i)
+  {
+    fout.write(padding, static_cast<std::streamsize>(table[i].offset - position));
+    fout.write(static_cast<const char*>(blobs[i].data), static_cast<std::streamsize>(blobs[i].size));
+
+    position = table[i].offset + table[i].size;
+  }
+
+  fout.close();
+
+  if (fout.fail())
+  {
+    std::cerr << "ERROR: GeometryCache::store() could not write " << filenameTemp << std::endl;
+    std::remove(filenameTemp.c_str());
+    return false;
+  }
+
+  std::remove(filename.c_str()); // std::rename() doesn't replace existing files on Windows.
+
+  if (std::rename(filenameTemp.c_str(), filename.c_str()) != 0)
+  {
+    std::cerr << "ERROR: GeometryCache::store() could not rename " << filenameTemp << std::endl;
+    std::remove(filenameTemp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+unsigned long long GeometryCache::hash(const void* data, const size_t size, const unsigned long long seed)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+  unsigned long long h = seed;
+
+  size_t i = 0;
+
+  for (; i + 8 <= size; i += 8)
+  {
+    unsigned long long word;
+    memcpy(&word, bytes + i, 8);
+
+    h = (h ^ word) * GEOMETRY_CACHE_HASH_PRIME;
+    h ^= h >> 32; // The multiplication only carries upwards, fold the high bits back.
+  }
+
+  for (; i < size; ++i)
+  {
+    h = (h ^ bytes[i]) * GEOMETRY_CACHE_HASH_PRIME;
+  }
+
+  return h;
+}
+
+bool GeometryCache::hashFile(std::string const& filename, unsigned long long& key)
+{
+  std::ifstream fin(filename, std::ios::binary);
+  if (fin.fail())
+  {
+    return false;
+  }
+
+  std::vector<char> buffer(1 << 20);
+
+  unsigned long long size = 0;
+
+  while (fin)
+  {
+    fin.read(buffer.data(), buffer.size());
+
+    const size_t count = static_cast<size_t>(fin.gcount());
+
+    key   = hash(buffer.data(), count, key);
+    size += count;
+  }
+
+  key = hashValue(size, key);
+
+  return true;
+}
@@ -0,0 +1,370 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/InstanceTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "inc/MyAssert.h"
+
+
+// m = a * b;
+static void multiplyMatrix(float* m, const float* a, const float* b)
+{
+  m[ 0] = a[0] * b[0] + a[1] * b[4] + a[ 2] * b[ 8]; // + a[3] * 0
+  m[ 1] = a[0] * b[1] + a[1] * b[5] + a[ 2] * b[ 9]; // + a[3] * 0
+  m[ 2] = a[0] * b[2] + a[1] * b[6] + a[ 2] * b[10]; // + a[3] * 0
+  m[ 3] = a[0] * b[3] + a[1] * b[7] + a[ 2] * b[11] + a[3]; // * 1
+
+  m[ 4] = a[4] * b[0] + a[5] * b[4] + a[ 6] * b[ 8]; // + a[7] * 0
+  m[ 5] = a[4] * b[1] + a[5] * b[5] + a[ 6] * b[ 9]; // + a[7] * 0
+  m[ 6] = a[4] * b[2] + a[5] * b[6] + a[ 6] * b[10]; // + a[7] * 0
+  m[ 7] = a[4] * b[3] + a[5] * b[7] + a[ 6] * b[11] + a[7]; // * 1
+
+  m[ 8] = a[8] * b[0] + a[9] * b[4] + a[10] * b[ 8]; // + a[11] * 0
+  m[ 9] = a[8] * b[1] + a[9] * b[5] + a[10] * b[ 9]; // + a[11] * 0
+  m[10] = a[8] * b[2] + a[9] * b[6] + a[10] * b[10]; // + a[11] * 0
+  m[11] = a[8] * b[3] + a[9] * b[7] + a[10] * b[11] + a[11]; // * 1
+}
+
+
+InstanceTable::InstanceTable()
+: m_scene(nullptr)
+{
+}
+
+InstanceTable::~InstanceTable()
+{
+}
+
+void InstanceTable::build(sg::Scene& scene, const sg::NodeHandle root)
+{
+  m_scene = &scene;
+
+  m_nodes.clear();
+  m_nodeParents.clear();
+  m_nodeEnds.clear();
+  m_nodeInstances.clear();
+
+  m_parents.clear();
+  m_arrays.clear();
+  m_elements.clear();
+  m_geometries.clear();
+  m_triangles.clear();
+  m_primitives.clear();
+
+  m_changed.clear();
+
+  traverse(root, ~0u);
+
+  const unsigned int numNodes     = static_cast<unsigned int>(m_nodes.size());
+  const unsigned int numInstances = getNumInstances();
+
+  m_nodeMatrices.resize(numNodes * 12);
+  m_nodeMaterials.resize(numNodes);
+  m_nodeLights.resize(numNodes);
+
+  m_matrices.resize(numInstances * 12);
+  m_materials.resize(numInstances);
+  m_lights.resize(numInstances);
+
+  // The top level nodes partition all nodes, each call updates one subtree.
+  unsigned int first = 0;
+  while (first < numNodes)
+  {
+    updateNodes(first, m_nodeEnds[first]);
+    first = m_nodeEnds[first];
+  }
+
+  // Counting sort of the nodes by their Instance handle index.
+  m_instanceNodeFirst.assign(m_scene->getNumInstances() + 1, 0);
+
+  for (const sg::NodeHandle node : m_nodes)
+  {
+    ++m_instanceNodeFirst[sg::getHandleIndex(node) + 1];
+  }
+  for (size_t k = 1; k < m_instanceNodeFirst.size(); ++k)
+  {
+    m_instanceNodeFirst[k] += m_instanceNodeFirst[k - 1];
+  }
+
+  m_instanceNodes.resize(numNodes);
+
+  std::vector<unsigned int> next(m_instanceNodeFirst.begin(), m_instanceNodeFirst.end() - 1);
+
+  for (unsigned int i = 0; i < numNodes; ++i)
+  {
+    m_instanceNodes[next[sg::getHandleIndex(m_nodes[i])]++] = i;
+  }
+
+  m_scene->clearDirty();
+
+  m_changed.clear(); // Everything is new after a build.
+}
+
+void InstanceTable::traverse(const sg::NodeHandle node, const unsigned int parent)
+{
+  switch (sg::getHandleType(node))
+  {
+    case sg::NodeType::NT_GROUP:
+    {
+      const unsigned int numChildren = m_scene->getNumChildren(node);
+      const sg::NodeHandle* children = m_scene->getChildren(node);
+
+      for (unsigned int i = 0; i < numChildren; ++i)
+      {
+        traverse(children[i], parent);
+      }
+    }
+    break;
+
+    case sg::NodeType::NT_INSTANCE:
+    {
+      const unsigned int index = static_cast<unsigned int>(m_nodes.size());
+
+      m_nodes.push_back(node);
+      m_nodeParents.push_back(parent);
+      m_nodeEnds.push_back(0);
+      m_nodeInstances.push_back(getNumInstances());
+
+      const sg::NodeHandle child = m_scene->getChild(node);
+      MY_ASSERT(child != SG_HANDLE_INVALID);
+
+      traverse(child, index);
+
+      m_nodeEnds[index] = static_cast<unsigned int>(m_nodes.size());
+    }
+    break;
+
+    case sg::NodeType::NT_TRIANGLES:
+    case sg::NodeType::NT_PRIMITIVE:
+    {
+      MY_ASSERT(parent != ~0u); // Groups only hold Instances.
+
+      m_parents.push_back(parent);
+      m_arrays.push_back(SG_HANDLE_INVALID);
+      m_elements.push_back(0);
+      m_geometries.push_back(addGeometry(node));
+    }
+    break;
+
+    case sg::NodeType::NT_INSTANCE_ARRAY:
+    {
+      MY_ASSERT(parent != ~0u);
+
+      const unsigned int idGeometry = addGeometry(m_scene->getArrayGeometry(node));
+      const unsigned int count      = m_scene->getArraySize(node);
+
+      for (unsigned int i = 0; i < count; ++i)
+      {
+        m_parents.push_back(parent);
+        m_arrays.push_back(node);
+        m_elements.push_back(i);
+        m_geometries.push_back(idGeometry);
+      }
+    }
+    break;
+  }
+}
+
+// Registers the Triangles or Primitive under its geometry ID and returns the ID.
+unsigned int InstanceTable::addGeometry(const sg::NodeHandle node)
+{
+  const unsigned int idGeometry = sg::getHandleIndex(node);
+
+  if (sg::getHandleType(node) == sg::NodeType::NT_TRIANGLES)
+  {
+    if (m_triangles.size() <= idGeometry)
+    {
+      m_triangles.resize(idGeometry + 1);
+    }
+    m_triangles[idGeometry] = m_scene->getTriangles(node);
+  }
+  else
+  {
+    MY_ASSERT(sg::getHandleType(node) == sg::NodeType::NT_PRIMITIVE);
+
+    if (m_primitives.size() <= idGeometry)
+    {
+      m_primitives.resize(idGeometry + 1);
+    }
+    m_primitives[idGeometry] = m_scene->getPrimitive(node);
+  }
+  return idGeometry;
+}
+
+// Nodes [first, last) must be one or more complete subtrees. Their parents are up to date.
+void InstanceTable::updateNodes(const unsigned int first, const unsigned int last)
+{
+  static const float identity[12] = { 1.0f, 0.0f, 0.0f, 0.0f,
+                                      0.0f, 1.0f, 0.0f, 0.0f,
+                                      0.0f, 0.0f, 1.0f, 0.0f };
+
+  for (unsigned int i = first; i < last; ++i)
+  {
+    const sg::NodeHandle node = m_nodes[i];
+
+    const unsigned int parent = m_nodeParents[i];
+
+    const float* matrix = (parent != ~0u) ? &m_nodeMatrices[parent * 12] : identity;
+
+    multiplyMatrix(&m_nodeMatrices[i * 12], matrix, m_scene->getTransform(node));
+
+    const int idMaterial = m_scene->getMaterial(node);
+    const int idLight    = m_scene->getLight(node);
+
+    m_nodeMaterials[i] = (0 <= idMaterial || parent == ~0u) ? idMaterial : m_nodeMaterials[parent];
+    m_nodeLights[i]    = (0 <= idLight    || parent == ~0u) ? idLight    : m_nodeLights[parent];
+  }
+
+  const unsigned int end = (last < m_nodes.size()) ? m_nodeInstances[last] : getNumInstances();
+
+  for (unsigned int i = m_nodeInstances[first]; i < end; ++i)
+  {
+    const unsigned int parent = m_parents[i];
+
+    if (m_arrays[i] == SG_HANDLE_INVALID)
+    {
+      memcpy(&m_matrices[i * 12], &m_nodeMatrices[parent * 12], sizeof(float) * 12);
+    }
+    else
+    {
+      multiplyMatrix(&m_matrices[i * 12], &m_nodeMatrices[parent * 12], m_scene->getArrayTransforms(m_arrays[i]) + m_elements[i] * 12);
+    }
+
+    m_materials[i] = m_nodeMaterials[parent];
+    m_lights[i]    = m_nodeLights[parent];
+
+    m_changed.push_back(i);
+  }
+}
+
+unsigned int InstanceTable::update()
+{
+  m_changed.clear();
+  m_dirtyNodes.clear();
+
+  // Only the nodes of the listed Instances are visited. The work is proportional to the number and size of the dirty subtrees.
+  std::vector<sg::NodeHandle> const& dirtyInstances = m_scene->getDirtyInstances();
+
+  unsigned int dirty = sg::DIRTY_NONE;
+
+  for (const sg::NodeHandle instance : dirtyInstances)
+  {
+    dirty |= m_scene->getDirty(instance);
+
+    const unsigned int index = sg::getHandleIndex(instance);
+
+    if (index + 1 < m_instanceNodeFirst.size()) // Instances created after the build() are not inside the table.
+    {
+      m_dirtyNodes.insert(m_dirtyNodes.end(), m_instanceNodes.begin() + m_instanceNodeFirst[index], m_instanceNodes.begin() + m_instanceNodeFirst[index + 1]);
+    }
+  }
+
+  // Depth-first order. Nested dirty nodes lie inside the subtree of an earlier one and are updated with it.
+  std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end());
+
+  unsigned int end = 0;
+
+  for (const unsigned int i : m_dirtyNodes)
+  {
+    if (end <= i)
+    {
+      updateNodes(i, m_nodeEnds[i]);
+      end = m_nodeEnds[i];
+    }
+  }
+
+  // Shared nodes are dirty on every path, so clear them only after all paths were visited.
+  m_scene->clearDirty();
+
+  return dirty;
+}
+
+unsigned int InstanceTable::getNumInstances() const
+{
+  return static_cast<unsigned int>(m_parents.size());
+}
+
+const float* InstanceTable::getMatrix(const unsigned int index) const
+{
+  return &m_matrices[index * 12];
+}
+
+unsigned int InstanceTable::getGeometry(const unsigned int index) const
+{
+  return m_geometries[index];
+}
+
+int InstanceTable::getMaterial(const unsigned int index) const
+{
+  return m_materials[index];
+}
+
+int InstanceTable::getLight(const unsigned int index) const
+{
+  return m_lights[index];
+}
+
+std::shared_ptr<sg::Triangles> InstanceTable::getTriangles(const unsigned int idGeometry) const
+{
+  return (idGeometry < m_triangles.size()) ? m_triangles[idGeometry] : nullptr;
+}
+
+std::shared_ptr<sg::Primitive> InstanceTable::getPrimitive(const unsigned int idGeometry) const
+{
+  return (idGeometry < m_primitives.size()) ? m_primitives[idGeometry] : nullptr;
+}
+
+std::vector<unsigned int> const& InstanceTable::getChanged() const
+{
+  return m_changed;
+}
+
+size_t InstanceTable::getMemorySize() const
+{
+  return m_nodes.capacity()         * sizeof(sg::NodeHandle) +
+         m_nodeParents.capacity()   * sizeof(unsigned int) +
+         m_nodeEnds.capacity()      * sizeof(unsigned int) +
+         m_nodeInstances.capacity() * sizeof(unsigned int) +
+         m_nodeMatrices.capacity()  * sizeof(float) +
+         m_nodeMaterials.capacity() * sizeof(int) +
+         m_nodeLights.capacity()    * sizeof(int) +
+         m_instanceNodeFirst.capacity() * sizeof(unsigned int) +
+         m_instanceNodes.capacity() * sizeof(unsigned int) +
+         m_parents.capacity()       * sizeof(unsigned int) +
+         m_arrays.capacity()        * sizeof(sg::NodeHandle) +
+         m_elements.capacity()      * sizeof(unsigned int) +
+         m_matrices.capacity()      * sizeof(float) +
+         m_geometries.capacity()    * sizeof(unsigned int) +
+         m_materials.capacity()     * sizeof(int) +
+         m_lights.capacity()        * sizeof(int) +
+         m_triangles.capacity()     * sizeof(std::shared_ptr<sg::Triangles>) +
+         m_primitives.capacity()    * sizeof(std::shared_ptr<sg::Primitive>);
+}
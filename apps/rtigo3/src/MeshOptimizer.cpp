@@ -0,0 +1,357 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/SceneGraph.h"
+
+#include "shaders/vector_math.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "inc/MyAssert.h"
+
+// Post-transform vertex cache size the index reordering optimizes for.
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+// Number of consecutive triangles in Morton order which are reordered for the vertex cache as one cluster.
+// Small enough that the clusters stay spatially compact, large enough for a good cache hit rate.
+#define MESH_OPTIMIZER_CLUSTER_SIZE 256
+
+namespace sg
+{
+
+  // Bitwise hash and equality of the TriangleAttributes. Only exact duplicates are welded.
+  struct AttributesHash
+  {
+    size_t operator()(const TriangleAttributes* attributes) const
+    {
+      const unsigned int* words = reinterpret_cast<const unsigned int*>(attributes);
+
+      size_t h = 2166136261u;
+      for (size_t i = 0; i < sizeof(TriangleAttributes) / sizeof(unsigned int); ++i)
+      {
+        h = (h ^ words[i]) * 16777619u;
+      }
+      return h;
+    }
+  };
+
+  struct AttributesEqual
+  {
+    bool operator()(const TriangleAttributes* a, const TriangleAttributes* b) const
+    {
+      return memcmp(a, b, sizeof(TriangleAttributes)) == 0;
+    }
+  };
+
+  struct MeshOptimizerTriangle
+  {
+    unsigned int code;  // 30-bit Morton code of the centroid.
+    unsigned int index; // Original triangle index.
+  };
+
+  // Inserts two zero bits above each of the lower 10 bits.
+  static inline unsigned int expandBits10(unsigned int v)
+  {
+    v &= 0x3FFu;
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v <<  8)) & 0x0300F00Fu;
+    v = (v | (v <<  4)) & 0x030C30C3u;
+    v = (v | (v <<  2)) & 0x09249249u;
+    return v;
+  }
+
+  // Tipsify (Sander, Nehab, Barczak 2007) over one cluster of triangles.
+  // Emits the triangles fanning around a current vertex and picks the next fanning vertex among the ones likely still in the cache.
+  // The triangles are given and returned as local vertex indices [0, numVertices).
+  static void reorderCluster(const unsigned int* indices, const unsigned int numTriangles, const unsigned int numVertices, unsigned int* result)
+  {
+    // Vertex to triangle adjacency in compressed row form.
+    std::vector<unsigned int> offsets(numVertices + 1, 0);
+    std::vector<unsigned int> live(numVertices, 0); // Number of not yet emitted triangles per vertex.
+
+    for (unsigned int i = 0; i < numTriangles * 3; ++i)
+    {
+      ++live[indices[i]];
+    }
+    for (unsigned int v = 0; v < numVertices; ++v)
+    {
+      offsets[v + 1] = offsets[v] + live[v];
+    }
+
+    std::vector<unsigned int> adjacency(numTriangles * 3);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+
+    for (unsigned int t = 0; t < numTriangles; ++t)
+    {
+      for (unsigned int k = 0; k < 3; ++k)
+      {
+        const unsigned int v = indices[t * 3 + k];
+        adjacency[fill[v]++] = t;
+      }
+    }
+
+    std::vector<unsigned int> timestamps(numVertices, 0);
+    std::vector<unsigned int> deadEnd; // Stack of recently referenced vertices.
+    std::vector<unsigned int> candidates;
+    std::vector<bool>         emitted(numTriangles, false);
+
+    const unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE;
+
+    unsigned int time   = cacheSize + 1;
+    unsigned int cursor = 0; // Fallback scan position for fully isolated restarts.
+    unsigned int count  = 0;
+
+    int fanning = 0;
+
+    while (0 <= fanning)
+    {
+      candidates.clear();
+
+      for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+      {
+        const unsigned int t = adjacency[a];
+        if (emitted[t])
+        {
+          continue;
+        }
+        emitted[t] = true;
+
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          const unsigned int v = indices[t * 3 + k];
+
+          result[count++] = v;
+
+          deadEnd.push_back(v);
+          candidates.push_back(v);
+          --live[v];
+
+          if (cacheSize < time - timestamps[v]) // Not in the cache, gets loaded now.
+          {
+            timestamps[v] = time++;
+          }
+        }
+      }
+
+      // Prefer the candidate which stays longest in the cache while its remaining triangles are emitted.
+      fanning = -1;
+      unsigned int best = 0;
+
+      for (const unsigned int v : candidates)
+      {
+        if (0 < live[v])
+        {
+          unsigned int priority = 0;
+          if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+          {
+            priority = time - timestamps[v];
+          }
+          if (fanning < 0 || best < priority)
+          {
+            best    = priority;
+            fanning = static_cast<int>(v);
+          }
+        }
+      }
+
+      if (fanning < 0)
+      {
+        // Dead end. Continue at the most recently referenced vertex with live triangles, else at the next one in input order.
+        while (!deadEnd.empty())
+        {
+          const unsigned int v = deadEnd.back();
+          deadEnd.pop_back();
+          if (0 < live[v])
+          {
+            fanning = static_cast<int>(v);
+            break;
+          }
+        }
+        while (fanning < 0 && cursor < numVertices)
+        {
+          if (0 < live[cursor])
+          {
+            fanning = static_cast<int>(cursor);
+          }
+          ++cursor;
+        }
+      }
+    }
+
+    MY_ASSERT(count == numTriangles * 3);
+  }
+
+
+  // Welds bitwise identical vertices, drops triangles which became degenerate by index,
+  // sorts the triangles along the Morton curve of their centroids so that spatially close triangles are close in memory,
+  // reorders the triangles inside small clusters of that order for the post-transform vertex cache,
+  // and finally renumbers the vertices in order of their first reference.
+  void Triangles::optimize()
+  {
+    if (m_attributes.empty())
+    {
+      return;
+    }
+
+    if (m_indices.empty()) // Independent triangles.
+    {
+      m_indices.resize(m_attributes.size() - m_attributes.size() % 3);
+      for (size_t i = 0; i < m_indices.size(); ++i)
+      {
+        m_indices[i] = static_cast<unsigned int>(i);
+      }
+    }
+
+    // Weld.
+    std::unordered_map<const TriangleAttributes*, unsigned int, AttributesHash, AttributesEqual> unique(m_attributes.size());
+    std::vector<unsigned int> remap(m_attributes.size());
+
+    for (size_t i = 0; i < m_attributes.size(); ++i)
+    {
+      remap[i] = unique.emplace(&m_attributes[i], static_cast<unsigned int>(i)).first->second;
+    }
+
+    std::vector<unsigned int> indices;
+    indices.reserve(m_indices.size());
+
+    for (size_t i = 0; i + 2 < m_indices.size(); i += 3)
+    {
+      const unsigned int i0 = remap[m_indices[i    ]];
+      const unsigned int i1 = remap[m_indices[i + 1]];
+      const unsigned int i2 = remap[m_indices[i + 2]];
+
+      if (i0 != i1 && i1 != i2 && i2 != i0)
+      {
+        indices.push_back(i0);
+        indices.push_back(i1);
+        indices.push_back(i2);
+      }
+    }
+
+    const unsigned int numTriangles = static_cast<unsigned int>(indices.size() / 3);
+
+    // Morton order of the triangle centroids.
+    std::vector<MeshOptimizerTriangle> triangles(numTriangles);
+
+    float3 aabbMin = make_float3(1e37f);
+    float3 aabbMax = make_float3(-1e37f);
+
+    std::vector<float3> centroids(numTriangles);
+
+    for (unsigned int t = 0; t < numTriangles; ++t)
+    {
+      const float3 c = (m_attributes[indices[t * 3]].vertex + m_attributes[indices[t * 3 + 1]].vertex + m_attributes[indices[t * 3 + 2]].vertex) * (1.0f / 3.0f);
+
+      centroids[t] = c;
+      aabbMin = fminf(aabbMin, c);
+      aabbMax = fmaxf(aabbMax, c);
+    }
+
+    const float3 extent = aabbMax - aabbMin;
+    const float3 scale  = make_float3((0.0f < extent.x) ? 1023.0f / extent.x : 0.0f,
+                                      (0.0f < extent.y) ? 1023.0f / extent.y : 0.0f,
+                                      (0.0f < extent.z) ? 1023.0f / extent.z : 0.0f);
+
+    for (unsigned int t = 0; t < numTriangles; ++t)
+    {
+      const float3 p = (centroids[t] - aabbMin) * scale;
+
+      triangles[t].code  = (expandBits10(static_cast<unsigned int>(p.x)) << 2) |
+                           (expandBits10(static_cast<unsigned int>(p.y)) << 1) |
+                            expandBits10(static_cast<unsigned int>(p.z));
+      triangles[t].index = t;
+    }
+
+    std::stable_sort(triangles.begin(), triangles.end(), [](MeshOptimizerTriangle const& a, MeshOptimizerTriangle const& b)
+    {
+      return a.code < b.code;
+    });
+
+    // Vertex cache order inside each cluster. Local vertex indices keep the per cluster arrays small.
+    std::vector<unsigned int> local(m_attributes.size(), ~0u);
+    std::vector<unsigned int> global;
+    std::vector<unsigned int> clusterIndices;
+    std::vector<unsigned int> clusterResult;
+
+    m_indices.resize(numTriangles * 3);
+
+    for (unsigned int first = 0; first < numTriangles; first += MESH_OPTIMIZER_CLUSTER_SIZE)
+    {
+      const unsigned int count = std::min(numTriangles - first, static_cast<unsigned int>(MESH_OPTIMIZER_CLUSTER_SIZE));
+
+      global.clear();
+      clusterIndices.resize(count * 3);
+      clusterResult.resize(count * 3);
+
+      for (unsigned int t = 0; t < count; ++t)
+      {
+        const unsigned int src = triangles[first + t].index;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+          const unsigned int v = indices[src * 3 + k];
+          if (local[v] == ~0u)
+          {
+            local[v] = static_cast<unsigned int>(global.size());
+            global.push_back(v);
+          }
+          clusterIndices[t * 3 + k] = local[v];
+        }
+      }
+
+      reorderCluster(clusterIndices.data(), count, static_cast<unsigned int>(global.size()), clusterResult.data());
+
+      for (unsigned int i = 0; i < count * 3; ++i)
+      {
+        m_indices[first * 3 + i] = global[clusterResult[i]];
+      }
+      for (const unsigned int v : global)
+      {
+        local[v] = ~0u;
+      }
+    }
+
+    // Vertices in order of first reference. Also drops the welded and unreferenced ones.
+    std::vector<unsigned int>       order(m_attributes.size(), ~0u);
+    std::vector<TriangleAttributes> attributes;
+    attributes.reserve(unique.size());
+
+    for (unsigned int& index : m_indices)
+    {
+      if (order[index] == ~0u)
+      {
+        order[index] = static_cast<unsigned int>(attributes.size());
+        attributes.push_back(m_attributes[index]);
+      }
+      index = order[index];
+    }
+
+    m_attributes.swap(attributes);
+  }
+
+} // namespace sg
@@ -0,0 +1,1599 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/Application.h"
+#include "inc/AssimpModel.h"
+#include "inc/Parser.h"
+#include "inc/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+
+#include "inc/MyAssert.h"
+
+// Bytes of OBJ text per parser work item. Each block is extended to the next line break.
+#define NATIVE_OBJ_BLOCK_SIZE (1 << 20)
+// Average corners per hash table when welding the OBJ corners into vertices.
+#define NATIVE_WELD_BUCKET_SIZE (1 << 18)
+// The material name of faces without usemtl and of PLY files, same as inside the assimp importers.
+#define NATIVE_DEFAULT_MATERIAL "DefaultMaterial"
+
+
+struct NativeMaterial
+{
+  std::string  name;
+  float3       diffuse;
+  unsigned int hasDiffuse;
+};
+
+// The native models have a single root node with one mesh per used material. Mesh i is geometry i with material i.
+static void setNativeModel(AssimpModel& model, std::vector<NativeMaterial> const& materials)
+{
+  const unsigned int numMeshes = static_cast<unsigned int>(materials.size());
+
+  model.meshes.resize(numMeshes);
+  model.materials.resize(numMeshes);
+  model.names.clear();
+  model.nodeMeshes.resize(numMeshes);
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    model.meshes[i].geometry = i;
+    model.meshes[i].material = i;
+
+    model.materials[i].diffuse    = materials[i].diffuse;
+    model.materials[i].hasDiffuse = materials[i].hasDiffuse;
+    model.materials[i].offsetName = static_cast<unsigned int>(model.names.size());
+    model.materials[i].lengthName = static_cast<unsigned int>(materials[i].name.size());
+
+    model.names += materials[i].name;
+
+    model.nodeMeshes[i] = i;
+  }
+
+  AssimpCacheNode root;
+
+  memset(root.trafo, 0, sizeof(root.trafo));
+  root.trafo[0]  = 1.0f;
+  root.trafo[5]  = 1.0f;
+  root.trafo[10] = 1.0f;
+
+  root.numChildren = 0;
+  root.firstMesh   = 0;
+  root.numMeshes   = numMeshes;
+
+  model.nodes.assign(1, root);
+}
+
+// Area weighted vertex normals like aiProcess_GenSmoothNormals, for files without normals.
+// Gathers the triangles per position instead of scattering, so that the sums do not depend on the thread scheduling.
+static void generateNormals(ThreadPool& pool, std::vector<float3> const& positions, std::vector<unsigned int> const& indices, std::vector<float3>& normals)
+{
+  const unsigned int numPositions = static_cast<unsigned int>(positions.size());
+  const unsigned int numTriangles = static_cast<unsigned int>(indices.size() / 3);
+
+  std::vector<AssimpImportChunk> chunksPositions;
+  std::vector<AssimpImportChunk> chunksTriangles;
+
+  appendChunks(0, numPositions, chunksPositions);
+  appendChunks(0, numTriangles, chunksTriangles);
+
+  // Triangles per position, then the offsets into the adjacency list. The counters become the write cursors.
+  std::unique_ptr< std::atomic<unsigned int>[] > cursors(new std::atomic<unsigned int>[numPositions]());
+
+  pool.parallelFor(static_cast<unsigned int>(chunksTriangles.size()), [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksTriangles[index];
+
+    for (size_t i = size_t(chunk.first) * 3; i < (size_t(chunk.first) + chunk.count) * 3; ++i)
+    {
+      cursors[indices[i]].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+
+  std::vector<unsigned int> offsets(size_t(numPositions) + 1);
+
+  offsets[0] = 0;
+  for (unsigned int i = 0; i < numPositions; ++i)
+  {
+    offsets[i + 1] = offsets[i] + cursors[i].load(std::memory_order_relaxed);
+    cursors[i].store(offsets[i], std::memory_order_relaxed);
+  }
+
+  std::vector<unsigned int> adjacency(offsets[numPositions]);
+
+  pool.parallelFor(static_cast<unsigned int>(chunksTriangles.size()), [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksTriangles[index];
+
+    for (size_t i = size_t(chunk.first) * 3; i < (size_t(chunk.first) + chunk.count) * 3; ++i)
+    {
+      adjacency[cursors[indices[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned int>(i / 3);
+    }
+  });
+
+  normals.resize(numPositions);
+
+  pool.parallelFor(static_cast<unsigned int>(chunksPositions.size()), [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunksPositions[index];
+
+    for (unsigned int i = chunk.first; i < chunk.first + chunk.count; ++i)
+    {
+      std::sort(adjacency.begin() + offsets[i], adjacency.begin() + offsets[i + 1]);
+
+      float3 normal = make_float3(0.0f);
+
+      for (unsigned int j = offsets[i]; j < offsets[i + 1]; ++j)
+      {
+        const unsigned int* triangle = &indices[size_t(adjacency[j]) * 3];
+
+        const float3 v0 = positions[triangle[0]];
+
+        normal += cross(positions[triangle[1]] - v0, positions[triangle[2]] - v0); // Length is twice the area.
+      }
+
+      const float len = length(normal);
+
+      normals[i] = (0.0f < len) ? normal / len : make_float3(0.0f, 0.0f, 1.0f);
+    }
+  });
+}
+
+
+// OBJ
+
+// Corner of an OBJ face. Zero-based indices of the position, texcoord and normal. -1 for absent texcoords and normals.
+struct ObjCorner
+{
+  int index[3];
+};
+
+struct ObjMaterialRun
+{
+  unsigned int first; // First triangle of the block which uses the material.
+  std::string  name;
+};
+
+// The parse results of one block of lines.
+struct ObjBlock
+{
+  const char* begin;
+  const char* end;
+
+  std::vector<float3>         positions;
+  std::vector<float2>         texcoords;
+  std::vector<float3>         normals;
+  std::vector<ObjCorner>      corners;   // Three per triangle, the faces are triangulated as fans.
+  std::vector<size_t>         relative;  // Slots (corner * 3 + component) of the negative indices. They hold the index relative to the block until the bases are known.
+  std::vector<ObjMaterialRun> runs;      // The usemtl statements.
+  std::vector<std::string>    libraries; // The mtllib statements.
+  std::vector<int>            face;      // The raw indices of the current face.
+
+  const char* error; // First line which could not be parsed, nullptr when all were fine.
+};
+
+// Triangles of one block which use the same material.
+struct ObjSegment
+{
+  unsigned int block;
+  unsigned int first;
+  unsigned int count;
+  unsigned int mesh;
+  size_t       offset; // Destination triangle inside the mesh.
+};
+
+static bool isBlank(const char c)
+{
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Next whitespace separated token inside the line [p, end).
+static bool getToken(const char*& p, const char* end, ParserToken& token)
+{
+  while (p < end && isBlank(*p))
+  {
+    ++p;
+  }
+  token.data = p;
+  while (p < end && !isBlank(*p))
+  {
+    ++p;
+  }
+  token.size = p - token.data;
+
+  return token.size != 0;
+}
+
+// The rest of the line without the surrounding whitespace. Material and file names can contain blanks.
+static void getRest(const char* p, const char* end, std::string& name)
+{
+  while (p < end && isBlank(*p))
+  {
+    ++p;
+  }
+  while (p < end && isBlank(end[-1]))
+  {
+    --end;
+  }
+  name.assign(p, end - p);
+}
+
+static bool getIndex(const char*& p, const char* end, int& value)
+{
+  const bool negative = (p < end && *p == '-');
+  if (negative)
+  {
+    ++p;
+  }
+  if (p == end || *p < '0' || '9' < *p)
+  {
+    return false;
+  }
+
+  long long v = 0;
+  for (; p < end && '0' <= *p && *p <= '9'; ++p)
+  {
+    v = v * 10 + (*p - '0');
+    if (0x7FFFFFFFll < v)
+    {
+      return false;
+    }
+  }
+  value = static_cast<int>((negative) ? -v : v);
+
+  return value != 0; // OBJ indices are one-based.
+}
+
+// Converts the one-based or negative OBJ indices of a face corner into an ObjCorner.
+static void appendCorner(ObjBlock& block, const int* raw)
+{
+  const size_t counts[3] = { block.positions.size(), block.texcoords.size(), block.normals.size() };
+
+  ObjCorner corner;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    if (0 < raw[i])
+    {
+      corner.index[i] = raw[i] - 1;
+    }
+    else if (raw[i] < 0)
+    {
+      corner.index[i] = static_cast<int>(counts[i]) + raw[i]; // Relative to the first element of this block. Can be negative.
+      block.relative.push_back(block.corners.size() * 3 + i);
+    }
+    else
+    {
+      corner.index[i] = -1; // Only texcoords and normals can be absent.
+    }
+  }
+  block.corners.push_back(corner);
+}
+
+// Parses "v", "v/t", "v//n" or "v/t/n" and appends the raw indices, 0 for absent ones.
+static bool parseCorner(ParserToken const& token, std::vector<int>& face)
+{
+  const char* p   = token.data;
+  const char* end = token.data + token.size;
+
+  int v = 0;
+  int t = 0;
+  int n = 0;
+
+  if (!getIndex(p, end, v))
+  {
+    return false;
+  }
+  if (p < end && *p == '/')
+  {
+    ++p;
+    if (p < end && *p != '/' && !getIndex(p, end, t))
+    {
+      return false;
+    }
+    if (p < end && *p == '/')
+    {
+      ++p;
+      if (!getIndex(p, end, n))
+      {
+        return false;
+      }
+    }
+  }
+  if (p != end)
+  {
+    return false;
+  }
+
+  face.push_back(v);
+  face.push_back(t);
+  face.push_back(n);
+
+  return true;
+}
+
+static bool parseLine(const char* p, const char* end, ObjBlock& block)
+{
+  ParserToken keyword;
+
+  if (!getToken(p, end, keyword) || keyword.data[0] == '#')
+  {
+    return true;
+  }
+
+  ParserToken token;
+
+  if (keyword == "v")
+  {
+    float3 v = make_float3(0.0f);
+
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    v.x = token.toFloat();
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    v.y = token.toFloat();
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    v.z = token.toFloat();
+
+    block.positions.push_back(v); // Ignores the optional w and vertex colors.
+  }
+  else if (keyword == "vt")
+  {
+    float2 t = make_float2(0.0f);
+
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    t.x = token.toFloat();
+    if (getToken(p, end, token))
+    {
+      t.y = token.toFloat();
+    }
+    block.texcoords.push_back(t);
+  }
+  else if (keyword == "vn")
+  {
+    float3 n = make_float3(0.0f);
+
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    n.x = token.toFloat();
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    n.y = token.toFloat();
+    if (!getToken(p, end, token))
+    {
+      return false;
+    }
+    n.z = token.toFloat();
+
+    block.normals.push_back(n);
+  }
+  else if (keyword == "f")
+  {
+    block.face.clear();
+
+    while (getToken(p, end, token))
+    {
+      if (!parseCorner(token, block.face))
+      {
+        return false;
+      }
+    }
+
+    // Fan triangulation. Points and lines are ignored, like with aiProcess_SortByPType.
+    const size_t numCorners = block.face.size() / 3;
+
+    for (size_t i = 2; i < numCorners; ++i)
+    {
+      appendCorner(block, &block.face[0]);
+      appendCorner(block, &block.face[(i - 1) * 3]);
+      appendCorner(block, &block.face[i * 3]);
+    }
+  }
+  else if (keyword == "usemtl")
+  {
+    ObjMaterialRun run;
+
+    run.first = static_cast<unsigned int>(block.corners.size() / 3);
+    getRest(p, end, run.name);
+
+    block.runs.push_back(run);
+  }
+  else if (keyword == "mtllib")
+  {
+    std::string name;
+
+    getRest(p, end, name);
+
+    block.libraries.push_back(name);
+  }
+  // Everything else, like groups, smoothing groups, lines and points, is ignored.
+  return true;
+}
+
+static void parseBlock(ObjBlock& block)
+{
+  const char* p = block.begin;
+
+  while (p < block.end)
+  {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', block.end - p));
+    const char* end = (eol != nullptr) ? eol : block.end;
+
+    if (!parseLine(p, end, block))
+    {
+      block.error = p;
+      return;
+    }
+    p = end + 1;
+  }
+}
+
+// Reads the newmtl names and their Kd colors. The other material parameters come from the scene description.
+static void parseMaterialLibrary(std::string const& filename, std::map<std::string, float3>& diffuse)
+{
+  Parser parser;
+
+  if (!parser.load(filename))
+  {
+    return; // The materials keep the colors of the scene description.
+  }
+
+  const char* data = parser.getData();
+  const char* last = data + parser.getSize();
+
+  std::string name;
+  ParserToken keyword;
+  ParserToken token;
+
+  while (data < last)
+  {
+    const char* eol = static_cast<const char*>(memchr(data, '\n', last - data));
+    const char* end = (eol != nullptr) ? eol : last;
+    const char* p   = data;
+
+    if (getToken(p, end, keyword))
+    {
+      if (keyword == "newmtl")
+      {
+        getRest(p, end, name);
+      }
+      else if (keyword == "Kd" && !name.empty())
+      {
+        float3 color = make_float3(0.0f);
+
+        if (getToken(p, end, token))
+        {
+          color.x = token.toFloat();
+          color.y = color.x;
+          color.z = color.x;
+        }
+        if (getToken(p, end, token))
+        {
+          color.y = token.toFloat();
+        }
+        if (getToken(p, end, token))
+        {
+          color.z = token.toFloat();
+        }
+        diffuse[name] = color;
+      }
+    }
+    data = end + 1;
+  }
+}
+
+// Parses blocks of lines in parallel, then welds the position, texcoord and normal indices of the corners into vertices per material.
+bool Application::readOBJ(AssimpModel& model, ThreadPool& pool,
+                          std::vector< std::vector<TriangleAttributes> >& attributes, std::vector< std::vector<unsigned int> >& indices)
+{
+  Parser parser;
+
+  if (!parser.load(model.filename))
+  {
+    return false;
+  }
+
+  const char* data = parser.getData();
+  const size_t size = parser.getSize();
+
+  std::vector<ObjBlock> blocks;
+
+  for (size_t first = 0; first < size; )
+  {
+    size_t last = std::min(first + NATIVE_OBJ_BLOCK_SIZE, size);
+
+    const char* eol = static_cast<const char*>(memchr(data + last, '\n', size - last));
+    last = (eol != nullptr) ? (eol - data) + 1 : size;
+
+    ObjBlock block;
+
+    block.begin = data + first;
+    block.end   = data + last;
+    block.error = nullptr;
+
+    blocks.push_back(block);
+
+    first = last;
+  }
+
+  const unsigned int numBlocks = static_cast<unsigned int>(blocks.size());
+
+  pool.parallelFor(numBlocks, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    parseBlock(blocks[index]);
+  });
+
+  // The first element of each block inside the whole file.
+  std::vector<size_t> basePositions(numBlocks);
+  std::vector<size_t> baseTexcoords(numBlocks);
+  std::vector<size_t> baseNormals(numBlocks);
+
+  size_t numPositions = 0;
+  size_t numTexcoords = 0;
+  size_t numNormals   = 0;
+
+  for (unsigned int i = 0; i < numBlocks; ++i)
+  {
+    if (blocks[i].error != nullptr)
+    {
+      const char* eol = static_cast<const char*>(memchr(blocks[i].error, '\n', blocks[i].end - blocks[i].error));
+
+      std::cerr << "ERROR: readOBJ() " << model.filename << " cannot parse \""
+                << std::string(blocks[i].error, (eol != nullptr) ? eol : blocks[i].end) << "\"" << std::endl;
+      return false;
+    }
+
+    basePositions[i] = numPositions;
+    baseTexcoords[i] = numTexcoords;
+    baseNormals[i]   = numNormals;
+
+    numPositions += blocks[i].positions.size();
+    numTexcoords += blocks[i].texcoords.size();
+    numNormals   += blocks[i].normals.size();
+  }
+
+  if (0x7FFFFFFF < numPositions || 0x7FFFFFFF < numTexcoords || 0x7FFFFFFF < numNormals)
+  {
+    return false;
+  }
+
+  // One mesh per material in the order of the first triangle using it. A usemtl reaches into the following blocks.
+  std::vector<NativeMaterial>         materials;
+  std::map<std::string, unsigned int> meshOfMaterial;
+  std::vector<ObjSegment>             segments;
+  std::vector<size_t>                 numMeshTriangles;
+
+  std::string current(NATIVE_DEFAULT_MATERIAL);
+
+  for (unsigned int i = 0; i < numBlocks; ++i)
+  {
+    ObjBlock const& block = blocks[i];
+
+    const unsigned int numTriangles = static_cast<unsigned int>(block.corners.size() / 3);
+
+    for (size_t j = 0; j <= block.runs.size(); ++j)
+    {
+      const unsigned int first = (j == 0) ? 0 : block.runs[j - 1].first;
+      const unsigned int last  = (j < block.runs.size()) ? block.runs[j].first : numTriangles;
+
+      if (first < last)
+      {
+        std::map<std::string, unsigned int>::const_iterator it = meshOfMaterial.find(current);
+        if (it == meshOfMaterial.end())
+        {
+          NativeMaterial material;
+
+          material.name       = current;
+          material.diffuse    = make_float3(0.0f);
+          material.hasDiffuse = 0;
+
+          it = meshOfMaterial.insert(std::make_pair(current, static_cast<unsigned int>(materials.size()))).first;
+          materials.push_back(material);
+          numMeshTriangles.push_back(0);
+        }
+
+        ObjSegment segment;
+
+        segment.block  = i;
+        segment.first  = first;
+        segment.count  = last - first;
+        segment.mesh   = it->second;
+        segment.offset = numMeshTriangles[segment.mesh];
+
+        numMeshTriangles[segment.mesh] += segment.count;
+
+        segments.push_back(segment);
+      }
+      if (j < block.runs.size())
+      {
+        current = block.runs[j].name;
+      }
+    }
+  }
+
+  const unsigned int numMeshes = static_cast<unsigned int>(materials.size());
+  if (numMeshes == 0)
+  {
+    std::cerr << "ERROR: readOBJ() " << model.filename << " has no faces" << std::endl;
+    return false;
+  }
+
+  // The material libraries are relative to the OBJ file.
+  const std::string::size_type slash = model.filename.find_last_of("/\\");
+  const std::string path = (slash != std::string::npos) ? model.filename.substr(0, slash + 1) : std::string();
+
+  std::map<std::string, float3> diffuse;
+
+  for (unsigned int i = 0; i < numBlocks; ++i)
+  {
+    for (size_t j = 0; j < blocks[i].libraries.size(); ++j)
+    {
+      parseMaterialLibrary(path + blocks[i].libraries[j], diffuse);
+    }
+  }
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    std::map<std::string, float3>::const_iterator it = diffuse.find(materials[i].name);
+    if (it != diffuse.end())
+    {
+      materials[i].diffuse    = it->second;
+      materials[i].hasDiffuse = 1;
+    }
+  }
+
+  // Resolve the relative indices, validate all corners and gather the triangles per mesh.
+  std::vector<float3> positions(numPositions);
+  std::vector<float2> texcoords(numTexcoords);
+  std::vector<float3> normals(numNormals);
+
+  std::vector< std::vector<ObjCorner> > corners(numMeshes);
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    if (0x7FFFFFFF / 3 < numMeshTriangles[i])
+    {
+      return false;
+    }
+    corners[i].resize(numMeshTriangles[i] * 3);
+  }
+
+  std::vector<unsigned int> firstSegments(numBlocks + 1, static_cast<unsigned int>(segments.size()));
+
+  for (unsigned int i = static_cast<unsigned int>(segments.size()); 0 < i; --i)
+  {
+    firstSegments[segments[i - 1].block] = i - 1;
+  }
+  for (unsigned int i = numBlocks; 0 < i; --i)
+  {
+    firstSegments[i - 1] = std::min(firstSegments[i - 1], firstSegments[i]);
+  }
+
+  std::vector<unsigned char> isValid(numBlocks, 1);
+  std::vector<unsigned char> hasNormals(numBlocks, 1);
+
+  pool.parallelFor(numBlocks, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    ObjBlock& block = blocks[index];
+
+    std::copy(block.positions.begin(), block.positions.end(), positions.begin() + basePositions[index]);
+    std::copy(block.texcoords.begin(), block.texcoords.end(), texcoords.begin() + baseTexcoords[index]);
+    std::copy(block.normals.begin(),   block.normals.end(),   normals.begin()   + baseNormals[index]);
+
+    const long long bases[3] = { (long long) basePositions[index], (long long) baseTexcoords[index], (long long) baseNormals[index] };
+
+    for (size_t i = 0; i < block.relative.size(); ++i)
+    {
+      const size_t slot = block.relative[i];
+
+      int& value = block.corners[slot / 3].index[slot % 3];
+
+      const long long absolute = bases[slot % 3] + value;
+
+      value = (0 <= absolute) ? static_cast<int>(absolute) : 0x7FFFFFFF; // Invalid, fails the range check below.
+    }
+
+    for (size_t i = 0; i < block.corners.size(); ++i)
+    {
+      ObjCorner const& corner = block.corners[i];
+
+      if (numPositions <= (size_t) corner.index[0] ||
+          (corner.index[1] != -1 && numTexcoords <= (size_t) corner.index[1]) ||
+          (corner.index[2] != -1 && numNormals   <= (size_t) corner.index[2]))
+      {
+        isValid[index] = 0;
+      }
+      if (corner.index[2] == -1)
+      {
+        hasNormals[index] = 0;
+      }
+    }
+
+    for (unsigned int i = firstSegments[index]; i < firstSegments[index + 1]; ++i)
+    {
+      ObjSegment const& segment = segments[i];
+
+      std::copy(block.corners.begin() + size_t(segment.first) * 3, block.corners.begin() + (size_t(segment.first) + segment.count) * 3,
+                corners[segment.mesh].begin() + segment.offset * 3);
+    }
+
+    // Release the block data early, the welding needs about the same amount of memory again.
+    std::vector<float3>().swap(block.positions);
+    std::vector<float2>().swap(block.texcoords);
+    std::vector<float3>().swap(block.normals);
+    std::vector<ObjCorner>().swap(block.corners);
+    std::vector<size_t>().swap(block.relative);
+  });
+
+  for (unsigned int i = 0; i < numBlocks; ++i)
+  {
+    if (!isValid[i])
+    {
+      std::cerr << "ERROR: readOBJ() " << model.filename << " has invalid face indices" << std::endl;
+      return false;
+    }
+  }
+
+  // Corners without normals get the smooth normal of their position over all meshes.
+  std::vector<float3> smoothNormals;
+
+  if (std::find(hasNormals.begin(), hasNormals.end(), 0) != hasNormals.end())
+  {
+    std::vector<unsigned int> positionIndices;
+
+    positionIndices.reserve(std::accumulate(numMeshTriangles.begin(), numMeshTriangles.end(), size_t(0)) * 3);
+
+    for (unsigned int i = 0; i < numMeshes; ++i)
+    {
+      for (size_t j = 0; j < corners[i].size(); ++j)
+      {
+        positionIndices.push_back(static_cast<unsigned int>(corners[i][j].index[0]));
+      }
+    }
+
+    generateNormals(pool, positions, positionIndices, smoothNormals);
+  }
+
+  // Weld identical corners into vertices. The corners of each mesh are split into buckets by their hash.
+  // The buckets are welded in parallel and their vertices concatenated, which keeps the result independent of the number of threads.
+  std::vector<unsigned int> numBuckets(numMeshes);
+  std::vector<unsigned int> firstBuckets(numMeshes + 1);
+
+  std::vector<AssimpImportChunk> chunks;
+  std::vector<unsigned int>      firstChunks(numMeshes + 1);
+
+  firstBuckets[0] = 0;
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    numBuckets[i]       = std::max(1u, static_cast<unsigned int>(corners[i].size() / NATIVE_WELD_BUCKET_SIZE));
+    firstBuckets[i + 1] = firstBuckets[i] + numBuckets[i];
+    firstChunks[i]      = static_cast<unsigned int>(chunks.size());
+
+    appendChunks(i, static_cast<unsigned int>(corners[i].size()), chunks);
+  }
+  firstChunks[numMeshes] = static_cast<unsigned int>(chunks.size());
+
+  const unsigned int numChunks       = static_cast<unsigned int>(chunks.size());
+  const unsigned int numBucketsTotal = firstBuckets[numMeshes];
+
+  auto hashCorner = [](ObjCorner const& corner) -> unsigned long long
+  {
+    unsigned long long h = static_cast<unsigned int>(corner.index[0]) * 0x9E3779B97F4A7C15ull;
+
+    h ^= static_cast<unsigned int>(corner.index[1]) * 0xC2B2AE3D27D4EB4Full;
+    h ^= static_cast<unsigned int>(corner.index[2]) * 0x165667B19E3779F9ull;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+
+    return h;
+  };
+
+  // Corners per bucket and chunk, turned into the write offsets of each chunk.
+  std::vector<size_t> firstCounts(numChunks + 1);
+
+  firstCounts[0] = 0;
+  for (unsigned int i = 0; i < numChunks; ++i)
+  {
+    firstCounts[i + 1] = firstCounts[i] + numBuckets[chunks[i].geometry];
+  }
+
+  std::vector<unsigned int> counts(firstCounts[numChunks], 0);
+
+  pool.parallelFor(numChunks, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunks[index];
+
+    const ObjCorner* src = corners[chunk.geometry].data();
+    unsigned int*    dst = &counts[firstCounts[index]];
+
+    for (unsigned int i = chunk.first; i < chunk.first + chunk.count; ++i)
+    {
+      ++dst[hashCorner(src[i]) % numBuckets[chunk.geometry]];
+    }
+  });
+
+  std::vector<unsigned int> bucketFirst(numBucketsTotal); // First entry of the bucket inside the order of its mesh.
+  std::vector<unsigned int> bucketCount(numBucketsTotal);
+  std::vector<unsigned int> bucketMesh(numBucketsTotal);
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    unsigned int offset = 0;
+
+    for (unsigned int b = 0; b < numBuckets[i]; ++b)
+    {
+      bucketFirst[firstBuckets[i] + b] = offset;
+      bucketMesh[firstBuckets[i] + b]  = i;
+
+      for (unsigned int c = firstChunks[i]; c < firstChunks[i + 1]; ++c)
+      {
+        const unsigned int count = counts[firstCounts[c] + b];
+
+        counts[firstCounts[c] + b] = offset;
+        offset += count;
+      }
+      bucketCount[firstBuckets[i] + b] = offset - bucketFirst[firstBuckets[i] + b];
+    }
+  }
+
+  // The corner indices of each mesh sorted by bucket, in file order inside each bucket.
+  std::vector< std::vector<unsigned int> > order(numMeshes);
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    order[i].resize(corners[i].size());
+  }
+
+  pool.parallelFor(numChunks, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunks[index];
+
+    const ObjCorner* src = corners[chunk.geometry].data();
+    unsigned int*    dst = &counts[firstCounts[index]];
+
+    for (unsigned int i = chunk.first; i < chunk.first + chunk.count; ++i)
+    {
+      order[chunk.geometry][dst[hashCorner(src[i]) % numBuckets[chunk.geometry]]++] = i;
+    }
+  });
+
+  // Open addressing hash table per bucket. The indices receive the vertex index inside the bucket first.
+  std::vector< std::vector<unsigned int> > representatives(numBucketsTotal); // The first corner of each vertex.
+
+  indices.resize(numMeshes);
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    indices[i].resize(corners[i].size());
+  }
+
+  pool.parallelFor(numBucketsTotal, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    const unsigned int mesh = bucketMesh[index];
+
+    const ObjCorner* src = corners[mesh].data();
+    unsigned int*    dst = indices[mesh].data();
+
+    std::vector<unsigned int>& vertices = representatives[index];
+
+    unsigned int sizeTable = 16;
+    while (sizeTable < bucketCount[index] * 2)
+    {
+      sizeTable *= 2;
+    }
+
+    std::vector<unsigned int> table(sizeTable, ~0u);
+
+    for (unsigned int i = bucketFirst[index]; i < bucketFirst[index] + bucketCount[index]; ++i)
+    {
+      const unsigned int c = order[mesh][i];
+
+      ObjCorner const& corner = src[c];
+
+      unsigned int slot = static_cast<unsigned int>(hashCorner(corner) >> 32) & (sizeTable - 1);
+
+      while (table[slot] != ~0u)
+      {
+        ObjCorner const& other = src[vertices[table[slot]]];
+
+        if (other.index[0] == corner.index[0] && other.index[1] == corner.index[1] && other.index[2] == corner.index[2])
+        {
+          break;
+        }
+        slot = (slot + 1) & (sizeTable - 1);
+      }
+      if (table[slot] == ~0u)
+      {
+        table[slot] = static_cast<unsigned int>(vertices.size());
+        vertices.push_back(c);
+      }
+      dst[c] = table[slot];
+    }
+  });
+
+  std::vector<unsigned int> bucketBase(numBucketsTotal);
+
+  attributes.resize(numMeshes);
+
+  for (unsigned int i = 0; i < numMeshes; ++i)
+  {
+    unsigned int numVertices = 0;
+
+    for (unsigned int b = firstBuckets[i]; b < firstBuckets[i + 1]; ++b)
+    {
+      bucketBase[b] = numVertices;
+      numVertices += static_cast<unsigned int>(representatives[b].size());
+    }
+
+    attributes[i].resize(numVertices);
+  }
+
+  pool.parallelFor(numBucketsTotal, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    const unsigned int mesh = bucketMesh[index];
+
+    std::vector<unsigned int> const& vertices = representatives[index];
+
+    TriangleAttributes* dst = attributes[mesh].data() + bucketBase[index];
+
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+      ObjCorner const& corner = corners[mesh][vertices[i]];
+
+      dst[i].vertex  = positions[corner.index[0]];
+      dst[i].tangent = make_float3(1.0f, 0.0f, 0.0f); // Replaced by the geometry tangents.
+      dst[i].normal  = (corner.index[2] != -1) ? normals[corner.index[2]] : smoothNormals[corner.index[0]];
+
+      if (corner.index[1] != -1)
+      {
+        const float2 t = texcoords[corner.index[1]];
+
+        dst[i].texcoord = make_float3(t.x, t.y, 0.0f);
+      }
+      else
+      {
+        dst[i].texcoord = make_float3(0.0f);
+      }
+    }
+  });
+
+  pool.parallelFor(numChunks, [&](const unsigned int index, const unsigned int threadIndex)
+  {
+    AssimpImportChunk const& chunk = chunks[index];
+
+    const ObjCorner* src = corners[chunk.geometry].data();
+    unsigned int*    dst = indices[chunk.geometry].data();
+
+    const unsigned int* bases = &bucketBase[firstBuckets[chunk.geometry]];
+
+    for (unsigned int i = chunk.first; i < chunk.first + chunk.count; ++i)
+    {
+      dst[i] += bases[hashCorner(src[i]) % numBuckets[chunk.geometry]];
+    }
+  });
+
+  setNativeModel(model, materials);
+
+  return true;
+}
+
+
+// PLY
+
+enum PlyType
+{
+  PLY_NONE,
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64
+};
+
+struct PlyProperty
+{
+  std::string name;
+  PlyType     type;      // Scalar type or the type of the list entries.
+  PlyType     typeCount; // Type of the list count, PLY_NONE for scalars.
+  size_t      offset;    // Inside the element, only valid for elements without lists.
+};
+
+struct PlyElement
+{
+  std::string              name;
+  size_t                   count;
+  std::vector<PlyProperty> properties;
+  size_t                   stride; // Bytes per element, 0 when the element contains lists.
+};
+
+static PlyType getPlyType(ParserToken const& token)
+{
+  if (token == "char"   || token == "int8")    return PLY_INT8;
+  if (token == "uchar"  || token == "uint8")   return PLY_UINT8;
+  if (token == "short"  || token == "int16")   return PLY_INT16;
+  if (token == "ushort" || token == "uint16")  return PLY_UINT16;
+  if (token == "int"    || token == "int32")   return PLY_INT32;
+  if (token == "uint"   || token == "uint32")  return PLY_UINT32;
+  if (token == "float"  || token == "float32") return PLY_FLOAT32;
+  if (token == "double" || token == "float64") return PLY_FLOAT64;
+  return PLY_NONE;
+}
+
+static size_t getPlySize(const PlyType type)
+{
+  static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+  return sizes[type];
+}
+
+static double getPlyValue(const unsigned char* p, const PlyType type, const bool swap)
+{
+  unsigned char bytes[8];
+
+  const size_t size = getPlySize(type);
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    bytes[i] = (swap) ? p[size - 1 - i] : p[i];
+  }
+
+  switch (type)
+  {
+    case PLY_INT8:    { signed char        v; memcpy(&v, bytes, 1); return v; }
+    case PLY_UINT8:   { unsigned char      v; memcpy(&v, bytes, 1); return v; }
+    case PLY_INT16:   { short              v; memcpy(&v, bytes, 2); return v; }
+    case PLY_UINT16:  { unsigned short     v; memcpy(&v, bytes, 2); return v; }
+    case PLY_INT32:   { int                v; memcpy(&v, bytes, 4); return v; }
+    case PLY_UINT32:  { unsigned int       v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT32: { float              v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT64: { double             v; memcpy(&v, bytes, 8); return v; }
+    default:
+      return 0.0;
+  }
+}
+
+// Indices and list counts. Negative values and fractions become ~0u, which fails the range checks.
+static unsigned int getPlyIndex(const unsigned char* p, const PlyType type, const bool swap)
+{
+  const double value = getPlyValue(p, type, swap);
+
+  return (0.0 <= value && value < 4294967295.0 && value == static_cast<double>(static_cast<unsigned int>(value))) ? static_cast<unsigned int>(value) : ~0u;
+}
+
+static const PlyProperty* findPlyProperty(PlyElement const& element, const char* name)
+{
+  for (size_t i = 0; i < element.properties.size(); ++i)
+  {
+    if (element.properties[i].name == name)
+    {
+      return &element.properties[i];
+    }
+  }
+  return nullptr;
+}
+
+// Parses the header. Returns false for ASCII and malformed files. The data starts at offset.
+static bool parsePlyHeader(const char* data, const size_t size, bool& isLittleEndian, std::vector<PlyElement>& elements, size_t& offset)
+{
+  const char* p    = data;
+  const char* last = data + size;
+
+  bool hasFormat = false;
+  bool hasEnd    = false;
+  bool isFirst   = true;
+
+  ParserToken keyword;
+  ParserToken token;
+
+  while (p < last)
+  {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', last - p));
+    if (eol == nullptr)
+    {
+      return false;
+    }
+
+    const char* q = p;
+    p = eol + 1;
+
+    if (!getToken(q, eol, keyword))
+    {
+      continue;
+    }
+    if (isFirst)
+    {
+      if (keyword != "ply")
+      {
+        return false;
+      }
+      isFirst = false;
+    }
+    else if (keyword == "format")
+    {
+      getToken(q, eol, token);
+      if (token == "binary_little_endian")
+      {
+        isLittleEndian = true;
+      }
+      else if (token == "binary_big_endian")
+      {
+        isLittleEndian = false;
+      }
+      else
+      {
+        return false; // ASCII is left to assimp.
+      }
+      hasFormat = true;
+    }
+    else if (keyword == "element")
+    {
+      PlyElement element;
+
+      if (!getToken(q, eol, token))
+      {
+        return false;
+      }
+      token.assign(element.name);
+      if (!getToken(q, eol, token))
+      {
+        return false;
+      }
+      element.count  = static_cast<size_t>(strtoull(token.str().c_str(), nullptr, 10));
+      element.stride = 0;
+
+      elements.push_back(element);
+    }
+    else if (keyword == "property")
+    {
+      if (elements.empty() || !getToken(q, eol, token))
+      {
+        return false;
+      }
+
+      PlyProperty property;
+
+      property.typeCount = PLY_NONE;
+      property.offset    = 0;
+
+      if (token == "list")
+      {
+        if (!getToken(q, eol, token))
+        {
+          return false;
+        }
+        property.typeCount = getPlyType(token);
+        if (property.typeCount == PLY_NONE || !getToken(q, eol, token))
+        {
+          return false;
+        }
+      }
+      property.type = getPlyType(token);
+      if (property.type == PLY_NONE || !getToken(q, eol, token))
+      {
+        return false;
+      }
+      token.assign(property.name);
+
+      elements.back().properties.push_back(property);
+    }
+    else if (keyword == "end_header")
+    {
+      offset = p - data;
+      hasEnd = true;
+      break;
+    }
+    // Ignores comment and obj_info.
+  }
+
+  if (!hasFormat || !hasEnd)
+  {
+    return false;
+  }
+
+  // Fixed size elements get their offsets and stride.
+  for (size_t i = 0; i < elements.size(); ++i)
+  {
+    PlyElement& element = elements[i];
+
+    size_t stride = 0;
+
+    for (size_t j = 0; j < element.properties.size() && stride != ~size_t(0); ++j)
+    {
+      if (element.properties[j].typeCount != PLY_NONE)
+      {
+        stride = ~size_t(0);
+      }
+      else
+      {
+        element.properties[j].offset = stride;
+        stride += getPlySize(element.properties[j].type);
+      }
+    }
+    element.stride = (stride != ~size_t(0)) ? stride : 0;
+  }
+  return true;
+}
+
+// Streams binary PLY vertex and face elements into the attributes and indices of a single mesh.
+bool Application::readPLY(AssimpModel& model, ThreadPool& pool,
+                          std::vector< std::vector<TriangleAttributes> >& attributes, std::vector< std::vector<unsigned int> >& indices)
+{
+  Parser parser;
+
+  if (!parser.load(model.filename))
+  {
+    return false;
+  }
+
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(parser.getData());
+  const size_t         size = parser.getSize();
+
+  bool isLittleEndian = true;
+  std::vector<PlyElement> elements;
+  size_t offset = 0;
+
+  if (!parsePlyHeader(parser.getData(), size, isLittleEndian, elements, offset))
+  {
+    return false;
+  }
+
+  const unsigned int one = 1;
+  const bool swap = ((*reinterpret_cast<const unsigned char*>(&one) == 1) != isLittleEndian);
+
+  std::vector<TriangleAttributes> vertices;
+  std::vector<unsigned int>       triangles;
+
+  bool hasVertices = false;
+  bool hasNormals  = false;
+
+  for (size_t e = 0; e < elements.size(); ++e)
+  {
+    PlyElement const& element = elements[e];
+
+    if (element.name == "vertex")
+    {
+      const PlyProperty* x = findPlyProperty(element, "x");
+      const PlyProperty* y = findPlyProperty(element, "y");
+      const PlyProperty* z = findPlyProperty(element, "z");
+
+      const PlyProperty* nx = findPlyProperty(element, "nx");
+      const PlyProperty* ny = findPlyProperty(element, "ny");
+      const PlyProperty* nz = findPlyProperty(element, "nz");
+
+      const PlyProperty* u = findPlyProperty(element, "u");
+      const PlyProperty* v = findPlyProperty(element, "v");
+      if (u == nullptr || v == nullptr)
+      {
+        u = findPlyProperty(element, "s");
+        v = findPlyProperty(element, "t");
+      }
+      if (u == nullptr || v == nullptr)
+      {
+        u = findPlyProperty(element, "texture_u");
+        v = findPlyProperty(element, "texture_v");
+      }
+      if (u == nullptr || v == nullptr)
+      {
+        u = findPlyProperty(element, "texture_s");
+        v = findPlyProperty(element, "texture_t");
+      }
+
+      if (element.stride == 0 || x == nullptr || y == nullptr || z == nullptr ||
+          0xFFFFFFFF < element.count || (size - offset) / element.stride < element.count)
+      {
+        return false;
+      }
+
+      hasVertices = true;
+      hasNormals  = (nx != nullptr && ny != nullptr && nz != nullptr);
+
+      const bool hasTexcoords = (u != nullptr && v != nullptr);
+
+      vertices.resize(element.count);
+
+      std::vector<AssimpImportChunk> chunks;
+
+      appendChunks(0, static_cast<unsigned int>(element.count), chunks);
+
+      const unsigned char* src = data + offset;
+
+      pool.parallelFor(static_cast<unsigned int>(chunks.size()), [&](const unsigned int index, const unsigned int threadIndex)
+      {
+        AssimpImportChunk const& chunk = chunks[index];
+
+        for (unsigned int i = chunk.first; i < chunk.first + chunk.count; ++i)
+        {
+          const unsigned char* p = src + i * element.stride;
+
+          TriangleAttributes& attrib = vertices[i];
+
+          attrib.vertex  = make_float3(float(getPlyValue(p + x->offset, x->type, swap)),
+                                       float(getPlyValue(p + y->offset, y->type, swap)),
+                                       float(getPlyValue(p + z->offset, z->type, swap)));
+          attrib.tangent = make_float3(1.0f, 0.0f, 0.0f); // Replaced by the geometry tangents.
+
+          if (hasNormals)
+          {
+            attrib.normal = make_float3(float(getPlyValue(p + nx->offset, nx->type, swap)),
+                                        float(getPlyValue(p + ny->offset, ny->type, swap)),
+                                        float(getPlyValue(p + nz->offset, nz->type, swap)));
+          }
+          else
+          {
+            attrib.normal = make_float3(0.0f, 0.0f, 1.0f);
+          }
+
+          if (hasTexcoords)
+          {
+            attrib.texcoord = make_float3(float(getPlyValue(p + u->offset, u->type, swap)),
+                                          float(getPlyValue(p + v->offset, v->type, swap)),
+                                          0.0f);
+          }
+          else
+          {
+            attrib.texcoord = make_float3(0.0f);
+          }
+        }
+      });
+
+      offset += element.count * element.stride;
+    }
+    else if (element.name == "face")
+    {
+      const PlyProperty* list = findPlyProperty(element, "vertex_indices");
+      if (list == nullptr)
+      {
+        list = findPlyProperty(element, "vertex_index");
+      }
+      if (list == nullptr || list->typeCount == PLY_NONE)
+      {
+        return false;
+      }
+
+      const size_t sizeCount = getPlySize(list->typeCount);
+      const size_t sizeIndex = getPlySize(list->type);
+
+      // Fast path for faces with only the index list when all of them are triangles, which is the common case.
+      const size_t stride = sizeCount + 3 * sizeIndex;
+
+      bool isTriangles = (element.properties.size() == 1 && element.count <= 0x7FFFFFFF / 3 && element.count <= (size - offset) / stride);
+
+      if (isTriangles)
+      {
+        std::vector<AssimpImportChunk> chunks;
+
+        appendChunks(0, static_cast<unsigned int>(element.count), chunks);
+
+        std::vector<unsigned char> isValid(chunks.size(), 1);
+
+        triangles.resize(element.count * 3);
+
+        const unsigned char* src = data + offset;
+
+        pool.parallelFor(static_cast<unsigned int>(chunks.size()), [&](const unsigned int index, const unsigned int threadIndex)
+        {
+          AssimpImportChunk const& chunk = chunks[index];
+
+          for (unsigned int i = chunk.first; i < chunk.first + chunk.count && isValid[index]; ++i)
+          {
+            const unsigned char* p = src + i * stride;
+
+            if (getPlyIndex(p, list->typeCount, swap) != 3)
+            {
+              isValid[index] = 0;
+            }
+            else
+            {
+              triangles[size_t(i) * 3    ] = getPlyIndex(p + sizeCount,                 list->type, swap);
+              triangles[size_t(i) * 3 + 1] = getPlyIndex(p + sizeCount + sizeIndex,     list->type, swap);
+              triangles[size_t(i) * 3 + 2] = getPlyIndex(p + sizeCount + 2 * sizeIndex, list->type, swap);
+            }
+          }
+        });
+
+        isTriangles = (std::find(isValid.begin(), isValid.end(), 0) == isValid.end());
+
+        if (isTriangles)
+        {
+          offset += element.count * stride;
+        }
+        else
+        {
+          triangles.clear();
+        }
+      }
+
+      if (!isTriangles)
+      {
+        // General faces with fan triangulation and other properties.
+        for (size_t i = 0; i < element.count; ++i)
+        {
+          for (size_t j = 0; j < element.properties.size(); ++j)
+          {
+            PlyProperty const& property = element.properties[j];
+
+            if (property.typeCount == PLY_NONE)
+            {
+              if (size - offset < getPlySize(property.type))
+              {
+                return false;
+              }
+              offset += getPlySize(property.type);
+              continue;
+            }
+            if (size - offset < getPlySize(property.typeCount))
+            {
+              return false;
+            }
+
+            const unsigned int count = getPlyIndex(data + offset, property.typeCount, swap);
+
+            offset += getPlySize(property.typeCount);
+
+            const size_t sizeEntry = getPlySize(property.type);
+            if (count == ~0u || (size - offset) / sizeEntry < count)
+            {
+              return false;
+            }
+
+            if (&property == list)
+            {
+              for (unsigned int k = 2; k < count; ++k)
+              {
+                triangles.push_back(getPlyIndex(data + offset,                   property.type, swap));
+                triangles.push_back(getPlyIndex(data + offset + (k - 1) * sizeEntry, property.type, swap));
+                triangles.push_back(getPlyIndex(data + offset + k * sizeEntry,       property.type, swap));
+              }
+            }
+            offset += count * sizeEntry;
+          }
+        }
+      }
+    }
+    else if (element.stride != 0)
+    {
+      if ((size - offset) / element.stride < element.count)
+      {
+        return false;
+      }
+      offset += element.count * element.stride;
+    }
+    else
+    {
+      // Skip other elements with lists.
+      for (size_t i = 0; i < element.count; ++i)
+      {
+        for (size_t j = 0; j < element.properties.size(); ++j)
+        {
+          PlyProperty const& property = element.properties[j];
+
+          size_t sizeProperty = getPlySize(property.type);
+
+          if (property.typeCount != PLY_NONE)
+          {
+            if (size - offset < getPlySize(property.typeCount))
+            {
+              return false;
+            }
+
+            const unsigned int count = getPlyIndex(data + offset, property.typeCount, swap);
+            if (count == ~0u)
+            {
+              return false;
+            }
+
+            offset += getPlySize(property.typeCount);
+            sizeProperty *= count;
+          }
+          if (size - offset < sizeProperty)
+          {
+            return false;
+          }
+          offset += sizeProperty;
+        }
+      }
+    }
+  }
+
+  if (!hasVertices || triangles.empty())
+  {
+    std::cerr << "ERROR: readPLY() " << model.filename << " has no triangles" << std::endl;
+    return false;
+  }
+
+  const unsigned int numVertices = static_cast<unsigned int>(vertices.size());
+
+  for (size_t i = 0; i < triangles.size(); ++i)
+  {
+    if (numVertices <= triangles[i])
+    {
+      std::cerr << "ERROR: readPLY() " << model.filename << " has invalid face indices" << std::endl;
+      return false;
+    }
+  }
+
+  if (!hasNormals)
+  {
+    std::vector<float3> positions(numVertices);
+    std::vector<float3> normals;
+
+    for (unsigned int i = 0; i < numVertices; ++i)
+    {
+      positions[i] = vertices[i].vertex;
+    }
+
+    generateNormals(pool, positions, triangles, normals);
+
+    for (unsigned int i = 0; i < numVertices; ++i)
+    {
+      vertices[i].normal = normals[i];
+    }
+  }
+
+  attributes.resize(1);
+  indices.resize(1);
+
+  attributes[0].swap(vertices);
+  indices[0].swap(triangles);
+
+  NativeMaterial material;
+
+  material.name       = std::string(NATIVE_DEFAULT_MATERIAL);
+  material.diffuse    = make_float3(0.0f);
+  material.hasDiffuse = 0;
+
+  setNativeModel(model, std::vector<NativeMaterial>(1, material));
+
+  return true;
+}
@@ -146,7 +146,7 @@ void Options::printUsage(std::string const& argv0)
     "   ? | help | --help       Print this usage message and exit.\n"
     "  -w | --width <int>       Width of the client window  (512) \n"
     "  -h | --height <int>      Height of the client window (512)\n"
-    "  -m | --mode <int>        0 = interactive, 1 == benchmark (0)\n"
+    "  -m | --mode <int>        0 = interactive, 1 == benchmark, 2 == host BVH benchmark, 3 == scene graph benchmark, 4 == parser benchmark, 5 == compile the scene into the cachePath (0)\n"
     "  -s | --system <filename> Filename for system options (empty).\n"
     "  -d | --desc   <filename> Filename for scene description (empty).\n"
   "App Keystrokes:\n"
@@ -29,26 +29,198 @@
 
 #include "inc/Parser.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+ParserToken::ParserToken()
+: data(nullptr)
+, size(0)
+{
+}
+
+std::string ParserToken::str() const
+{
+  return std::string(data, size);
+}
+
+void ParserToken::assign(std::string& dst) const
+{
+  dst.assign(data, size);
+}
+
+// Powers of ten which are exact in double precision.
+static const double s_powersOfTen[23] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Fast path for decimal numbers with up to 15 significant digits and small exponents, which covers everything in the scene descriptions.
+// The mantissa and the power of ten are exact doubles then, so the single correctly rounded multiply or divide is the strtod() result.
+// Everything else falls back to strtod() on a null terminated copy.
+float ParserToken::toFloat() const
+{
+  const char* p   = data;
+  const char* end = data + size;
+
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-'))
+  {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  unsigned long long mantissa = 0;
+  int  numDigits = 0; // Significant digits in the mantissa.
+  int  exponent  = 0;
+  bool hasDigits = false;
+
+  for (; p < end && '0' <= *p && *p <= '9'; ++p)
+  {
+    mantissa = mantissa * 10 + (*p - '0');
+    numDigits += (mantissa != 0) ? 1 : 0;
+    hasDigits = true;
+  }
+  if (p < end && *p == '.')
+  {
+    for (++p; p < end && '0' <= *p && *p <= '9'; ++p)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      numDigits += (mantissa != 0) ? 1 : 0;
+      --exponent;
+      hasDigits = true;
+    }
+  }
+  if (hasDigits && p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char* q = p + 1;
+
+    bool negativeExponent = false;
+    if (q < end && (*q == '+' || *q == '-'))
+    {
+      negativeExponent = (*q == '-');
+      ++q;
+    }
+    if (q < end && '0' <= *q && *q <= '9')
+    {
+      int e = 0;
+      for (; q < end && '0' <= *q && *q <= '9'; ++q)
+      {
+        e = (e < 10000) ? e * 10 + (*q - '0') : e;
+      }
+      exponent += (negativeExponent) ? -e : e;
+      p = q;
+    }
+  }
+
+  if (p == end && hasDigits && numDigits <= 15 && -22 <= exponent && exponent <= 22)
+  {
+    double value = static_cast<double>(mantissa);
+
+    value = (exponent < 0) ? value / s_powersOfTen[-exponent] : value * s_powersOfTen[exponent];
+
+    return static_cast<float>((negative) ? -value : value);
+  }
+
+  // Slow path with the exact atof() semantics.
+  char buffer[64];
+
+  if (size < sizeof(buffer))
+  {
+    memcpy(buffer, data, size);
+    buffer[size] = '\0';
+    return static_cast<float>(strtod(buffer, nullptr));
+  }
+  return static_cast<float>(strtod(str().c_str(), nullptr));
+}
+
+int ParserToken::toInt() const
+{
+  const char* p   = data;
+  const char* end = data + size;
+
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-'))
+  {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  long long value = 0;
+
+  for (; p < end && '0' <= *p && *p <= '9'; ++p)
+  {
+    value = value * 10 + (*p - '0');
+    if (value > 0x80000000ll)
+    {
+      return static_cast<int>(strtol(str().c_str(), nullptr, 10)); // Out of range, let atoi() semantics decide.
+    }
+  }
+  return static_cast<int>((negative) ? -value : value);
+}
+
+bool ParserToken::operator==(const char* rhs) const
+{
+  return strncmp(data, rhs, size) == 0 && rhs[size] == '\0';
+}
+
+bool ParserToken::operator!=(const char* rhs) const
+{
+  return !(*this == rhs);
+}
+
+std::ostream& operator<<(std::ostream& stream, ParserToken const& token)
+{
+  return stream.write(token.data, token.size);
+}
+
 
 Parser::Parser()
-: m_index(0)
+: m_data(nullptr)
+, m_size(0)
+, m_index(0)
 , m_line(1)
+, m_mapping(nullptr)
 {
 }
 
 Parser::~Parser()
 {
+  unmap();
 }
 
-bool Parser::load(std::string const& filename)
+bool Parser::load(std::string const& filename, const bool mapped)
 {
+  unmap();
   m_source.clear();
 
-  std::ifstream inputStream(filename);
+  m_data  = nullptr;
+  m_size  = 0;
+  m_index = 0;
+  m_line  = 1;
+
+  if (mapped && map(filename))
+  {
+    return true;
+  }
+
+  std::ifstream inputStream(filename, std::ios::binary);
   if (!inputStream)
   {
     std::cerr << "ERROR: Parser::load() failed to open file " << filename << std::endl;
@@ -66,49 +238,147 @@ bool Parser::load(std::string const& filename)
   }
 
   m_source = data.str();
+
+  m_data = m_source.data();
+  m_size = m_source.size();
+
   return true;
 }
 
-ParserTokenType Parser::getNextToken(std::string& token)
+// Returns false when the file can't be mapped. The caller falls back to reading it.
+bool Parser::map(std::string const& filename)
 {
-  const static std::string whitespace = " \t"; // space, tab
-  const static std::string value      = "+-0123456789.eE";
-  const static std::string delimiter  = " \t\r\n"; // space, tab, carriage return, linefeed
-  const static std::string newline    = "\n";
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
 
-  token.clear(); // Make sure the returned token starts empty.
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false; // Empty files can't be mapped.
+  }
 
-  ParserTokenType type = PTT_UNKNOWN; // This return value indicates an error.
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr)
+  {
+    return false;
+  }
+
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping); // The view keeps the mapping alive.
+  if (view == nullptr)
+  {
+    return false;
+  }
+
+  m_mapping = view;
+  m_size    = static_cast<size_t>(size.QuadPart);
+#else
+  const int file = open(filename.c_str(), O_RDONLY);
+  if (file < 0)
+  {
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size == 0)
+  {
+    close(file);
+    return false; // Empty files and pipes can't be mapped.
+  }
+
+  void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  close(file); // The mapping keeps the file open.
+  if (view == MAP_FAILED)
+  {
+    return false;
+  }
+
+  madvise(view, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+
+  m_mapping = view;
+  m_size    = static_cast<size_t>(status.st_size);
+#endif
+
+  m_data = static_cast<const char*>(m_mapping);
+  return true;
+}
+
+void Parser::unmap()
+{
+  if (m_mapping != nullptr)
+  {
+#if defined(_WIN32)
+    UnmapViewOfFile(m_mapping);
+#else
+    munmap(m_mapping, m_size);
+#endif
+    m_mapping = nullptr;
+    m_data    = nullptr;
+    m_size    = 0;
+  }
+}
+
+static inline bool isWhitespace(const char c)
+{
+  return c == ' ' || c == '\t'; // space, tab
+}
+
+static inline bool isDelimiter(const char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n'; // space, tab, carriage return, linefeed
+}
+
+static inline bool isValue(const char c)
+{
+  return ('0' <= c && c <= '9') || c == '+' || c == '-' || c == '.' || c == 'e' || c == 'E';
+}
+
+ParserTokenType Parser::getNextToken(ParserToken& token)
+{
+  token.data = m_data + m_index; // Make sure the returned token starts empty.
+  token.size = 0;
 
-  std::string::size_type first;
-  std::string::size_type last;
+  ParserTokenType type = PTT_UNKNOWN; // This return value indicates an error.
 
   bool done = false;
   while (!done)
   {
     // Find first character which is not a whitespace.
-    first = m_source.find_first_not_of(whitespace, m_index);
-    if (first == std::string::npos)
+    size_t first = m_index;
+    while (first < m_size && isWhitespace(m_data[first]))
+    {
+      ++first;
+    }
+    if (first == m_size)
     {
-      token = std::string();
+      m_index = m_size;
+      token.data = m_data + m_size;
       type = PTT_EOF;
       done = true;
       continue;
     }
 
     // The found character indicates how parsing continues.
-    char c = m_source[first];
+    const char c = m_data[first];
 
     if (c == '#') // comment until the next newline
     {
-      // m_index = first + 1; // skip '#' // Redundant.
-      first = m_source.find_first_of(newline, m_index); // Skip everything until the next newline.
-      if (first == std::string::npos)
+      const char* newline = static_cast<const char*>(memchr(m_data + first, '\n', m_size - first)); // Skip everything until the next newline.
+      if (newline == nullptr)
       {
+        m_index = m_size;
+        token.data = m_data + m_size;
         type = PTT_EOF;
         done = true;
+        continue;
       }
-      m_index = first + 1; // skip newline
+      m_index = (newline - m_data) + 1; // skip newline
       m_line++;
     }
     else if (c == '\r') // carriage return 13
@@ -122,23 +392,24 @@ ParserTokenType Parser::getNextToken(std::string& token)
     }
     else // anything else
     {
-      last = m_source.find_first_of(delimiter, first);
-      if (last == std::string::npos) 
-      { 
-        last = m_source.size();
+      size_t last = first;
+      bool isNumber = true;
+      while (last < m_size && !isDelimiter(m_data[last]))
+      {
+        isNumber = isNumber && isValue(m_data[last]);
+        ++last;
       }
       m_index = last;
-      token = m_source.substr(first, last - first);
+
+      token.data = m_data + first;
+      token.size = last - first;
+
       type = PTT_ID; // Default to general identifier.
       // Check if token is only built of characters used for numbers. 
       // (Not perfectly parsing a floating point number but good enough for most filenames.)
-      if (isdigit(c) || c == '-' || c == '+' || c == '.') // Legal start characters for a floating point number.
+      if (isNumber && (('0' <= c && c <= '9') || c == '-' || c == '+' || c == '.')) // Legal start characters for a floating point number.
       {
-        last = token.find_first_not_of(value, 0);
-        if (last == std::string::npos) 
-        { 
-          type = PTT_VAL;
-        }
+        type = PTT_VAL;
       }
       done = true;
     }
@@ -149,88 +420,89 @@ ParserTokenType Parser::getNextToken(std::string& token)
 
 // Get the rest of the line, including whitespaces in strings, but pruning the trailing ones before the EOL or EOF.
 // This is used to handle file paths with whitespaces and no quotation marks.
-ParserTokenType Parser::getNextLine(std::string& token)
+ParserTokenType Parser::getNextLine(ParserToken& token)
 {
-  const static std::string whitespace = " \t"; // space, tab
-  const static std::string delimiter  = "\r\n"; // carriage return, linefeed
-
-  token.clear();               // Make sure the returned token starts empty.
-  ParserTokenType type = PTT_UNKNOWN; // This return value indicates an error.
+  // Find first character which is not a whitespace.
+  size_t first = m_index;
+  while (first < m_size && isWhitespace(m_data[first]))
+  {
+    ++first;
+  }
 
-  std::string::size_type first;
-  std::string::size_type last;
+  token.data = m_data + first; // Make sure the returned token starts empty.
+  token.size = 0;
 
-  bool done = false;
-  while (!done)
+  if (first == m_size)
   {
-    // Find first character which is not a whitespace.
-    first = m_source.find_first_not_of(whitespace, m_index);
-    if (first == std::string::npos)
-    {
-      token.clear();
-      type = PTT_EOF;
-      done = true;
-      continue;
-    }
+    m_index = m_size;
+    return PTT_EOF;
+  }
 
-    // The found character indicates how parsing continues.
-    const char c = m_source[first];
+  // The found character indicates how parsing continues.
+  const char c = m_data[first];
 
-    // If it's a carriage return or linefeed, the line ended and the token stays empty.
-    if (c == '\r') // carriage return 13
-    {
-      m_index = first + 1;
-      type = PTT_EOL; // Token is empty.
-      done = true;
-    }
-    else if (c == '\n') // newline (linefeed 10)
-    {
-      m_index = first + 1;
-      m_line++;
-      type = PTT_EOL; // Token is empty.
-      done = true;
-    }
-    else // anything else
-    {
-      last = m_source.find_first_of(delimiter, first);
-      if (last == std::string::npos) 
-      { 
-        last = m_source.size();
-      }
- 
-      m_index = last; // Skip the filename for the next scan.
-
-      // Prune whitespace at the end of the filename.
-      while ((first < last) && (m_source[last - 1] == ' '  || 
-                                m_source[last - 1] == '\t' || 
-                                m_source[last - 1] == '\r' ||
-                                m_source[last - 1] == '\n'))
-      {
-        --last;
-      }
+  // If it's a carriage return or linefeed, the line ended and the token stays empty.
+  if (c == '\r') // carriage return 13
+  {
+    m_index = first + 1;
+    return PTT_EOL; // Token is empty.
+  }
+  if (c == '\n') // newline (linefeed 10)
+  {
+    m_index = first + 1;
+    m_line++;
+    return PTT_EOL; // Token is empty.
+  }
 
-      // Empty filename!
-      if (first == last)
-      {
-        token.clear();
-        return PTT_EOL;
-      }
+  size_t last = first;
+  while (last < m_size && m_data[last] != '\r' && m_data[last] != '\n')
+  {
+    ++last;
+  }
 
-      token = m_source.substr(first, last - first); // Get the filename.
-      type = PTT_ID;
-      done = true;
-    }
+  m_index = last; // Skip the filename for the next scan.
+
+  // Prune whitespace at the end of the filename.
+  while ((first < last) && isWhitespace(m_data[last - 1]))
+  {
+    --last;
   }
 
+  token.size = last - first; // Get the filename.
+  return PTT_ID;
+}
+
+ParserTokenType Parser::getNextToken(std::string& token)
+{
+  ParserToken view;
+
+  const ParserTokenType type = getNextToken(view);
+
+  view.assign(token);
+  return type;
+}
+
+ParserTokenType Parser::getNextLine(std::string& token)
+{
+  ParserToken view;
+
+  const ParserTokenType type = getNextLine(view);
+
+  view.assign(token);
   return type;
 }
 
-std::string::size_type Parser::getSize() const
+const char* Parser::getData() const
 {
-  return m_source.size();
+  return m_data;
 }
 
-std::string::size_type Parser::getIndex() const
+size_t Parser::getSize() const
+{
+  return m_size;
+}
+
+size_t Parser::getIndex() const
 {
   return m_index;
 }
@@ -239,6 +511,3 @@ unsigned int Parser::getLine() const
 {
   return m_line;
 }
-
-
-
@@ -50,6 +50,11 @@ Raytracer::Raytracer(RendererStrategy strategy,
 , m_iterationIndex(0)
 , m_samplesPerPixel(1)
 {
+  if (m_strategy == RS_CPU_MULTICORE)
+  {
+    return; // Host rendering, don't require a CUDA driver. m_visibleDevices stays 0.
+  }
+
   CU_CHECK( cuInit(0) ); // Initialize CUDA driver API.
 
   int versionDriver = 0;
@@ -309,12 +314,22 @@ void Raytracer::initMaterials(std::vector<MaterialGUI> const& materialsGUI)
   }
 }
 
+void Raytracer::setGeometryFormat(const GeometryFormat format)
+{
+  for (size_t i = 0; i < m_activeDevices.size(); ++i)
+  {
+    m_activeDevices[i]->setGeometryFormat(format);
+  }
+}
+
 // Traverse the SceneGraph and store Groups, Instances and Triangles nodes in the raytracer representation.
-void Raytracer::initScene(std::shared_ptr<sg::Group> root, const unsigned int numGeometries)
+void Raytracer::initScene(sg::Scene& scene, const sg::NodeHandle root, const unsigned int numGeometries)
 {
+  m_instanceTable.build(scene, root);
+
   for (size_t i = 0; i < m_activeDevices.size(); ++i)
   {
-    m_activeDevices[i]->initScene(root, numGeometries);
+    m_activeDevices[i]->initScene(m_instanceTable, numGeometries);
   }
 }
 
@@ -355,6 +370,20 @@ void Raytracer::updateMaterial(const int idMaterial, MaterialGUI const& material
   m_iterationIndex = 0; // Restart accumulation.
 }
 
+void Raytracer::updateInstances()
+{
+  if (m_instanceTable.update() == sg::DIRTY_NONE)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < m_activeDevices.size(); ++i)
+  {
+    m_activeDevices[i]->updateInstances(m_instanceTable);
+  }
+  m_iterationIndex = 0; // Restart accumulation.
+}
+
 void Raytracer::updateState(DeviceState const& state)
 {
   m_samplesPerPixel = (unsigned int)(state.samplesSqrt * state.samplesSqrt);
@@ -365,3 +394,11 @@ void Raytracer::updateState(DeviceState const& state)
   }
   m_iterationIndex = 0; // Restart accumulation.
 }
+
+void Raytracer::getMemoryStatistics(std::vector<DeviceMemoryStatistics>& devices) const
+{
+  for (size_t i = 0; i < m_activeDevices.size(); ++i)
+  {
+    devices.push_back(m_activeDevices[i]->getMemoryStatistics());
+  }
+}
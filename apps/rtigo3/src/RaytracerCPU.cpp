@@ -0,0 +1,171 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/RaytracerCPU.h"
+
+#include <iostream>
+
+RaytracerCPU::RaytracerCPU(const int numThreads,
+                           const int miss,
+                           const int interop,
+                           const unsigned int tex,
+                           const unsigned int pbo,
+                           std::string const& cachePath,
+                           const bool compressedNodes,
+                           const int builder)
+: Raytracer(RS_CPU_MULTICORE, interop, tex, pbo)
+, m_device(nullptr)
+{
+  m_device = new DeviceCPU(numThreads, miss, tex);
+  m_device->setCachePath(cachePath);
+  m_device->setNodeFormat((compressedNodes) ? BVH8_NODES_COMPRESSED : BVH8_NODES_FULL);
+  m_device->setBuildMethod((builder != 0) ? BVH_BUILD_LBVH : BVH_BUILD_SAH, (builder == 2));
+
+  std::cout << "RaytracerCPU() Using " << m_device->getNumThreads() << " host threads" << std::endl;
+
+  m_isValid = true;
+}
+
+RaytracerCPU::~RaytracerCPU()
+{
+  delete m_device;
+}
+
+
+// HACK Hardcocded textures.
+void RaytracerCPU::initTextures(std::map<std::string, Picture*> const& mapOfPictures)
+{
+  m_device->initTextures(mapOfPictures);
+}
+
+void RaytracerCPU::initCameras(std::vector<CameraDefinition> const& cameras)
+{
+  m_device->initCameras(cameras);
+}
+
+void RaytracerCPU::initLights(std::vector<LightDefinition> const& lights)
+{
+  m_device->initLights(lights);
+}
+
+void RaytracerCPU::initMaterials(std::vector<MaterialGUI> const& materialsGUI)
+{
+  m_device->initMaterials(materialsGUI);
+}
+
+void RaytracerCPU::setGeometryFormat(const GeometryFormat format)
+{
+  m_device->setGeometryFormat(format);
+}
+
+void RaytracerCPU::initScene(sg::Scene& scene, const sg::NodeHandle root, const unsigned int numGeometries)
+{
+  m_instanceTable.build(scene, root);
+
+  m_device->initScene(m_instanceTable, numGeometries);
+}
+
+void RaytracerCPU::initState(DeviceState const& state)
+{
+  m_samplesPerPixel = (unsigned int)(state.samplesSqrt * state.samplesSqrt);
+
+  m_device->setState(state);
+}
+
+
+void RaytracerCPU::updateCamera(const int idCamera, CameraDefinition const& camera)
+{
+  m_device->updateCamera(idCamera, camera);
+
+  m_iterationIndex = 0; // Restart accumulation.
+}
+
+void RaytracerCPU::updateLight(const int idLight, LightDefinition const& light)
+{
+  m_device->updateLight(idLight, light);
+
+  m_iterationIndex = 0; // Restart accumulation.
+}
+
+void RaytracerCPU::updateMaterial(const int idMaterial, MaterialGUI const& src)
+{
+  m_device->updateMaterial(idMaterial, src);
+
+  m_iterationIndex = 0; // Restart accumulation.
+}
+
+void RaytracerCPU::updateInstances()
+{
+  if (m_instanceTable.update() == sg::DIRTY_NONE)
+  {
+    return;
+  }
+
+  m_device->updateInstances(m_instanceTable);
+
+  m_iterationIndex = 0; // Restart accumulation.
+}
+
+void RaytracerCPU::updateState(DeviceState const& state)
+{
+  m_samplesPerPixel = (unsigned int)(state.samplesSqrt * state.samplesSqrt);
+
+  m_device->setState(state);
+
+  m_iterationIndex = 0; // Restart accumulation.
+}
+
+void RaytracerCPU::getMemoryStatistics(std::vector<DeviceMemoryStatistics>& devices) const
+{
+  devices.push_back(m_device->getMemoryStatistics());
+}
+
+
+// Returns the count of renderered iterations (m_iterationIndex after it has been incremented).
+unsigned int RaytracerCPU::render()
+{
+  // Continue manual accumulation rendering if the samples per pixel have not been reached.
+  if (m_iterationIndex < m_samplesPerPixel)
+  {
+    m_device->render(m_iterationIndex); // Synchronous, returns when all host threads have finished the iteration.
+
+    ++m_iterationIndex;
+  }  
+
+  return m_iterationIndex;
+}
+
+void RaytracerCPU::updateDisplayTexture()
+{
+  m_device->updateDisplayTexture();
+}
+
+const void* RaytracerCPU::getOutputBufferHost()
+{
+  return m_device->getOutputBufferHost();
+}
@@ -0,0 +1,666 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/Application.h"
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "inc/MyAssert.h"
+
+
+// Compiled scene descriptions. One cache entry holds the complete host scene after loadSceneDescription():
+// Blob 0 the SceneCacheInfo, blob 1 all names, blob 2 the SceneCacheDependency of the scene file and the models,
+// blob 3 the SceneCacheMaterial, blob 4 the SceneCacheReference, blob 5 the LightDefinition,
+// blob 6 the SceneCacheGeometry in m_geometries then m_primitives order, blob 7 the SceneCacheGroup, blob 8 the group children,
+// blob 9 the SceneCacheInstance, blob 10 the SceneCacheArray and blob 11 the array transforms.
+// The attributes and indices blobs of each Triangles in m_geometries follow.
+#define SCENE_CACHE_FIRST_GEOMETRY 12
+
+struct SceneCacheInfo
+{
+  sg::NodeHandle root;
+  unsigned int   numGeometries; // m_idGeometry
+};
+
+struct SceneCacheDependency
+{
+  unsigned int       offsetName;
+  unsigned int       lengthName;
+  unsigned long long size;
+  long long          mtime;
+};
+
+struct SceneCacheMaterial
+{
+  int          indexBSDF; // FunctionIndex
+  float3       albedo;
+  float3       absorptionColor;
+  float        absorptionScale;
+  float        ior;
+  unsigned int thinwalled;
+  unsigned int useAlbedoTexture;
+  unsigned int useCutoutTexture;
+  float2       roughness;
+  unsigned int offsetName;
+  unsigned int lengthName;
+};
+
+struct SceneCacheReference
+{
+  int          material;
+  unsigned int offsetName;
+  unsigned int lengthName;
+};
+
+struct SceneCacheGeometry
+{
+  unsigned int        id;
+  unsigned int        type; // NT_TRIANGLES or NT_PRIMITIVE
+  float               spatialSplitAlpha;
+  PrimitiveDefinition definition; // NT_PRIMITIVE only.
+};
+
+struct SceneCacheGroup
+{
+  unsigned int first; // Into the children blob.
+  unsigned int count;
+};
+
+struct SceneCacheInstance
+{
+  float          matrix[12];
+  int            material;
+  int            light;
+  sg::NodeHandle child;
+};
+
+struct SceneCacheArray
+{
+  unsigned int   first; // Into the array transforms, in units of 12 floats.
+  unsigned int   count;
+  sg::NodeHandle geometry;
+};
+
+
+// Size and modification time of a file. Returns false when the file does not exist.
+static bool getFileStatus(std::string const& filename, unsigned long long& size, long long& mtime)
+{
+  struct stat status;
+
+  if (stat(filename.c_str(), &status) != 0)
+  {
+    return false;
+  }
+
+  size  = static_cast<unsigned long long>(status.st_size);
+  mtime = static_cast<long long>(status.st_mtime);
+
+  return true;
+}
+
+static bool isValidName(const unsigned int offset, const unsigned int length, const size_t sizeNames)
+{
+  return offset <= sizeNames && length <= sizeNames - offset;
+}
+
+// The group hierarchy below the group must not contain itself.
+static bool isAcyclic(const unsigned int group,
+                      const SceneCacheGroup* groups, const sg::NodeHandle* children, const SceneCacheInstance* instances,
+                      std::vector<unsigned char>& state)
+{
+  if (state[group] != 0)
+  {
+    return state[group] == 2; // 1 means the group is on the current path.
+  }
+
+  state[group] = 1;
+
+  for (unsigned int i = 0; i < groups[group].count; ++i)
+  {
+    const sg::NodeHandle child = instances[sg::getHandleIndex(children[groups[group].first + i])].child;
+
+    if (sg::getHandleType(child) == sg::NT_GROUP && !isAcyclic(sg::getHandleIndex(child), groups, children, instances, state))
+    {
+      return false;
+    }
+  }
+
+  state[group] = 2;
+
+  return true;
+}
+
+
+// Loads the compiled scene from the geometry cache when it is up to date. Otherwise parses the scene description and compiles it.
+bool Application::loadScene(std::string const& filename)
+{
+  unsigned long long key = 0;
+
+  const bool isKeyValid = m_geometryCache.isEnabled() && getSceneKey(filename, key);
+
+  if (isKeyValid && m_mode != 5 && loadSceneCache(key))
+  {
+    std::cout << "loadScene() " << filename << " from compiled scene " << std::hex << key << std::dec << std::endl;
+    return true;
+  }
+
+  if (m_mode == 5 && !isKeyValid)
+  {
+    std::cerr << "ERROR: loadScene() compiling " << filename << " needs the cachePath" << std::endl;
+    return false;
+  }
+
+  m_sceneDependencies.clear();
+  m_sceneDependencies.push_back(filename);
+
+  if (!loadSceneDescription(filename))
+  {
+    return false;
+  }
+
+  // The scene compiler fails when nothing was stored. The other modes only lose the faster load next time.
+  if (isKeyValid && !storeSceneCache(key) && m_mode == 5)
+  {
+    std::cerr << "ERROR: loadScene() failed to store the compiled scene " << filename << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// The scene file contents and all system options which change the generated scene.
+// The models referenced by the scene are checked by size and modification time in loadSceneCache().
+bool Application::getSceneKey(std::string const& filename, unsigned long long& key) const
+{
+  key = GeometryCache::hash("scene", 5);
+  key = GeometryCache::hashValue(m_miss, key);
+  key = GeometryCache::hashValue(m_light, key);
+  key = GeometryCache::hashValue(getMeshOptimizerVersion(), key);
+  key = GeometryCache::hashValue(m_tessellationLod, key);
+
+  if (0.0f < m_tessellationLod) // The tessellation level-of-detail depends on the initial camera.
+  {
+    key = GeometryCache::hashValue(m_triangleBudget, key);
+    key = GeometryCache::hashValue(m_resolution, key);
+    key = GeometryCache::hash(&m_cameras[0], sizeof(CameraDefinition), key);
+  }
+
+  return GeometryCache::hashFile(filename, key);
+}
+
+bool Application::loadSceneCache(const unsigned long long key)
+{
+  std::shared_ptr<CacheFile> file = m_geometryCache.load(key);
+  if (!file || file->getNumBlobs() < SCENE_CACHE_FIRST_GEOMETRY || (file->getNumBlobs() - SCENE_CACHE_FIRST_GEOMETRY) % 2 != 0)
+  {
+    return false;
+  }
+
+  size_t sizeInfo;
+  size_t sizeNames;
+  size_t sizeDependencies;
+  size_t sizeMaterials;
+  size_t sizeReferences;
+  size_t sizeLights;
+  size_t sizeGeometries;
+  size_t sizeGroups;
+  size_t sizeChildren;
+  size_t sizeInstances;
+  size_t sizeArrays;
+  size_t sizeMatrices;
+
+  const SceneCacheInfo*       info         = static_cast<const SceneCacheInfo*>(file->getBlob(0, sizeInfo));
+  const char*                 names        = static_cast<const char*>(file->getBlob(1, sizeNames));
+  const SceneCacheDependency* dependencies = static_cast<const SceneCacheDependency*>(file->getBlob(2, sizeDependencies));
+  const SceneCacheMaterial*   materials    = static_cast<const SceneCacheMaterial*>(file->getBlob(3, sizeMaterials));
+  const SceneCacheReference*  references   = static_cast<const SceneCacheReference*>(file->getBlob(4, sizeReferences));
+  const LightDefinition*      lights       = static_cast<const LightDefinition*>(file->getBlob(5, sizeLights));
+  const SceneCacheGeometry*   geometries   = static_cast<const SceneCacheGeometry*>(file->getBlob(6, sizeGeometries));
+  const SceneCacheGroup*      groups       = static_cast<const SceneCacheGroup*>(file->getBlob(7, sizeGroups));
+  const sg::NodeHandle*       children     = static_cast<const sg::NodeHandle*>(file->getBlob(8, sizeChildren));
+  const SceneCacheInstance*   instances    = static_cast<const SceneCacheInstance*>(file->getBlob(9, sizeInstances));
+  const SceneCacheArray*      arrays       = static_cast<const SceneCacheArray*>(file->getBlob(10, sizeArrays));
+  const float*                matrices     = static_cast<const float*>(file->getBlob(11, sizeMatrices));
+
+  const unsigned int numDependencies = static_cast<unsigned int>(sizeDependencies / sizeof(SceneCacheDependency));
+  const unsigned int numMaterials    = static_cast<unsigned int>(sizeMaterials / sizeof(SceneCacheMaterial));
+  const unsigned int numReferences   = static_cast<unsigned int>(sizeReferences / sizeof(SceneCacheReference));
+  const unsigned int numLights       = static_cast<unsigned int>(sizeLights / sizeof(LightDefinition));
+  const unsigned int numGeometries   = static_cast<unsigned int>(sizeGeometries / sizeof(SceneCacheGeometry));
+  const unsigned int numGroups       = static_cast<unsigned int>(sizeGroups / sizeof(SceneCacheGroup));
+  const unsigned int numChildren     = static_cast<unsigned int>(sizeChildren / sizeof(sg::NodeHandle));
+  const unsigned int numInstances    = static_cast<unsigned int>(sizeInstances / sizeof(SceneCacheInstance));
+  const unsigned int numArrays       = static_cast<unsigned int>(sizeArrays / sizeof(SceneCacheArray));
+  const size_t       numMatrices     = sizeMatrices / (12 * sizeof(float));
+  const unsigned int numTriangles    = (file->getNumBlobs() - SCENE_CACHE_FIRST_GEOMETRY) / 2;
+
+  // Validate all indices before the current scene is replaced.
+  bool isValid = (info != nullptr && sizeInfo == sizeof(SceneCacheInfo) &&
+                  sizeDependencies % sizeof(SceneCacheDependency) == 0 &&
+                  sizeMaterials    % sizeof(SceneCacheMaterial)   == 0 &&
+                  sizeReferences   % sizeof(SceneCacheReference)  == 0 &&
+                  sizeLights       % sizeof(LightDefinition)      == 0 &&
+                  sizeGeometries   % sizeof(SceneCacheGeometry)   == 0 &&
+                  sizeGroups       % sizeof(SceneCacheGroup)      == 0 &&
+                  sizeChildren     % sizeof(sg::NodeHandle)       == 0 &&
+                  sizeInstances    % sizeof(SceneCacheInstance)   == 0 &&
+                  sizeArrays       % sizeof(SceneCacheArray)      == 0 &&
+                  sizeMatrices     % (12 * sizeof(float))         == 0 &&
+                  numGeometries == info->numGeometries && numGeometries <= SG_HANDLE_INDEX_MASK);
+
+  for (unsigned int i = 0; isValid && i < numDependencies; ++i)
+  {
+    isValid = isValidName(dependencies[i].offsetName, dependencies[i].lengthName, sizeNames);
+  }
+  for (unsigned int i = 0; isValid && i < numMaterials; ++i)
+  {
+    isValid = isValidName(materials[i].offsetName, materials[i].lengthName, sizeNames);
+  }
+  for (unsigned int i = 0; isValid && i < numReferences; ++i)
+  {
+    isValid = isValidName(references[i].offsetName, references[i].lengthName, sizeNames) && references[i].material < int(numMaterials);
+  }
+
+  // Geometry IDs are unique and dense. The Triangles come first in the same order as their blobs.
+  std::vector<unsigned char> types(numGeometries, 0xFF);
+
+  for (unsigned int i = 0; isValid && i < numGeometries; ++i)
+  {
+    SceneCacheGeometry const& geometry = geometries[i];
+
+    isValid = geometry.id < numGeometries && types[geometry.id] == 0xFF &&
+              geometry.type == ((i < numTriangles) ? sg::NT_TRIANGLES : sg::NT_PRIMITIVE);
+    if (isValid)
+    {
+      types[geometry.id] = static_cast<unsigned char>(geometry.type);
+    }
+  }
+  isValid = isValid && numTriangles <= numGeometries;
+
+  for (unsigned int i = 0; isValid && i < numGroups; ++i)
+  {
+    isValid = groups[i].first <= numChildren && groups[i].count <= numChildren - groups[i].first;
+  }
+  for (unsigned int i = 0; isValid && i < numChildren; ++i)
+  {
+    isValid = sg::getHandleType(children[i]) == sg::NT_INSTANCE && sg::getHandleIndex(children[i]) < numInstances;
+  }
+  for (unsigned int i = 0; isValid && i < numArrays; ++i)
+  {
+    const sg::NodeHandle geometry = arrays[i].geometry;
+
+    isValid = arrays[i].first <= numMatrices && arrays[i].count <= numMatrices - arrays[i].first &&
+              sg::getHandleIndex(geometry) < numGeometries && types[sg::getHandleIndex(geometry)] == sg::getHandleType(geometry);
+  }
+  for (unsigned int i = 0; isValid && i < numInstances; ++i)
+  {
+    SceneCacheInstance const& instance = instances[i];
+
+    const sg::NodeType type  = sg::getHandleType(instance.child);
+    const unsigned int index = sg::getHandleIndex(instance.child);
+
+    isValid = -1 <= instance.material && instance.material < int(numMaterials) &&
+              -1 <= instance.light    && instance.light    < int(numLights);
+
+    if (type == sg::NT_GROUP)
+    {
+      isValid = isValid && index < numGroups;
+    }
+    else if (type == sg::NT_INSTANCE_ARRAY)
+    {
+      isValid = isValid && index < numArrays;
+    }
+    else if (type == sg::NT_TRIANGLES || type == sg::NT_PRIMITIVE)
+    {
+      isValid = isValid && index < numGeometries && types[index] == type;
+    }
+    else
+    {
+      isValid = isValid && instance.child == SG_HANDLE_INVALID; // Instance without child.
+    }
+  }
+
+  std::vector<unsigned char> state(numGroups, 0);
+
+  isValid = isValid && sg::getHandleType(info->root) == sg::NT_GROUP && sg::getHandleIndex(info->root) < numGroups;
+
+  for (unsigned int i = 0; isValid && i < numGroups; ++i)
+  {
+    isValid = isAcyclic(i, groups, children, instances, state);
+  }
+
+  if (!isValid)
+  {
+    std::cerr << "ERROR: loadSceneCache() invalid cache entry " << std::hex << key << std::dec << std::endl;
+    return false;
+  }
+
+  // The scene file and the models must be unchanged since the compilation.
+  for (unsigned int i = 0; i < numDependencies; ++i)
+  {
+    SceneCacheDependency const& dependency = dependencies[i];
+
+    const std::string filename(names + dependency.offsetName, dependency.lengthName);
+
+    unsigned long long size;
+    long long          mtime;
+
+    if (!getFileStatus(filename, size, mtime) || size != dependency.size || mtime != dependency.mtime)
+    {
+      std::cout << "loadSceneCache() " << filename << " changed, recompiling the scene" << std::endl;
+      return false;
+    }
+  }
+
+  std::vector< std::shared_ptr<sg::Triangles> > triangles(numTriangles);
+
+  for (unsigned int i = 0; i < numTriangles; ++i)
+  {
+    triangles[i] = std::make_shared<sg::Triangles>(geometries[i].id);
+
+    if (!loadTriangles(*file, SCENE_CACHE_FIRST_GEOMETRY + i * 2, triangles[i]))
+    {
+      std::cerr << "ERROR: loadSceneCache() invalid geometry in cache entry " << std::hex << key << std::dec << std::endl;
+      return false;
+    }
+    triangles[i]->setSpatialSplitAlpha(geometries[i].spatialSplitAlpha);
+  }
+
+  // Replace everything createLights() and loadSceneDescription() generated.
+  m_scene.clear();
+
+  m_geometries = triangles;
+  m_primitives.clear();
+
+  for (unsigned int i = numTriangles; i < numGeometries; ++i)
+  {
+    std::shared_ptr<sg::Primitive> primitive(new sg::Primitive(geometries[i].id));
+    primitive->setDefinition(geometries[i].definition);
+
+    m_primitives.push_back(primitive);
+  }
+
+  m_idGeometry = numGeometries;
+
+  m_mapGeometries.clear();
+  m_mapPrimitives.clear();
+  m_mapGroups.clear();
+
+  m_lights.assign(lights, lights + numLights);
+
+  m_materialsGUI.resize(numMaterials);
+
+  for (unsigned int i = 0; i < numMaterials; ++i)
+  {
+    SceneCacheMaterial const& src = materials[i];
+    MaterialGUI&              dst = m_materialsGUI[i];
+
+    dst.name             = std::string(names + src.offsetName, src.lengthName);
+    dst.indexBSDF        = static_cast<FunctionIndex>(src.indexBSDF);
+    dst.albedo           = src.albedo;
+    dst.absorptionColor  = src.absorptionColor;
+    dst.absorptionScale  = src.absorptionScale;
+    dst.ior              = src.ior;
+    dst.thinwalled       = (src.thinwalled != 0);
+    dst.useAlbedoTexture = (src.useAlbedoTexture != 0);
+    dst.useCutoutTexture = (src.useCutoutTexture != 0);
+    dst.roughness        = src.roughness;
+  }
+
+  m_mapMaterialReferences.clear();
+
+  for (unsigned int i = 0; i < numReferences; ++i)
+  {
+    m_mapMaterialReferences[std::string(names + references[i].offsetName, references[i].lengthName)] = references[i].material;
+  }
+
+  // Same node indices as in the compiled scene, so that the stored handles stay valid.
+  m_scene.reserve(numGroups, numInstances, numChildren);
+
+  for (unsigned int i = 0; i < m_geometries.size(); ++i)
+  {
+    m_scene.addTriangles(m_geometries[i]);
+  }
+  for (unsigned int i = 0; i < m_primitives.size(); ++i)
+  {
+    m_scene.addPrimitive(m_primitives[i]);
+  }
+  for (unsigned int i = 0; i < numGroups; ++i)
+  {
+    m_scene.createGroup();
+  }
+  for (unsigned int i = 0; i < numArrays; ++i)
+  {
+    m_scene.createInstanceArray(arrays[i].geometry, matrices + size_t(arrays[i].first) * 12, arrays[i].count);
+  }
+  for (unsigned int i = 0; i < numInstances; ++i)
+  {
+    SceneCacheInstance const& src = instances[i];
+
+    const sg::NodeHandle instance = m_scene.createInstance();
+
+    m_scene.setTransform(instance, src.matrix);
+    if (src.child != SG_HANDLE_INVALID)
+    {
+      m_scene.setChild(instance, src.child);
+    }
+    m_scene.setMaterial(instance, src.material);
+    m_scene.setLight(instance, src.light);
+  }
+  for (unsigned int i = 0; i < numGroups; ++i)
+  {
+    const sg::NodeHandle group = sg::makeHandle(sg::NT_GROUP, i);
+
+    for (unsigned int j = 0; j < groups[i].count; ++j)
+    {
+      m_scene.addChild(group, children[groups[i].first + j]);
+    }
+  }
+
+  m_root = info->root;
+
+  return true;
+}
+
+bool Application::storeSceneCache(const unsigned long long key)
+{
+  std::string names;
+
+  std::vector<SceneCacheDependency> dependencies;
+
+  for (size_t i = 0; i < m_sceneDependencies.size(); ++i)
+  {
+    SceneCacheDependency dependency;
+
+    if (!getFileStatus(m_sceneDependencies[i], dependency.size, dependency.mtime))
+    {
+      continue; // Missing models are not cached. They fail again when the scene is compiled again.
+    }
+
+    dependency.offsetName = static_cast<unsigned int>(names.size());
+    dependency.lengthName = static_cast<unsigned int>(m_sceneDependencies[i].size());
+
+    names += m_sceneDependencies[i];
+
+    dependencies.push_back(dependency);
+  }
+
+  std::vector<SceneCacheMaterial> materials(m_materialsGUI.size());
+
+  for (size_t i = 0; i < m_materialsGUI.size(); ++i)
+  {
+    MaterialGUI const&  src = m_materialsGUI[i];
+    SceneCacheMaterial& dst = materials[i];
+
+    memset(&dst, 0, sizeof(SceneCacheMaterial)); // No uninitialized padding in the file.
+
+    dst.indexBSDF        = static_cast<int>(src.indexBSDF);
+    dst.albedo           = src.albedo;
+    dst.absorptionColor  = src.absorptionColor;
+    dst.absorptionScale  = src.absorptionScale;
+    dst.ior              = src.ior;
+    dst.thinwalled       = (src.thinwalled) ? 1 : 0;
+    dst.useAlbedoTexture = (src.useAlbedoTexture) ? 1 : 0;
+    dst.useCutoutTexture = (src.useCutoutTexture) ? 1 : 0;
+    dst.roughness        = src.roughness;
+    dst.offsetName       = static_cast<unsigned int>(names.size());
+    dst.lengthName       = static_cast<unsigned int>(src.name.size());
+
+    names += src.name;
+  }
+
+  std::vector<SceneCacheReference> references;
+
+  for (std::map<std::string, int>::const_iterator it = m_mapMaterialReferences.begin(); it != m_mapMaterialReferences.end(); ++it)
+  {
+    SceneCacheReference reference;
+
+    reference.material   = it->second;
+    reference.offsetName = static_cast<unsigned int>(names.size());
+    reference.lengthName = static_cast<unsigned int>(it->first.size());
+
+    names += it->first;
+
+    references.push_back(reference);
+  }
+
+  std::vector<SceneCacheGeometry> geometries(m_geometries.size() + m_primitives.size());
+
+  memset(geometries.data(), 0, geometries.size() * sizeof(SceneCacheGeometry));
+
+  for (size_t i = 0; i < m_geometries.size(); ++i)
+  {
+    geometries[i].id                = m_geometries[i]->getId();
+    geometries[i].type              = sg::NT_TRIANGLES;
+    geometries[i].spatialSplitAlpha = m_geometries[i]->getSpatialSplitAlpha();
+  }
+  for (size_t i = 0; i < m_primitives.size(); ++i)
+  {
+    SceneCacheGeometry& geometry = geometries[m_geometries.size() + i];
+
+    geometry.id         = m_primitives[i]->getId();
+    geometry.type       = sg::NT_PRIMITIVE;
+    geometry.definition = m_primitives[i]->getDefinition();
+  }
+
+  // Only the used child ranges. The addChild() reallocations leave unused slots behind.
+  std::vector<SceneCacheGroup> groups(m_scene.getNumGroups());
+  std::vector<sg::NodeHandle>  children;
+
+  for (unsigned int i = 0; i < m_scene.getNumGroups(); ++i)
+  {
+    const sg::NodeHandle group = sg::makeHandle(sg::NT_GROUP, i);
+
+    const unsigned int count = m_scene.getNumChildren(group);
+    const sg::NodeHandle* first = m_scene.getChildren(group);
+
+    groups[i].first = static_cast<unsigned int>(children.size());
+    groups[i].count = count;
+
+    children.insert(children.end(), first, first + count);
+  }
+
+  std::vector<SceneCacheInstance> instances(m_scene.getNumInstances());
+
+  for (unsigned int i = 0; i < m_scene.getNumInstances(); ++i)
+  {
+    const sg::NodeHandle instance = sg::makeHandle(sg::NT_INSTANCE, i);
+
+    memcpy(instances[i].matrix, m_scene.getTransform(instance), 12 * sizeof(float));
+
+    instances[i].material = m_scene.getMaterial(instance);
+    instances[i].light    = m_scene.getLight(instance);
+    instances[i].child    = m_scene.getChild(instance);
+  }
+
+  std::vector<SceneCacheArray> arrays(m_scene.getNumInstanceArrays());
+  std::vector<float>           matrices;
+
+  for (unsigned int i = 0; i < m_scene.getNumInstanceArrays(); ++i)
+  {
+    const sg::NodeHandle array = sg::makeHandle(sg::NT_INSTANCE_ARRAY, i);
+
+    const unsigned int count = m_scene.getArraySize(array);
+    const float* transforms  = m_scene.getArrayTransforms(array);
+
+    arrays[i].first    = static_cast<unsigned int>(matrices.size() / 12);
+    arrays[i].count    = count;
+    arrays[i].geometry = m_scene.getArrayGeometry(array);
+
+    matrices.insert(matrices.end(), transforms, transforms + size_t(count) * 12);
+  }
+
+  SceneCacheInfo info;
+
+  info.root          = m_root;
+  info.numGeometries = m_idGeometry;
+
+  std::vector<CacheBlob> blobs(SCENE_CACHE_FIRST_GEOMETRY);
+
+  blobs[ 0].data = &info;
+  blobs[ 0].size = sizeof(SceneCacheInfo);
+  blobs[ 1].data = names.data();
+  blobs[ 1].size = names.size();
+  blobs[ 2].data = dependencies.data();
+  blobs[ 2].size = dependencies.size() * sizeof(SceneCacheDependency);
+  blobs[ 3].data = materials.data();
+  blobs[ 3].size = materials.size() * sizeof(SceneCacheMaterial);
+  blobs[ 4].data = references.data();
+  blobs[ 4].size = references.size() * sizeof(SceneCacheReference);
+  blobs[ 5].data = m_lights.data();
+  blobs[ 5].size = m_lights.size() * sizeof(LightDefinition);
+  blobs[ 6].data = geometries.data();
+  blobs[ 6].size = geometries.size() * sizeof(SceneCacheGeometry);
+  blobs[ 7].data = groups.data();
+  blobs[ 7].size = groups.size() * sizeof(SceneCacheGroup);
+  blobs[ 8].data = children.data();
+  blobs[ 8].size = children.size() * sizeof(sg::NodeHandle);
+  blobs[ 9].data = instances.data();
+  blobs[ 9].size = instances.size() * sizeof(SceneCacheInstance);
+  blobs[10].data = arrays.data();
+  blobs[10].size = arrays.size() * sizeof(SceneCacheArray);
+  blobs[11].data = matrices.data();
+  blobs[11].size = matrices.size() * sizeof(float);
+
+  for (size_t i = 0; i < m_geometries.size(); ++i)
+  {
+    appendTriangles(m_geometries[i], blobs);
+  }
+
+  if (!m_geometryCache.store(key, blobs))
+  {
+    return false;
+  }
+
+  std::cout << "storeSceneCache() compiled scene " << std::hex << key << std::dec << std::endl;
+  return true;
+}
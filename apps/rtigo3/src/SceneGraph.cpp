@@ -30,6 +30,7 @@
 
 #include "inc/SceneGraph.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -48,103 +49,314 @@ namespace sg
   {
   }
 
-  // ========== Group
-  Group::Group(const unsigned int id)
-  : Node(id)
+  // ========== Scene
+  Scene::Scene()
   {
   }
 
-  Group::~Group()
+  Scene::~Scene()
   {
   }
 
-  sg::NodeType Group::getType() const
+  void Scene::clear()
   {
-    return NT_GROUP;
+    m_groups.clear();
+    m_instances.clear();
+    m_children.clear();
+    m_arrays.clear();
+    m_arrayMatrices.clear();
+    m_dirtyInstances.clear();
+    m_triangles.clear();
+    m_primitives.clear();
   }
 
-  void Group::addChild(std::shared_ptr<sg::Instance> instance)
+  void Scene::reserve(const unsigned int numGroups, const unsigned int numInstances, const unsigned int numChildren)
   {
-    m_children.push_back(instance);
+    m_groups.reserve(numGroups);
+    m_instances.reserve(numInstances);
+    m_children.reserve(numChildren);
   }
 
-  size_t Group::getNumChildren() const
+  NodeHandle Scene::createGroup()
   {
-    return m_children.size();
+    MY_ASSERT(m_groups.size() < SG_HANDLE_INDEX_MASK);
+
+    GroupNode group;
+
+    group.first    = static_cast<unsigned int>(m_children.size());
+    group.count    = 0;
+    group.capacity = 0;
+
+    m_groups.push_back(group);
+
+    return makeHandle(NT_GROUP, static_cast<unsigned int>(m_groups.size() - 1));
   }
 
-  std::shared_ptr<sg::Instance> Group::getChild(const size_t index)
+  NodeHandle Scene::createInstance()
   {
-    MY_ASSERT(index < m_children.size());
-    return m_children[index];
+    MY_ASSERT(m_instances.size() < SG_HANDLE_INDEX_MASK);
+
+    InstanceNode instance;
+
+    // Set the affine matrix to identity by default.
+    memset(instance.matrix, 0, sizeof(float) * 12);
+    instance.matrix[ 0] = 1.0f;
+    instance.matrix[ 5] = 1.0f;
+    instance.matrix[10] = 1.0f;
+
+    instance.material = -1;
+    instance.light    = -1;
+    instance.child    = SG_HANDLE_INVALID;
+    instance.dirty    = DIRTY_NONE;
+
+    m_instances.push_back(instance);
+
+    return makeHandle(NT_INSTANCE, static_cast<unsigned int>(m_instances.size() - 1));
   }
 
+  NodeHandle Scene::addTriangles(std::shared_ptr<sg::Triangles> geometry)
+  {
+    const unsigned int id = geometry->getId();
+    MY_ASSERT(id <= SG_HANDLE_INDEX_MASK);
 
-  // ========== Instance
-  Instance::Instance(const unsigned int id)
-  : Node(id)
-  , m_material(-1) // No material index  set by default. Last one >= 0 along a path wins.
-  , m_light(-1)    // No light index set by default. Not a light.
+    if (m_triangles.size() <= id)
+    {
+      m_triangles.resize(id + 1);
+    }
+    m_triangles[id] = geometry;
+
+    return makeHandle(NT_TRIANGLES, id);
+  }
+
+  NodeHandle Scene::addPrimitive(std::shared_ptr<sg::Primitive> primitive)
   {
-    // Set the affine matrix to identity by default.
-    memset(m_matrix, 0, sizeof(float) * 12);
-    m_matrix[ 0] = 1.0f;
-    m_matrix[ 5] = 1.0f;
-    m_matrix[10] = 1.0f;
+    const unsigned int id = primitive->getId();
+    MY_ASSERT(id <= SG_HANDLE_INDEX_MASK);
+
+    if (m_primitives.size() <= id)
+    {
+      m_primitives.resize(id + 1);
+    }
+    m_primitives[id] = primitive;
+
+    return makeHandle(NT_PRIMITIVE, id);
+  }
+
+  void Scene::addChild(const NodeHandle group, const NodeHandle instance)
+  {
+    MY_ASSERT(getHandleType(group) == NT_GROUP && getHandleType(instance) == NT_INSTANCE);
+
+    GroupNode& node = m_groups[getHandleIndex(group)];
+
+    // Groups which get all their children before the next node is created grow in place.
+    // Otherwise the range moves to the end once per doubling of its size. The old slots stay unused.
+    if (node.count == node.capacity && node.first + node.count != m_children.size())
+    {
+      const unsigned int first = static_cast<unsigned int>(m_children.size());
+
+      node.capacity = std::max(4u, node.capacity * 2);
+      m_children.resize(first + node.capacity, SG_HANDLE_INVALID);
+
+      memcpy(&m_children[first], &m_children[node.first], sizeof(NodeHandle) * node.count);
+
+      node.first = first;
+    }
+
+    if (node.first + node.count == m_children.size())
+    {
+      m_children.push_back(instance);
+      node.capacity = std::max(node.capacity, node.count + 1);
+    }
+    else
+    {
+      m_children[node.first + node.count] = instance;
+    }
+
+    ++node.count;
+  }
+
+  unsigned int Scene::getNumChildren(const NodeHandle group) const
+  {
+    MY_ASSERT(getHandleType(group) == NT_GROUP);
+    return m_groups[getHandleIndex(group)].count;
+  }
+
+  const NodeHandle* Scene::getChildren(const NodeHandle group) const
+  {
+    MY_ASSERT(getHandleType(group) == NT_GROUP);
+    return m_children.data() + m_groups[getHandleIndex(group)].first;
+  }
+
+  void Scene::setTransform(const NodeHandle instance, const float m[12])
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+
+    InstanceNode& node = m_instances[getHandleIndex(instance)];
+
+    memcpy(node.matrix, m, sizeof(float) * 12);
+    if (node.dirty == DIRTY_NONE)
+    {
+      m_dirtyInstances.push_back(instance);
+    }
+    node.dirty |= DIRTY_TRANSFORM;
+  }
+
+  const float* Scene::getTransform(const NodeHandle instance) const
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+    return m_instances[getHandleIndex(instance)].matrix;
+  }
+
+  void Scene::setChild(const NodeHandle instance, const NodeHandle node)
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE && getHandleType(node) != NT_INSTANCE);
+    m_instances[getHandleIndex(instance)].child = node;
+  }
+
+  NodeHandle Scene::getChild(const NodeHandle instance) const
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+    return m_instances[getHandleIndex(instance)].child;
+  }
+
+  NodeHandle Scene::createInstanceArray(const NodeHandle geometry, const float* matrices, const unsigned int count)
+  {
+    MY_ASSERT(getHandleType(geometry) == NT_TRIANGLES || getHandleType(geometry) == NT_PRIMITIVE);
+    MY_ASSERT(m_arrays.size() < SG_HANDLE_INDEX_MASK);
+
+    InstanceArrayNode array;
+
+    array.first    = static_cast<unsigned int>(m_arrayMatrices.size() / 12);
+    array.count    = count;
+    array.geometry = geometry;
+
+    m_arrayMatrices.insert(m_arrayMatrices.end(), matrices, matrices + size_t(count) * 12);
+
+    m_arrays.push_back(array);
+
+    return makeHandle(NT_INSTANCE_ARRAY, static_cast<unsigned int>(m_arrays.size() - 1));
+  }
+
+  unsigned int Scene::getArraySize(const NodeHandle array) const
+  {
+    MY_ASSERT(getHandleType(array) == NT_INSTANCE_ARRAY);
+    return m_arrays[getHandleIndex(array)].count;
+  }
+
+  const float* Scene::getArrayTransforms(const NodeHandle array) const
+  {
+    MY_ASSERT(getHandleType(array) == NT_INSTANCE_ARRAY);
+    return &m_arrayMatrices[size_t(m_arrays[getHandleIndex(array)].first) * 12];
+  }
+
+  NodeHandle Scene::getArrayGeometry(const NodeHandle array) const
+  {
+    MY_ASSERT(getHandleType(array) == NT_INSTANCE_ARRAY);
+    return m_arrays[getHandleIndex(array)].geometry;
+  }
+
+  void Scene::setMaterial(const NodeHandle instance, const int index)
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+
+    InstanceNode& node = m_instances[getHandleIndex(instance)];
+
+    node.material = index;
+    if (node.dirty == DIRTY_NONE)
+    {
+      m_dirtyInstances.push_back(instance);
+    }
+    node.dirty |= DIRTY_MATERIAL;
+  }
+
+  int Scene::getMaterial(const NodeHandle instance) const
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+    return m_instances[getHandleIndex(instance)].material;
   }
 
-  Instance::~Instance()
+  void Scene::setLight(const NodeHandle instance, const int index)
   {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+
+    InstanceNode& node = m_instances[getHandleIndex(instance)];
+
+    node.light = index;
+    if (node.dirty == DIRTY_NONE)
+    {
+      m_dirtyInstances.push_back(instance);
+    }
+    node.dirty |= DIRTY_LIGHT;
+  }
+
+  int Scene::getLight(const NodeHandle instance) const
+  {
+    MY_ASSERT(getHandleType(instance) == NT_INSTANCE);
+    return m_instances[getHandleIndex(instance)].light;
   }
 
-  sg::NodeType Instance::getType() const
+  unsigned int Scene::getDirty(const NodeHandle instance) const
   {
-    return NT_INSTANCE;
+    return m_instances[getHandleIndex(instance)].dirty;
   }
 
-  void Instance::setTransform(const float m[12])
+  std::vector<NodeHandle> const& Scene::getDirtyInstances() const
   {
-    memcpy(m_matrix, m, sizeof(float) * 12);
+    return m_dirtyInstances;
   }
 
-  const float* Instance::getTransform() const
+  void Scene::clearDirty()
   {
-    return m_matrix;
+    for (const NodeHandle instance : m_dirtyInstances)
+    {
+      m_instances[getHandleIndex(instance)].dirty = DIRTY_NONE;
+    }
+    m_dirtyInstances.clear();
   }
 
-  void Instance::setChild(std::shared_ptr<sg::Node> node) // Instances can hold all other groups.
+  std::shared_ptr<sg::Triangles> const& Scene::getTriangles(const NodeHandle triangles) const
   {
-    m_child = node;
+    MY_ASSERT(getHandleType(triangles) == NT_TRIANGLES && getHandleIndex(triangles) < m_triangles.size());
+    return m_triangles[getHandleIndex(triangles)];
   }
 
-  std::shared_ptr<sg::Node> Instance::getChild()
+  std::shared_ptr<sg::Primitive> const& Scene::getPrimitive(const NodeHandle primitive) const
   {
-    return m_child;
+    MY_ASSERT(getHandleType(primitive) == NT_PRIMITIVE && getHandleIndex(primitive) < m_primitives.size());
+    return m_primitives[getHandleIndex(primitive)];
   }
 
-  void Instance::setMaterial(const int index)
+  unsigned int Scene::getNumGroups() const
   {
-    m_material = index;
+    return static_cast<unsigned int>(m_groups.size());
   }
 
-  int Instance::getMaterial() const
+  unsigned int Scene::getNumInstances() const
   {
-    return m_material;
+    return static_cast<unsigned int>(m_instances.size());
   }
 
-  void Instance::setLight(const int index)
+  unsigned int Scene::getNumInstanceArrays() const
   {
-    m_light = index;
+    return static_cast<unsigned int>(m_arrays.size());
   }
 
-  int Instance::getLight() const
+  size_t Scene::getMemorySize() const
   {
-    return m_light;
+    return m_groups.capacity()    * sizeof(GroupNode) +
+           m_instances.capacity() * sizeof(InstanceNode) +
+           m_children.capacity()  * sizeof(NodeHandle) +
+           m_arrays.capacity()    * sizeof(InstanceArrayNode) +
+           m_arrayMatrices.capacity() * sizeof(float) +
+           m_dirtyInstances.capacity() * sizeof(NodeHandle) +
+           m_triangles.capacity() * sizeof(std::shared_ptr<sg::Triangles>) +
+           m_primitives.capacity() * sizeof(std::shared_ptr<sg::Primitive>);
   }
 
   // ========== Triangles
   Triangles::Triangles(const unsigned int id)
   : Node(id)
+  , m_spatialSplitAlpha(0.0f)
   {
   }
 
@@ -163,21 +375,142 @@ namespace sg
     memcpy(m_attributes.data(), attributes.data(), sizeof(TriangleAttributes) * attributes.size());
   }
 
+  void Triangles::setAttributes(const TriangleAttributes* attributes, const size_t count)
+  {
+    m_attributes.assign(attributes, attributes + count);
+  }
+
   std::vector<TriangleAttributes> const& Triangles::getAttributes() const
   {
     return m_attributes;
   }
 
+  size_t Triangles::encodeAttributes(const GeometryFormat format, std::vector<unsigned int>& data, float3& offset, float3& scale) const
+  {
+    MY_ASSERT(format == GEOMETRY_FORMAT_COMPACT || format == GEOMETRY_FORMAT_QUANTIZED);
+
+    float3 aabbMin = make_float3(0.0f);
+    float3 aabbMax = make_float3(0.0f);
+
+    if (!m_attributes.empty())
+    {
+      aabbMin = m_attributes[0].vertex;
+      aabbMax = m_attributes[0].vertex;
+
+      for (TriangleAttributes const& attributes : m_attributes)
+      {
+        aabbMin = fminf(aabbMin, attributes.vertex);
+        aabbMax = fmaxf(aabbMax, attributes.vertex);
+      }
+    }
+
+    offset = aabbMin;
+    scale  = (aabbMax - aabbMin) / float(VERTEX_QUANTIZATION_MAX);
+
+    const size_t stride = getTriangleAttributesSize(format);
+
+    data.resize(m_attributes.size() * stride / sizeof(unsigned int));
+
+    for (size_t i = 0; i < m_attributes.size(); ++i)
+    {
+      TriangleAttributes const& src = m_attributes[i];
+
+      if (format == GEOMETRY_FORMAT_COMPACT)
+      {
+        TriangleAttributesCompact& dst = reinterpret_cast<TriangleAttributesCompact*>(data.data())[i];
+
+        dst.vertex   = src.vertex;
+        dst.tangent  = encodeOctahedral(src.tangent);
+        dst.normal   = encodeOctahedral(src.normal);
+        dst.texcoord = encodeTexcoord(src.texcoord);
+      }
+      else
+      {
+        TriangleAttributesQuantized& dst = reinterpret_cast<TriangleAttributesQuantized*>(data.data())[i];
+
+        encodeQuantized(dst.vertex, src.vertex, offset, scale);
+        dst.tangent  = encodeOctahedral(src.tangent);
+        dst.normal   = encodeOctahedral(src.normal);
+        dst.texcoord = encodeTexcoord(src.texcoord);
+      }
+    }
+    return stride;
+  }
+
   void Triangles::setIndices(std::vector<unsigned int> const& indices)
   {
     m_indices.resize(indices.size());
     memcpy(m_indices.data(), indices.data(), sizeof(unsigned int) * indices.size());
   }
+
+  void Triangles::setIndices(const unsigned int* indices, const size_t count)
+  {
+    m_indices.assign(indices, indices + count);
+  }
+
+  void Triangles::setSpatialSplitAlpha(const float alpha)
+  {
+    m_spatialSplitAlpha = alpha;
+  }
+
+  float Triangles::getSpatialSplitAlpha() const
+  {
+    return m_spatialSplitAlpha;
+  }
   
   std::vector<unsigned int> const& Triangles::getIndices() const
   {
     return m_indices;
   }
 
+  // ========== Primitive
+  Primitive::Primitive(const unsigned int id)
+  : Node(id)
+  {
+    memset(&m_definition, 0, sizeof(PrimitiveDefinition));
+    m_definition.type   = PRIMITIVE_SPHERE;
+    m_definition.radius = 1.0f;
+  }
+
+  Primitive::~Primitive()
+  {
+  }
+
+  sg::NodeType Primitive::getType() const
+  {
+    return NT_PRIMITIVE;
+  }
+
+  void Primitive::createSphere(const float radius)
+  {
+    memset(&m_definition, 0, sizeof(PrimitiveDefinition));
+
+    m_definition.type     = PRIMITIVE_SPHERE;
+    m_definition.position = make_float3(0.0f);
+    m_definition.radius   = radius;
+  }
+
+  // Same arguments as Triangles::createParallelogram().
+  void Primitive::createParallelogram(float3 const& position, float3 const& vecU, float3 const& vecV, float3 const& normal)
+  {
+    memset(&m_definition, 0, sizeof(PrimitiveDefinition));
+
+    m_definition.type     = PRIMITIVE_PARALLELOGRAM;
+    m_definition.position = position;
+    m_definition.vecU     = vecU;
+    m_definition.vecV     = vecV;
+    m_definition.normal   = normal;
+  }
+
+  void Primitive::setDefinition(PrimitiveDefinition const& definition)
+  {
+    m_definition = definition;
+  }
+
+  PrimitiveDefinition const& Primitive::getDefinition() const
+  {
+    return m_definition;
+  }
+
 } // namespace sg
 
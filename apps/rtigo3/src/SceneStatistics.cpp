@@ -0,0 +1,211 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/SceneStatistics.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+
+DeviceMemoryStatistics::DeviceMemoryStatistics()
+: attributes(0)
+, indices(0)
+, blas(0)
+, blasTemp(0)
+, tlas(0)
+, tlasTemp(0)
+, instances(0)
+, sbt(0)
+, textures(0)
+, cdf(0)
+, outputBuffers(0)
+{
+}
+
+// The temporary build buffers are freed after the builds and not part of the total.
+size_t DeviceMemoryStatistics::getTotal() const
+{
+  return attributes + indices + blas + tlas + instances + sbt + textures + cdf + outputBuffers;
+}
+
+
+SceneStatistics::SceneStatistics()
+: numGroups(0)
+, numInstances(0)
+, numInstanceArrays(0)
+, numTriangles(0)
+, numPrimitives(0)
+, numTableInstances(0)
+, uniqueTriangles(0)
+, instancedTriangles(0)
+, uniqueVertices(0)
+, attributes(0)
+, indices(0)
+, sceneGraph(0)
+, instanceTable(0)
+{
+}
+
+static std::string formatBytes(const size_t bytes)
+{
+  std::ostringstream stream;
+
+  stream << std::fixed << std::setprecision(2) << double(bytes) / (1024.0 * 1024.0) << " MiB";
+
+  return stream.str();
+}
+
+void SceneStatistics::print(std::ostream& stream) const
+{
+  stream << "Scene statistics:" << std::endl;
+  stream << "  groups = " << numGroups << ", instances = " << numInstances << ", instance arrays = " << numInstanceArrays << ", flattened instances = " << numTableInstances << std::endl;
+  stream << "  meshes = " << numTriangles << ", primitives = " << numPrimitives << ", vertices = " << uniqueVertices
+         << ", unique triangles = " << uniqueTriangles << ", instanced triangles = " << instancedTriangles << std::endl;
+  stream << "  host: attributes = " << formatBytes(attributes) << ", indices = " << formatBytes(indices)
+         << ", scene graph = " << formatBytes(sceneGraph) << ", instance table = " << formatBytes(instanceTable) << std::endl;
+
+  for (std::map<std::string, size_t>::const_iterator it = pictures.begin(); it != pictures.end(); ++it)
+  {
+    stream << "  picture " << it->first << " = " << formatBytes(it->second) << std::endl;
+  }
+
+  for (size_t i = 0; i < devices.size(); ++i)
+  {
+    DeviceMemoryStatistics const& device = devices[i];
+
+    stream << "  device " << i << " (" << device.name << "): total = " << formatBytes(device.getTotal()) << std::endl;
+    stream << "    attributes = " << formatBytes(device.attributes) << ", indices = " << formatBytes(device.indices)
+           << ", BLAS = " << formatBytes(device.blas) << " (temp " << formatBytes(device.blasTemp) << ")"
+           << ", TLAS = " << formatBytes(device.tlas) << " (temp " << formatBytes(device.tlasTemp) << ")"
+           << ", instances = " << formatBytes(device.instances) << std::endl;
+    stream << "    SBT = " << formatBytes(device.sbt) << ", textures = " << formatBytes(device.textures)
+           << ", CDF = " << formatBytes(device.cdf) << ", output buffers = " << formatBytes(device.outputBuffers) << std::endl;
+  }
+}
+
+static std::string escapeJSON(std::string const& text)
+{
+  std::ostringstream stream;
+
+  for (const char c : text)
+  {
+    switch (c)
+    {
+      case '"':
+        stream << "\\\"";
+        break;
+      case '\\':
+        stream << "\\\\";
+        break;
+      case '\n':
+        stream << "\\n";
+        break;
+      case '\t':
+        stream << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec << std::setfill(' ');
+        }
+        else
+        {
+          stream << c;
+        }
+        break;
+    }
+  }
+  return stream.str();
+}
+
+// All sizes in bytes.
+bool SceneStatistics::writeJSON(std::string const& filename) const
+{
+  std::ofstream file(filename);
+  if (!file)
+  {
+    std::cerr << "ERROR: writeJSON() failed to open " << filename << std::endl;
+    return false;
+  }
+
+  file << "{" << std::endl;
+  file << "  \"scene\": {" << std::endl;
+  file << "    \"groups\": " << numGroups << "," << std::endl;
+  file << "    \"instances\": " << numInstances << "," << std::endl;
+  file << "    \"instanceArrays\": " << numInstanceArrays << "," << std::endl;
+  file << "    \"flattenedInstances\": " << numTableInstances << "," << std::endl;
+  file << "    \"meshes\": " << numTriangles << "," << std::endl;
+  file << "    \"primitives\": " << numPrimitives << "," << std::endl;
+  file << "    \"vertices\": " << uniqueVertices << "," << std::endl;
+  file << "    \"uniqueTriangles\": " << uniqueTriangles << "," << std::endl;
+  file << "    \"instancedTriangles\": " << instancedTriangles << std::endl;
+  file << "  }," << std::endl;
+  file << "  \"host\": {" << std::endl;
+  file << "    \"attributes\": " << attributes << "," << std::endl;
+  file << "    \"indices\": " << indices << "," << std::endl;
+  file << "    \"sceneGraph\": " << sceneGraph << "," << std::endl;
+  file << "    \"instanceTable\": " << instanceTable << "," << std::endl;
+  file << "    \"pictures\": {";
+
+  for (std::map<std::string, size_t>::const_iterator it = pictures.begin(); it != pictures.end(); ++it)
+  {
+    file << ((it == pictures.begin()) ? "" : ",") << std::endl;
+    file << "      \"" << escapeJSON(it->first) << "\": " << it->second;
+  }
+  file << std::endl << "    }" << std::endl;
+  file << "  }," << std::endl;
+  file << "  \"devices\": [";
+
+  for (size_t i = 0; i < devices.size(); ++i)
+  {
+    DeviceMemoryStatistics const& device = devices[i];
+
+    file << ((i == 0) ? "" : ",") << std::endl;
+    file << "    {" << std::endl;
+    file << "      \"name\": \"" << escapeJSON(device.name) << "\"," << std::endl;
+    file << "      \"attributes\": " << device.attributes << "," << std::endl;
+    file << "      \"indices\": " << device.indices << "," << std::endl;
+    file << "      \"blas\": " << device.blas << "," << std::endl;
+    file << "      \"blasTemp\": " << device.blasTemp << "," << std::endl;
+    file << "      \"tlas\": " << device.tlas << "," << std::endl;
+    file << "      \"tlasTemp\": " << device.tlasTemp << "," << std::endl;
+    file << "      \"instances\": " << device.instances << "," << std::endl;
+    file << "      \"sbt\": " << device.sbt << "," << std::endl;
+    file << "      \"textures\": " << device.textures << "," << std::endl;
+    file << "      \"cdf\": " << device.cdf << "," << std::endl;
+    file << "      \"outputBuffers\": " << device.outputBuffers << "," << std::endl;
+    file << "      \"total\": " << device.getTotal() << std::endl;
+    file << "    }";
+  }
+  file << std::endl << "  ]" << std::endl;
+  file << "}" << std::endl;
+
+  return static_cast<bool>(file);
+}
@@ -649,6 +649,7 @@ Texture::Texture()
 , m_textureObject(0)
 , m_d_array(0)
 , m_d_mipmappedArray(0)
+, m_numLevels(1)
 , m_d_envCDF_U(0)
 , m_d_envCDF_V(0)
 , m_integral(1.0f)
@@ -850,6 +851,7 @@ bool Texture::create1D(const Picture* picture)
     // A 1D layered CUDA mipmapped array is allocated if only Height is zero and the CUDA_ARRAY3D_LAYERED flag is set.
     // Each layer is a 1D array. The number of layers is determined by the Depth extent.
     CU_CHECK( cuMipmappedArrayCreate(&m_d_mipmappedArray, &m_descArray3D, numLevels) );
+    m_numLevels = numLevels;
 
     for (unsigned int level = 0; level < numLevels; ++level)
     {
@@ -962,6 +964,7 @@ bool Texture::create2D(const Picture* picture)
     // A 2D layered CUDA mipmapped array is allocated if all three extents are non-zero and the ::CUDA_ARRAY3D_LAYERED flag is set.
     // Each layer is a 2D array. The number of layers is determined by the Depth extent.
     CU_CHECK( cuMipmappedArrayCreate(&m_d_mipmappedArray, &m_descArray3D, numLevels) );
+    m_numLevels = numLevels;
 
     for (unsigned int level = 0; level < numLevels; ++level)
     {
@@ -1065,6 +1068,7 @@ bool Texture::create3D(const Picture* picture)
   {
     // A 3D mipmapped array is allocated if all three extents are non-zero.
     CU_CHECK( cuMipmappedArrayCreate(&m_d_mipmappedArray, &m_descArray3D, numLevels) );
+    m_numLevels = numLevels;
 
     for (unsigned int level = 0; level < numLevels; ++level)
     {
@@ -1191,6 +1195,7 @@ bool Texture::createCube(const Picture* picture)
     // A cubemap layered CUDA array is a special type of 2D layered CUDA array that consists of a collection of cubemaps.
     // The first six layers represent the first cubemap, the next six layers form the second cubemap, and so on.
     CU_CHECK( cuMipmappedArrayCreate(&m_d_mipmappedArray, &m_descArray3D, numLevels) );
+    m_numLevels = numLevels;
 
     for (unsigned int level = 0; level < numLevels; ++level)
     {
@@ -1660,6 +1665,48 @@ float Texture::getIntegral() const
   return m_integral;
 }
 
+// Ignores the pitch alignment of the driver.
+size_t Texture::getSizeInBytes() const
+{
+  if (m_d_array == 0 && m_d_mipmappedArray == 0)
+  {
+    return 0;
+  }
+
+  // Only 3D textures shrink in depth. Layers and cube faces stay.
+  const bool shrinkDepth = ((m_descArray3D.Flags & (CUDA_ARRAY3D_LAYERED | CUDA_ARRAY3D_CUBEMAP)) == 0);
+
+  size_t width  = std::max(size_t(1), m_descArray3D.Width);
+  size_t height = std::max(size_t(1), m_descArray3D.Height);
+  size_t depth  = std::max(size_t(1), m_descArray3D.Depth);
+
+  const unsigned int numLevels = (m_d_mipmappedArray) ? m_numLevels : 1;
+
+  size_t size = 0;
+
+  for (unsigned int level = 0; level < numLevels; ++level)
+  {
+    size += width * height * depth * m_sizeBytesPerElement;
+
+    width  = std::max(size_t(1), width  >> 1);
+    height = std::max(size_t(1), height >> 1);
+    if (shrinkDepth)
+    {
+      depth = std::max(size_t(1), depth >> 1);
+    }
+  }
+  return size;
+}
+
+size_t Texture::getCDFSizeInBytes() const
+{
+  if (!m_d_envCDF_U)
+  {
+    return 0;
+  }
+  return (size_t(m_width + 1) * m_height + (m_height + 1)) * sizeof(float);
+}
+
 
 bool Texture::update1D(const Picture* picture)
 {
@@ -1761,6 +1808,7 @@ bool Texture::update2D(const Picture* picture)
   if (1 < numLevels && (m_flags & IMAGE_FLAG_MIPMAP)) // 2D (layered) mipmapped texture // FIXME Add a mechanism to generate mipmaps if there are none.
   {
     CU_CHECK( cuMipmappedArrayCreate(&m_d_mipmappedArray, &m_descArray3D, numLevels) );
+    m_numLevels = numLevels;
 
     for (unsigned int level = 0; level < numLevels; ++level)
     {
@@ -1838,6 +1886,7 @@ bool Texture::update3D(const Picture* picture)
   {
     // A 3D mipmapped array is allocated if all three extents are non-zero.
     CU_CHECK( cuMipmappedArrayCreate(&m_d_mipmappedArray, &m_descArray3D, numLevels) );
+    m_numLevels = numLevels;
 
     for (unsigned int level = 0; level < numLevels; ++level)
     {
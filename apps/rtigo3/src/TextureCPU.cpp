@@ -0,0 +1,392 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/TextureCPU.h"
+
+#include "shaders/vector_math.h"
+
+#include "inc/MyAssert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+
+// Integer data is read as normalized float like the CUDA textures with the default CU_TRSF_NORMALIZED_COORDINATES and no CU_TRSF_READ_AS_INTEGER flag.
+template<typename T>
+static float toFloat(const T value)
+{
+  if (std::numeric_limits<T>::is_integer)
+  {
+    // Signed normalized values are clamped to -1.0f, same as the hardware.
+    return std::max(-1.0f, float(value) / float(std::numeric_limits<T>::max()));
+  }
+  return float(value);
+}
+
+// Expand any of the DevIL formats to RGBA32F. Luminance is replicated to RGB, missing alpha is set to 1.0f. (Same as the Texture class host encodings.)
+template<typename T>
+static void convertToFloat4(float4* dst, const void* src, const int format, const size_t count)
+{
+  const T* p = reinterpret_cast<const T*>(src);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    float4& texel = dst[i];
+
+    switch (format)
+    {
+      case IL_RGB:
+        texel = make_float4(toFloat(p[0]), toFloat(p[1]), toFloat(p[2]), 1.0f);
+        p += 3;
+        break;
+      case IL_RGBA:
+        texel = make_float4(toFloat(p[0]), toFloat(p[1]), toFloat(p[2]), toFloat(p[3]));
+        p += 4;
+        break;
+      case IL_BGR:
+        texel = make_float4(toFloat(p[2]), toFloat(p[1]), toFloat(p[0]), 1.0f);
+        p += 3;
+        break;
+      case IL_BGRA:
+        texel = make_float4(toFloat(p[2]), toFloat(p[1]), toFloat(p[0]), toFloat(p[3]));
+        p += 4;
+        break;
+      case IL_LUMINANCE:
+        texel = make_float4(toFloat(p[0]), toFloat(p[0]), toFloat(p[0]), 1.0f);
+        p += 1;
+        break;
+      case IL_ALPHA:
+        texel = make_float4(0.0f, 0.0f, 0.0f, toFloat(p[0]));
+        p += 1;
+        break;
+      case IL_LUMINANCE_ALPHA:
+        texel = make_float4(toFloat(p[0]), toFloat(p[0]), toFloat(p[0]), toFloat(p[1]));
+        p += 2;
+        break;
+      default:
+        MY_ASSERT(!"Unsupported user pixel format.");
+        return;
+    }
+  }
+}
+
+
+TextureCPU::TextureCPU()
+: m_width(0)
+, m_height(0)
+, m_flags(0)
+, m_integral(1.0f)
+{
+}
+
+TextureCPU::~TextureCPU()
+{
+}
+
+bool TextureCPU::create(const Picture* picture, const unsigned int flags)
+{
+  // Only the 2D textures and the spherical environment map are used by the renderer.
+  if (picture == nullptr || (flags & IMAGE_FLAG_2D) == 0)
+  {
+    std::cerr << "ERROR: TextureCPU::create() only supports 2D pictures." << std::endl;
+    return false;
+  }
+
+  const Image* image = picture->getImageLevel(0, 0); // LOD 0 only.
+  if (image == nullptr || image->m_width == 0 || image->m_height == 0)
+  {
+    std::cerr << "ERROR: TextureCPU::create() picture has no image data." << std::endl;
+    return false;
+  }
+
+  m_width  = image->m_width;
+  m_height = image->m_height;
+  m_flags  = flags;
+
+  const size_t count = size_t(m_width) * size_t(m_height);
+
+  m_texels.resize(count);
+
+  switch (image->m_type)
+  {
+    case IL_BYTE:
+      convertToFloat4<char>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    case IL_UNSIGNED_BYTE:
+      convertToFloat4<unsigned char>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    case IL_SHORT:
+      convertToFloat4<short>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    case IL_UNSIGNED_SHORT:
+      convertToFloat4<unsigned short>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    case IL_INT:
+      convertToFloat4<int>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    case IL_UNSIGNED_INT:
+      convertToFloat4<unsigned int>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    case IL_FLOAT:
+      convertToFloat4<float>(m_texels.data(), image->m_pixels, image->m_format, count);
+      break;
+    default:
+      std::cerr << "ERROR: TextureCPU::create() unsupported user data format." << std::endl;
+      m_texels.clear();
+      return false;
+  }
+
+  if (m_flags & IMAGE_FLAG_ENV)
+  {
+    // Generate the CDFs for direct environment lighting and the environment texture sampler itself.
+    calculateSphericalCDF();
+  }
+
+  return true;
+}
+
+unsigned int TextureCPU::getWidth() const
+{
+  return m_width;
+}
+
+unsigned int TextureCPU::getHeight() const
+{
+  return m_height;
+}
+
+float4 TextureCPU::fetch(int x, int y) const
+{
+  const int w = static_cast<int>(m_width);
+  const int h = static_cast<int>(m_height);
+
+  // Wrap in x. Only the last neighbour can leave the range after the wrapping of the coordinate in sample().
+  x = (x < 0) ? x + w : ((w <= x) ? x - w : x);
+
+  if (m_flags & IMAGE_FLAG_ENV)
+  {
+    y = std::min(std::max(y, 0), h - 1); // The spherical environment uses CU_TR_ADDRESS_MODE_CLAMP for v.
+  }
+  else
+  {
+    y = (y < 0) ? y + h : ((h <= y) ? y - h : y);
+  }
+
+  return m_texels[size_t(y) * m_width + x];
+}
+
+float4 TextureCPU::sample(const float u, const float v) const
+{
+  // Wrap the normalized coordinates into [0, 1) first. The clamped v of the environment is handled in fetch().
+  const float uw = u - floorf(u);
+  const float vw = (m_flags & IMAGE_FLAG_ENV) ? v : v - floorf(v);
+
+  // Bilinear filtering on texel centers, the same addressing as CU_TR_FILTER_MODE_LINEAR.
+  const float x = uw * float(m_width)  - 0.5f;
+  const float y = vw * float(m_height) - 0.5f;
+
+  const float x0 = floorf(x);
+  const float y0 = floorf(y);
+
+  const float fx = x - x0;
+  const float fy = y - y0;
+
+  const int ix = static_cast<int>(x0);
+  const int iy = static_cast<int>(y0);
+
+  const float4 t00 = fetch(ix,     iy);
+  const float4 t10 = fetch(ix + 1, iy);
+  const float4 t01 = fetch(ix,     iy + 1);
+  const float4 t11 = fetch(ix + 1, iy + 1);
+
+  return lerp(lerp(t00, t10, fx), lerp(t01, t11, fx), fy);
+}
+
+const float* TextureCPU::getCDF_U() const
+{
+  return m_cdfU.data();
+}
+
+const float* TextureCPU::getCDF_V() const
+{
+  return m_cdfV.data();
+}
+
+float TextureCPU::getIntegral() const
+{
+  return m_integral;
+}
+
+size_t TextureCPU::getSizeInBytes() const
+{
+  return m_texels.capacity() * sizeof(float4);
+}
+
+size_t TextureCPU::getCDFSizeInBytes() const
+{
+  return (m_cdfU.capacity() + m_cdfV.capacity()) * sizeof(float);
+}
+
+
+// Implement a simple Gaussian 3x3 filter with sigma = 0.5
+// This must match the Texture class implementation to get the same importance sampling on both strategies.
+static float gaussianFilter(const float4* rgba, unsigned int width, unsigned int height, unsigned int x, unsigned int y)
+{
+  // Lookup is repeated in x and clamped to edge in y.
+  unsigned int left   = (0 < x)          ? x - 1 : width - 1; // repeat
+  unsigned int right  = (x < width - 1)  ? x + 1 : 0;         // repeat
+  unsigned int bottom = (0 < y)          ? y - 1 : y;         // clamp
+  unsigned int top    = (y < height - 1) ? y + 1 : y;         // clamp
+
+  // Center
+  const float4* p = rgba + width * y + x;
+  float intensity = (p->x + p->y + p->z) * 0.619347f;
+
+  // 4-neighbours
+  p = rgba + width * bottom + x;
+  float f = p->x + p->y + p->z;
+  p = rgba + width * y + left;
+  f += p->x + p->y + p->z;
+  p = rgba + width * y + right;
+  f += p->x + p->y + p->z;
+  p = rgba + width * top + x;
+  f += p->x + p->y + p->z;
+  intensity += f * 0.0838195f;
+
+  // 8-neighbours corners
+  p = rgba + width * bottom + left;
+  f  = p->x + p->y + p->z;
+  p = rgba + width * bottom + right;
+  f += p->x + p->y + p->z;
+  p = rgba + width * top + left;
+  f += p->x + p->y + p->z;
+  p = rgba + width * top + right;
+  f += p->x + p->y + p->z;
+  intensity += f * 0.0113437f;
+
+  return intensity / 3.0f;
+}
+
+// Same as Texture::calculateSphericalCDF(), only the results stay on the host.
+// See "Physically Based Rendering" v2, chapter 14.6.5 on Infinite Area Lights.
+void TextureCPU::calculateSphericalCDF()
+{
+  const float4* rgba = m_texels.data();
+
+  // The original data needs to be retained to calculate the PDF.
+  std::vector<float> funcU(m_width * m_height);
+  std::vector<float> funcV(m_height + 1);
+
+  float sum = 0.0f;
+  // First generate the function data.
+  for (unsigned int y = 0; y < m_height; ++y)
+  {
+    // Scale distibution by the sine to get the sampling uniform. (Avoid sampling more values near the poles.)
+    float sinTheta = float(sin(M_PI * (double(y) + 0.5) / double(m_height))); // Make this as accurate as possible.
+
+    for (unsigned int x = 0; x < m_width; ++x)
+    {
+      // Filter to keep the piecewise linear function intact for samples with zero value next to non-zero values.
+      const float value = gaussianFilter(rgba, m_width, m_height, x, y);
+      funcU[y * m_width + x] = value * sinTheta;
+
+      // Compute integral over the actual function.
+      const float4* p = rgba + y * m_width + x;
+      const float intensity = (p->x + p->y + p->z) / 3.0f;
+      sum += intensity * sinTheta;
+    }
+  }
+
+  // This integral is used inside the light sampling function (see sysData.envIntegral).
+  m_integral = sum * 2.0f * M_PIf * M_PIf / float(m_width * m_height);
+
+  // Now generate the CDF data.
+  // Normalized 1D distributions in the rows of the 2D buffer, and the marginal CDF in the 1D buffer.
+  // Include the starting 0.0f and the ending 1.0f to avoid special cases during the continuous sampling.
+  m_cdfU.resize((m_width + 1) * m_height);
+  m_cdfV.resize(m_height + 1);
+
+  float* cdfU = m_cdfU.data();
+  float* cdfV = m_cdfV.data();
+
+  for (unsigned int y = 0; y < m_height; ++y)
+  {
+    unsigned int row = y * (m_width + 1); // Watch the stride!
+    cdfU[row + 0] = 0.0f; // CDF starts at 0.0f.
+
+    for (unsigned int x = 1; x <= m_width; ++x)
+    {
+      unsigned int i = row + x;
+      cdfU[i] = cdfU[i - 1] + funcU[y * m_width + x - 1]; // Attention, funcU is only m_width wide!
+    }
+
+    const float integral = cdfU[row + m_width]; // The integral over this row is in the last element.
+    funcV[y] = integral;                        // Store this as function values of the marginal CDF.
+
+    if (integral != 0.0f)
+    {
+      for (unsigned int x = 1; x <= m_width; ++x)
+      {
+        cdfU[row + x] /= integral;
+      }
+    }
+    else // All texels were black in this row. Generate an equal distribution.
+    {
+      for (unsigned int x = 1; x <= m_width; ++x)
+      {
+        cdfU[row + x] = float(x) / float(m_width);
+      }
+    }
+  }
+
+  // Now do the same thing with the marginal CDF.
+  cdfV[0] = 0.0f; // CDF starts at 0.0f.
+  for (unsigned int y = 1; y <= m_height; ++y)
+  {
+    cdfV[y] = cdfV[y - 1] + funcV[y - 1];
+  }
+
+  const float integral = cdfV[m_height]; // The integral over this marginal CDF is in the last element.
+
+  if (integral != 0.0f)
+  {
+    for (unsigned int y = 1; y <= m_height; ++y)
+    {
+      cdfV[y] /= integral;
+    }
+  }
+  else // All texels were black in the whole image. Generate an equal distribution.
+  {
+    for (unsigned int y = 1; y <= m_height; ++y)
+    {
+      cdfV[y] = float(y) / float(m_height);
+    }
+  }
+}
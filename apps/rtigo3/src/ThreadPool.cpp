@@ -0,0 +1,151 @@
+/* 
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of NVIDIA CORPORATION nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "inc/ThreadPool.h"
+
+#include "inc/MyAssert.h"
+
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(const unsigned int numThreads)
+: m_func(nullptr)
+, m_count(0)
+, m_next(0)
+, m_busy(0)
+, m_generation(0)
+, m_terminate(false)
+{
+  unsigned int count = numThreads;
+
+  if (count == 0)
+  {
+    count = std::max(1u, std::thread::hardware_concurrency()); // hardware_concurrency() is allowed to return 0 when it's not computable.
+  }
+
+  // The calling thread is the first thread, only create the additional ones.
+  for (unsigned int i = 1; i < count; ++i)
+  {
+    m_threads.push_back(std::thread(&ThreadPool::worker, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_terminate = true;
+  }
+  m_conditionStart.notify_all();
+
+  for (size_t i = 0; i < m_threads.size(); ++i)
+  {
+    m_threads[i].join();
+  }
+}
+
+unsigned int ThreadPool::getNumThreads() const
+{
+  return static_cast<unsigned int>(m_threads.size()) + 1;
+}
+
+void ThreadPool::parallelFor(const unsigned int count, std::function<void(const unsigned int index, const unsigned int threadIndex)> const& func)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  // No need to wake up the workers when there is nothing to share.
+  if (m_threads.empty() || count == 1)
+  {
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      func(i, 0);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MY_ASSERT(m_func == nullptr); // Not reentrant.
+
+    m_func  = &func;
+    m_count = count;
+    m_next  = 0;
+    m_busy  = static_cast<unsigned int>(m_threads.size());
+    ++m_generation;
+  }
+  m_conditionStart.notify_all();
+
+  execute(0); // The calling thread works on the job as well.
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_conditionDone.wait(lock, [this]{ return m_busy == 0; });
+
+  m_func = nullptr;
+}
+
+void ThreadPool::worker(const unsigned int threadIndex)
+{
+  unsigned int generation = 0;
+
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_conditionStart.wait(lock, [this, generation]{ return m_terminate || m_generation != generation; });
+
+      if (m_terminate)
+      {
+        return;
+      }
+      generation = m_generation;
+    }
+
+    execute(threadIndex);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_busy == 0)
+      {
+        m_conditionDone.notify_one();
+      }
+    }
+  }
+}
+
+void ThreadPool::execute(const unsigned int threadIndex)
+{
+  // PERF One atomic increment per index. Callers should make the indices coarse enough (e.g. tiles, not pixels).
+  for (unsigned int i = m_next.fetch_add(1); i < m_count; i = m_next.fetch_add(1))
+  {
+    (*m_func)(i, threadIndex);
+  }
+}
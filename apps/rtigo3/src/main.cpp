@@ -170,6 +170,18 @@ static int runApp(Options const& options)
   {
     g_app->benchmark();
   }
+  else if (mode == 2) // Host acceleration structure build and ray query benchmark on the loaded scene.
+  {
+    g_app->benchmarkBVH();
+  }
+  else if (mode == 3) // Host scene graph build, flattening and update benchmark.
+  {
+    g_app->benchmarkSceneGraph();
+  }
+  else if (mode == 4) // Scene description parser benchmark.
+  {
+    g_app->benchmarkParser();
+  }
 
   delete g_app;
 